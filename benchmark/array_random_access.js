@@ -0,0 +1,5 @@
+// Random access into an array of a few thousand elements
+var arr = [];
+for (var i=0;i<2000;i++) arr.push(i);
+var sum = 0;
+for (i=0;i<2000;i++) sum += arr[(i*997)%2000];
@@ -0,0 +1,14 @@
+// Calls a function with whitespace and comments in its body many times
+function step(i) {
+  /* XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+  XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX*/
+  var total = 0;
+  if (i & 1)   {
+    total = total + i;     // odd
+  } else {
+    total = total - i;     // even
+  }
+  return total;
+}
+var sum = 0;
+for (i=0;i<10000;i++) sum += step(i);
@@ -0,0 +1,20 @@
+// Garbage collects a 100k element linked list and some trees. process.memory().gctime is the time the GC took
+var list;
+for (var i=0;i<100000;i++) list = { v:i, next:list };
+print("Linked list: "+process.memory().gctime+"ms");
+list = undefined;
+
+// a balanced binary tree (built without recursion, as JS recursion depth is limited)
+var tree = {}, todo = [[tree, 14]];
+while (todo.length) {
+  var t = todo.pop(), node = t[0], depth = t[1];
+  if (depth) {
+    node.l = {};
+    node.r = {};
+    todo.push([node.l, depth-1], [node.r, depth-1]);
+  } else node.v = 1;
+}
+// and a deep one - a long chain where each node also has a few children
+var deep = {};
+for (i=0;i<20000;i++) deep = { a:deep, b:{ c:[i,i] }, d:"x"+i };
+print("Trees: "+process.memory().gctime+"ms");
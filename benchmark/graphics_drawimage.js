@@ -0,0 +1,17 @@
+// Drawing sprites with drawImage - an 8bpp sprite (copied raw), a 1bpp transparent sprite
+// and one frame at a time from a 4bpp sprite sheet
+var g = Graphics.createArrayBuffer(128,64,8);
+var s = Graphics.createArrayBuffer(32,32,8);
+s.setColor(7); s.fillRect(4,4,27,27);
+var sprite = { width:32, height:32, bpp:8, buffer:s.buffer };
+var m = Graphics.createArrayBuffer(32,32,1,{msb:true});
+m.fillPoly([16,0,31,16,16,31,0,16]);
+var mono = { width:32, height:32, bpp:1, transparent:0, buffer:m.buffer };
+var sheet = Graphics.createArrayBuffer(128,32,4,{msb:true});
+for (var i=0;i<16;i++) { sheet.setColor(i); sheet.fillRect(i*8,0,i*8+7,31); }
+var sheetImg = { width:128, height:32, bpp:4, buffer:sheet.buffer };
+for (var i=0;i<1000;i++) {
+  g.drawImage(sprite, i&127, (i*3)&63);
+  g.drawImage(mono, (i*7)&127, i&63);
+  g.drawImage(sheetImg, i&127, 20, {area:{x:(i&3)*32,y:0,width:32,height:32}});
+}
@@ -0,0 +1,15 @@
+// Clearing and filling ArrayBuffer Graphics - the buffer is flat, so this is done directly on memory
+[1,8,16].forEach(function(bpp) {
+  var g = Graphics.createArrayBuffer(128,64,bpp);
+  for (var i=0;i<200;i++) {
+    g.clear();
+    g.setColor(i);
+    g.fillRect(i&31,3,100,60);
+    g.drawLine(0,0,127,63);
+  }
+});
+var g = Graphics.createArrayBuffer(128,64,1,{vertical_byte:true});
+for (var i=0;i<200;i++) {
+  g.clear();
+  g.fillRect(i&31,3,100,60);
+}
@@ -0,0 +1,12 @@
+// Filled polygons - convex shapes, and a big star with lots of scanlines
+var g = Graphics.createArrayBuffer(160,120,8);
+var star = [], i;
+for (i=0;i<20;i++) {
+  var a = i*Math.PI/10, r = (i&1) ? 25 : 58;
+  star.push(80+r*Math.sin(a), 60-r*Math.cos(a));
+}
+for (i=0;i<2000;i++) {
+  g.setColor(i);
+  g.fillPoly([i&63,10, 150,(i&31)+5, 155,115, 10,110]);
+  g.fillPoly(star);
+}
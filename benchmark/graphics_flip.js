@@ -0,0 +1,28 @@
+// Updating a status bar (plus a blinking cursor in the opposite corner) on a 128x64 1bpp
+// display - sending only the modified areas with flip() vs sending the whole buffer.
+// 'send' stands in for an SPI transfer of whole rows of the buffer
+var sent = 0;
+function send(y1,y2) {
+  var a = new Uint8Array(g.buffer, y1*16, (1+y2-y1)*16);
+  E.sum(a);
+  sent += a.length;
+}
+var g = Graphics.createArrayBuffer(128,64,1,{flip:function(x1,y1,x2,y2) { send(y1,y2); }});
+function frame(i) {
+  g.setColor(0);
+  g.fillRect(0,0,127,7);
+  g.setColor(1);
+  g.drawString("12:"+(i%60)+" Batt "+(i%100)+"%",0,1);
+  g.setColor(i&1);
+  g.fillRect(124,58,127,63);
+}
+
+var t = getTime();
+for (var i=0;i<1000;i++) { frame(i); g.flip(); }
+var partialTime = getTime()-t, partialBytes = sent/1000;
+sent = 0;
+t = getTime();
+for (var i=0;i<1000;i++) { frame(i); g.getModified(true); send(0,63); }
+var fullTime = getTime()-t, fullBytes = sent/1000;
+console.log("flip(): "+partialBytes+" bytes/frame, "+(partialTime*1000).toFixed(3)+"ms");
+console.log("full:   "+fullBytes+" bytes/frame, "+(fullTime*1000).toFixed(3)+"ms");
@@ -0,0 +1,10 @@
+// Redrawing the same text in a vector font - a dashboard updating its values
+var g = Graphics.createArrayBuffer(128,64,1);
+for (var i=0;i<500;i++) {
+  g.clear();
+  g.setFontVector(16);
+  g.drawString("Temp "+(20+(i%10))+"C",0,0);
+  g.setFontVector(12);
+  g.drawString("Humidity "+(40+(i%7))+"%",0,20);
+  g.drawString("Wind 12km/h",0,36);
+}
@@ -0,0 +1,62 @@
+#!/usr/bin/python
+# Time a series of sequential HTTP requests made by Espruino to a local
+# HTTP/1.1 server, with and without a keep-alive agent, and count how many
+# TCP connections the server saw.
+#
+# usage: benchmark/http_keepalive.py [path/to/espruino]
+
+import subprocess
+import sys
+import threading
+try:
+  from http.server import BaseHTTPRequestHandler, HTTPServer
+  from socketserver import ThreadingMixIn
+except ImportError:
+  from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+  from SocketServer import ThreadingMixIn
+
+espruino = sys.argv[1] if len(sys.argv)>1 else "./espruino"
+REQUESTS = 200
+PORT = 8127
+
+connections = [0]
+
+class Handler(BaseHTTPRequestHandler):
+  protocol_version = "HTTP/1.1"
+  disable_nagle_algorithm = True # headers and body are written separately
+  def setup(self):
+    connections[0] += 1
+    BaseHTTPRequestHandler.setup(self)
+  def do_GET(self):
+    body = b'{"ok":true}'
+    self.send_response(200)
+    self.send_header("Content-Length", str(len(body)))
+    self.end_headers()
+    self.wfile.write(body)
+  def log_message(self, format, *args):
+    pass
+
+class Server(ThreadingMixIn, HTTPServer):
+  daemon_threads = True
+
+server = Server(("localhost", PORT), Handler)
+threading.Thread(target=server.serve_forever).start()
+
+for agent in ["undefined", "{keepAlive:true}"]:
+  connections[0] = 0
+  script = "/tmp/http_keepalive.js"
+  open(script, "w").write("""
+var http = require('http'), n = 0, t = getTime();
+function next() {
+  if (n++ == %d) return console.log('TIME '+((getTime()-t)*1000/%d).toFixed(2));
+  http.request({host:'localhost', port:%d, path:'/telemetry', method:'GET', agent:%s}, function(res) {
+    res.on('close', next);
+  }).end();
+}
+next();
+""" % (REQUESTS, REQUESTS, PORT, agent))
+  out = subprocess.check_output([espruino, script], stdin=subprocess.PIPE, timeout=120).decode("utf-8", "replace")
+  ms = [l.split()[1] for l in out.splitlines() if "TIME " in l]
+  print("agent %-16s %sms per request, %d TCP connections for %d requests" % (agent, ms[0] if ms else "?", connections[0], REQUESTS))
+
+server.shutdown()
@@ -0,0 +1,60 @@
+#!/usr/bin/python
+# Simple HTTP load generator: keep a few connections' worth of requests in
+# flight against an Espruino HTTP server and report requests/sec. Each
+# request is a new connection (Espruino's server is HTTP/1.0 with
+# Connection: close).
+#
+# usage: benchmark/http_requests.py [path/to/espruino] [concurrency]
+
+import os
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+espruino = sys.argv[1] if len(sys.argv)>1 else "./espruino"
+CONCURRENCY = int(sys.argv[2]) if len(sys.argv)>2 else 4
+DURATION = 5
+PORT = 8125
+
+def cpu_time(p):
+  # utime+stime of the process, in seconds
+  fields = open("/proc/%d/stat" % p.pid).read().rsplit(")",1)[1].split()
+  return (int(fields[11])+int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+script = "/tmp/http_requests.js"
+open(script, "w").write("require('http').createServer(function(req,res){res.writeHead(200,{'Content-Type':'text/plain'});res.end('Hello World');}).listen(%d);" % PORT)
+p = subprocess.Popen([espruino, script], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+time.sleep(1) # wait for startup
+
+counts = [0]*CONCURRENCY
+errors = [0]*CONCURRENCY
+stop = time.time()+DURATION
+
+def worker(n):
+  while time.time()<stop:
+    try:
+      s = socket.create_connection(("localhost", PORT), timeout=2)
+      s.sendall(b"GET / HTTP/1.0\r\nHost: localhost\r\n\r\n")
+      got = b""
+      while True:
+        d = s.recv(1024)
+        if not d: break
+        got += d
+      s.close()
+      if got.endswith(b"Hello World"): counts[n] += 1
+      else: errors[n] += 1
+    except socket.error:
+      errors[n] += 1
+
+startCPU = cpu_time(p)
+start = time.time()
+threads = [threading.Thread(target=worker, args=(i,)) for i in range(CONCURRENCY)]
+for t in threads: t.start()
+for t in threads: t.join()
+elapsed = time.time()-start
+used = cpu_time(p)-startCPU
+print("%d concurrent: %.0f requests/sec, %.1fus Espruino CPU per request, %d errors" % (CONCURRENCY, sum(counts)/elapsed, used*1000000/sum(counts), sum(errors)))
+p.kill()
+p.communicate()
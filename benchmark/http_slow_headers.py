@@ -0,0 +1,53 @@
+#!/usr/bin/python
+# Send HTTP requests with large headers a few bytes at a time (like a slow
+# or 'slowloris' client) and measure how much CPU Espruino uses per request
+# to collect and parse them.
+#
+# usage: benchmark/http_slow_headers.py [path/to/espruino] [header bytes]
+
+import os
+import socket
+import subprocess
+import sys
+import time
+
+espruino = sys.argv[1] if len(sys.argv)>1 else "./espruino"
+HEADER_BYTES = int(sys.argv[2]) if len(sys.argv)>2 else 2000
+PIECE = 8
+REQUESTS = 10
+PORT = 8126
+
+def cpu_time(p):
+  # utime+stime of the process, in seconds
+  fields = open("/proc/%d/stat" % p.pid).read().rsplit(")",1)[1].split()
+  return (int(fields[11])+int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+script = "/tmp/http_slow_headers.js"
+open(script, "w").write("require('http').createServer(function(req,res){res.end('ok');}).listen(%d);" % PORT)
+p = subprocess.Popen([espruino, script], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+time.sleep(1) # wait for startup
+
+request = b"GET / HTTP/1.0\r\n"
+while len(request)<HEADER_BYTES:
+  request += b"X-Padding-%d: %s\r\n" % (len(request), b"x"*40)
+request += b"\r\n"
+
+startCPU = cpu_time(p)
+ok = 0
+for r in range(REQUESTS):
+  s = socket.create_connection(("localhost", PORT))
+  s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+  for i in range(0, len(request), PIECE):
+    s.sendall(request[i:i+PIECE])
+    time.sleep(0.0005)
+  got = b""
+  while True:
+    d = s.recv(1024)
+    if not d: break
+    got += d
+  s.close()
+  if got.endswith(b"ok"): ok += 1
+used = cpu_time(p)-startCPU
+print("%d byte headers in %d byte pieces: %.1fms Espruino CPU per request (%d/%d ok)" % (len(request), PIECE, used*1000/REQUESTS, ok, REQUESTS))
+p.kill()
+p.communicate()
@@ -0,0 +1,70 @@
+#!/usr/bin/python
+# Measure how much CPU Espruino on Linux uses while it's idle (at the
+# prompt, with a timer, and with an open HTTP server), how often it wakes
+# up, and how quickly it responds to a socket and to a timer while idle.
+#
+# usage: benchmark/linux_idle.py [path/to/espruino]
+
+import os
+import socket
+import subprocess
+import sys
+import time
+
+espruino = sys.argv[1] if len(sys.argv)>1 else "./espruino"
+PORT = 8123
+
+def cpu_time(p):
+  # utime+stime of the process, in seconds
+  fields = open("/proc/%d/stat" % p.pid).read().rsplit(")",1)[1].split()
+  return (int(fields[11])+int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+def wakeups(p):
+  # context switches of all threads in the process
+  n = 0
+  for task in os.listdir("/proc/%d/task" % p.pid):
+    for line in open("/proc/%d/task/%s/status" % (p.pid, task)):
+      if line.startswith("voluntary_ctxt_switches"): n += int(line.split()[1])
+  return n
+
+def run(name, code, measure=None):
+  args = [espruino]
+  if code is not None: # otherwise just sit at the prompt
+    args.append("/tmp/linux_idle.js")
+    open(args[1], "w").write(code)
+  p = subprocess.Popen(args, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+  time.sleep(1) # wait for startup
+  start = cpu_time(p)
+  startWakeups = wakeups(p)
+  time.sleep(2)
+  used = cpu_time(p)-start
+  woke = wakeups(p)-startWakeups
+  extra = measure() if measure else ""
+  p.kill()
+  p.communicate()
+  print("%-24s %5.1f%% CPU, %4d wakeups/sec %s" % (name, used*50, woke/2, extra))
+
+def http_latency():
+  times = []
+  for i in range(20):
+    t = time.time()
+    s = socket.create_connection(("localhost", PORT))
+    s.sendall(b"GET / HTTP/1.0\r\n\r\n")
+    while s.recv(1024): pass
+    s.close()
+    times.append(time.time()-t)
+    time.sleep(0.02)
+  return "- HTTP request %.2fms" % (min(times)*1000)
+
+run("idle at the prompt", None)
+run("setInterval(...,100)", "setInterval(function(){},100);")
+run("HTTP server", "require('http').createServer(function(q,r){r.end('x');}).listen(%d);" % PORT, http_latency)
+# how late does a 5ms timeout fire when we're otherwise idle?
+code = ('var n=0,late=0;function t(){var s=getTime();setTimeout(function(){late+=getTime()-s-0.005;'
+        'if(++n<100)t();else console.log("LATE",(late*1000/n).toFixed(2));},5);}t();')
+open("/tmp/linux_idle.js", "w").write(code)
+out = subprocess.Popen([espruino, "/tmp/linux_idle.js"], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+time.sleep(3)
+out.kill()
+for line in out.communicate()[0].decode().split("\n"):
+  if line.find("LATE ")>=0: print("setTimeout(5ms) fires %sms late on average" % line[line.find("LATE ")+5:].strip())
@@ -0,0 +1,5 @@
+// Reads and writes fields of an object with several fields many times
+var packet = { header:1, type:2, length:3, flags:4, sequence:5, checksum:0, payload:6 };
+for (var i=0;i<2000;i++) {
+  packet.checksum = (packet.checksum + packet.payload + packet.sequence + packet.length) & 255;
+}
@@ -0,0 +1,6 @@
+// Looks up keys in an object with a few hundred keys
+var table = {};
+for (var i=0;i<300;i++) table["cmd"+i] = i;
+var sum = 0;
+for (var j=0;j<20;j++)
+  for (i=0;i<300;i+=7) sum += table["cmd"+i];
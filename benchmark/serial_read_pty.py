@@ -0,0 +1,46 @@
+#!/usr/bin/python
+# Measure how fast Serial data is received on Linux by writing 64KB as
+# fast as possible to a pseudo-terminal that Serial1 is set up on, and
+# report how much arrived (in how many 'data' events) and how full the IO
+# event queue got.
+#
+# usage: benchmark/serial_read_pty.py [path/to/espruino]
+
+import fcntl
+import os
+import pty
+import select
+import subprocess
+import sys
+import time
+import tty
+
+LENGTH = 65536
+espruino = sys.argv[1] if len(sys.argv)>1 else "./espruino"
+
+master, slave = pty.openpty()
+tty.setraw(master)
+tty.setraw(slave)
+fcntl.fcntl(master, fcntl.F_SETFL, os.O_NONBLOCK)
+code = ('var n=0,e=0;Serial1.setup(921600,{path:%r});'
+        'Serial1.on("data",function(d){n+=d.length;e++;});'
+        'setTimeout(function(){console.log("RECEIVED",n,"in",e,"events",JSON.stringify(E.getEventQueueInfo()));quit();},3000);') % os.ttyname(slave)
+script = "/tmp/serial_read_pty.js"
+open(script, "w").write(code)
+
+p = subprocess.Popen([espruino, script], stdin=open(os.devnull), stdout=subprocess.PIPE)
+time.sleep(0.5) # wait for startup
+data = b"x"*LENGTH
+written = 0
+start = time.time()
+while written < LENGTH and time.time() < start+2:
+  r,w,x = select.select([], [master], [], 0.1)
+  if w:
+    try:
+      written += os.write(master, data[written:written+4096])
+    except OSError:
+      pass # EAGAIN
+end = time.time()
+print("Wrote %d bytes in %.3fs - %d bytes/sec" % (written, end-start, written/(end-start)))
+for line in p.communicate()[0].decode().split("\n"):
+  if line.find("RECEIVED ")>=0: print(line[line.find("RECEIVED "):].strip())
@@ -0,0 +1,42 @@
+#!/usr/bin/python
+# Measure Serial.write throughput on Linux by writing a 64KB string to
+# Serial1, set up on a pseudo-terminal that this script reads from.
+#
+# usage: benchmark/serial_write_pty.py [path/to/espruino]
+
+import os
+import pty
+import select
+import subprocess
+import sys
+import time
+import tty
+
+LENGTH = 65536
+espruino = sys.argv[1] if len(sys.argv)>1 else "./espruino"
+
+master, slave = pty.openpty()
+tty.setraw(master)
+tty.setraw(slave)
+code = ('var s="0123456789ABCDEF";while (s.length<%d) s+=s;'
+        'Serial1.setup(115200,{path:%r});'
+        'Serial1.write(s);setTimeout(function(){},5000);') % (LENGTH, os.ttyname(slave))
+script = "/tmp/serial_write_pty.js"
+open(script, "w").write(code)
+
+p = subprocess.Popen([espruino, script], stdin=open(os.devnull), stdout=open(os.devnull, "w"))
+received = 0
+start = None
+while received < LENGTH:
+  r,w,x = select.select([master], [], [], 5)
+  if not r: break
+  data = os.read(master, 4096)
+  if start is None: start = time.time()
+  received += len(data)
+end = time.time()
+p.kill()
+p.wait()
+if received < LENGTH:
+  print("Only received %d of %d bytes" % (received, LENGTH))
+  sys.exit(1)
+print("%d bytes in %.3fs - %d bytes/sec" % (received, end-start, received/(end-start)))
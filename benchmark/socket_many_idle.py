@@ -0,0 +1,45 @@
+#!/usr/bin/python
+# Measure how long echo round trips over one socket take when there are also
+# lots of idle connections open to the same Espruino server, and how much
+# CPU Espruino uses doing it.
+#
+# usage: benchmark/socket_many_idle.py [path/to/espruino] [idle connections]
+
+import os
+import socket
+import subprocess
+import sys
+import time
+
+espruino = sys.argv[1] if len(sys.argv)>1 else "./espruino"
+IDLE = int(sys.argv[2]) if len(sys.argv)>2 else 100
+ROUNDS = 500
+PORT = 8124
+
+def cpu_time(p):
+  # utime+stime of the process, in seconds
+  fields = open("/proc/%d/stat" % p.pid).read().rsplit(")",1)[1].split()
+  return (int(fields[11])+int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+script = "/tmp/socket_many_idle.js"
+open(script, "w").write("require('net').createServer(function(c){c.on('data',function(d){c.write(d);});}).listen(%d);" % PORT)
+p = subprocess.Popen([espruino, script], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+time.sleep(1) # wait for startup
+idle = []
+for i in range(IDLE):
+  idle.append(socket.create_connection(("localhost", PORT)))
+  time.sleep(0.005) # Espruino accepts one connection per idle, with a backlog of 10
+s = socket.create_connection(("localhost", PORT))
+s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+time.sleep(1) # let all the connections be accepted
+startCPU = cpu_time(p)
+start = time.time()
+for i in range(ROUNDS):
+  s.sendall(b"ping")
+  got = b""
+  while len(got)<4: got += s.recv(16)
+end = time.time()
+used = cpu_time(p)-startCPU
+print("%d idle connections: %.3fms per round trip, %.1fms CPU per round trip" % (IDLE, (end-start)*1000/ROUNDS, used*1000/ROUNDS))
+p.kill()
+p.communicate()
@@ -0,0 +1,9 @@
+// Appending longer strings - the copying is done a whole block at a time
+var chunk = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!?";
+var s;
+for (var j=0;j<20;j++) {
+  s = "";
+  for (var i=0;i<100;i++) s += chunk;
+}
+var t = "";
+for (var i=0;i<200;i++) t = JSON.stringify({ text:s.substr(i*10,100) });
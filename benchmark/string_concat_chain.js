@@ -0,0 +1,8 @@
+// Build a long string from a chain of '+' in one expression
+var body = "";
+for (var i=0;i<40;i++) body += "<li>Item number "+i+"</li>";
+for (var i=0;i<1000;i++) {
+  var s = "HTTP/1.1 200 OK\r\n" + "Content-Type: text/html\r\n" +
+          "Content-Length: " + body.length + "\r\n\r\n" +
+          "<html><body><ul>" + body + "</ul></body></html>";
+}
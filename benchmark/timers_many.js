@@ -0,0 +1,12 @@
+// 300 slow intervals, and a fast timeout that re-schedules itself 2000 times.
+// The time taken is mostly spent looking after the timers that aren't due
+for (var i=0;i<300;i++) setInterval(function() {}, 100000+i);
+var n = 0, start = getTime();
+function tick() {
+  if (++n < 2000) setTimeout(tick, 0.1);
+  else {
+    print("2000 timeouts with 300 intervals: "+((getTime()-start)*1000).toFixed(1)+"ms");
+    clearInterval();
+  }
+}
+tick();
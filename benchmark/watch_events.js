@@ -0,0 +1,18 @@
+// 10000 watch events on one pin, while 15 other pins have 20 watches each.
+// Uses E.pushWatchEvent to add events without needing real hardware
+for (var p=1;p<=15;p++)
+  for (var i=0;i<20;i++) setWatch(function() {}, p, {repeat:true});
+var n = 0, pushed = 0, start = getTime();
+setWatch(function() {
+  if (++n == 10000) {
+    print("10000 watch events with 300 other watches: "+((getTime()-start)*1000).toFixed(1)+"ms");
+    clearWatch();
+  }
+}, 16, {repeat:true});
+function push() {
+  // only push as many as will fit in the input queue
+  for (var i=0;i<100 && pushed<10000 && E.pushWatchEvent(16, pushed&1);i++)
+    pushed++;
+  if (pushed<10000) setTimeout(push, 0.1);
+}
+push();
@@ -20,6 +20,7 @@
 #include "jsutils.h"
 #include "jsvar.h"
 #include "jsparse.h"
+#include "jswrap_math.h"
 
 #include "lcd_arraybuffer.h"
 #include "lcd_js.h"
@@ -55,6 +56,30 @@ void graphicsFallbackFillRect(JsGraphics *gfx, short x1, short y1, short x2, sho
       graphicsSetPixelDevice(gfx,x,y, gfx->data.fgColor);
 }
 
+void graphicsFallbackBlitSpan(JsGraphics *gfx, short x, short y, short pixelCount, const unsigned int *cols) {
+  short i;
+  for (i=0;i<pixelCount;i++)
+    gfx->setPixel(gfx, (short)(x+i), y, cols[i]);
+}
+
+void graphicsFallbackFillSpan(JsGraphics *gfx, short x1, short x2, short y) {
+  gfx->fillRect(gfx, x1, y, x2, y);
+}
+
+void graphicsFallbackFlip(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
+  JsVar *flip = jsvObjectGetChild(gfx->graphicsVar, "iFlip", 0);
+  if (flip) {
+    JsVar *args[4];
+    args[0] = jsvNewFromInteger(x1);
+    args[1] = jsvNewFromInteger(y1);
+    args[2] = jsvNewFromInteger(x2);
+    args[3] = jsvNewFromInteger(y2);
+    jsvUnLock(jspExecuteFunction(flip, gfx->graphicsVar, 4, args));
+    jsvUnLockMany(4, args);
+    jsvUnLock(flip);
+  }
+}
+
 // ----------------------------------------------------------------------------------------------
 
 bool graphicsGetFromVar(JsGraphics *gfx, JsVar *parent) {
@@ -67,6 +92,11 @@ bool graphicsGetFromVar(JsGraphics *gfx, JsVar *parent) {
     gfx->setPixel = graphicsFallbackSetPixel;
     gfx->getPixel = graphicsFallbackGetPixel;
     gfx->fillRect = graphicsFallbackFillRect;
+    gfx->fillSpan = graphicsFallbackFillSpan;
+    gfx->blitSpan = graphicsFallbackBlitSpan;
+    gfx->copySpan = 0;
+    gfx->flip = graphicsFallbackFlip;
+    gfx->backendData = 0;
 #ifdef USE_LCD_SDL
     if (gfx->data.type == JSGRAPHICSTYPE_SDL) {
       lcdSetCallbacks_SDL(gfx);
@@ -106,6 +136,97 @@ void graphicsSetVar(JsGraphics *gfx) {
 
 // ----------------------------------------------------------------------------------------------
 
+#ifdef JSGRAPHICS_MODIFIED_RECTS
+static int graphicsRectArea(const JsGraphicsRect *r) {
+  return (1+r->x2-r->x1) * (1+r->y2-r->y1);
+}
+
+static void graphicsRectUnion(JsGraphicsRect *r, const JsGraphicsRect *e) {
+  if (e->x1 < r->x1) r->x1 = e->x1;
+  if (e->y1 < r->y1) r->y1 = e->y1;
+  if (e->x2 > r->x2) r->x2 = e->x2;
+  if (e->y2 > r->y2) r->y2 = e->y2;
+}
+#endif
+
+void graphicsSetModified(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
+  if (x1 < gfx->data.modMinX) gfx->data.modMinX=x1;
+  if (x2 > gfx->data.modMaxX) gfx->data.modMaxX=x2;
+  if (y1 < gfx->data.modMinY) gfx->data.modMinY=y1;
+  if (y2 > gfx->data.modMaxY) gfx->data.modMaxY=y2;
+#ifdef JSGRAPHICS_MODIFIED_RECTS
+  /* Keep a few non-overlapping rectangles. Anything that overlaps, or that can
+   * be merged without covering much extra area, is merged. If we run out of
+   * rectangles, merge with whichever one grows the least */
+  JsGraphicsRect r = { x1, y1, x2, y2 };
+  JsGraphicsRect *rects = gfx->data.modRects;
+  int i = 0;
+  while (i < gfx->data.modRectCount) {
+    JsGraphicsRect *e = &rects[i];
+    if (r.x1>=e->x1 && r.y1>=e->y1 && r.x2<=e->x2 && r.y2<=e->y2)
+      return; // already covered
+    JsGraphicsRect u = r;
+    graphicsRectUnion(&u, e);
+    bool overlaps = r.x1<=e->x2 && r.x2>=e->x1 && r.y1<=e->y2 && r.y2>=e->y1;
+    if (overlaps || graphicsRectArea(&u) <= graphicsRectArea(&r)+graphicsRectArea(e)) {
+      // merge, remove the old one, and start again as 'r' is now bigger
+      r = u;
+      rects[i] = rects[--gfx->data.modRectCount];
+      i = 0;
+      continue;
+    }
+    i++;
+    if (i == JSGRAPHICS_MODIFIED_RECTS) {
+      // out of space - merge with whichever grows least, then check again
+      int best = 0, bestGrowth = 0x7FFFFFFF;
+      for (i=0;i<JSGRAPHICS_MODIFIED_RECTS;i++) {
+        u = r;
+        graphicsRectUnion(&u, &rects[i]);
+        int growth = graphicsRectArea(&u) - graphicsRectArea(&rects[i]);
+        if (growth < bestGrowth) {
+          bestGrowth = growth;
+          best = i;
+        }
+      }
+      graphicsRectUnion(&r, &rects[best]);
+      rects[best] = rects[--gfx->data.modRectCount];
+      i = 0;
+    }
+  }
+  rects[gfx->data.modRectCount++] = r;
+#endif
+}
+
+void graphicsFlip(JsGraphics *gfx) {
+  JsGraphicsRect rects[
+#ifdef JSGRAPHICS_MODIFIED_RECTS
+    JSGRAPHICS_MODIFIED_RECTS
+#else
+    1
+#endif
+  ];
+  int i, count = 0;
+#ifdef JSGRAPHICS_MODIFIED_RECTS
+  count = gfx->data.modRectCount;
+  for (i=0;i<count;i++) rects[i] = gfx->data.modRects[i];
+#else
+  if (gfx->data.modMinX <= gfx->data.modMaxX) {
+    rects[0].x1 = gfx->data.modMinX;
+    rects[0].y1 = gfx->data.modMinY;
+    rects[0].x2 = gfx->data.modMaxX;
+    rects[0].y2 = gfx->data.modMaxY;
+    count = 1;
+  }
+#endif
+  // reset first, as the flip callback may well draw something else
+  graphicsResetModified(gfx);
+  graphicsSetVar(gfx);
+  for (i=0;i<count;i++)
+    gfx->flip(gfx, rects[i].x1, rects[i].y1, rects[i].x2, rects[i].y2);
+}
+
+// ----------------------------------------------------------------------------------------------
+
 // If graphics is flipped or rotated then the coordinates need modifying
 void graphicsToDeviceCoordinates(const JsGraphics *gfx, short *x, short *y) {
   if (gfx->data.flags & JSGRAPHICSFLAGS_SWAP_XY) {
@@ -121,10 +242,7 @@ void graphicsToDeviceCoordinates(const JsGraphics *gfx, short *x, short *y) {
 
 static void graphicsSetPixelDevice(JsGraphics *gfx, short x, short y, unsigned int col) {
   if (x<0 || y<0 || x>=gfx->data.width || y>=gfx->data.height) return;
-  if (x < gfx->data.modMinX) gfx->data.modMinX=x;
-  if (x > gfx->data.modMaxX) gfx->data.modMaxX=x;
-  if (y < gfx->data.modMinY) gfx->data.modMinY=y;
-  if (y > gfx->data.modMaxY) gfx->data.modMaxY=y;
+  graphicsSetModified(gfx, x, y, x, y);
   gfx->setPixel(gfx,x,y,col & (unsigned int)((1L<<gfx->data.bpp)-1));
 }
 
@@ -150,10 +268,7 @@ static void graphicsFillRectDevice(JsGraphics *gfx, short x1, short y1, short x2
   if (y2>=gfx->data.height) y2 = (short)(gfx->data.height - 1);
   if (x2<x1 || y2<y1) return; // nope
 
-  if (x1 < gfx->data.modMinX) gfx->data.modMinX=x1;
-  if (x2 > gfx->data.modMaxX) gfx->data.modMaxX=x2;
-  if (y1 < gfx->data.modMinY) gfx->data.modMinY=y1;
-  if (y2 > gfx->data.modMaxY) gfx->data.modMaxY=y2;
+  graphicsSetModified(gfx, x1, y1, x2, y2);
 
   if (x1==x2 && y1==y2) {
     graphicsSetPixelDevice(gfx,x1,y1,gfx->data.fgColor);
@@ -246,95 +361,320 @@ void graphicsDrawLine(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
   }
 }
 
-static inline void graphicsFillPolyCreateScanLines(JsGraphics *gfx, short *minx, short *maxx, short x1, short y1,short x2, short y2) {
-    if (y2 < y1) {
+/* Spans that are output are merged vertically into rectangles where possible,
+ * as for drivers that don't draw directly into memory that's a lot faster */
+typedef struct {
+  JsGraphicsRect pending; ///< rectangle waiting to be drawn (y2<y1 if none)
+  JsGraphicsRect area; ///< area that has been drawn into
+} JsGraphicsSpans;
+
+static void graphicsSpansInit(JsGraphicsSpans *spans) {
+  spans->pending.y1 = 0;
+  spans->pending.y2 = -1;
+  spans->area.x1 = 32767;
+  spans->area.y1 = 32767;
+  spans->area.x2 = -32768;
+  spans->area.y2 = -32768;
+}
+
+static void graphicsSpansFlush(JsGraphics *gfx, JsGraphicsSpans *spans) {
+  JsGraphicsRect *r = &spans->pending;
+  if (r->y2 < r->y1) return;
+  if (r->y1 != r->y2)
+    gfx->fillRect(gfx, r->x1, r->y1, r->x2, r->y2);
+  else if (r->x1 != r->x2)
+    gfx->fillSpan(gfx, r->x1, r->x2, r->y1);
+  else
+    gfx->setPixel(gfx, r->x1, r->y1, gfx->data.fgColor & (unsigned int)((1L<<gfx->data.bpp)-1));
+  r->y2 = (short)(r->y1-1);
+}
+
+// Fill x1..x2 (inclusive) on row y (DEVICE coordinates). y must already be on screen
+static void graphicsSpansAdd(JsGraphics *gfx, JsGraphicsSpans *spans, int x1, int x2, short y) {
+  if (x1<0) x1=0;
+  if (x2>=gfx->data.width) x2=gfx->data.width-1;
+  if (x2<x1) return;
+  JsGraphicsRect *r = &spans->pending;
+  if (r->y2>=r->y1 && r->x1==x1 && r->x2==x2 && r->y2+1==y) {
+    r->y2 = y;
+    return;
+  }
+  graphicsSpansFlush(gfx, spans);
+  r->x1 = (short)x1;
+  r->x2 = (short)x2;
+  r->y1 = r->y2 = y;
+  if (r->x1 < spans->area.x1) spans->area.x1 = r->x1;
+  if (r->x2 > spans->area.x2) spans->area.x2 = r->x2;
+  if (y < spans->area.y1) spans->area.y1 = y;
+  if (y > spans->area.y2) spans->area.y2 = y;
+}
+
+static void graphicsSpansFinish(JsGraphics *gfx, JsGraphicsSpans *spans) {
+  graphicsSpansFlush(gfx, spans);
+  if (spans->area.x1 <= spans->area.x2)
+    graphicsSetModified(gfx, spans->area.x1, spans->area.y1, spans->area.x2, spans->area.y2);
+}
+
+/// A polygon edge, for graphicsFillPolys
+typedef struct {
+  int x; ///< x position on the current scanline, 24.8 fixed point
+  int stepX; ///< change in x per scanline, 24.8 fixed point
+  short yMin, yMax; ///< first and last scanlines the edge is on
+  signed char dir; ///< 1 if the edge goes down the screen, -1 if up, 0 if horizontal
+} JsGraphicsEdge;
+
+static int graphicsEdgeX(const JsGraphicsEdge *e) {
+  int x = e->x>>8;
+  if (x<-32768) x=-32768;
+  if (x>32767) x=32767;
+  return x;
+}
+
+/* Work out which parts of a scanline are inside the polygon, using the edges
+ * in 'active' (sorted by x) that 'ignoreY' isn't the end of. Adds spans to spanX1/spanX2 */
+static int graphicsFillPolyScanSpans(const JsGraphicsEdge *edges, const int *active, int activeCount, bool ignoreMax, short y, bool nonZero, int *spanX1, int *spanX2, int spanCount) {
+  int i, winding = 0, startX = 0;
+  for (i=0;i<activeCount;i++) {
+    const JsGraphicsEdge *e = &edges[active[i]];
+    if (!e->dir || (ignoreMax ? e->yMax : e->yMin)==y) continue;
+    bool wasInside = nonZero ? winding!=0 : (winding&1)!=0;
+    winding += nonZero ? e->dir : 1;
+    bool isInside = nonZero ? winding!=0 : (winding&1)!=0;
+    if (!wasInside && isInside) {
+      startX = graphicsEdgeX(e);
+    } else if (wasInside && !isInside) {
+      spanX1[spanCount] = startX;
+      spanX2[spanCount] = graphicsEdgeX(e);
+      spanCount++;
+    }
+  }
+  return spanCount;
+}
+
+/* Fill one or more polygons (eg. a shape and the holes in it) using an active
+ * edge table. Pixels that the outline goes through are always filled, and
+ * which parts are 'inside' is decided with the even-odd or non-zero rule.
+ *
+ * Each scanline is worked out twice - once with the edges that start on it and
+ * once with the edges that end on it - and the two are combined. That way a
+ * vertex always gets drawn, and a convex polygon gives exactly the same pixels
+ * as the simple min/max scanline fill that this used to be */
+void graphicsFillPolys(JsGraphics *gfx, int polyCount, const int *polyPoints, short *vertices, bool nonZero) {
+  int i, j, p, points = 0;
+  for (p=0;p<polyCount;p++) points += polyPoints[p];
+  if (points<=0) return;
+  short minx = 32767, maxx = -32768, miny = 32767, maxy = -32768;
+  for (i=0;i<points*2;i+=2) {
+    // convert into device coordinates...
+    graphicsToDeviceCoordinates(gfx, &vertices[i], &vertices[i+1]);
+    if (vertices[i]<minx) minx=vertices[i];
+    if (vertices[i]>maxx) maxx=vertices[i];
+    if (vertices[i+1]<miny) miny=vertices[i+1];
+    if (vertices[i+1]>maxy) maxy=vertices[i+1];
+  }
+  JsGraphicsSpans spans;
+  graphicsSpansInit(&spans);
+  if (miny==maxy) {
+    // completely flat - no edges to scan, so just draw the line
+    if (miny>=0 && miny<gfx->data.height)
+      graphicsSpansAdd(gfx, &spans, minx, maxx, miny);
+    graphicsSpansFinish(gfx, &spans);
+    return;
+  }
+  // build the edge table, sorted by yMin
+  JsGraphicsEdge edges[points];
+  int edgeCount = 0, first = 0;
+  for (p=0;p<polyCount;p++) {
+    j = (first+polyPoints[p]-1)*2;
+    for (i=first*2;i<(first+polyPoints[p])*2;i+=2) {
+      short x1 = vertices[j+0], y1 = vertices[j+1];
+      short x2 = vertices[i+0], y2 = vertices[i+1];
+      JsGraphicsEdge e;
+      e.dir = (signed char)((y1<y2) ? 1 : ((y1>y2) ? -1 : 0));
+      if (y2 < y1) {
         short t;
         t=x1;x1=x2;x2=t;
         t=y1;y1=y2;y2=t;
+      }
+      // horizontal edges just add their first point - the edges either side do the rest
+      e.x = x1*256;
+      e.stepX = e.dir ? (x2-x1)*256 / (y2-y1) : 0;
+      e.yMin = y1;
+      e.yMax = y2;
+      int k = edgeCount++;
+      while (k>0 && edges[k-1].yMin > e.yMin) {
+        edges[k] = edges[k-1];
+        k--;
+      }
+      edges[k] = e;
+      j = i;
     }
-    int xh = x1*256;
-    int yl = y2-y1;
-    if (yl==0) yl=1;
-    int stepx = (x2-x1)*256 / yl;
-    short y;
-    for (y=y1;y<=y2;y++) {
-        int x = xh>>8;
-        if (x<-32768) x=-32768;
-        if (x>32767) x=32767;
-        if (y>=0 && y<gfx->data.height) {
-            if (x<minx[y]) {
-                minx[y] = (short)x;
-            }
-            if (x>maxx[y]) {
-                maxx[y] = (short)x;
-            }
+    first += polyPoints[p];
+  }
+  // now scan, keeping a list of the edges that cross the current scanline
+  int active[edgeCount];
+  int spanX1[edgeCount*2], spanX2[edgeCount*2];
+  int activeCount = 0, nextEdge = 0;
+  short y = (short)((miny<0) ? 0 : miny);
+  short lastY = (short)((maxy>=gfx->data.height) ? gfx->data.height-1 : maxy);
+  bool isVertexRow = false; // do any edges start or end on this scanline?
+  for (;y<=lastY;y++) {
+    // add new edges (skipping to this scanline if they started off the screen)
+    while (nextEdge<edgeCount && edges[nextEdge].yMin<=y) {
+      JsGraphicsEdge *e = &edges[nextEdge];
+      if (e->yMax >= y) {
+        e->x += (y - e->yMin)*e->stepX;
+        active[activeCount++] = nextEdge;
+        isVertexRow = true;
+      }
+      nextEdge++;
+    }
+    // sort by x - this is usually already sorted
+    for (i=1;i<activeCount;i++) {
+      int a = active[i];
+      j = i;
+      while (j>0 && edges[active[j-1]].x > edges[a].x) {
+        active[j] = active[j-1];
+        j--;
+      }
+      active[j] = a;
+    }
+    if (!isVertexRow && activeCount==2) {
+      // the usual case - one span, and nothing to merge
+      graphicsSpansAdd(gfx, &spans, graphicsEdgeX(&edges[active[0]]), graphicsEdgeX(&edges[active[1]]), y);
+    } else {
+      // work out the spans - if no edges start or end here, one pass is enough
+      int spanCount = graphicsFillPolyScanSpans(edges, active, activeCount, true, y, nonZero, spanX1, spanX2, 0);
+      if (isVertexRow) {
+        spanCount = graphicsFillPolyScanSpans(edges, active, activeCount, false, y, nonZero, spanX1, spanX2, spanCount);
+        for (i=0;i<activeCount;i++) {
+          if (!edges[active[i]].dir) {
+            spanX1[spanCount] = spanX2[spanCount] = graphicsEdgeX(&edges[active[i]]);
+            spanCount++;
+          }
+        }
+      }
+      // sort them, merge any that overlap, and draw
+      for (i=1;i<spanCount;i++) {
+        int x1 = spanX1[i], x2 = spanX2[i];
+        j = i;
+        while (j>0 && spanX1[j-1] > x1) {
+          spanX1[j] = spanX1[j-1];
+          spanX2[j] = spanX2[j-1];
+          j--;
         }
-        xh += stepx;
+        spanX1[j] = x1;
+        spanX2[j] = x2;
+      }
+      i = 0;
+      while (i<spanCount) {
+        int x1 = spanX1[i], x2 = spanX2[i];
+        for (i++;i<spanCount && spanX1[i]<=x2+1;i++)
+          if (spanX2[i]>x2) x2 = spanX2[i];
+        graphicsSpansAdd(gfx, &spans, x1, x2, y);
+      }
     }
+    // move on to the next scanline, removing edges that have finished
+    isVertexRow = false;
+    j = 0;
+    for (i=0;i<activeCount;i++) {
+      JsGraphicsEdge *e = &edges[active[i]];
+      if (e->yMax > y) {
+        e->x += e->stepX;
+        if (e->yMax == y+1) isVertexRow = true;
+        active[j++] = active[i];
+      }
+    }
+    activeCount = j;
+    if (jspIsInterrupted()) break;
+  }
+  graphicsSpansFinish(gfx, &spans);
 }
 
 void graphicsFillPoly(JsGraphics *gfx, int points, short *vertices) {
-  int i;
-  short miny = (short)(gfx->data.height-1);
-  short maxy = 0;
-  for (i=0;i<points*2;i+=2) {
-    // convert into device coordinates...
-    graphicsToDeviceCoordinates(gfx, &vertices[i], &vertices[i+1]);
-    short y = vertices[i+1];
-    if (y<miny) miny=y;
-    if (y>maxy) maxy=y;
-  }
-  if (miny<0) miny=0;
-  if (maxy>=gfx->data.height) maxy=(short)(gfx->data.height-1);
-  short minx[gfx->data.height];
-  short maxx[gfx->data.height];
-  short y;
-  for (y=miny;y<=maxy;y++) {
-    minx[y] = (short)(gfx->data.width);
-    maxx[y] = -1;
-  }
-  int j = (points-1)*2;
-  for (i=0;i<points*2;i+=2) {
-    graphicsFillPolyCreateScanLines(gfx, minx, maxx, vertices[j+0], vertices[j+1], vertices[i+0], vertices[i+1]);
-    j = i;
-  }
-  for (y=miny;y<=maxy;y++) {
-    if (maxx[y]>=minx[y] && maxx[y]>=0 && minx[y]<gfx->data.width) {
-      // clip
-      if (minx[y]<0) minx[y]=0;
-      if (maxx[y]>=gfx->data.width) maxx[y]=(short)(gfx->data.width-1);
-      // try and expand the rect that we fill
-      short oldy = y;
-      while (y<maxy && minx[y+1]==minx[oldy] && maxx[y+1]==maxx[oldy])
-        y++;
-      // actually fill
-      graphicsFillRectDevice(gfx,minx[y],oldy,maxx[y],y);
-      if (jspIsInterrupted()) break;
+  graphicsFillPolys(gfx, 1, &points, vertices, false);
+}
+
+void graphicsFillEllipse(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
+  graphicsToDeviceCoordinates(gfx, &x1, &y1);
+  graphicsToDeviceCoordinates(gfx, &x2, &y2);
+  if (x1>x2) { short t=x1; x1=x2; x2=t; }
+  if (y1>y2) { short t=y1; y1=y2; y2=t; }
+  /* Work in half pixels, so the centre can be between pixels. The radii are
+   * made half a pixel bigger so the edges of the bounding box get drawn */
+  int cx2 = x1+x2, cy2 = y1+y2;
+  JsVarFloat rx2 = (JsVarFloat)(x2-x1+1), ry2 = (JsVarFloat)(y2-y1+1);
+  JsGraphicsSpans spans;
+  graphicsSpansInit(&spans);
+  short y = (short)((y1<0) ? 0 : y1);
+  short lastY = (short)((y2>=gfx->data.height) ? gfx->data.height-1 : y2);
+  for (;y<=lastY;y++) {
+    JsVarFloat dy = (JsVarFloat)(y*2 - cy2) / ry2;
+    int w = (int)(rx2 * jswrap_math_sqrt(1 - dy*dy)); // half pixels either side of the centre
+    int sx1 = (cx2-w+1)>>1;
+    int sx2 = (cx2+w)>>1;
+    if (sx1<x1) sx1=x1;
+    if (sx2>x2) sx2=x2;
+    if (sx1<=sx2)
+      graphicsSpansAdd(gfx, &spans, sx1, sx2, y);
+  }
+  graphicsSpansFinish(gfx, &spans);
+}
+
+void graphicsDrawPoly(JsGraphics *gfx, int points, const short *vertices, bool closed, short width) {
+  int i, segments = (closed && points>2) ? points : points-1;
+  if (width<=1) {
+    for (i=0;i<segments;i++) {
+      int j = (i+1)%points;
+      graphicsDrawLine(gfx, vertices[i*2], vertices[i*2+1], vertices[j*2], vertices[j*2+1]);
     }
+    return;
+  }
+  /* Thick lines - each segment is a filled rectangle, with a filled circle at
+   * each point for the joints (and round ends) */
+  JsVarFloat halfWidth = (JsVarFloat)(width-1) / 2;
+  short r = (short)((width-1)/2);
+  for (i=0;i<segments;i++) {
+    int j = (i+1)%points;
+    JsVarFloat dx = vertices[j*2] - vertices[i*2];
+    JsVarFloat dy = vertices[j*2+1] - vertices[i*2+1];
+    JsVarFloat len = jswrap_math_sqrt(dx*dx + dy*dy);
+    if (len==0) continue;
+    JsVarFloat fx = -dy * halfWidth / len, fy = dx * halfWidth / len;
+    short nx = (short)((fx<0) ? fx-0.5 : fx+0.5);
+    short ny = (short)((fy<0) ? fy-0.5 : fy+0.5);
+    short quad[8] = {
+        (short)(vertices[i*2]+nx), (short)(vertices[i*2+1]+ny),
+        (short)(vertices[j*2]+nx), (short)(vertices[j*2+1]+ny),
+        (short)(vertices[j*2]-nx), (short)(vertices[j*2+1]-ny),
+        (short)(vertices[i*2]-nx), (short)(vertices[i*2+1]-ny) };
+    graphicsFillPoly(gfx, 4, quad);
+  }
+  for (i=0;i<points;i++) {
+    short x = (short)(vertices[i*2]-r), y = (short)(vertices[i*2+1]-r);
+    graphicsFillEllipse(gfx, x, y, (short)(x+width-1), (short)(y+width-1));
   }
 }
 
 #ifndef SAVE_ON_FLASH
-// prints character, returns width
-unsigned int graphicsFillVectorChar(JsGraphics *gfx, short x1, short y1, short size, char ch) {
-  // no need to modify coordinates as graphicsFillPoly does that
-  if (size<0) return 0;
-  if (ch<vectorFontOffset || ch-vectorFontOffset>=vectorFontCount) return 0;
-  int vertOffset = 0;
-  int i;
-  /* compute offset (I figure a ~50 iteration FOR loop is preferable to
-   * a 200 byte array) */
-  int fontOffset = ch-vectorFontOffset;
-  for (i=0;i<fontOffset;i++)
-    vertOffset += READ_FLASH_UINT8(&vectorFonts[i].vertCount);
-  VectorFontChar vector;
-  vector.vertCount = READ_FLASH_UINT8(&vectorFonts[fontOffset].vertCount);
-  vector.width = READ_FLASH_UINT8(&vectorFonts[fontOffset].width);
+#define VECTOR_FONT_CACHE_NAME JS_HIDDEN_CHAR_STR"VFc" ///< on hiddenRoot - rendered glyphs
+#define VECTOR_FONT_CACHE_GLYPHS 32 ///< how many rendered glyphs we keep
+#define VECTOR_FONT_CACHE_MAX_BYTES 256 ///< don't cache glyphs that would take more bytes than this
+#define VECTOR_FONT_GLYPH_HEADER 4 ///< x offset, y offset, width, height
+
+static short graphicsVectorCharCoord(int idx, short size) {
+  return (short)((((READ_FLASH_UINT8(&vectorFontPolys[idx])&0x7F)*size + (VECTOR_FONT_POLY_SIZE/2)) / VECTOR_FONT_POLY_SIZE));
+}
+
+// fill all the polygons of a character, with its top left at x1,y1
+static void graphicsFillVectorCharPolys(JsGraphics *gfx, short x1, short y1, short size, int fontOffset) {
+  int vertOffset = READ_FLASH_UINT16(&vectorFontOffsets[fontOffset]);
+  int vertCount = READ_FLASH_UINT8(&vectorFonts[fontOffset].vertCount);
   short verts[VECTOR_FONT_MAX_POLY_SIZE*2];
-  int idx=0;
-  for (i=0;i<vector.vertCount;i+=2) {
-    verts[idx+0] = (short)(x1 + (((READ_FLASH_UINT8(&vectorFontPolys[vertOffset+i+0])&0x7F)*size + (VECTOR_FONT_POLY_SIZE/2)) / VECTOR_FONT_POLY_SIZE));
-    verts[idx+1] = (short)(y1 + (((READ_FLASH_UINT8(&vectorFontPolys[vertOffset+i+1])&0x7F)*size + (VECTOR_FONT_POLY_SIZE/2)) / VECTOR_FONT_POLY_SIZE));
+  int i, idx=0;
+  for (i=0;i<vertCount;i+=2) {
+    verts[idx+0] = (short)(x1 + graphicsVectorCharCoord(vertOffset+i+0, size));
+    verts[idx+1] = (short)(y1 + graphicsVectorCharCoord(vertOffset+i+1, size));
     idx+=2;
     if (READ_FLASH_UINT8(&vectorFontPolys[vertOffset+i+1]) & VECTOR_FONT_POLY_SEPARATOR) {
       graphicsFillPoly(gfx,idx/2, verts);
@@ -343,7 +683,119 @@ unsigned int graphicsFillVectorChar(JsGraphics *gfx, short x1, short y1, short s
       idx=0;
     }
   }
-  return (vector.width * (unsigned int)size)/(VECTOR_FONT_POLY_SIZE*2);
+}
+
+/* Get a character rendered as a 1bpp bitmap, from the cache or by rendering it
+ * and adding it. The result is a flat string - VECTOR_FONT_GLYPH_HEADER bytes then
+ * the bitmap. Returns 0 if it can't (or shouldn't) be cached */
+static JsVar *graphicsGetVectorCharGlyph(short size, int fontOffset) {
+  char key[12];
+  key[0] = (char)(fontOffset+vectorFontOffset);
+  itostr(size, &key[1], 10);
+  JsVar *cache = jsvObjectGetChild(execInfo.hiddenRoot, VECTOR_FONT_CACHE_NAME, 0);
+  JsVar *glyph = cache ? jsvObjectGetChild(cache, key, 0) : 0;
+  if (glyph || !jsvMoreFreeVariablesThan(jsvGetMemoryTotal()/4)) {
+    jsvUnLock(cache);
+    return glyph;
+  }
+  // work out the area the character covers
+  int vertOffset = READ_FLASH_UINT16(&vectorFontOffsets[fontOffset]);
+  int vertCount = READ_FLASH_UINT8(&vectorFonts[fontOffset].vertCount);
+  short minX = 32767, minY = 32767, maxX = -1, maxY = -1;
+  int i;
+  for (i=0;i<vertCount;i+=2) {
+    short x = graphicsVectorCharCoord(vertOffset+i+0, size);
+    short y = graphicsVectorCharCoord(vertOffset+i+1, size);
+    if (x<minX) minX = x;
+    if (x>maxX) maxX = x;
+    if (y<minY) minY = y;
+    if (y>maxY) maxY = y;
+  }
+  int width = 1+maxX-minX, height = 1+maxY-minY;
+  unsigned int bytes = (unsigned int)(VECTOR_FONT_GLYPH_HEADER + ((width*height+7)>>3));
+  if (maxX<0 || maxX>255 || maxY>255 || bytes>VECTOR_FONT_CACHE_MAX_BYTES) {
+    jsvUnLock(cache);
+    return 0;
+  }
+  glyph = jsvNewFlatStringOfLength(bytes);
+  if (!glyph) {
+    jsvUnLock(cache);
+    return 0;
+  }
+  // render the polygons straight into the bitmap
+  unsigned char *data = (unsigned char*)jsvGetFlatStringPointer(glyph);
+  memset(data, 0, bytes);
+  data[0] = (unsigned char)minX;
+  data[1] = (unsigned char)minY;
+  data[2] = (unsigned char)width;
+  data[3] = (unsigned char)height;
+  JsGraphics gfx;
+  graphicsStructInit(&gfx);
+  gfx.graphicsVar = 0;
+  gfx.data.type = JSGRAPHICSTYPE_ARRAYBUFFER;
+  gfx.data.flags = JSGRAPHICSFLAGS_ARRAYBUFFER_MSB; // same as images
+  gfx.data.width = (unsigned short)width;
+  gfx.data.height = (unsigned short)height;
+  gfx.data.bpp = 1;
+  gfx.data.fgColor = 1;
+  lcdSetCallbacks_ArrayBufferPointer(&gfx, &data[VECTOR_FONT_GLYPH_HEADER]);
+  graphicsFillVectorCharPolys(&gfx, (short)-minX, (short)-minY, size, fontOffset);
+  // add to the cache, throwing out the oldest glyph if it's full
+  if (!cache) cache = jsvObjectGetChild(execInfo.hiddenRoot, VECTOR_FONT_CACHE_NAME, JSV_OBJECT);
+  if (cache) {
+    if (jsvGetChildren(cache) >= VECTOR_FONT_CACHE_GLYPHS) {
+      JsVar *oldest = jsvLock(jsvGetFirstChild(cache));
+      jsvRemoveChild(cache, oldest);
+      jsvUnLock(oldest);
+    }
+    jsvObjectSetChild(cache, key, glyph);
+    jsvUnLock(cache);
+  }
+  return glyph;
+}
+
+/// Free all cached vector font glyphs. Returns true if anything was freed
+bool graphicsFreeVectorFontCache() {
+  JsVar *cache = jsvObjectGetChild(execInfo.hiddenRoot, VECTOR_FONT_CACHE_NAME, 0);
+  if (!cache) return false;
+  jsvUnLock(cache);
+  jsvRemoveNamedChild(execInfo.hiddenRoot, VECTOR_FONT_CACHE_NAME);
+  return true;
+}
+
+// prints character, returns width
+unsigned int graphicsFillVectorChar(JsGraphics *gfx, short x1, short y1, short size, char ch) {
+  // no need to modify coordinates as graphicsFillPoly/graphicsDrawImage do that
+  if (size<0) return 0;
+  if (ch<vectorFontOffset || ch-vectorFontOffset>=vectorFontCount) return 0;
+  int fontOffset = ch-vectorFontOffset;
+  unsigned char width = READ_FLASH_UINT8(&vectorFonts[fontOffset].width);
+  if (READ_FLASH_UINT8(&vectorFonts[fontOffset].vertCount)) {
+    /* Draw the character from its bitmap if we can - it's the same
+     * as filling the polygons, but much faster */
+    JsVar *glyph = graphicsGetVectorCharGlyph(size, fontOffset);
+    if (glyph) {
+      const unsigned char *data = (const unsigned char*)jsvGetFlatStringPointer(glyph);
+      unsigned int palette[2] = { gfx->data.bgColor, gfx->data.fgColor };
+      JsGraphicsImage img;
+      img.width = data[2];
+      img.height = data[3];
+      img.bpp = 1;
+      img.isTransparent = true;
+      img.transparentCol = 0;
+      img.palette = palette;
+      img.buffer = 0;
+      img.data = &data[VECTOR_FONT_GLYPH_HEADER];
+      img.areaX = 0;
+      img.areaY = 0;
+      img.areaWidth = img.width;
+      img.areaHeight = img.height;
+      graphicsDrawImage(gfx, &img, (short)(x1+data[0]), (short)(y1+data[1]));
+      jsvUnLock(glyph);
+    } else
+      graphicsFillVectorCharPolys(gfx, x1, y1, size, fontOffset);
+  }
+  return (width * (unsigned int)size)/(VECTOR_FONT_POLY_SIZE*2);
 }
 
 // returns the width of a character
@@ -356,6 +808,191 @@ unsigned int graphicsVectorCharWidth(JsGraphics *gfx, short size, char ch) {
 }
 #endif
 
+// ----------------------------------------------------------------------------------------------
+
+// How many image pixels are decoded (or read from a buffer that isn't flat) at once
+#define GRAPHICS_IMAGE_CHUNK 32
+
+// Get 'bpp' bits of image data (MSB first), starting at bit index 'bitIdx'
+static unsigned int graphicsImageGetBits(const unsigned char *data, unsigned int bitIdx, unsigned int bpp) {
+  data += bitIdx>>3;
+  bitIdx &= 7;
+  if (bitIdx+bpp <= 8) // the usual case - all in one byte
+    return (unsigned int)(*data >> (8-(bitIdx+bpp))) & ((1U<<bpp)-1);
+  unsigned int i, bytes = (bitIdx+bpp+7)>>3;
+  unsigned long long v = 0;
+  for (i=0;i<bytes;i++)
+    v = (v<<8) | data[i];
+  v >>= bytes*8 - (bitIdx+bpp);
+  return (unsigned int)(v & ((1ULL<<bpp)-1));
+}
+
+// Decode 'count' image pixels, and draw them starting at USER coordinates x,y (already clipped)
+static void graphicsDrawImagePixels(JsGraphics *gfx, const JsGraphicsImage *img, const unsigned char *data, unsigned int bitIdx, short x, short y, short count) {
+  unsigned int cols[GRAPHICS_IMAGE_CHUNK];
+  unsigned int deviceMask = (gfx->data.bpp>=32) ? 0xFFFFFFFF : ((1U<<gfx->data.bpp)-1);
+  // work out where the pixels go on the device once - they're a row (or a column if rotated)
+  bool swapXY = (gfx->data.flags & JSGRAPHICSFLAGS_SWAP_XY)!=0;
+  bool invert = (gfx->data.flags & (swapXY ? JSGRAPHICSFLAGS_INVERT_Y : JSGRAPHICSFLAGS_INVERT_X))!=0;
+  graphicsToDeviceCoordinates(gfx, &x, &y);
+  short i, runStart = 0, n = 0;
+  if (img->bpp==1) {
+    /* 1 bit images (and font glyphs) - find runs of the same bit, skipping
+     * whole bytes where we can, and fill each run in one go */
+    unsigned int oldFgColor = gfx->data.fgColor;
+    i = 0;
+    while (i<count) {
+      unsigned int b = bitIdx+(unsigned int)i;
+      unsigned int val = (data[b>>3] >> (7-(b&7))) & 1;
+      runStart = i++;
+      while (i<count) {
+        b = bitIdx+(unsigned int)i;
+        if (!(b&7) && count-i>=8 && data[b>>3]==(val?0xFF:0)) {
+          i = (short)(i+8);
+          continue;
+        }
+        if (((data[b>>3] >> (7-(b&7))) & 1) != val) break;
+        i++;
+      }
+      if (img->isTransparent && val==img->transparentCol) continue;
+      unsigned int col = (img->palette ? img->palette[val] : val) & deviceMask;
+      short r1 = invert ? (short)-(i-1) : runStart;
+      short r2 = invert ? (short)-runStart : (short)(i-1);
+      if (r1==r2) {
+        gfx->setPixel(gfx, swapXY ? x : (short)(x+r1), swapXY ? (short)(y+r1) : y, col);
+      } else {
+        gfx->data.fgColor = col;
+        if (swapXY)
+          gfx->fillRect(gfx, x, (short)(y+r1), x, (short)(y+r2));
+        else
+          gfx->fillRect(gfx, (short)(x+r1), y, (short)(x+r2), y);
+      }
+    }
+    gfx->data.fgColor = oldFgColor;
+    return;
+  }
+  for (i=0;i<count;i++) {
+    unsigned int col = graphicsImageGetBits(data, bitIdx, img->bpp);
+    bitIdx += img->bpp;
+    bool draw = !img->isTransparent || col!=img->transparentCol;
+    if (draw) {
+      if (!n) runStart = i;
+      cols[n++] = (img->palette ? img->palette[col] : col) & deviceMask;
+    }
+    if (n && (!draw || n==GRAPHICS_IMAGE_CHUNK || i==count-1)) {
+      if (swapXY) {
+        short j;
+        for (j=0;j<n;j++)
+          gfx->setPixel(gfx, x, (short)(invert ? y-(runStart+j) : y+runStart+j), cols[j]);
+      } else if (invert) {
+        // the run goes right to left on the device
+        short j;
+        for (j=0;j<n/2;j++) {
+          unsigned int t = cols[j];
+          cols[j] = cols[n-(j+1)];
+          cols[n-(j+1)] = t;
+        }
+        gfx->blitSpan(gfx, (short)(x-(runStart+n-1)), y, n, cols);
+      } else
+        gfx->blitSpan(gfx, (short)(x+runStart), y, n, cols);
+      n = 0;
+    }
+  }
+}
+
+// Can the image data be copied straight to the device?
+static bool graphicsImageIsRaw(JsGraphics *gfx, const JsGraphicsImage *img) {
+  if (!gfx->copySpan || img->isTransparent || img->bpp!=gfx->data.bpp ||
+      (gfx->data.flags & (JSGRAPHICSFLAGS_SWAP_XY|JSGRAPHICSFLAGS_INVERT_X)))
+    return false;
+  if (img->palette) {
+    unsigned int i, deviceMask = (gfx->data.bpp>=32) ? 0xFFFFFFFF : ((1U<<gfx->data.bpp)-1);
+    for (i=0;i<(1U<<img->bpp);i++)
+      if ((img->palette[i]&deviceMask) != i) return false;
+  }
+  return true;
+}
+
+/// Draw an image with its top left at x,y (USER coordinates)
+void graphicsDrawImage(JsGraphics *gfx, const JsGraphicsImage *img, short x, short y) {
+  // Clip once, against the area of the image and the screen
+  int userWidth = (gfx->data.flags & JSGRAPHICSFLAGS_SWAP_XY) ? gfx->data.height : gfx->data.width;
+  int userHeight = (gfx->data.flags & JSGRAPHICSFLAGS_SWAP_XY) ? gfx->data.width : gfx->data.height;
+  int areaX = img->areaX, areaY = img->areaY;
+  int x1 = x, y1 = y, x2 = x+img->areaWidth-1, y2 = y+img->areaHeight-1;
+  if (x1<0) { areaX -= x1; x1 = 0; }
+  if (y1<0) { areaY -= y1; y1 = 0; }
+  if (x2>=userWidth) x2 = userWidth-1;
+  if (y2>=userHeight) y2 = userHeight-1;
+  if (x2<x1 || y2<y1) return;
+
+  short dx1 = (short)x1, dy1 = (short)y1, dx2 = (short)x2, dy2 = (short)y2;
+  graphicsToDeviceCoordinates(gfx, &dx1, &dy1);
+  graphicsToDeviceCoordinates(gfx, &dx2, &dy2);
+  if (dx1>dx2) { short t = dx1; dx1 = dx2; dx2 = t; }
+  if (dy1>dy2) { short t = dy1; dy1 = dy2; dy2 = t; }
+  graphicsSetModified(gfx, dx1, dy1, dx2, dy2);
+
+  // If the data is flat we can read it directly, otherwise read it a chunk at a time
+  unsigned int availableBits;
+  const unsigned char *ptr;
+  if (img->data) {
+    availableBits = (unsigned int)(img->width*img->height*img->bpp);
+    ptr = img->data;
+  } else {
+    availableBits = (unsigned int)(jsvGetArrayBufferLength(img->buffer) * JSV_ARRAYBUFFER_GET_SIZE(img->buffer->varData.arraybuffer.type) * 8);
+    size_t len;
+    ptr = (const unsigned char *)jsvGetDataPointer(img->buffer, &len);
+  }
+  JsVar *str = 0;
+  JsvStringIterator it;
+  if (!ptr) {
+    str = jsvGetArrayBufferBackingString(img->buffer);
+    jsvStringIteratorNew(&it, str, img->buffer->varData.arraybuffer.byteOffset);
+  }
+  bool raw = graphicsImageIsRaw(gfx, img);
+
+  int row;
+  for (row=y1;row<=y2;row++) {
+    unsigned int bitIdx = (unsigned int)(((areaY+row-y1)*img->width + areaX)*img->bpp);
+    if (bitIdx >= availableBits) break; // out of data
+    short count = (short)(1+x2-x1);
+    if (bitIdx + (unsigned int)count*img->bpp > availableBits)
+      count = (short)((availableBits-bitIdx) / img->bpp);
+    short dx = (short)x1, dy = (short)row;
+    graphicsToDeviceCoordinates(gfx, &dx, &dy);
+    if (ptr) {
+      if (!(raw && gfx->copySpan(gfx, dx, dy, count, ptr, bitIdx)))
+        graphicsDrawImagePixels(gfx, img, ptr, bitIdx, (short)x1, (short)row, count);
+    } else {
+      unsigned char buf[(GRAPHICS_IMAGE_CHUNK*32+7+7)>>3];
+      short i;
+      for (i=0;i<count;i=(short)(i+GRAPHICS_IMAGE_CHUNK)) {
+        short n = (short)(count-i);
+        if (n>GRAPHICS_IMAGE_CHUNK) n = GRAPHICS_IMAGE_CHUNK;
+        unsigned int b = bitIdx + (unsigned int)i*img->bpp;
+        size_t firstByte = img->buffer->varData.arraybuffer.byteOffset + (b>>3);
+        unsigned int j, bytes = ((b&7) + (unsigned int)n*img->bpp + 7)>>3;
+        // rows (and chunks) only ever go forwards, so the iterator does too
+        while (jsvStringIteratorHasChar(&it) && jsvStringIteratorGetIndex(&it)<firstByte)
+          jsvStringIteratorNext(&it);
+        JsvStringIterator dataIt = jsvStringIteratorClone(&it);
+        for (j=0;j<bytes;j++) {
+          buf[j] = (unsigned char)jsvStringIteratorGetChar(&dataIt);
+          jsvStringIteratorNext(&dataIt);
+        }
+        jsvStringIteratorFree(&dataIt);
+        if (!(raw && gfx->copySpan(gfx, (short)(dx+i), dy, n, buf, b&7)))
+          graphicsDrawImagePixels(gfx, img, buf, b&7, (short)(x1+i), (short)row, n);
+      }
+    }
+  }
+  if (str) {
+    jsvStringIteratorFree(&it);
+    jsvUnLock(str);
+  }
+}
+
 // Splash screen
 void graphicsSplash(JsGraphics *gfx) {
   graphicsClear(gfx);
@@ -52,6 +52,14 @@ typedef enum {
 #define JSGRAPHICS_CUSTOMFONT_HEIGHT JS_HIDDEN_CHAR_STR"fnH"
 #define JSGRAPHICS_CUSTOMFONT_FIRSTCHAR JS_HIDDEN_CHAR_STR"fn1"
 
+#ifndef SAVE_ON_FLASH
+#define JSGRAPHICS_MODIFIED_RECTS 4 ///< How many separate modified areas are kept track of (for partial flips)
+#endif
+
+typedef struct {
+  short x1, y1, x2, y2;
+} PACKED_FLAGS JsGraphicsRect;
+
 typedef struct {
   JsGraphicsType type;
   JsGraphicsFlags flags;
@@ -61,18 +69,49 @@ typedef struct {
   short fontSize; ///< See JSGRAPHICS_FONTSIZE_ constants
   short cursorX, cursorY; ///< current cursor positions
   short modMinX, modMinY, modMaxX, modMaxY; ///< area that has been modified
+#ifdef JSGRAPHICS_MODIFIED_RECTS
+  unsigned char modRectCount;
+  JsGraphicsRect modRects[JSGRAPHICS_MODIFIED_RECTS]; ///< non-overlapping areas that have been modified (all inside modMin/Max)
+#endif
 } PACKED_FLAGS JsGraphicsData;
 
 typedef struct JsGraphics {
   JsVar *graphicsVar; // this won't be locked again - we just know that it is already locked by something else
   JsGraphicsData data;
   unsigned char _blank; ///< this is needed as jsvGetString for 'data' wants to add a trailing zero  
+  unsigned char *backendData; ///< ArrayBuffer: pointer to the pixels if they're in flat memory (or 0). Only valid until JS code next runs
 
   void (*setPixel)(struct JsGraphics *gfx, short x, short y, unsigned int col);
   void (*fillRect)(struct JsGraphics *gfx, short x1, short y1, short x2, short y2);
+  void (*fillSpan)(struct JsGraphics *gfx, short x1, short x2, short y); ///< fill a row of pixels with fgColor (x1<=x2)
   unsigned int (*getPixel)(struct JsGraphics *gfx, short x, short y);
+  void (*blitSpan)(struct JsGraphics *gfx, short x, short y, short pixelCount, const unsigned int *cols); ///< draw a row of pixels, left to right
+  bool (*copySpan)(struct JsGraphics *gfx, short x, short y, short pixelCount, const unsigned char *data, unsigned int bitIdx); ///< copy a row of pixels in image format (same bpp, MSB first) - returns false if it can't. May be 0
+  void (*flip)(struct JsGraphics *gfx, short x1, short y1, short x2, short y2); ///< push an area that has been modified to the display
 } PACKED_FLAGS JsGraphics;
 
+/// An image for graphicsDrawImage
+typedef struct {
+  int width, height; ///< size of the whole image
+  unsigned char bpp;
+  bool isTransparent;
+  unsigned int transparentCol; ///< if isTransparent, pixels of this (image) colour aren't drawn
+  const unsigned int *palette; ///< device colour for each image colour, or 0 to use the image colours as-is
+  JsVar *buffer; ///< ArrayBuffer containing the image - MSB first, rows aren't padded
+  const unsigned char *data; ///< if set, the image data is here rather than in 'buffer'
+  int areaX, areaY, areaWidth, areaHeight; ///< the area of the image that should be drawn
+} JsGraphicsImage;
+
+static inline void graphicsResetModified(JsGraphics *gfx) {
+  gfx->data.modMaxX = -32768;
+  gfx->data.modMaxY = -32768;
+  gfx->data.modMinX = 32767;
+  gfx->data.modMinY = 32767;
+#ifdef JSGRAPHICS_MODIFIED_RECTS
+  gfx->data.modRectCount = 0;
+#endif
+}
+
 static inline void graphicsStructInit(JsGraphics *gfx) {
   // type/width/height/bpp should be set elsewhere...
   gfx->data.flags = JSGRAPHICSFLAGS_NONE;
@@ -81,16 +120,16 @@ static inline void graphicsStructInit(JsGraphics *gfx) {
   gfx->data.fontSize = JSGRAPHICS_FONTSIZE_4X6;
   gfx->data.cursorX = 0;
   gfx->data.cursorY = 0;
-  gfx->data.modMaxX = -32768;
-  gfx->data.modMaxY = -32768;
-  gfx->data.modMinX = 32767;
-  gfx->data.modMinY = 32767;
+  graphicsResetModified(gfx);
+  gfx->backendData = 0;
 }
 
 // ---------------------------------- these are in graphics.c
 // Access a JsVar and get/set the relevant info in JsGraphics
 bool graphicsGetFromVar(JsGraphics *gfx, JsVar *parent);
 void graphicsSetVar(JsGraphics *gfx);
+void graphicsSetModified(JsGraphics *gfx, short x1, short y1, short x2, short y2); ///< Mark an area as modified (DEVICE coordinates, x1<=x2, y1<=y2)
+void graphicsFlip(JsGraphics *gfx); ///< Push all modified areas to the display, and reset them
 // ----------------------------------------------------------------------------------------------
 // drawing functions - all coordinates are in USER coordinates, not DEVICE coordinates
 void         graphicsSetPixel(JsGraphics *gfx, short x, short y, unsigned int col);
@@ -98,13 +137,21 @@ unsigned int graphicsGetPixel(JsGraphics *gfx, short x, short y);
 void         graphicsClear(JsGraphics *gfx);
 void         graphicsFillRect(JsGraphics *gfx, short x1, short y1, short x2, short y2);
 void graphicsFallbackFillRect(JsGraphics *gfx, short x1, short y1, short x2, short y2); // Simple fillrect - doesn't call device-specific FR
+void graphicsFallbackFillSpan(JsGraphics *gfx, short x1, short x2, short y); // Simple fillSpan - calls fillRect
+void graphicsFallbackFlip(JsGraphics *gfx, short x1, short y1, short x2, short y2); // Calls the JS flip callback (if there is one)
+void graphicsFallbackBlitSpan(JsGraphics *gfx, short x, short y, short pixelCount, const unsigned int *cols); // Simple blitSpan - calls setPixel for each pixel
+void graphicsDrawImage(JsGraphics *gfx, const JsGraphicsImage *img, short x, short y);
 void graphicsDrawRect(JsGraphics *gfx, short x1, short y1, short x2, short y2);
 void graphicsDrawString(JsGraphics *gfx, short x1, short y1, const char *str);
 void graphicsDrawLine(JsGraphics *gfx, short x1, short y1, short x2, short y2);
 void graphicsFillPoly(JsGraphics *gfx, int points, short *vertices); // may overwrite vertices...
+void graphicsFillPolys(JsGraphics *gfx, int polyCount, const int *polyPoints, short *vertices, bool nonZero); ///< fill several polygons (eg. with holes) at once. may overwrite vertices...
+void graphicsDrawPoly(JsGraphics *gfx, int points, const short *vertices, bool closed, short width); ///< draw lines between the points (width>1 for thick lines)
+void graphicsFillEllipse(JsGraphics *gfx, short x1, short y1, short x2, short y2);
 #ifndef SAVE_ON_FLASH
 unsigned int graphicsFillVectorChar(JsGraphics *gfx, short x1, short y1, short size, char ch); ///< prints character, returns width
 unsigned int graphicsVectorCharWidth(JsGraphics *gfx, short size, char ch); ///< returns the width of a character
+bool graphicsFreeVectorFontCache(); ///< free cached vector font glyphs, returns true if anything was freed
 #endif
 void graphicsSplash(JsGraphics *gfx); ///< splash screen
 
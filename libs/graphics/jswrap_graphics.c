@@ -72,6 +72,17 @@ void jswrap_graphics_init() {
 #endif
 }
 
+/*JSON{
+  "type" : "kill",
+  "generate" : "jswrap_graphics_kill"
+}*/
+void jswrap_graphics_kill() {
+#ifndef SAVE_ON_FLASH
+  // rendered glyphs are just a cache - don't save them
+  graphicsFreeVectorFontCache();
+#endif
+}
+
 
 static bool isValidBPP(int bpp) {
   return bpp==1 || bpp==2 || bpp==4 || bpp==8 || bpp==16 || bpp==24 || bpp==32; // currently one colour can't ever be spread across multiple bytes
@@ -87,11 +98,12 @@ static bool isValidBPP(int bpp) {
     ["height","int32","Pixels high"],
     ["bpp","int32","Number of bits per pixel"],
     ["options","JsVar",[
-      "An object of other options. ```{ zigzag : true/false(default), vertical_byte : true/false(default), msb : true/false(default), color_order: 'rgb'(default),'bgr',etc }```",
+      "An object of other options. ```{ zigzag : true/false(default), vertical_byte : true/false(default), msb : true/false(default), color_order: 'rgb'(default),'bgr',etc, flip : function(x1,y1,x2,y2) }```",
       "zigzag = whether to alternate the direction of scanlines for rows",
       "vertical_byte = whether to align bits in a byte vertically or not",
       "msb = when bits<8, store pixels msb first",
-      "color_order = re-orders the colour values that are supplied via setColor"
+      "color_order = re-orders the colour values that are supplied via setColor",
+      "flip = called by `g.flip()` for each area of the buffer that has been modified, so it can be sent to a display"
     ]]
   ],
   "return" : ["JsVar","The new Graphics object"],
@@ -149,6 +161,10 @@ JsVar *jswrap_graphics_createArrayBuffer(int width, int height, int bpp, JsVar *
         jsWarn("color_order must be 3 characters");
       jsvUnLock(colorv);
     }
+    JsVar *flip = jsvObjectGetChild(options, "flip", 0);
+    if (jsvIsFunction(flip))
+      jsvObjectSetChild(parent, "iFlip", flip);
+    jsvUnLock(flip);
   }
 
   lcdInit_ArrayBuffer(&gfx);
@@ -165,7 +181,7 @@ JsVar *jswrap_graphics_createArrayBuffer(int width, int height, int bpp, JsVar *
     ["width","int32","Pixels wide"],
     ["height","int32","Pixels high"],
     ["bpp","int32","Number of bits per pixel"],
-    ["callback","JsVar","A function of the form ```function(x,y,col)``` that is called whenever a pixel needs to be drawn, or an object with: ```{setPixel:function(x,y,col),fillRect:function(x1,y1,x2,y2,col)}```. All arguments are already bounds checked."]
+    ["callback","JsVar","A function of the form ```function(x,y,col)``` that is called whenever a pixel needs to be drawn, or an object with: ```{setPixel:function(x,y,col),fillRect:function(x1,y1,x2,y2,col),flip:function(x1,y1,x2,y2)}```. All arguments are already bounds checked. flip is called by `g.flip()` for each area that has been modified."]
   ],
   "return" : ["JsVar","The new Graphics object"],
   "return_object" : "Graphics"
@@ -211,6 +227,12 @@ JsVar *jswrap_graphics_createCallback(int width, int height, int bpp, JsVar *cal
   gfx.data.height = (unsigned short)height;
   gfx.data.bpp = (unsigned char)bpp;
   lcdInit_JS(&gfx, callbackSetPixel, callbackFillRect);
+  if (jsvIsObject(callback)) {
+    JsVar *callbackFlip = jsvObjectGetChild(callback, "flip", 0);
+    if (jsvIsFunction(callbackFlip))
+      jsvObjectSetChild(parent, "iFlip", callbackFlip);
+    jsvUnLock(callbackFlip);
+  }
   graphicsSetVar(&gfx);
   jsvUnLock2(callbackSetPixel, callbackFillRect);
   return parent;
@@ -332,6 +354,45 @@ void jswrap_graphics_drawRect(JsVar *parent, int x1, int y1, int x2, int y2) {
   graphicsSetVar(&gfx); // gfx data changed because modified area
 }
 
+/*JSON{
+  "type" : "method",
+  "class" : "Graphics",
+  "name" : "fillCircle",
+  "generate" : "jswrap_graphics_fillCircle",
+  "params" : [
+    ["x","int32","The X axis"],
+    ["y","int32","The Y axis"],
+    ["rad","int32","The circle radius"]
+  ]
+}
+Draw a filled circle in the Foreground Color
+*/
+void jswrap_graphics_fillCircle(JsVar *parent, int x, int y, int rad) {
+  JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
+  graphicsFillEllipse(&gfx, (short)(x-rad),(short)(y-rad),(short)(x+rad),(short)(y+rad));
+  graphicsSetVar(&gfx); // gfx data changed because modified area
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Graphics",
+  "name" : "fillEllipse",
+  "generate" : "jswrap_graphics_fillEllipse",
+  "params" : [
+    ["x1","int32","The left"],
+    ["y1","int32","The top"],
+    ["x2","int32","The right"],
+    ["y2","int32","The bottom"]
+  ]
+}
+Draw a filled ellipse that fits inside the given rectangle, in the Foreground Color
+*/
+void jswrap_graphics_fillEllipse(JsVar *parent, int x1, int y1, int x2, int y2) {
+  JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
+  graphicsFillEllipse(&gfx, (short)x1,(short)y1,(short)x2,(short)y2);
+  graphicsSetVar(&gfx); // gfx data changed because modified area
+}
+
 /*JSON{
   "type" : "method",
   "class" : "Graphics",
@@ -764,34 +825,96 @@ void jswrap_graphics_moveTo(JsVar *parent, int x, int y) {
   graphicsSetVar(&gfx);
 }
 
+#define GRAPHICS_POLY_MAX_VERTS 128 ///< max number of coordinates (2 per point) for fillPoly/drawPoly
+#define GRAPHICS_POLY_MAX_POLYS 8 ///< max number of separate polygons for fillPoly
+
+// Read an array of coordinates into verts, returns the number of points
+static int jswrap_graphics_getPoly(JsVar *poly, short *verts, int maxVerts, const char *fnName) {
+  int idx = 0;
+  JsvIterator it;
+  jsvIteratorNew(&it, poly);
+  while (jsvIteratorHasElement(&it) && idx<maxVerts) {
+    verts[idx++] = (short)jsvIteratorGetIntegerValue(&it);
+    jsvIteratorNext(&it);
+  }
+  if (jsvIteratorHasElement(&it))
+    jsWarn("Maximum number of points (%d) exceeded for %s", GRAPHICS_POLY_MAX_VERTS/2, fnName);
+  jsvIteratorFree(&it);
+  return idx/2;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "Graphics",
   "name" : "fillPoly",
   "generate" : "jswrap_graphics_fillPoly",
   "params" : [
-    ["poly","JsVar","An array of vertices, of the form ```[x1,y1,x2,y2,x3,y3,etc]```"]
+    ["poly","JsVar","An array of vertices, of the form ```[x1,y1,x2,y2,x3,y3,etc]```, or an array of these arrays for several polygons (eg. a shape with holes in it)"],
+    ["options","JsVar","[optional] ```{fillRule:'evenodd'/'nonzero'}``` - how to decide what is inside the polygon when it overlaps itself. Default is evenodd"]
   ]
 }
-Draw a filled polygon in the current foreground color
+Draw a filled polygon in the current foreground color. Polygons may be concave
+and may cross themselves. Give several polygons to cut holes out of a shape.
 */
-void jswrap_graphics_fillPoly(JsVar *parent, JsVar *poly) {
+void jswrap_graphics_fillPoly(JsVar *parent, JsVar *poly, JsVar *options) {
   JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
   if (!jsvIsIterable(poly)) return;
-  const int maxVerts = 128;
-  short verts[maxVerts];
-  int idx = 0;
-  JsvIterator it;
-  jsvIteratorNew(&it, poly);
-  while (jsvIteratorHasElement(&it) && idx<maxVerts) {
-    verts[idx++] = (short)jsvIteratorGetIntegerValue(&it);
-    jsvIteratorNext(&it);
+  bool nonZero = false;
+  if (jsvIsObject(options)) {
+    JsVar *fillRule = jsvObjectGetChild(options, "fillRule", 0);
+    nonZero = jsvIsString(fillRule) && jsvIsStringEqual(fillRule, "nonzero");
+    jsvUnLock(fillRule);
   }
-  jsvIteratorFree(&it);
-  if (idx==maxVerts) {
-    jsWarn("Maximum number of points (%d) exceeded for fillPoly", maxVerts/2);
+  short verts[GRAPHICS_POLY_MAX_VERTS];
+  int polyPoints[GRAPHICS_POLY_MAX_POLYS];
+  int polyCount = 0, idx = 0;
+  bool isMulti = false;
+  if (jsvIsArray(poly)) { // typed arrays can only be a single polygon
+    JsVar *firstVar = jsvGetArrayItem(poly, 0);
+    isMulti = jsvIsIterable(firstVar);
+    jsvUnLock(firstVar);
   }
-  graphicsFillPoly(&gfx, idx/2, verts);
+  if (isMulti) {
+    JsvIterator it;
+    jsvIteratorNew(&it, poly);
+    while (jsvIteratorHasElement(&it) && polyCount<GRAPHICS_POLY_MAX_POLYS) {
+      JsVar *p = jsvIteratorGetValue(&it);
+      if (jsvIsIterable(p)) {
+        polyPoints[polyCount] = jswrap_graphics_getPoly(p, &verts[idx], GRAPHICS_POLY_MAX_VERTS-idx, "fillPoly");
+        idx += polyPoints[polyCount++]*2;
+      }
+      jsvUnLock(p);
+      jsvIteratorNext(&it);
+    }
+    if (jsvIteratorHasElement(&it))
+      jsWarn("Maximum number of polygons (%d) exceeded for fillPoly", GRAPHICS_POLY_MAX_POLYS);
+    jsvIteratorFree(&it);
+  } else {
+    polyPoints[polyCount++] = jswrap_graphics_getPoly(poly, verts, GRAPHICS_POLY_MAX_VERTS, "fillPoly");
+  }
+  graphicsFillPolys(&gfx, polyCount, polyPoints, verts, nonZero);
+  graphicsSetVar(&gfx); // gfx data changed because modified area
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Graphics",
+  "name" : "drawPoly",
+  "generate" : "jswrap_graphics_drawPoly",
+  "params" : [
+    ["poly","JsVar","An array of vertices, of the form ```[x1,y1,x2,y2,x3,y3,etc]```"],
+    ["closed","bool","Draw another line between the last element of the array and the first"],
+    ["width","int32","[optional] The width of the lines in pixels (default 1). Wider lines have rounded ends and joints"]
+  ]
+}
+Draw a polyline (lines between each of the points in `poly`) in the current foreground color
+*/
+void jswrap_graphics_drawPoly(JsVar *parent, JsVar *poly, bool closed, int width) {
+  JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
+  if (!jsvIsIterable(poly)) return;
+  short verts[GRAPHICS_POLY_MAX_VERTS];
+  int points = jswrap_graphics_getPoly(poly, verts, GRAPHICS_POLY_MAX_VERTS, "drawPoly");
+  graphicsDrawPoly(&gfx, points, verts, closed, (short)width);
   graphicsSetVar(&gfx); // gfx data changed because modified area
 }
 
@@ -843,69 +966,81 @@ void jswrap_graphics_setRotation(JsVar *parent, int rotation, bool reflect) {
   "name" : "drawImage",
   "generate" : "jswrap_graphics_drawImage",
   "params" : [
-    ["image","JsVar","An object with the following fields `{ width : int, height : int, bpp : int, buffer : ArrayBuffer, transparent: optional int }`. bpp = bits per pixel, transparent (if defined) is the colour that will be treated as transparent"],
+    ["image","JsVar","An object with the following fields `{ width : int, height : int, bpp : int, buffer : ArrayBuffer, transparent: optional int, palette : optional array }`. bpp = bits per pixel, transparent (if defined) is the colour that will be treated as transparent, palette (if defined, and bpp<=8) is the colour to draw for each colour in the image"],
     ["x","int32","The X offset to draw the image"],
-    ["y","int32","The Y offset to draw the image"]
+    ["y","int32","The Y offset to draw the image"],
+    ["options","JsVar","[optional] An object `{ area : {x,y,width,height} }` - if area is specified, only that part of the image is drawn (for instance one sprite from a sprite sheet)"]
   ]
 }
 Draw an image at the specified position. If the image is 1 bit, the graphics foreground/background colours will be used. Otherwise color data will be copied as-is. Bitmaps are rendered MSB-first
 */
-void jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos) {
+void jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos, JsVar *options) {
   JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
   if (!jsvIsObject(image)) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to be an object");
     return;
   }
-  int imageWidth = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(image, "width", 0));
-  int imageHeight = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(image, "height", 0));
+  JsGraphicsImage img;
+  img.width = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(image, "width", 0));
+  img.height = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(image, "height", 0));
   int imageBpp = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(image, "bpp", 0));
-  unsigned int imageBitMask = (unsigned int)((1L<<imageBpp)-1L);
   JsVar *transpVar = jsvObjectGetChild(image, "transparent", 0);
-  bool imageIsTransparent = transpVar!=0;
-  unsigned int imageTransparentCol = (unsigned int)jsvGetInteger(transpVar);
+  img.isTransparent = transpVar!=0;
+  img.transparentCol = (unsigned int)jsvGetInteger(transpVar);
   jsvUnLock(transpVar);
-  JsVar *imageBuffer = jsvObjectGetChild(image, "buffer", 0);
-  if (!(jsvIsArrayBuffer(imageBuffer) && imageWidth>0 && imageHeight>0 && imageBpp>0 && imageBpp<=32)) {
+  img.buffer = jsvObjectGetChild(image, "buffer", 0);
+  if (!(jsvIsArrayBuffer(img.buffer) && img.width>0 && img.height>0 && imageBpp>0 && imageBpp<=32)) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to a valid Image");
-    jsvUnLock(imageBuffer);
+    jsvUnLock(img.buffer);
     return;
   }
-  JsVar *imageBufferString = jsvGetArrayBufferBackingString(imageBuffer);
-  jsvUnLock(imageBuffer);
-
+  img.bpp = (unsigned char)imageBpp;
+  img.data = 0;
+  img.areaX = 0;
+  img.areaY = 0;
+  img.areaWidth = img.width;
+  img.areaHeight = img.height;
+  JsVar *area = jsvIsObject(options) ? jsvObjectGetChild(options, "area", 0) : 0;
+  if (jsvIsObject(area)) {
+    img.areaX = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(area, "x", 0));
+    img.areaY = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(area, "y", 0));
+    img.areaWidth = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(area, "width", 0));
+    img.areaHeight = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(area, "height", 0));
+    // keep the area inside the image
+    if (img.areaX<0) { img.areaWidth += img.areaX; img.areaX = 0; }
+    if (img.areaY<0) { img.areaHeight += img.areaY; img.areaY = 0; }
+    if (img.areaX+img.areaWidth > img.width) img.areaWidth = img.width-img.areaX;
+    if (img.areaY+img.areaHeight > img.height) img.areaHeight = img.height-img.areaY;
+  }
+  jsvUnLock(area);
 
-  int x=0, y=0;
-  int bits=0;
-  unsigned int colData = 0;
-  JsvStringIterator it;
-  jsvStringIteratorNew(&it, imageBufferString, 0);
-  while ((bits>=imageBpp || jsvStringIteratorHasChar(&it)) && y<imageHeight) {
-    // Get the data we need...
-    while (bits < imageBpp) {
-      colData = (colData<<8) | ((unsigned char)jsvStringIteratorGetChar(&it));
-      jsvStringIteratorNext(&it);
-      bits += 8;
-    }
-    // extract just the bits we want
-    unsigned int col = (colData>>(bits-imageBpp))&imageBitMask;
-    bits -= imageBpp;
-    // Try and write pixel!
-    if (!imageIsTransparent || imageTransparentCol!=col) {
-      if (imageBpp==1)
-        col = col ? gfx.data.fgColor : gfx.data.bgColor;
-      graphicsSetPixel(&gfx, (short)(x+xPos), (short)(y+yPos), col);
+  // Work out the device colour for each image colour once, rather than for every pixel
+  unsigned int *palette = 0;
+  JsVar *paletteVar = jsvObjectGetChild(image, "palette", 0);
+  if (img.bpp==1 || (img.bpp<=8 && jsvIsIterable(paletteVar))) {
+    unsigned int i, colors = 1U<<img.bpp;
+    palette = (unsigned int *)alloca(sizeof(unsigned int)*colors);
+    if (img.bpp==1) {
+      palette[0] = gfx.data.bgColor;
+      palette[1] = gfx.data.fgColor;
+    } else {
+      for (i=0;i<colors;i++) palette[i] = i;
     }
-    // Go to next pixel
-    x++;
-    if (x>=imageWidth) {
-      x=0;
-      y++;
-      // we don't care about image height - we'll stop next time...
+    if (jsvIsIterable(paletteVar)) {
+      JsvIterator it;
+      jsvIteratorNew(&it, paletteVar);
+      for (i=0;i<colors && jsvIteratorHasElement(&it);i++) {
+        palette[i] = (unsigned int)jsvIteratorGetIntegerValue(&it);
+        jsvIteratorNext(&it);
+      }
+      jsvIteratorFree(&it);
     }
-
   }
-  jsvStringIteratorFree(&it);
-  jsvUnLock(imageBufferString);
+  jsvUnLock(paletteVar);
+  img.palette = palette;
+
+  graphicsDrawImage(&gfx, &img, (short)xPos, (short)yPos);
+  jsvUnLock(img.buffer);
   graphicsSetVar(&gfx); // gfx data changed because modified area
 }
 
@@ -937,11 +1072,67 @@ JsVar *jswrap_graphics_getModified(JsVar *parent, bool reset) {
     }
   }
   if (reset) {
-    gfx.data.modMaxX = -32768;
-    gfx.data.modMaxY = -32768;
-    gfx.data.modMinX = 32767;
-    gfx.data.modMinY = 32767;
+    graphicsResetModified(&gfx);
     graphicsSetVar(&gfx);
   }
   return obj;
 }
+
+/*JSON{
+  "type" : "method",
+  "class" : "Graphics",
+  "name" : "getModifiedRects",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_graphics_getModifiedRects",
+  "params" : [
+    ["reset","bool","Whether to reset the modified area or not"]
+  ],
+  "return" : ["JsVar","An array of non-overlapping {x1,y1,x2,y2} areas that have been modified"]
+}
+Like `getModified`, but rather than one area covering everything that has been
+modified, return a few separate areas. For instance drawing in two opposite corners
+of the screen will give two small areas rather than the whole screen.
+
+Areas that are close together get merged, and only a few areas are kept, so
+there may be some pixels included that haven't been modified.
+*/
+#ifndef SAVE_ON_FLASH
+JsVar *jswrap_graphics_getModifiedRects(JsVar *parent, bool reset) {
+  JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return 0;
+  JsVar *arr = jsvNewWithFlags(JSV_ARRAY);
+  if (!arr) return 0;
+  int i;
+  for (i=0;i<gfx.data.modRectCount;i++) {
+    JsVar *obj = jsvNewObject();
+    if (!obj) break;
+    jsvObjectSetChildAndUnLock(obj, "x1", jsvNewFromInteger(gfx.data.modRects[i].x1));
+    jsvObjectSetChildAndUnLock(obj, "y1", jsvNewFromInteger(gfx.data.modRects[i].y1));
+    jsvObjectSetChildAndUnLock(obj, "x2", jsvNewFromInteger(gfx.data.modRects[i].x2));
+    jsvObjectSetChildAndUnLock(obj, "y2", jsvNewFromInteger(gfx.data.modRects[i].y2));
+    jsvArrayPushAndUnLock(arr, obj);
+  }
+  if (reset) {
+    graphicsResetModified(&gfx);
+    graphicsSetVar(&gfx);
+  }
+  return arr;
+}
+#endif
+
+/*JSON{
+  "type" : "method",
+  "class" : "Graphics",
+  "name" : "flip",
+  "generate" : "jswrap_graphics_flip"
+}
+Send the areas that have been modified since the last `flip` to the display, and
+reset the modified areas (see `getModifiedRects`).
+
+For ArrayBuffer and Callback Graphics, this calls the `flip` function given when the
+Graphics was created as `flip(x1,y1,x2,y2)` once for each area (in device coordinates),
+so only the parts of the display that have changed need sending.
+*/
+void jswrap_graphics_flip(JsVar *parent) {
+  JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
+  graphicsFlip(&gfx);
+}
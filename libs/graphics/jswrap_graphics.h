@@ -19,6 +19,7 @@
 
 bool jswrap_graphics_idle();
 void jswrap_graphics_init();
+void jswrap_graphics_kill();
 
 // For creating graphics classes
 JsVar *jswrap_graphics_createArrayBuffer(int width, int height, int bpp,  JsVar *options);
@@ -32,6 +33,8 @@ int jswrap_graphics_getWidthOrHeight(JsVar *parent, bool height);
 void jswrap_graphics_clear(JsVar *parent);
 void jswrap_graphics_fillRect(JsVar *parent, int x1, int y1, int x2, int y2);
 void jswrap_graphics_drawRect(JsVar *parent, int x1, int y1, int x2, int y2);
+void jswrap_graphics_fillCircle(JsVar *parent, int x, int y, int rad);
+void jswrap_graphics_fillEllipse(JsVar *parent, int x1, int y1, int x2, int y2);
 int jswrap_graphics_getPixel(JsVar *parent, int x, int y);
 void jswrap_graphics_setPixel(JsVar *parent, int x, int y, JsVar *color);
 void jswrap_graphics_setColorX(JsVar *parent, JsVar *r, JsVar *g, JsVar *b, bool isForeground);
@@ -43,7 +46,12 @@ JsVarInt jswrap_graphics_stringWidth(JsVar *parent, JsVar *var);
 void jswrap_graphics_drawLine(JsVar *parent, int x1, int y1, int x2, int y2);
 void jswrap_graphics_lineTo(JsVar *parent, int x, int y);
 void jswrap_graphics_moveTo(JsVar *parent, int x, int y);
-void jswrap_graphics_fillPoly(JsVar *parent, JsVar *poly);
+void jswrap_graphics_fillPoly(JsVar *parent, JsVar *poly, JsVar *options);
+void jswrap_graphics_drawPoly(JsVar *parent, JsVar *poly, bool closed, int width);
 void jswrap_graphics_setRotation(JsVar *parent, int rotation, bool reflect);
-void jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos);
+void jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos, JsVar *options);
 JsVar *jswrap_graphics_getModified(JsVar *parent, bool reset);
+#ifndef SAVE_ON_FLASH
+JsVar *jswrap_graphics_getModifiedRects(JsVar *parent, bool reset);
+#endif
+void jswrap_graphics_flip(JsVar *parent);
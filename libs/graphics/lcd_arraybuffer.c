@@ -27,6 +27,13 @@ unsigned int lcdGetPixelIndex_ArrayBuffer(JsGraphics *gfx, int x, int y, int pix
     return (unsigned int)((x + y*gfx->data.width)*gfx->data.bpp);
 }
 
+// how many bytes of buffer we need for the whole display
+static unsigned int lcdGetBufferLength_ArrayBuffer(JsGraphics *gfx) {
+  if (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE)
+    return (unsigned int)(gfx->data.width * ((gfx->data.height+7)>>3));
+  return (unsigned int)((gfx->data.width * gfx->data.height * gfx->data.bpp + 7) >> 3);
+}
+
 unsigned int lcdGetPixel_ArrayBuffer(JsGraphics *gfx, short x, short y) {
   unsigned int col = 0;
   JsVar *buf = jsvObjectGetChild(gfx->graphicsVar, "buffer", 0);
@@ -115,14 +122,249 @@ void  lcdFillRect_ArrayBuffer(struct JsGraphics *gfx, short x1, short y1, short
     lcdSetPixels_ArrayBuffer(gfx, x1, y, (short)(1+x2-x1), gfx->data.fgColor);
 }
 
+#ifndef SAVE_ON_FLASH
+// ----------------------------------------------------------------------------------------------
+// Fast path - used when the buffer is in flat memory, so we can write to it directly
+
+// Fill 'pixels' whole-byte pixels (of 'bytesPerPixel' bytes each) with col
+static void lcdFillBytes_ArrayBuffer(unsigned char *p, unsigned int bytesPerPixel, unsigned int pixels, unsigned int col) {
+  size_t total = (size_t)pixels*bytesPerPixel;
+  if (!total) return;
+  bool sameBytes = true;
+  unsigned int i;
+  for (i=0;i<bytesPerPixel;i++) {
+    p[i] = (unsigned char)(col >> (i*8));
+    if (p[i]!=p[0]) sameBytes = false;
+  }
+  if (sameBytes) {
+    memset(p, p[0], total);
+    return;
+  }
+  // copy what we've already filled, doubling each time - so most of it is done by memcpy
+  size_t filled = bytesPerPixel;
+  while (filled < total) {
+    size_t n = (filled < total-filled) ? filled : total-filled;
+    memcpy(&p[filled], p, n);
+    filled += n;
+  }
+}
+
+// Fill 'pixels' pixels starting at bit index 'idx' (not for VERTICAL_BYTE)
+static void lcdFillSpan_ArrayBuffer(JsGraphics *gfx, unsigned int idx, unsigned int pixels, unsigned int col) {
+  unsigned int bpp = gfx->data.bpp;
+  unsigned char *p = &gfx->backendData[idx>>3];
+  if (!(bpp&7)) {
+    lcdFillBytes_ArrayBuffer(p, bpp>>3, pixels, col);
+    return;
+  }
+  unsigned int mask = (1U<<bpp)-1;
+  bool msb = (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB)!=0;
+  col &= mask;
+  unsigned int bit = idx&7;
+  // pixels up to the first byte boundary
+  while (bit && pixels) {
+    unsigned int shift = msb ? 8-(bit+bpp) : bit;
+    *p = (unsigned char)((*p & ~(mask<<shift)) | (col<<shift));
+    pixels--;
+    bit += bpp;
+    if (bit>=8) {
+      bit = 0;
+      p++;
+    }
+  }
+  // whole bytes - the colour repeated across the byte is the same whichever order the pixels are in
+  unsigned int wholeBytes = (pixels*bpp) >> 3;
+  memset(p, (int)(col*(0xFF/mask)), wholeBytes);
+  p += wholeBytes;
+  pixels -= wholeBytes*8/bpp;
+  // whatever is left will fit in the last byte
+  while (pixels--) {
+    unsigned int shift = msb ? 8-(bit+bpp) : bit;
+    *p = (unsigned char)((*p & ~(mask<<shift)) | (col<<shift));
+    bit += bpp;
+  }
+}
+
+// Fill a rectangle for 1bpp VERTICAL_BYTE - each byte is 8 pixels in a column, so go a row of bytes at a time
+static void lcdFillRectVertical_ArrayBuffer(JsGraphics *gfx, short x1, short y1, short x2, short y2, unsigned int col) {
+  bool msb = (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB)!=0;
+  unsigned int count = (unsigned int)(1+x2-x1);
+  int y = y1;
+  while (y<=y2) {
+    int yEnd = (y|7) < y2 ? (y|7) : y2;
+    unsigned char m = 0;
+    int b;
+    for (b=y&7;b<=(yEnd&7);b++)
+      m = (unsigned char)(m | (1<<(msb ? 7-b : b)));
+    unsigned char *p = &gfx->backendData[x1 + (y>>3)*gfx->data.width];
+    if (m==0xFF) {
+      memset(p, (col&1) ? 0xFF : 0, count);
+    } else {
+      unsigned char set = (col&1) ? m : 0;
+      unsigned int i;
+      for (i=0;i<count;i++)
+        p[i] = (unsigned char)((p[i] & ~m) | set);
+    }
+    y = yEnd+1;
+  }
+}
+
+static unsigned int lcdGetPixelFast_ArrayBuffer(JsGraphics *gfx, short x, short y) {
+  unsigned int idx = lcdGetPixelIndex_ArrayBuffer(gfx,x,y,1);
+  unsigned char *p = &gfx->backendData[idx>>3];
+  unsigned int col = 0;
+  if (gfx->data.bpp&7/*not a multiple of one byte*/) {
+    idx = idx & 7;
+    unsigned int mask = (unsigned int)(1<<gfx->data.bpp)-1;
+    unsigned int bitIdx = (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB) ? 8-(idx+gfx->data.bpp) : idx;
+    col = (((unsigned int)*p)>>bitIdx)&mask;
+  } else {
+    int i;
+    for (i=0;i<gfx->data.bpp;i+=8)
+      col |= ((unsigned int)*(p++)) << i;
+  }
+  return col;
+}
+
+static void lcdSetPixelFast_ArrayBuffer(JsGraphics *gfx, short x, short y, unsigned int col) {
+  if (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE)
+    lcdFillRectVertical_ArrayBuffer(gfx, x, y, x, y, col);
+  else
+    lcdFillSpan_ArrayBuffer(gfx, lcdGetPixelIndex_ArrayBuffer(gfx,x,y,1), 1, col);
+}
+
+static void lcdBlitSpanFast_ArrayBuffer(JsGraphics *gfx, short x, short y, short pixelCount, const unsigned int *cols) {
+  short i;
+  if (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE) {
+    unsigned char *p = &gfx->backendData[x + (y>>3)*gfx->data.width];
+    unsigned char m = (unsigned char)(1<<((gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB) ? 7-(y&7) : (y&7)));
+    for (i=0;i<pixelCount;i++,p++)
+      *p = (unsigned char)((cols[i]&1) ? (*p | m) : (*p & ~m));
+    return;
+  }
+  unsigned int bpp = gfx->data.bpp;
+  unsigned int idx = lcdGetPixelIndex_ArrayBuffer(gfx,x,y,pixelCount);
+  // zigzagged rows go the other way in memory
+  bool reverse = (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_ZIGZAG) && (y&1);
+  if (!(bpp&7)) {
+    unsigned char *p = &gfx->backendData[idx>>3];
+    for (i=0;i<pixelCount;i++) {
+      unsigned int col = cols[reverse ? pixelCount-(i+1) : i];
+      unsigned int b;
+      for (b=0;b<bpp;b+=8)
+        *(p++) = (unsigned char)(col >> b);
+    }
+  } else {
+    unsigned int mask = (1U<<bpp)-1;
+    bool msb = (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB)!=0;
+    for (i=0;i<pixelCount;i++) {
+      unsigned int col = cols[reverse ? pixelCount-(i+1) : i] & mask;
+      unsigned char *p = &gfx->backendData[idx>>3];
+      unsigned int shift = msb ? 8-((idx&7)+bpp) : (idx&7);
+      *p = (unsigned char)((*p & ~(mask<<shift)) | (col<<shift));
+      idx += bpp;
+    }
+  }
+}
+
+/* Copy image data (MSB first) straight into the buffer. We can only do this if
+ * the pixels are stored the same way - 8bpp, or MSB first with the same alignment */
+static bool lcdCopySpanFast_ArrayBuffer(JsGraphics *gfx, short x, short y, short pixelCount, const unsigned char *data, unsigned int bitIdx) {
+  unsigned int bpp = gfx->data.bpp;
+  if (bpp>8 || ((bpp&7) && !(gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB)) ||
+      (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE) ||
+      ((gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_ZIGZAG) && (y&1)))
+    return false;
+  unsigned int idx = lcdGetPixelIndex_ArrayBuffer(gfx,x,y,pixelCount);
+  if ((idx&7) != (bitIdx&7)) return false;
+  unsigned char *p = &gfx->backendData[idx>>3];
+  data += bitIdx>>3;
+  unsigned int bits = (unsigned int)pixelCount*bpp;
+  unsigned int first = idx&7;
+  if (first) { // partial first byte
+    unsigned int n = (8-first < bits) ? 8-first : bits;
+    unsigned char m = (unsigned char)((0xFF>>first) & (0xFF<<(8-(first+n))));
+    *p = (unsigned char)((*p & ~m) | (*data & m));
+    p++;
+    data++;
+    bits -= n;
+  }
+  memcpy(p, data, bits>>3);
+  p += bits>>3;
+  data += bits>>3;
+  if (bits&7) { // partial last byte
+    unsigned char m = (unsigned char)(0xFF<<(8-(bits&7)));
+    *p = (unsigned char)((*p & ~m) | (*data & m));
+  }
+  return true;
+}
+
+static void lcdFillRectFast_ArrayBuffer(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
+  unsigned int col = gfx->data.fgColor;
+  if (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE) {
+    lcdFillRectVertical_ArrayBuffer(gfx, x1, y1, x2, y2, col);
+  } else if (x1==0 && x2==gfx->data.width-1) {
+    // whole rows are contiguous (even when zigzagged) so do it all in one go
+    lcdFillSpan_ArrayBuffer(gfx, lcdGetPixelIndex_ArrayBuffer(gfx,0,y1,gfx->data.width), (unsigned int)((1+y2-y1)*gfx->data.width), col);
+  } else {
+    short y;
+    for (y=y1;y<=y2;y++)
+      lcdFillSpan_ArrayBuffer(gfx, lcdGetPixelIndex_ArrayBuffer(gfx,x1,y,1+x2-x1), (unsigned int)(1+x2-x1), col);
+  }
+}
+
+static void lcdFillSpanFast_ArrayBuffer(JsGraphics *gfx, short x1, short x2, short y) {
+  if (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE)
+    lcdFillRectVertical_ArrayBuffer(gfx, x1, y, x2, y, gfx->data.fgColor);
+  else
+    lcdFillSpan_ArrayBuffer(gfx, lcdGetPixelIndex_ArrayBuffer(gfx,x1,y,1+x2-x1), (unsigned int)(1+x2-x1), gfx->data.fgColor);
+}
+#endif
+
+// ----------------------------------------------------------------------------------------------
+
 void lcdInit_ArrayBuffer(JsGraphics *gfx) {
-  // create buffer
-  JsVar *buf = jswrap_arraybuffer_constructor((gfx->data.width * gfx->data.height * gfx->data.bpp + 7) >> 3);
+  // create buffer - in flat memory if we can, so that we can draw into it directly
+  unsigned int byteLength = lcdGetBufferLength_ArrayBuffer(gfx);
+  JsVar *buf = 0;
+  JsVar *str = jsvNewFlatStringOfLength(byteLength);
+  if (str) {
+    buf = jsvNewArrayBufferFromString(str, byteLength);
+    jsvUnLock(str);
+  } else
+    buf = jswrap_arraybuffer_constructor((int)byteLength);
   jsvUnLock2(jsvAddNamedChild(gfx->graphicsVar, buf, "buffer"), buf);
 }
 
+#ifndef SAVE_ON_FLASH
+void lcdSetCallbacks_ArrayBufferPointer(JsGraphics *gfx, unsigned char *ptr) {
+  gfx->backendData = ptr;
+  gfx->setPixel = lcdSetPixelFast_ArrayBuffer;
+  gfx->getPixel = lcdGetPixelFast_ArrayBuffer;
+  gfx->fillRect = lcdFillRectFast_ArrayBuffer;
+  gfx->fillSpan = lcdFillSpanFast_ArrayBuffer;
+  gfx->blitSpan = lcdBlitSpanFast_ArrayBuffer;
+  gfx->copySpan = lcdCopySpanFast_ArrayBuffer;
+}
+#endif
+
 void lcdSetCallbacks_ArrayBuffer(JsGraphics *gfx) {
   gfx->setPixel = lcdSetPixel_ArrayBuffer;
   gfx->getPixel = lcdGetPixel_ArrayBuffer;
   gfx->fillRect = lcdFillRect_ArrayBuffer;
+  /* If the buffer is in flat memory (and big enough), use it directly. Flat
+   * strings don't get moved, and nothing can replace 'buffer' until JS code runs */
+#ifndef SAVE_ON_FLASH
+  JsVar *buf = jsvObjectGetChild(gfx->graphicsVar, "buffer", 0);
+  JsVar *str = (buf && jsvIsArrayBuffer(buf)) ? jsvGetArrayBufferBackingString(buf) : 0;
+  if (str && jsvIsFlatString(str) &&
+      (gfx->data.flags & (JSGRAPHICSFLAGS_ARRAYBUFFER_ZIGZAG|JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE)) !=
+          (JSGRAPHICSFLAGS_ARRAYBUFFER_ZIGZAG|JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE)) {
+    size_t len = 0;
+    char *ptr = jsvGetDataPointer(buf, &len);
+    if (ptr && len >= lcdGetBufferLength_ArrayBuffer(gfx))
+      lcdSetCallbacks_ArrayBufferPointer(gfx, (unsigned char*)ptr);
+  }
+  jsvUnLock2(str, buf);
+#endif
 }
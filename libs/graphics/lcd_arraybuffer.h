@@ -15,3 +15,7 @@
 
 void lcdInit_ArrayBuffer(JsGraphics *gfx);
 void lcdSetCallbacks_ArrayBuffer(JsGraphics *gfx);
+#ifndef SAVE_ON_FLASH
+/// Draw directly into memory at 'ptr' (which must be big enough for the whole display)
+void lcdSetCallbacks_ArrayBufferPointer(JsGraphics *gfx, unsigned char *ptr);
+#endif
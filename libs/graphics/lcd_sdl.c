@@ -65,8 +65,16 @@ void lcdIdle_SDL() {
   }
 }
 
+// Only update the area of the window that has changed
+void lcdFlip_SDL(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
+  if (!screen) return;
+  needsFlip = false;
+  SDL_UpdateRect(screen, x1, y1, (Uint32)(1+x2-x1), (Uint32)(1+y2-y1));
+}
+
 void lcdSetCallbacks_SDL(JsGraphics *gfx) {
   gfx->setPixel = lcdSetPixel_SDL;
   gfx->getPixel = lcdGetPixel_SDL;
+  gfx->flip = lcdFlip_SDL;
   // FIXME: idle callback would be a great idea to save lock/unlock
 }
@@ -2790,3 +2790,14 @@ static const VectorFontChar vectorFonts[] IN_FLASH_MEMORY = {
   {83, 50}, // char 125
   {145, 32}, // char 126
 };
+// offset of each character's first vertex in vectorFontPolys
+static const unsigned short vectorFontOffsets[] IN_FLASH_MEMORY = {
+  0, 0, 18, 34, 158, 306, 432, 566, 574, 614, 656, 710,
+  744, 758, 766, 774, 782, 872, 888, 948, 1042, 1094, 1178, 1298,
+  1332, 1468, 1580, 1596, 1618, 1636, 1652, 1670, 1728, 1966, 2008, 2112,
+  2204, 2278, 2322, 2358, 2456, 2496, 2504, 2540, 2584, 2600, 2650, 2682,
+  2778, 2844, 2970, 3050, 3144, 3168, 3240, 3262, 3312, 3352, 3382, 3410,
+  3434, 3442, 3466, 3484, 3492, 3500, 3588, 3686, 3758, 3846, 3928, 3974,
+  4086, 4132, 4148, 4172, 4216, 4224, 4298, 4350, 4426, 4520, 4608, 4644,
+  4730, 4780, 4828, 4850, 4896, 4936, 4970, 5004, 5058, 5066, 5116
+};
@@ -275,6 +275,23 @@ require("http").request(options, function(res) {
 
 You can easily pre-populate `options` from a URL using `var options = url.parse("http://www.example.com/foo.html")`
 
+If you make lots of requests to the same server, you can add an `agent` field to
+`options` so that the connection is kept open (with HTTP/1.1 keep-alive) and reused
+for the next request rather than connecting again each time:
+
+```
+var agent = {
+    keepAlive: true, // keep connections open between requests
+    maxSockets: 2,   // (optional) maximum connections to each host - further requests wait for one to become free
+    timeout: 4000    // (optional) milliseconds an unused connection is kept open for, defaults to 4000
+  };
+require("http").request({host:'example.com', path:'/', method:'GET', agent:agent}, ...).end();
+```
+
+The server needs to send a `Content-Length` header or use chunked encoding so that
+we know where the response ends. If you send data with the request, you should
+set a `Content-Length` header too.
+
 **Note:** if TLS/HTTPS is enabled, options can have `ca`, `key` and `cert` fields. See `tls.connect` for
 more information about these and how to use them.
 
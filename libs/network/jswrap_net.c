@@ -17,6 +17,9 @@
 #include "jsvariterator.h"
 #include "socketserver.h"
 #include "network.h"
+#if defined(LINUX) && defined(__linux__)
+#include "network_linux.h"
+#endif
 
 /*JSON{
   "type" : "idle",
@@ -27,6 +30,12 @@ bool jswrap_net_idle() {
   if (!networkGetFromVar(&net)) return false;
   net.idle(&net);
   bool b = socketIdle(&net);
+#if defined(LINUX) && defined(__linux__)
+  /* jshSleep wakes up as soon as a socket has data, so we don't need to
+   * keep polling just because sockets are open */
+  if (net.data.type == JSNETWORKTYPE_SOCKET)
+    b = net_linux_idleWasBusy();
+#endif
   networkFree(&net);
   return b;
 }
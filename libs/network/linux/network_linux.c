@@ -39,6 +39,43 @@
 
  #define closesocket(SOCK) close(SOCK)
 
+#ifdef __linux__
+#include <sys/epoll.h>
+// in targets/linux/jshardware.c - wake jshSleep when this socket has data
+extern void jshWakeOnFd(int fd);
+
+#define NET_READY_SOCKETS 1024 ///< sockets above this are always assumed to be ready
+static int netEpoll = -1; ///< epoll set containing all our sockets
+static uint32_t netReady[NET_READY_SOCKETS/32]; ///< bit set for each socket that had something to receive on the last idle
+static bool netAllReady; ///< too many sockets were ready to fit in one epoll_wait, so check them all
+
+/// Add a new socket to netEpoll (which jshSleep also waits on)
+static void net_linux_watch(int sckt) {
+  if (netEpoll<0) {
+    netEpoll = epoll_create1(EPOLL_CLOEXEC);
+    jshWakeOnFd(netEpoll);
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.fd = sckt;
+  epoll_ctl(netEpoll, EPOLL_CTL_ADD, sckt, &ev);
+  // it's new, so check it next time regardless
+  if (sckt<NET_READY_SOCKETS) netReady[sckt>>5] |= 1U<<(sckt&31);
+}
+#define WAKE_ON_SOCKET(SOCK) net_linux_watch(SOCK)
+#else
+#define WAKE_ON_SOCKET(SOCK)
+#endif
+
+/// Did any socket do something since net_linux_idleWasBusy was last called?
+static bool netBusy;
+
+bool net_linux_idleWasBusy() {
+  bool b = netBusy;
+  netBusy = false;
+  return b;
+}
 
 /// Get an IP address from a name. Sets out_ip_addr to 0 on failure
 void net_linux_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_addr) {
@@ -51,8 +88,29 @@ void net_linux_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_a
 /// Called on idle. Do any checks required for this device
 void net_linux_idle(JsNetwork *net) {
   NOT_USED(net);
+#ifdef __linux__
+  // Find out which sockets have something for us with one call (closed sockets leave epoll automatically)
+  memset(netReady, 0, sizeof(netReady));
+  netAllReady = false;
+  if (netEpoll<0) return;
+  struct epoll_event events[64];
+  int i, n = epoll_wait(netEpoll, events, sizeof(events)/sizeof(struct epoll_event), 0);
+  if (n == (int)(sizeof(events)/sizeof(struct epoll_event))) netAllReady = true;
+  for (i=0;i<n;i++) {
+    int sckt = events[i].data.fd;
+    if (sckt<NET_READY_SOCKETS) netReady[sckt>>5] |= 1U<<(sckt&31);
+  }
+#endif
 }
 
+#ifdef __linux__
+/// Returns false if there's definitely nothing to receive (or accept) on this socket
+bool net_linux_isReady(JsNetwork *net, int sckt) {
+  NOT_USED(net);
+  return netAllReady || sckt>=NET_READY_SOCKETS || (netReady[sckt>>5] & (1U<<(sckt&31)));
+}
+#endif
+
 /// Call just before returning to idle loop. This checks for errors and tries to recover. Returns true if no errors.
 bool net_linux_checkError(JsNetwork *net) {
   NOT_USED(net);
@@ -130,6 +188,10 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
       closesocket(sckt);
       return -1;
     }
+#ifndef WIN_OS
+    // so net_linux_accept doesn't block
+    fcntl(sckt, F_SETFL, fcntl(sckt, F_GETFL, 0) | O_NONBLOCK);
+#endif
   }
 
 #ifdef SO_NOSIGPIPE
@@ -139,6 +201,8 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
     jsWarn("setsockopt(SO_NOSIGPIPE) failed\n");
 #endif
 
+  WAKE_ON_SOCKET(sckt);
+  netBusy = true;
   return sckt;
 }
 
@@ -146,74 +210,44 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
 void net_linux_closesocket(JsNetwork *net, int sckt) {
   NOT_USED(net);
   closesocket(sckt);
+  netBusy = true;
 }
 
 /// If the given server socket can accept a connection, return it (or return < 0)
 int net_linux_accept(JsNetwork *net, int sckt) {
   NOT_USED(net);
   // TODO: look for unreffed servers?
-  fd_set s;
-  FD_ZERO(&s);
-  FD_SET(sckt,&s);
-  // check for waiting clients
-  struct timeval timeout;
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
-  int n = select(sckt+1,&s,NULL,NULL,&timeout);
-  if (n>0) {
-    // we have a client waiting to connect... try to connect and see what happens
-    int theClient = accept(sckt,0,0);
-    return theClient;
+  // The socket is non-blocking, so this just fails if there's no client waiting
+  int theClient = accept(sckt,0,0);
+  if (theClient >= 0) {
+    WAKE_ON_SOCKET(theClient);
+    netBusy = true;
   }
-  return -1;
+  return theClient;
 }
 
 /// Receive data if possible. returns nBytes on success, 0 on no data, or -1 on failure
 int net_linux_recv(JsNetwork *net, int sckt, void *buf, size_t len) {
   NOT_USED(net);
-  int num = 0;
-  fd_set s;
-  FD_ZERO(&s);
-  FD_SET(sckt,&s);
-  // check for waiting clients
-  struct timeval timeout;
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
-  int n = select(sckt+1,&s,NULL,NULL,&timeout);
-  if (n==SOCKET_ERROR) {
-    // we probably disconnected
-    return -1;
-  } else if (n>0) {
-    // receive data
-    num = (int)recv(sckt,buf,len,0);
-    if (num==0) num=-1; // select says data, but recv says 0 means connection is closed
-  }
-
+  int num = (int)recv(sckt,buf,len,MSG_DONTWAIT);
+  if (num==0) num=-1; // recv returning 0 means connection is closed
+  else if (num<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) num=0; // no data yet
+  if (num) netBusy = true;
   return num;
 }
 
 /// Send data if possible. returns nBytes on success, 0 on no data, or -1 on failure
 int net_linux_send(JsNetwork *net, int sckt, const void *buf, size_t len) {
   NOT_USED(net);
-  fd_set writefds;
-  FD_ZERO(&writefds);
-  FD_SET(sckt, &writefds);
-  struct timeval time;
-  time.tv_sec = 0;
-  time.tv_usec = 0;
-  int n = select(sckt+1, 0, &writefds, 0, &time);
-  if (n==SOCKET_ERROR ) {
-     // we probably disconnected so just get rid of this
-    return -1;
-  } else if (FD_ISSET(sckt, &writefds)) {
-    int flags = 0;
+  // we keep trying to send until it's all gone, so stay busy
+  netBusy = true;
+  int flags = MSG_DONTWAIT;
 #if !defined(SO_NOSIGPIPE) && defined(MSG_NOSIGNAL)
-    flags |= MSG_NOSIGNAL;
+  flags |= MSG_NOSIGNAL;
 #endif
-    n = (int)send(sckt, buf, len, flags);
-    return n;
-  } else
-    return 0; // just not ready
+  int n = (int)send(sckt, buf, len, flags);
+  if (n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) n=0; // just not ready
+  return n;
 }
 
 void netSetCallbacks_linux(JsNetwork *net) {
@@ -225,5 +259,8 @@ void netSetCallbacks_linux(JsNetwork *net) {
   net->gethostbyname = net_linux_gethostbyname;
   net->recv = net_linux_recv;
   net->send = net_linux_send;
+#ifdef __linux__
+  net->isReady = net_linux_isReady;
+#endif
   net->chunkSize = 536;
 }
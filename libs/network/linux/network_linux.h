@@ -14,3 +14,6 @@
 #include "network.h"
 
 void netSetCallbacks_linux(JsNetwork *net);
+
+/// Did any socket do something since this was last called? (clears the flag)
+bool net_linux_idleWasBusy();
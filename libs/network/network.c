@@ -161,6 +161,41 @@ unsigned long networkFlipIPAddress(unsigned long addr) {
  * A value of 0 returned for an IP address means we could NOT resolve the hostname.
  * A value of 0xFFFFFFFF for an IP address means that we haven't found it YET.
  */
+#ifndef SAVE_ON_FLASH
+/* A few recently resolved host names, so that making lots of requests to
+ * the same host doesn't need a DNS lookup each time. We don't get the TTL
+ * from gethostbyname, so entries just expire after a fixed time. */
+#define NETWORK_DNS_CACHE_SIZE 4
+#define NETWORK_DNS_CACHE_NAME_LEN 32 // longer names aren't cached
+#define NETWORK_DNS_CACHE_TIMEOUT 60000 // milliseconds
+typedef struct {
+  char name[NETWORK_DNS_CACHE_NAME_LEN];
+  uint32_t ip;
+  JsSysTime expires;
+} NetworkDnsCacheEntry;
+static NetworkDnsCacheEntry networkDnsCache[NETWORK_DNS_CACHE_SIZE];
+static unsigned char networkDnsCacheNext = 0; ///< the entry to replace next
+
+static uint32_t networkDnsCacheGet(const char *hostName) {
+  JsSysTime now = jshGetSystemTime();
+  int i;
+  for (i=0;i<NETWORK_DNS_CACHE_SIZE;i++)
+    if (networkDnsCache[i].ip && networkDnsCache[i].expires > now &&
+        strcmp(networkDnsCache[i].name, hostName)==0)
+      return networkDnsCache[i].ip;
+  return 0;
+}
+
+static void networkDnsCacheAdd(const char *hostName, uint32_t ip) {
+  if (strlen(hostName) >= NETWORK_DNS_CACHE_NAME_LEN) return;
+  NetworkDnsCacheEntry *entry = &networkDnsCache[networkDnsCacheNext];
+  networkDnsCacheNext = (unsigned char)((networkDnsCacheNext+1) % NETWORK_DNS_CACHE_SIZE);
+  strncpy(entry->name, hostName, NETWORK_DNS_CACHE_NAME_LEN);
+  entry->ip = ip;
+  entry->expires = jshGetSystemTime() + jshGetTimeFromMilliseconds(NETWORK_DNS_CACHE_TIMEOUT);
+}
+#endif
+
 void networkGetHostByName(
     JsNetwork *net,        //!< The network we are using for resolution.
     char      *hostName,   //!< The hostname to be resolved.
@@ -175,10 +210,21 @@ void networkGetHostByName(
   // first try and simply parse the IP address as a string
   *out_ip_addr = networkParseIPAddress(hostName);
 
+#ifndef SAVE_ON_FLASH
+  // then see if we looked it up recently
+  if (!*out_ip_addr) {
+    *out_ip_addr = networkDnsCacheGet(hostName);
+  }
+#endif
+
   // If we did not get an IP address from the string, then try and resolve it by
   // calling the network gethostbyname.
   if (!*out_ip_addr) {
     net->gethostbyname(net, hostName, out_ip_addr);
+#ifndef SAVE_ON_FLASH
+    // 0xFFFFFFFF means the driver is still resolving it (and remembers the name itself)
+    if (*out_ip_addr && *out_ip_addr!=0xFFFFFFFF) networkDnsCacheAdd(hostName, *out_ip_addr);
+#endif
   }
 }
 
@@ -228,6 +274,7 @@ bool networkGetFromVar(JsNetwork *net) {
 
   // Now we know which kind of network we are working with, invoke the corresponding initialization
   // function to set the callbacks for this network tyoe.
+  net->isReady = 0; // optional
   switch (net->data.type) {
 #if defined(USE_CC3000)
   case JSNETWORKTYPE_CC3000 : netSetCallbacks_cc3000(net); break;
@@ -742,3 +789,11 @@ int netSend(JsNetwork *net, int sckt, const void *buf, size_t len) {
 bool netIsConnected(JsNetwork *net, int sckt) {
   return net->isconnected(net, sckt);
 }
+
+bool netIsReady(JsNetwork *net, int sckt) {
+#ifdef USE_TLS
+  // TLS may have data buffered, or be part way through connecting
+  if (BITFIELD_GET(socketIsHTTPS, sckt)) return true;
+#endif
+  return !net->isReady || net->isReady(net, sckt);
+}
@@ -75,6 +75,9 @@ typedef struct JsNetwork {
   int (*send)(struct JsNetwork *net, int sckt, const void *buf, size_t len);
   /// Check if socket disconnected. returns 1 if connected, or 0 if disconnected
   bool (*isconnected)(struct JsNetwork *net, int sckt);
+  /** Optional. Returns false if there's definitely nothing to receive (or accept) on the socket right now,
+   * so it needn't be checked. The driver should update what is ready in 'idle'. If 0, every socket is checked every time */
+  bool (*isReady)(struct JsNetwork *net, int sckt);
 } PACKED_FLAGS JsNetwork;
 
 // ---------------------------------- these are in network.c
@@ -124,5 +127,7 @@ void netGetHostByName(JsNetwork *net, char * hostName, uint32_t* out_ip_addr);
 int netRecv(JsNetwork *net, int sckt, void *buf, size_t len);
 int netSend(JsNetwork *net, int sckt, const void *buf, size_t len);
 bool netIsConnected(JsNetwork *net, int sckt);
+/// Returns false if there's definitely nothing to receive (or accept) on this socket right now
+bool netIsReady(JsNetwork *net, int sckt);
 
 #endif // _NETWORK_H
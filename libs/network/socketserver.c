@@ -18,20 +18,13 @@
 #include "jshardware.h"
 #include "jswrap_stream.h"
 
-#define HTTP_NAME_SOCKETTYPE "type" // normal socket or HTTP
+#define HTTP_NAME_STATE JS_HIDDEN_CHAR_STR"st" // SocketState
 #define HTTP_NAME_PORT "port"
-#define HTTP_NAME_SOCKET "sckt"
-#define HTTP_NAME_HAD_HEADERS "hdrs"
 #define HTTP_NAME_RECEIVE_DATA "dRcv"
-#define HTTP_NAME_RECEIVE_COUNT "cRcv"
 #define HTTP_NAME_SEND_DATA "dSnd"
 #define HTTP_NAME_RESPONSE_VAR "res"
 #define HTTP_NAME_OPTIONS_VAR "opt"
 #define HTTP_NAME_SERVER_VAR "svr"
-#define HTTP_NAME_CHUNKED "chunked"
-#define HTTP_NAME_CLOSENOW "closeNow"  // boolean: gotta close
-#define HTTP_NAME_CONNECTED "conn"     // boolean: we are connected
-#define HTTP_NAME_CLOSE "close"        // close after sending
 #define HTTP_NAME_ON_CONNECT JS_EVENT_PREFIX"connect"
 #define HTTP_NAME_ON_CLOSE JS_EVENT_PREFIX"close"
 #define HTTP_NAME_ON_END JS_EVENT_PREFIX"end"
@@ -41,6 +34,9 @@
 #define HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS "HttpCC"
 #define HTTP_ARRAY_HTTP_SERVERS "HttpS"
 #define HTTP_ARRAY_HTTP_SERVER_CONNECTIONS "HttpSC"
+#define HTTP_ARRAY_HTTP_CLIENT_POOL "HttpCP" ///< idle keep-alive sockets
+
+#define HTTP_AGENT_DEFAULT_TIMEOUT 4000 ///< milliseconds an idle keep-alive socket is kept for (less than the 5s many servers use)
 
 #ifdef ESP8266
 // esp8266 debugging, need to remove this eventually
@@ -50,6 +46,50 @@ extern int os_printf_plus(const char *format, ...)  __attribute__((format(printf
 
 // -----------------------------
 
+typedef enum {
+  SF_NONE = 0,
+  SF_HAD_HEADERS = 1, ///< HTTP headers have been received and parsed
+  SF_CLOSE_NOW = 2,   ///< gotta close
+  SF_CONNECTED = 4,   ///< we are connected
+  SF_CLOSE = 8,       ///< close after sending
+  SF_CHUNKED = 16,    ///< HTTP client is sending with Transfer-Encoding:chunked
+  SF_KEEP_ALIVE = 32, ///< HTTP client: keep the socket open for the next request (options.agent.keepAlive)
+  SF_WAITING = 64,    ///< HTTP client: waiting for one of the agent's sockets to become free
+} SocketFlags;
+
+/* The state of a server, connection or HTTP response that is needed on every
+ * idle. It's stored in one hidden string (like JsNetwork/JsGraphics) so that
+ * we only do one lookup rather than one per field. */
+typedef struct {
+  int sckt; ///< socket number+1, or 0 if there is no socket
+  JsVarInt chunkLeft; ///< HTTP: body bytes left (Content-Length), chunk size being read, or how much of this chunk is left
+  unsigned char type; ///< SocketType
+  unsigned char flags; ///< SocketFlags
+  unsigned char parseState; ///< HTTP: HttpParseState
+} SocketState;
+
+static NO_INLINE void socketGetState(JsVar *var, SocketState *state) {
+  char buf[sizeof(SocketState)+1]; // jsvGetStringChars adds a trailing zero
+  JsVar *data = jsvObjectGetChild(var, HTTP_NAME_STATE, 0);
+  if (data) {
+    jsvGetStringChars(data, 0, buf, sizeof(SocketState));
+    memcpy(state, buf, sizeof(SocketState));
+    jsvUnLock(data);
+  } else
+    memset(state, 0, sizeof(SocketState));
+}
+
+static NO_INLINE void socketSetState(JsVar *var, const SocketState *state) {
+  JsVar *data = jsvObjectGetChild(var, HTTP_NAME_STATE, 0);
+  if (!data) {
+    data = jsvNewStringOfLength(sizeof(SocketState));
+    if (!data) return; // out of memory
+    jsvObjectSetChild(var, HTTP_NAME_STATE, data);
+  }
+  jsvSetString(data, (const char*)state, sizeof(SocketState));
+  jsvUnLock(data);
+}
+
 static void httpAppendHeaders(JsVar *string, JsVar *headerObject) {
   // append headers
   JsvObjectIterator it;
@@ -69,94 +109,177 @@ static void httpAppendHeaders(JsVar *string, JsVar *headerObject) {
   // free headers
 }
 
-// httpParseHeaders(&receiveData, reqVar, true) // server
-// httpParseHeaders(&receiveData, resVar, false) // client
-bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer) {
-  // find /r/n/r/n
-  int newlineIdx = 0;
-  int strIdx = 0;
-  int headerEnd = -1;
-  JsvStringIterator it;
-  jsvStringIteratorNew(&it, *receiveData, 0);
-  while (jsvStringIteratorHasChar(&it)) {
-    char ch = jsvStringIteratorGetChar(&it);
+typedef enum {
+  HPS_HEADER,        ///< reading headers, looking for the blank line at the end
+  HPS_HEADER_CR,     ///< ... got '\r'
+  HPS_HEADER_CRLF,   ///< ... got '\r\n'
+  HPS_HEADER_CRLFCR, ///< ... got '\r\n\r'
+  HPS_BODY,          ///< body data, passed straight through until the connection closes
+  HPS_BODY_LENGTH,   ///< body data, 'chunkLeft' bytes of it (Content-Length)
+  HPS_CHUNK_SIZE,    ///< chunked: reading the hex chunk size
+  HPS_CHUNK_EXT,     ///< chunked: skipping chunk extensions up to the end of the line
+  HPS_CHUNK_DATA,    ///< chunked: 'chunkLeft' bytes of data
+  HPS_CHUNK_END,     ///< chunked: skipping the line end after the data
+  HPS_TRAILER,       ///< chunked: start of a trailer line (or the final blank line)
+  HPS_TRAILER_LINE,  ///< chunked: skipping a trailer line
+  HPS_DONE,          ///< the whole body has been received - ignore anything else
+} HttpParseState;
+
+/** Look through newly received data for the blank line at the end of the
+ * HTTP headers, carrying on from where we left off last time (so headers that
+ * arrive in lots of small pieces don't get scanned over and over again).
+ * Returns the index in buf just after the headers, or -1 if they haven't ended yet. */
+static int httpFindHeaderEnd(unsigned char *parseState, const char *buf, int len) {
+  int i;
+  for (i=0;i<len;i++) {
+    char ch = buf[i];
     if (ch == '\r') {
-      if (newlineIdx==0) newlineIdx=1;
-      else if (newlineIdx==2) newlineIdx=3;
+      if (*parseState==HPS_HEADER) *parseState=HPS_HEADER_CR;
+      else if (*parseState==HPS_HEADER_CRLF) *parseState=HPS_HEADER_CRLFCR;
     } else if (ch == '\n') {
-      if (newlineIdx==1) newlineIdx=2;
-      else if (newlineIdx==3) {
-        headerEnd = strIdx+1;
+      if (*parseState==HPS_HEADER_CR) *parseState=HPS_HEADER_CRLF;
+      else if (*parseState==HPS_HEADER_CRLFCR) {
+        *parseState = HPS_BODY;
+        return i+1;
+      }
+    } else *parseState=HPS_HEADER;
+  }
+  return -1;
+}
+
+/** Decode body data in place - dropping Transfer-Encoding:chunked framing and
+ * anything past the end of the body - carrying on from where we left off last
+ * time. Returns how many bytes of actual data are now at the start of buf. */
+static int httpDecodeBody(unsigned char *parseState, JsVarInt *chunkLeft, char *buf, int len) {
+  int in = 0, out = 0;
+  while (in<len) {
+    if (*parseState==HPS_CHUNK_DATA || *parseState==HPS_BODY_LENGTH) {
+      // copy as much of the chunk as we can in one go
+      int n = len-in;
+      if (n > *chunkLeft) n = (int)*chunkLeft;
+      memmove(&buf[out], &buf[in], (size_t)n);
+      in += n;
+      out += n;
+      *chunkLeft -= n;
+      if (!*chunkLeft) *parseState = (*parseState==HPS_BODY_LENGTH) ? HPS_DONE : HPS_CHUNK_END;
+      continue;
+    }
+    char ch = buf[in++];
+    switch (*parseState) {
+    case HPS_CHUNK_SIZE:
+      if (isHexadecimal(ch)) {
+        if (*chunkLeft < 0x1000000) // ignore silly sizes rather than overflowing
+          *chunkLeft = (*chunkLeft<<4) | chtod(ch);
         break;
       }
-    } else newlineIdx=0;
-    jsvStringIteratorNext(&it);
-    strIdx++;
+      if (ch == '\n')
+        *parseState = *chunkLeft ? HPS_CHUNK_DATA : HPS_TRAILER;
+      else
+        *parseState = HPS_CHUNK_EXT; // '\r' or ';'
+      break;
+    case HPS_CHUNK_EXT:
+      if (ch == '\n')
+        *parseState = *chunkLeft ? HPS_CHUNK_DATA : HPS_TRAILER;
+      break;
+    case HPS_CHUNK_END:
+      if (ch == '\n') {
+        *parseState = HPS_CHUNK_SIZE;
+        *chunkLeft = 0;
+      }
+      break;
+    case HPS_TRAILER:
+      if (ch == '\n') *parseState = HPS_DONE;
+      else if (ch != '\r') *parseState = HPS_TRAILER_LINE;
+      break;
+    case HPS_TRAILER_LINE:
+      if (ch == '\n') *parseState = HPS_TRAILER;
+      break;
+    default: // HPS_DONE
+      break;
+    }
   }
-  jsvStringIteratorFree(&it);
-  // skip if we have no header
-  if (headerEnd<0) return false;
-  // Now parse the header
+  return out;
+}
+
+/** Parse a complete block of HTTP headers (up to and including the blank
+ * line) into objectForData, and set up state to decode the body that follows.
+ * httpParseHeaders(headerData, reqVar, true, &state) // server
+ * httpParseHeaders(headerData, resVar, false, &state) // client */
+static void httpParseHeaders(JsVar *headerData, JsVar *objectForData, bool isServer, SocketState *state) {
+  state->parseState = HPS_BODY;
   JsVar *vHeaders = jsvNewObject();
-  if (!vHeaders) return true;
+  if (!vHeaders) return;
   jsvUnLock(jsvAddNamedChild(objectForData, vHeaders, "headers"));
-  strIdx = 0;
+  int strIdx = 0;
   int firstSpace = -1;
   int secondSpace = -1;
   int firstEOL = -1;
   int lineNumber = 0;
   int lastLineStart = 0;
   int colonPos = 0;
-  //jsiConsolePrintStringVar(receiveData);
-  jsvStringIteratorNew(&it, *receiveData, 0);
-    while (jsvStringIteratorHasChar(&it)) {
-      char ch = jsvStringIteratorGetChar(&it);
-      if (ch==' ' || ch=='\r') {
-        if (firstSpace<0) firstSpace = strIdx;
-        else if (secondSpace<0) secondSpace = strIdx;
-      }
-      if (ch == ':' && colonPos<0) colonPos = strIdx;
-      if (ch == '\r') {
-        if (firstEOL<0) firstEOL=strIdx;
-        if (lineNumber>0 && colonPos>lastLineStart && lastLineStart<strIdx) {
-          JsVar *hVal = jsvNewFromEmptyString();
-          if (hVal)
-            jsvAppendStringVar(hVal, *receiveData, (size_t)colonPos+2, (size_t)(strIdx-(colonPos+2)));
-          JsVar *hKey = jsvNewFromEmptyString();
-          if (hKey) {
-            jsvMakeIntoVariableName(hKey, hVal);
-            jsvAppendStringVar(hKey, *receiveData, (size_t)lastLineStart, (size_t)(colonPos-lastLineStart));
-            jsvAddName(vHeaders, hKey);
-            jsvUnLock(hKey);
-          }
-          jsvUnLock(hVal);
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, headerData, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    char ch = jsvStringIteratorGetChar(&it);
+    if (ch==' ' || ch=='\r') {
+      if (firstSpace<0) firstSpace = strIdx;
+      else if (secondSpace<0) secondSpace = strIdx;
+    }
+    if (ch == ':' && colonPos<0) colonPos = strIdx;
+    if (ch == '\r') {
+      if (firstEOL<0) firstEOL=strIdx;
+      if (lineNumber>0 && colonPos>lastLineStart && lastLineStart<strIdx) {
+        JsVar *hVal = jsvNewFromEmptyString();
+        if (hVal)
+          jsvAppendStringVar(hVal, headerData, (size_t)colonPos+2, (size_t)(strIdx-(colonPos+2)));
+        JsVar *hKey = jsvNewFromEmptyString();
+        if (hKey) {
+          jsvMakeIntoVariableName(hKey, hVal);
+          jsvAppendStringVar(hKey, headerData, (size_t)lastLineStart, (size_t)(colonPos-lastLineStart));
+          jsvAddName(vHeaders, hKey);
+          jsvUnLock(hKey);
         }
-        lineNumber++;
-        colonPos=-1;
-      }
-      if (ch == '\r' || ch == '\n') {
-        lastLineStart = strIdx+1;
+        jsvUnLock(hVal);
       }
+      lineNumber++;
+      colonPos=-1;
+    }
+    if (ch == '\r' || ch == '\n') {
+      lastLineStart = strIdx+1;
+    }
 
-      jsvStringIteratorNext(&it);
-      strIdx++;
+    jsvStringIteratorNext(&it);
+    strIdx++;
+  }
+  jsvStringIteratorFree(&it);
+  // Work out where the body ends. Client responses are only cut short at
+  // Content-Length if we want to reuse the connection for another request
+  if (jsvIsStringEqualAndUnLock(jsvObjectGetChild(vHeaders, "Transfer-Encoding", 0), "chunked")) {
+    state->parseState = HPS_CHUNK_SIZE;
+    state->chunkLeft = 0;
+  } else if (isServer || (state->flags & SF_KEEP_ALIVE)) {
+    JsVar *contentLength = jsvObjectGetChild(vHeaders, "Content-Length", 0);
+    if (contentLength) {
+      state->chunkLeft = jsvGetIntegerAndUnLock(contentLength);
+      state->parseState = (state->chunkLeft>0) ? HPS_BODY_LENGTH : HPS_DONE;
     }
-    jsvStringIteratorFree(&it);
+  }
+  if (!isServer && jsvIsStringEqualAndUnLock(jsvObjectGetChild(vHeaders, "Connection", 0), "close"))
+    state->flags &= (unsigned char)~SF_KEEP_ALIVE;
   jsvUnLock(vHeaders);
   // try and pull out methods/etc
   if (isServer) {
-    jsvObjectSetChildAndUnLock(objectForData, "method", jsvNewFromStringVar(*receiveData, 0, (size_t)firstSpace));
-    jsvObjectSetChildAndUnLock(objectForData, "url", jsvNewFromStringVar(*receiveData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
+    jsvObjectSetChildAndUnLock(objectForData, "method", jsvNewFromStringVar(headerData, 0, (size_t)firstSpace));
+    jsvObjectSetChildAndUnLock(objectForData, "url", jsvNewFromStringVar(headerData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
   } else {
-    jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(*receiveData, 5, (size_t)firstSpace-5));
-    jsvObjectSetChildAndUnLock(objectForData, "statusCode", jsvNewFromStringVar(*receiveData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
-    jsvObjectSetChildAndUnLock(objectForData, "statusMessage", jsvNewFromStringVar(*receiveData, (size_t)(secondSpace+1), (size_t)(firstEOL-(secondSpace+1))));
+    jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(headerData, 5, (size_t)firstSpace-5));
+    jsvObjectSetChildAndUnLock(objectForData, "statusCode", jsvNewFromStringVar(headerData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
+    jsvObjectSetChildAndUnLock(objectForData, "statusMessage", jsvNewFromStringVar(headerData, (size_t)(secondSpace+1), (size_t)(firstEOL-(secondSpace+1))));
+    // these responses never have a body
+    JsVarInt statusCode = jsvGetIntegerAndUnLock(jsvObjectGetChild(objectForData, "statusCode", 0));
+    if ((state->flags & SF_KEEP_ALIVE) && (statusCode<200 || statusCode==204 || statusCode==304))
+      state->parseState = HPS_DONE;
   }
-  // strip out the header
-  JsVar *afterHeaders = jsvNewFromStringVar(*receiveData, (size_t)headerEnd, JSVAPPENDSTRINGVAR_MAXLENGTH);
-  jsvUnLock(*receiveData);
-  *receiveData = afterHeaders;
-  return true;
 }
 
 size_t httpStringGet(JsVar *v, char *str, size_t len) {
@@ -181,20 +304,61 @@ static JsVar *socketGetArray(const char *name, bool create) {
   return jsvObjectGetChild(execInfo.hiddenRoot, name, create?JSV_ARRAY:0);
 }
 
-static NO_INLINE SocketType socketGetType(JsVar *var) {
-  return jsvGetIntegerAndUnLock(jsvObjectGetChild(var, HTTP_NAME_SOCKETTYPE, 0));
+/* If the network can tell us which sockets are ready (netIsReady), we only
+ * look at connections that have something to receive, or that were marked
+ * with socketSetPending since the last idle (because JS wrote to them, or they
+ * still have data to send or receive, or are closing). */
+#define SOCKET_PENDING_MAX 8
+typedef struct {
+  int count; ///< number of sockets in 'sockets', or SOCKET_PENDING_MAX+1 to check every connection
+  int sockets[SOCKET_PENDING_MAX];
+} SocketPendingList;
+static SocketPendingList socketsPending = { SOCKET_PENDING_MAX+1, {0} }; ///< Marked since the last idle
+static SocketPendingList socketsToCheck; ///< Marked before this idle
+
+/// Make sure we look at this socket on the next idle. If sckt<0, look at every socket
+static void socketSetPending(int sckt) {
+  if (socketsPending.count > SOCKET_PENDING_MAX) return; // already checking everything
+  int i;
+  for (i=0;i<socketsPending.count;i++)
+    if (socketsPending.sockets[i]==sckt) return;
+  if (sckt<0 || socketsPending.count==SOCKET_PENDING_MAX)
+    socketsPending.count = SOCKET_PENDING_MAX+1;
+  else
+    socketsPending.sockets[socketsPending.count++] = sckt;
+}
+
+/// Make sure we look at this connection on the next idle
+static void socketSetPendingFor(const SocketState *state) {
+  if (state->sckt) socketSetPending(state->sckt-1); // connections without a socket are always checked anyway
+}
+
+/// Do we need to look at this socket on this idle?
+static bool socketNeedsIdle(JsNetwork *net, int sckt) {
+  if (sckt<0 || socketsToCheck.count > SOCKET_PENDING_MAX) return true;
+  int i;
+  for (i=0;i<socketsToCheck.count;i++)
+    if (socketsToCheck.sockets[i]==sckt) return true;
+  return netIsReady(net, sckt);
 }
 
-static NO_INLINE void socketSetType(JsVar *var, SocketType socketType) {
-  jsvObjectSetChildAndUnLock(var, HTTP_NAME_SOCKETTYPE, jsvNewFromInteger((JsVarInt)socketType));
+/// Create the state for a new server/connection/response
+static NO_INLINE void socketNewState(JsVar *var, SocketType socketType, int sckt) {
+  SocketState state;
+  memset(&state, 0, sizeof(state));
+  state.type = (unsigned char)socketType;
+  state.sckt = sckt+1;
+  socketSetState(var, &state);
 }
 
 void _socketConnectionKill(JsNetwork *net, JsVar *connection) {
   if (!net || networkState != NETWORKSTATE_ONLINE) return;
-  int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
-  if (sckt>=0) {
-    netCloseSocket(net, sckt);
-    jsvObjectSetChild(connection,HTTP_NAME_SOCKET,0);
+  SocketState state;
+  socketGetState(connection, &state);
+  if (state.sckt) {
+    netCloseSocket(net, state.sckt-1);
+    state.sckt = 0;
+    socketSetState(connection, &state);
   }
 }
 
@@ -221,10 +385,150 @@ NO_INLINE static void _socketCloseAllConnections(JsNetwork *net) {
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVER_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVERS);
+  _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_POOL);
+}
+
+// -----------------------------
+
+/* HTTP keep-alive. When a client request has options.agent.keepAlive set,
+ * its socket is put in HTTP_ARRAY_HTTP_CLIENT_POOL once the whole response
+ * has arrived, along with the host and port it is connected to. The next
+ * request to the same host and port takes it from there instead of
+ * looking up the host and connecting again. */
+
+/// Is the host and port in these two sets of options (or pool entries) the same?
+static bool socketIsSameHost(JsVar *a, JsVar *b) {
+  JsVar *hostA = jsvObjectGetChild(a, "host", 0);
+  JsVar *hostB = jsvObjectGetChild(b, "host", 0);
+  bool same = (!hostA && !hostB) || (jsvIsString(hostA) && jsvIsString(hostB) && jsvCompareString(hostA, hostB, 0, 0, false)==0);
+  jsvUnLock2(hostA, hostB);
+  return same &&
+      jsvGetIntegerAndUnLock(jsvObjectGetChild(a, "port", 0)) ==
+      jsvGetIntegerAndUnLock(jsvObjectGetChild(b, "port", 0));
+}
+
+/// Get an integer field of options.agent (or def if it isn't set)
+static JsVarInt socketGetAgentInt(JsVar *options, const char *name, JsVarInt def) {
+  JsVar *agent = jsvObjectGetChild(options, "agent", 0);
+  JsVar *v = jsvIsObject(agent) ? jsvObjectGetChild(agent, name, 0) : 0;
+  if (jsvIsNumeric(v)) def = jsvGetInteger(v);
+  jsvUnLock2(v, agent);
+  return def;
+}
+
+/// Was this client request a HEAD request (which never gets a body)?
+static bool socketRequestIsHead(JsVar *connection) {
+  JsVar *options = jsvObjectGetChild(connection, HTTP_NAME_OPTIONS_VAR, 0);
+  bool isHead = jsvIsStringEqualAndUnLock(jsvObjectGetChild(options, "method", 0), "HEAD");
+  jsvUnLock(options);
+  return isHead;
+}
+
+/// Put a client connection's socket in the pool so it can be used for the next request
+static void socketPoolAdd(JsNetwork *net, JsVar *connection) {
+  SocketState state;
+  socketGetState(connection, &state);
+  JsVar *options = jsvObjectGetChild(connection, HTTP_NAME_OPTIONS_VAR, 0);
+  JsVar *pool = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, true);
+  JsVar *entry = (options && pool) ? jsvNewObject() : 0;
+  if (entry) {
+    socketNewState(entry, state.type, state.sckt-1);
+    jsvObjectSetChildAndUnLock(entry, "host", jsvObjectGetChild(options, "host", 0));
+    jsvObjectSetChildAndUnLock(entry, "port", jsvObjectGetChild(options, "port", 0));
+    JsSysTime timeout = jshGetTimeFromMilliseconds((JsVarFloat)socketGetAgentInt(options, "timeout", HTTP_AGENT_DEFAULT_TIMEOUT));
+    jsvObjectSetChildAndUnLock(entry, "exp", jsvNewFromLongInteger(jshGetSystemTime() + timeout));
+    jsvArrayPush(pool, entry);
+    // the socket belongs to the pool now
+    state.sckt = 0;
+    socketSetState(connection, &state);
+    socketSetPending(-1); // so any requests waiting for a socket try again
+  } else // out of memory
+    _socketConnectionKill(net, connection);
+  jsvUnLock3(entry, pool, options);
+}
+
+/// Take a socket connected to the host in options from the pool, or return -1
+static int socketPoolTake(JsVar *options) {
+  JsVar *pool = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, false);
+  if (!pool) return -1;
+  int sckt = -1;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, pool);
+  while (sckt<0 && jsvObjectIteratorHasValue(&it)) {
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    if (socketIsSameHost(entry, options)) {
+      SocketState state;
+      socketGetState(entry, &state);
+      sckt = state.sckt-1;
+      JsVar *entryName = jsvObjectIteratorGetKey(&it);
+      jsvRemoveChild(pool, entryName);
+      jsvUnLock(entryName);
+    }
+    jsvUnLock(entry);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(pool);
+  return sckt;
+}
+
+/// How many keep-alive client connections to the host in options are using a socket right now?
+static int socketAgentSocketsInUse(JsVar *options) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS, false);
+  if (!arr) return 0;
+  int count = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, arr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *connection = jsvObjectIteratorGetValue(&it);
+    SocketState state;
+    socketGetState(connection, &state);
+    if (state.sckt && (state.flags & SF_KEEP_ALIVE)) {
+      JsVar *connectionOptions = jsvObjectGetChild(connection, HTTP_NAME_OPTIONS_VAR, 0);
+      if (socketIsSameHost(connectionOptions, options)) count++;
+      jsvUnLock(connectionOptions);
+    }
+    jsvUnLock(connection);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(arr);
+  return count;
+}
+
+/// Close pooled sockets that have timed out, or that the other end has closed
+static void socketPoolIdle(JsNetwork *net) {
+  JsVar *pool = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, false);
+  if (!pool) return;
+  JsSysTime now = jshGetSystemTime();
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, pool);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    SocketState state;
+    socketGetState(entry, &state);
+    bool closeNow = jsvGetLongIntegerAndUnLock(jsvObjectGetChild(entry, "exp", 0)) < now;
+    if (!closeNow && socketNeedsIdle(net, state.sckt-1)) {
+      char ch;
+      // it was closed, or sent us something we didn't ask for
+      closeNow = netRecv(net, state.sckt-1, &ch, 1) != 0;
+    }
+    if (closeNow) {
+      _socketConnectionKill(net, entry);
+      JsVar *entryName = jsvObjectIteratorGetKey(&it);
+      jsvObjectIteratorNext(&it);
+      jsvRemoveChild(pool, entryName);
+      jsvUnLock(entryName);
+    } else
+      jsvObjectIteratorNext(&it);
+    jsvUnLock(entry);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(pool);
 }
 
 // returns 0 on success and a (negative) error number on failure
-int socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData) {
+int socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData, bool wantClose) {
   char *buf = alloca(net->chunkSize); // allocate on stack
 
   assert(!jsvIsEmptyString(*sendData));
@@ -241,7 +545,6 @@ int socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData
     } else {
       // we sent all of it! Issue a drain event, unless we want to close, then we shouldn't
       // callback for more data
-      bool wantClose = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_CLOSE,0));
       if (!wantClose) {
         jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
       }
@@ -257,6 +560,7 @@ int socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData
 // -----------------------------
 
 void socketInit() {
+  socketSetPending(-1); // check everything to start with
 #ifdef WIN32
   // Init winsock 1.1
   WORD sockVersion;
@@ -309,11 +613,26 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
     // Get connection, socket, and socket type
     // For normal sockets, socket==connection, but for HTTP we split it into a request and a response
     JsVar *connection = jsvObjectIteratorGetValue(&it);
-    SocketType socketType = socketGetType(connection);
+    SocketState state;
+    socketGetState(connection, &state);
+    int sckt = state.sckt-1; // so -1 if no socket
+    if (!socketNeedsIdle(net, sckt)) {
+      // nothing to receive and nothing has changed - skip it
+      jsvUnLock(connection);
+      jsvObjectIteratorNext(&it);
+      continue;
+    }
+    SocketType socketType = state.type;
     JsVar *socket = ((socketType&ST_TYPE_MASK)==ST_HTTP) ? jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0) : jsvLockAgain(connection);
+    // the response (if there is one) has its own state for sending and closing
+    SocketState responseState;
+    SocketState *socketState = &state;
+    if (socket && socket!=connection) {
+      socketGetState(socket, &responseState);
+      socketState = &responseState;
+    }
 
-    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
-    bool closeConnectionNow = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, false));
+    bool closeConnectionNow = state.flags & SF_CLOSE_NOW;
     int error = 0;
 
     if (!closeConnectionNow) {
@@ -327,46 +646,64 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
         if (num>0) {
           JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
           JsVar *oldReceiveData = receiveData;
-          if (!receiveData) receiveData = jsvNewFromEmptyString();
-          if (receiveData) {
-            jsvAppendStringBuf(receiveData, buf, (size_t)num);
-            bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
-            if (!hadHeaders && httpParseHeaders(&receiveData, connection, true)) {
-              hadHeaders = true;
-              jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
-              JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
-              JsVar *args[2] = { connection, socket };
-              jsiQueueObjectCallbacks(server, HTTP_NAME_ON_CONNECT, args, ((socketType&ST_TYPE_MASK)==ST_HTTP) ? 2 : 1);
-              jsvUnLock(server);
-            }
-            if (hadHeaders && !jsvIsEmptyString(receiveData)) {
-              // Keep track of how much we received (so we can close once we have it)
-              if ((socketType&ST_TYPE_MASK)==ST_HTTP) {
-                jsvObjectSetChildAndUnLock(connection, HTTP_NAME_RECEIVE_COUNT,
-                    jsvNewFromInteger(
-                      jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_COUNT, JSV_INTEGER)) +
-                      jsvGetStringLength(receiveData)
-                    ));
-              }
-              // execute 'data' callback or save data
-              if (jswrap_stream_pushData(connection, receiveData, false)) {
-                // clear received data
+          char *body = buf;
+          int bodyLen = num;
+          if (!(state.flags & SF_HAD_HEADERS)) {
+            bodyLen = 0;
+            // collect the headers in receiveData until we have all of them
+            int headerEnd = httpFindHeaderEnd(&state.parseState, buf, num);
+            if (!receiveData) receiveData = jsvNewFromEmptyString();
+            if (receiveData) {
+              jsvAppendStringBuf(receiveData, buf, (size_t)((headerEnd<0) ? num : headerEnd));
+              if (headerEnd>=0) {
+                state.flags |= SF_HAD_HEADERS;
+                httpParseHeaders(receiveData, connection, true, &state);
                 jsvUnLock(receiveData);
                 receiveData = 0;
+                JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
+                JsVar *args[2] = { connection, socket };
+                jsiQueueObjectCallbacks(server, HTTP_NAME_ON_CONNECT, args, ((socketType&ST_TYPE_MASK)==ST_HTTP) ? 2 : 1);
+                jsvUnLock(server);
+                // anything after the headers is body
+                body = &buf[headerEnd];
+                bodyLen = num-headerEnd;
               }
             }
-            // if received data changed, update it
-            if (receiveData != oldReceiveData)
-              jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
-            jsvUnLock(receiveData);
+            socketSetState(connection, &state);
+          }
+          if (bodyLen && state.parseState!=HPS_BODY) {
+            bodyLen = httpDecodeBody(&state.parseState, &state.chunkLeft, body, bodyLen);
+            socketSetState(connection, &state);
+          }
+          if (bodyLen) {
+            if (!receiveData) receiveData = jsvNewFromEmptyString();
+            if (receiveData) jsvAppendStringBuf(receiveData, body, (size_t)bodyLen);
+          }
+          if ((state.flags & SF_HAD_HEADERS) && receiveData && !jsvIsEmptyString(receiveData)) {
+            // execute 'data' callback or save data
+            if (jswrap_stream_pushData(connection, receiveData, false)) {
+              // clear received data
+              jsvUnLock(receiveData);
+              receiveData = 0;
+            }
+            // the 'data' handler may have written to or ended the response
+            if (socketState != &state) socketGetState(socket, socketState);
           }
+          // if received data changed, update it
+          if (receiveData != oldReceiveData)
+            jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
+          jsvUnLock(receiveData);
         }
       }
 
+      if (num) socketSetPending(sckt);
       // send data if possible
+      // only close if we want to close, have no data to send, and aren't receiving data
+      bool wantClose = socketState->flags & SF_CLOSE;
       JsVar *sendData = jsvObjectGetChild(socket,HTTP_NAME_SEND_DATA,0);
       if (sendData && !jsvIsEmptyString(sendData)) {
-        int sent = socketSendData(net, socket, sckt, &sendData);
+        socketSetPending(sckt); // check again next time, in case we couldn't send it all
+        int sent = socketSendData(net, socket, sckt, &sendData, wantClose);
         // FIXME? checking for errors is a bit iffy. With the esp8266 network that returns
         // varied error codes we'd want to skip SOCKET_ERR_CLOSED and let the recv side deal
         // with normal closing so we don't miss the tail of what's received, but other drivers
@@ -378,22 +715,13 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
         }
         jsvObjectSetChild(socket, HTTP_NAME_SEND_DATA, sendData); // socketSendData prob updated sendData
       }
-      // only close if we want to close, have no data to send, and aren't receiving data
-      bool wantClose = jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_CLOSE,0));
+      if (wantClose) socketSetPending(sckt);
       if (wantClose && (!sendData || jsvIsEmptyString(sendData)) && num<=0) {
         bool reallyCloseNow = true;
-        if ((socketType&ST_TYPE_MASK)==ST_HTTP) {
-          // Check if we had a Content-Length header - if so, we need to wait until we have received that amount
-          JsVar *headers = jsvObjectGetChild(connection,"headers",0);
-          if (headers) {
-            JsVarInt contentLength = jsvGetIntegerAndUnLock(jsvObjectGetChild(headers,"Content-Length",0));
-            JsVarInt contentReceived = jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_COUNT, 0));
-            if (contentLength > contentReceived) {
-              reallyCloseNow = false;
-            }
-            jsvUnLock(headers);
-          }
-        }
+        // If we had a Content-Length header or a chunked body, we need to wait until we have received all of it
+        if ((socketType&ST_TYPE_MASK)==ST_HTTP &&
+            state.parseState>HPS_BODY && state.parseState<HPS_DONE)
+          reallyCloseNow = false;
         closeConnectionNow = reallyCloseNow;
       } else if (num > 0)
         closeConnectionNow = false; // guarantee that anything received is processed
@@ -402,7 +730,7 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
     if (closeConnectionNow) {
       // send out any data that we were POSTed
       JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
-      bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
+      bool hadHeaders = state.flags & SF_HAD_HEADERS;
       if (hadHeaders && !jsvIsEmptyString(receiveData)) {
         // execute 'data' callback or save data
         jswrap_stream_pushData(connection, receiveData, true);
@@ -460,7 +788,16 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
     // Get connection, socket, and socket type
     // For normal sockets, socket==connection, but for HTTP connection is httpCRq and socket is httpCRs
     JsVar *connection = jsvObjectIteratorGetValue(&it);
-    SocketType socketType = socketGetType(connection);
+    SocketState state;
+    socketGetState(connection, &state);
+    int sckt = state.sckt-1; // so -1 if no socket
+    if (!socketNeedsIdle(net, sckt)) {
+      // nothing to receive and nothing has changed - skip it
+      jsvUnLock(connection);
+      jsvObjectIteratorNext(&it);
+      continue;
+    }
+    SocketType socketType = state.type;
     JsVar *socket = ((socketType&ST_TYPE_MASK)==ST_HTTP) ? jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0) : jsvLockAgain(connection);
     bool socketClosed = false;
     JsVar *receiveData = 0;
@@ -468,31 +805,46 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
     bool hadHeaders = false;
     int error = 0; // error code received from netXxxx functions
     bool isHttp = (socketType&ST_TYPE_MASK) == ST_HTTP;
-    bool closeConnectionNow = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, false));
-    bool alreadyConnected = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CONNECTED, false));
-    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+    bool closeConnectionNow = state.flags & SF_CLOSE_NOW;
+    bool alreadyConnected = state.flags & SF_CONNECTED;
+    if (sckt<0 && (state.flags & SF_WAITING)) {
+      // see if one of the agent's sockets has become free
+      clientRequestConnect(net, connection);
+      socketGetState(connection, &state);
+      closeConnectionNow = state.flags & SF_CLOSE_NOW;
+    }
     if (sckt>=0) {
       if (isHttp)
-        hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
+        hadHeaders = state.flags & SF_HAD_HEADERS;
       else
         hadHeaders = true;
       receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
 
       /* We do this up here because we want to wait until we have been once
        * around the idle loop (=callbacks have been executed) before we run this */
-      if (hadHeaders)
+      if (hadHeaders && receiveData) {
         socketClientPushReceiveData(connection, socket, &receiveData);
+        socketGetState(connection, &state); // the 'data' handler may have changed it (eg. by calling end())
+      }
+      // If we got the whole response last time (so the callbacks have been run), the socket can go back to the pool
+      if ((state.flags & SF_KEEP_ALIVE) && hadHeaders && state.parseState==HPS_DONE && !receiveData)
+        closeConnectionNow = true;
+      // if we still have data (or are waiting to connect) we need to check again next time
+      if (receiveData || (!alreadyConnected && !isHttp))
+        socketSetPending(sckt);
 
       JsVar *sendData = jsvObjectGetChild(connection,HTTP_NAME_SEND_DATA,0);
       if (!closeConnectionNow) {
         // send data if possible
         if (sendData && !jsvIsEmptyString(sendData)) {
+          socketSetPending(sckt); // check again next time, in case we couldn't send it all
           // don't try to send if we're already in error state
           int num = 0;
-          if (error == 0) num = socketSendData(net, connection, sckt, &sendData);
+          if (error == 0) num = socketSendData(net, connection, sckt, &sendData, state.flags & SF_CLOSE);
           if (num > 0 && !alreadyConnected && !isHttp) { // whoa, we sent something, must be connected!
             jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &connection, 1);
-            jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CONNECTED, jsvNewFromBool(true));
+            state.flags |= SF_CONNECTED;
+            socketSetState(connection, &state);
             alreadyConnected = true;
           }
           if (num < 0) {
@@ -502,13 +854,14 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
           jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, sendData); // _http_send prob updated sendData
         } else {
           // no data to send, do we want to close? do so.
-          if (jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSE, false)))
+          if (state.flags & SF_CLOSE)
             closeConnectionNow = true;
         }
         // Now read data if possible (and we have space for it)
         if (!receiveData || !hadHeaders) {
           int num = netRecv(net, sckt, buf, net->chunkSize);
           //if (num != 0) printf("recv returned %d\r\n", num);
+          if (num) socketSetPending(sckt);
           if (!alreadyConnected && num == SOCKET_ERR_NO_CONN) {
             ; // ignore... it's just telling us we're not connected yet
           } else if (num < 0) {
@@ -520,7 +873,8 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
             // did we just get connected?
             if (!alreadyConnected && !isHttp) {
               jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &connection, 1);
-              jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CONNECTED, jsvNewFromBool(true));
+              state.flags |= SF_CONNECTED;
+              socketSetState(connection, &state);
               alreadyConnected = true;
               // if we do not have any data to send, issue a drain event
               if (!sendData || (int)jsvGetStringLength(sendData) == 0)
@@ -528,29 +882,57 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
             }
             // got data add it to our receive buffer
             if (num > 0) {
-              if (!receiveData) {
-                receiveData = jsvNewFromEmptyString();
-                jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
-              }
-              if (receiveData) { // could be out of memory
-                jsvAppendStringBuf(receiveData, buf, (size_t)num);
-                if ((socketType&ST_TYPE_MASK)==ST_HTTP && !hadHeaders) {
-                  // for HTTP see whether we now have full response headers
-                  JsVar *resVar = jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0);
-                  if (httpParseHeaders(&receiveData, resVar, false)) {
+              char *body = buf;
+              int bodyLen = num;
+              if (isHttp && !hadHeaders) {
+                bodyLen = 0;
+                // for HTTP collect the response headers until we have all of them
+                int headerEnd = httpFindHeaderEnd(&state.parseState, buf, num);
+                if (!receiveData) {
+                  receiveData = jsvNewFromEmptyString();
+                  jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
+                }
+                if (receiveData) { // could be out of memory
+                  jsvAppendStringBuf(receiveData, buf, (size_t)((headerEnd<0) ? num : headerEnd));
+                  if (headerEnd>=0) {
+                    JsVar *resVar = jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0);
+                    httpParseHeaders(receiveData, resVar, false, &state);
+                    if ((state.flags & SF_KEEP_ALIVE) && socketRequestIsHead(connection))
+                      state.parseState = HPS_DONE; // no body, even if there's a Content-Length
                     hadHeaders = true;
-                    jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
+                    state.flags |= SF_HAD_HEADERS;
                     jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &resVar, 1);
+                    jsvUnLock(resVar);
+                    // we're done with the headers - anything after them is body
+                    jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, 0);
+                    jsvUnLock(receiveData);
+                    receiveData = 0;
+                    body = &buf[headerEnd];
+                    bodyLen = num-headerEnd;
                   }
-                  jsvUnLock(resVar);
+                }
+                socketSetState(connection, &state);
+              }
+              if (isHttp && bodyLen && state.parseState!=HPS_BODY) {
+                bodyLen = httpDecodeBody(&state.parseState, &state.chunkLeft, body, bodyLen);
+                socketSetState(connection, &state);
+              }
+              if (bodyLen) {
+                if (!receiveData) {
+                  receiveData = jsvNewFromEmptyString();
                   jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
                 }
+                if (receiveData) // could be out of memory
+                  jsvAppendStringBuf(receiveData, body, (size_t)bodyLen);
               }
             }
           }
         }
-        jsvUnLock(sendData);
+        // got the whole response? make sure we come back next time to free the socket
+        if ((state.flags & SF_KEEP_ALIVE) && state.parseState==HPS_DONE)
+          socketSetPending(sckt);
       }
+      jsvUnLock(sendData);
     }
 
     if (closeConnectionNow) {
@@ -565,7 +947,10 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
           error = SOCKET_ERR_UNSENT_DATA;
         jsvUnLock(sendData);
 
-        _socketConnectionKill(net, connection);
+        if ((state.flags & SF_KEEP_ALIVE) && state.parseState==HPS_DONE && !error)
+          socketPoolAdd(net, connection);
+        else
+          _socketConnectionKill(net, connection);
         JsVar *connectionName = jsvObjectIteratorGetKey(&it);
         jsvObjectIteratorNext(&it);
         jsvRemoveChild(arr, connectionName);
@@ -579,7 +964,8 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
         JsVar *params[1] = { jsvNewFromBool(hadError) };
         jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, params, 1);
         jsvUnLock(params[0]);
-      }
+      } else
+        socketSetPending(sckt); // we still have data to push before we can close
     }
 
 
@@ -595,12 +981,26 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
 }
 
 
+bool socketHasConnections() {
+  const char *names[] = { HTTP_ARRAY_HTTP_SERVERS, HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS };
+  unsigned int i;
+  for (i=0;i<sizeof(names)/sizeof(const char*);i++) {
+    JsVar *arr = socketGetArray(names[i], false);
+    bool hasConnections = arr && !jsvArrayIsEmpty(arr);
+    jsvUnLock(arr);
+    if (hasConnections) return true;
+  }
+  return false;
+}
+
 bool socketIdle(JsNetwork *net) {
   if (networkState != NETWORKSTATE_ONLINE) {
     // clear all clients and servers
     _socketCloseAllConnections(net);
     return false;
   }
+  socketsToCheck = socketsPending;
+  socketsPending.count = 0;
   bool hadSockets = false;
   JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVERS,false);
   if (arr) {
@@ -610,16 +1010,20 @@ bool socketIdle(JsNetwork *net) {
       hadSockets = true;
 
       JsVar *server = jsvObjectIteratorGetValue(&it);
-      int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(server,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+      SocketState serverState;
+      socketGetState(server, &serverState);
+      int sckt = serverState.sckt-1; // so -1 if no socket
 
-      int theClient = netAccept(net, sckt);
+      int theClient = socketNeedsIdle(net, sckt) ? netAccept(net, sckt) : -1;
       if (theClient >= 0) {
-        SocketType socketType = socketGetType(server);
+        socketSetPending(theClient); // so we look at the new connection
+        SocketType socketType = serverState.type;
         if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
           JsVar *req = jspNewObject(0, "httpSRq");
           JsVar *res = jspNewObject(0, "httpSRs");
           if (res && req) { // out of memory?
-            socketSetType(req, ST_HTTP);
+            socketNewState(req, ST_HTTP, theClient);
+            socketNewState(res, ST_HTTP, theClient); // so writes to the response know which socket to check
             JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, true);
             if (arr) {
               jsvArrayPush(arr, req);
@@ -627,20 +1031,18 @@ bool socketIdle(JsNetwork *net) {
             }
             jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
             jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
-            jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(theClient+1));
           }
           jsvUnLock2(req, res);
         } else {
           // Normal sockets
           JsVar *sock = jspNewObject(0, "Socket");
           if (sock) { // out of memory?
-            socketSetType(sock, ST_NORMAL);
+            socketNewState(sock, ST_NORMAL, theClient);
             JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS, true);
             if (arr) {
               jsvArrayPush(arr, sock);
               jsvUnLock(arr);
             }
-            jsvObjectSetChildAndUnLock(sock, HTTP_NAME_SOCKET, jsvNewFromInteger(theClient+1));
             jsiQueueObjectCallbacks(server, HTTP_NAME_ON_CONNECT, &sock, 1);
             jsvUnLock(sock);
           }
@@ -655,6 +1057,7 @@ bool socketIdle(JsNetwork *net) {
   }
 
   if (socketServerConnectionsIdle(net)) hadSockets = true;
+  socketPoolIdle(net);
   if (socketClientConnectionsIdle(net)) hadSockets = true;
   netCheckError(net);
   return hadSockets;
@@ -665,7 +1068,7 @@ bool socketIdle(JsNetwork *net) {
 JsVar *serverNew(SocketType socketType, JsVar *callback) {
   JsVar *server = jspNewObject(0, ((socketType&ST_TYPE_MASK)==ST_HTTP) ? "httpSrv" : "Server");
   if (!server) return 0; // out of memory
-  socketSetType(server, socketType);
+  socketNewState(server, socketType, -1);
   jsvObjectSetChild(server, HTTP_NAME_ON_CONNECT, callback); // no unlock needed
   return server;
 }
@@ -676,12 +1079,16 @@ void serverListen(JsNetwork *net, JsVar *server, int port) {
 
   jsvObjectSetChildAndUnLock(server, HTTP_NAME_PORT, jsvNewFromInteger(port));
 
+  SocketState state;
+  socketGetState(server, &state);
   int sckt = netCreateSocket(net, 0/*server*/, (unsigned short)port, NCF_NORMAL, 0 /*options*/);
   if (sckt<0) {
     jsError("Unable to create socket\n");
-    jsvObjectSetChildAndUnLock(server, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
+    state.flags |= SF_CLOSE_NOW;
+    socketSetState(server, &state);
   } else {
-    jsvObjectSetChildAndUnLock(server, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+    state.sckt = sckt+1;
+    socketSetState(server, &state);
     // add to list of servers
     jsvArrayPush(arr, server);
   }
@@ -717,7 +1124,13 @@ JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback)
     req = jspNewObject(0, "Socket");
   }
   if (req) { // out of memory?
-   socketSetType(req, socketType);
+   socketNewState(req, socketType, -1);
+   if ((socketType&ST_TYPE_MASK)==ST_HTTP && socketGetAgentInt(options, "keepAlive", 0)) {
+     SocketState state;
+     socketGetState(req, &state);
+     state.flags |= SF_KEEP_ALIVE;
+     socketSetState(req, &state);
+   }
    if (callback != NULL)
      jsvUnLock(jsvAddNamedChild(req, callback, HTTP_NAME_ON_CONNECT));
 
@@ -731,20 +1144,26 @@ JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback)
 }
 
 void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
-  SocketType socketType = socketGetType(httpClientReqVar);
+  SocketState state;
+  socketGetState(httpClientReqVar, &state);
+  socketSetPendingFor(&state);
+  SocketType socketType = state.type;
   // Append data to sendData
   JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
   if (!sendData) {
     JsVar *options = 0;
     // Only append a header if we're doing HTTP AND we haven't already connected
     if ((socketType&ST_TYPE_MASK) == ST_HTTP)
-      if (jsvGetIntegerAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SOCKET, 0))==0)
+      if (!state.sckt)
         options = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_OPTIONS_VAR, 0);
     if (options) {
       // We're an HTTP client - make a header
       JsVar *method = jsvObjectGetChild(options, "method", 0);
       JsVar *path = jsvObjectGetChild(options, "path", 0);
-      sendData = jsvVarPrintf("%v %v HTTP/1.0\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: close\r\n", method, path);
+      if (state.flags & SF_KEEP_ALIVE)
+        sendData = jsvVarPrintf("%v %v HTTP/1.1\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: keep-alive\r\n", method, path);
+      else
+        sendData = jsvVarPrintf("%v %v HTTP/1.0\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: close\r\n", method, path);
       jsvUnLock2(method, path);
       JsVar *headers = jsvObjectGetChild(options, "headers", 0);
       bool hasHostHeader = false;
@@ -755,7 +1174,8 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
         httpAppendHeaders(sendData, headers);
         // if Transfer-Encoding:chunked was set, subsequent writes need to 'chunk' the data that is sent
         if (jsvIsStringEqualAndUnLock(jsvObjectGetChild(headers, "Transfer-Encoding", 0), "chunked")) {
-          jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+          state.flags |= SF_CHUNKED;
+          socketSetState(httpClientReqVar, &state);
         }
       }
       jsvUnLock(headers);
@@ -783,7 +1203,7 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
     JsVar *s = jsvAsString(data, false);
     if (s) {
       if ((socketType&ST_TYPE_MASK) == ST_HTTP &&
-          jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0))) {
+          (state.flags & SF_CHUNKED)) {
         // If we asked to send 'chunked' data, we need to wrap it up,
         // prefixed with the length
         jsvAppendPrintf(sendData, "%x\r\n%v\r\n", jsvGetStringLength(s), s);
@@ -803,12 +1223,38 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
 // Connect this connection/socket
 void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
   // Have we already connected? If so, don't go further
-  if (jsvGetIntegerAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SOCKET, 0))>0)
+  SocketState state;
+  socketGetState(httpClientReqVar, &state);
+  if (state.sckt)
     return;
 
-  SocketType socketType = socketGetType(httpClientReqVar);
+  SocketType socketType = state.type;
 
   JsVar *options = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_OPTIONS_VAR, false);
+  if (state.flags & SF_KEEP_ALIVE) {
+    // use an idle socket that's already connected to this host if we can
+    int sckt = socketPoolTake(options);
+    if (sckt<0) {
+      JsVarInt maxSockets = socketGetAgentInt(options, "maxSockets", 0);
+      if (maxSockets>0 && socketAgentSocketsInUse(options)>=maxSockets) {
+        // too many sockets already - wait until one is free (socketClientConnectionsIdle calls us again)
+        state.flags |= SF_WAITING;
+        socketSetState(httpClientReqVar, &state);
+        jsvUnLock(options);
+        return;
+      }
+    }
+    state.flags &= (unsigned char)~SF_WAITING;
+    if (sckt>=0) {
+      state.flags |= SF_CONNECTED;
+      state.sckt = sckt+1;
+      socketSetState(httpClientReqVar, &state);
+      socketSetPending(sckt); // so we start sending straight away
+      jsvUnLock(options);
+      return;
+    }
+    socketSetState(httpClientReqVar, &state);
+  }
   unsigned short port = (unsigned short)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
 
   char hostName[128];
@@ -825,7 +1271,8 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
   if(!host_addr) {
     jsError("Unable to locate host\n");
     // As this is already in the list of connections, an error will be thrown on idle anyway
-    jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
+    state.flags |= SF_CLOSE_NOW;
+    socketSetState(httpClientReqVar, &state);
     jsvUnLock(options);
     netCheckError(net);
     return;
@@ -845,9 +1292,12 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
   if (sckt<0) {
     jsError("Unable to create socket\n");
     // As this is already in the list of connections, an error will be thrown on idle anyway
-    jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
+    state.flags |= SF_CLOSE_NOW;
+    socketSetState(httpClientReqVar, &state);
   } else {
-    jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+    state.sckt = sckt+1;
+    socketSetState(httpClientReqVar, &state);
+    socketSetPending(sckt); // so we start sending as soon as we can
   }
 
   jsvUnLock(options);
@@ -857,10 +1307,13 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
 
 // 'end' this connection
 void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar) {
-  SocketType socketType = socketGetType(httpClientReqVar);
+  SocketState state;
+  socketGetState(httpClientReqVar, &state);
+  socketSetPendingFor(&state);
+  SocketType socketType = state.type;
   if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
     JsVar *finalData = 0;
-    if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0))) {
+    if (state.flags & SF_CHUNKED) {
       // If we were asked to send 'chunked' data, we need to finish up
       finalData = jsvNewFromString("");
     }
@@ -870,17 +1323,21 @@ void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar) {
     jsvUnLock(finalData);
   } else {
     // on normal sockets, we actually request close after all data sent
-    jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CLOSE, jsvNewFromBool(true));
+    state.flags |= SF_CLOSE;
     // if we never sent any data, make sure we close 'now'
     JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
     if (!sendData || jsvIsEmptyString(sendData))
-      jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
+      state.flags |= SF_CLOSE_NOW;
     jsvUnLock(sendData);
+    socketSetState(httpClientReqVar, &state);
   }
 }
 
 
 void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar *headers) {
+  SocketState state;
+  socketGetState(httpServerResponseVar, &state);
+  socketSetPendingFor(&state);
   if (!jsvIsUndefined(headers) && !jsvIsObject(headers)) {
     jsError("Headers sent to writeHead should be an object");
     return;
@@ -903,6 +1360,9 @@ void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar
 
 
 void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
+  SocketState state;
+  socketGetState(httpServerResponseVar, &state);
+  socketSetPendingFor(&state);
   // Append data to sendData
   JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
   if (!sendData) {
@@ -924,6 +1384,9 @@ void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
 void serverResponseEnd(JsVar *httpServerResponseVar) {
   serverResponseWrite(httpServerResponseVar, 0); // force connection->sendData to be created even if data not called
   // TODO: This should only close the connection once the received data length == contentLength header
-  jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_CLOSE, jsvNewFromBool(true));
+  SocketState state;
+  socketGetState(httpServerResponseVar, &state);
+  state.flags |= SF_CLOSE;
+  socketSetState(httpServerResponseVar, &state);
 }
 
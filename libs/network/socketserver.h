@@ -34,6 +34,8 @@ typedef enum {
 void socketInit();
 void socketKill(JsNetwork *net);
 bool socketIdle(JsNetwork *net);
+/// Are there any servers or connections open?
+bool socketHasConnections();
 
 // -----------------------------
 JsVar *serverNew(SocketType socketType, JsVar *callback);
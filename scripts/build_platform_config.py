@@ -312,7 +312,7 @@ if "default_console_baudrate" in board.info:
 
 codeOut("");
 if LINUX:
-  bufferSizeIO = 256
+  bufferSizeIO = 1024
   bufferSizeTX = 256
   bufferSizeTimer = 16
 else:
@@ -322,9 +322,17 @@ else:
 
 if 'util_timer_tasks' in board.info:
   bufferSizeTimer = board.info['util_timer_tasks']
+if 'io_buffer_size' in board.info:
+  bufferSizeIO = board.info['io_buffer_size']
+if 'tx_buffer_size' in board.info:
+  bufferSizeTX = board.info['tx_buffer_size']
 
-codeOut("#define IOBUFFERMASK "+str(bufferSizeIO-1)+" // (max 255) amount of items in event buffer - events take ~9 bytes each")
-codeOut("#define TXBUFFERMASK "+str(bufferSizeTX-1)+" // (max 255)")
+for name,size in [("io_buffer_size",bufferSizeIO),("tx_buffer_size",bufferSizeTX)]:
+  if size<2 or size>65536 or (size&(size-1))!=0:
+    die(name+" must be a power of 2, between 2 and 65536")
+
+codeOut("#define IOBUFFERMASK "+str(bufferSizeIO-1)+" // (max 65535) amount of items in event buffer - events take ~9 bytes each")
+codeOut("#define TXBUFFERMASK "+str(bufferSizeTX-1)+" // (max 65535)")
 codeOut("#define UTILTIMERTASK_TASKS ("+str(bufferSizeTimer)+") // Must be power of 2 - and max 256")
 
 codeOut("");
@@ -0,0 +1,962 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Bytecode compiler and interpreter for functions marked with "bytecode"
+ *
+ * Normally we execute JS as we parse it, which means every time round a loop
+ * we parse the code again. If a function starts with "bytecode" we instead
+ * compile it (once, when it is defined) into code for a simple stack machine
+ * which works on the normal JsVars. Anything we can't compile (eg. nested
+ * functions, try/catch, switch, for..in) just means the function is executed
+ * from source as before.
+ *
+ * Bytecode is stored in a flat string as:
+ *
+ *   [max stack depth] [local count] [local names, zero terminated...] [code...]
+ *
+ * Local variables (parameters and 'var's) are looked up once when the
+ * function starts, so accessing them doesn't need a search of the scopes.
+ * ----------------------------------------------------------------------------
+ */
+#include "jsbytecode.h"
+#include "jsparse.h"
+#include "jslex.h"
+
+typedef enum {
+  JSB_END,            ///< end of the function - return undefined
+  JSB_UNDEFINED,      ///< push undefined
+  JSB_NULL,           ///< push null
+  JSB_TRUE,           ///< push true
+  JSB_FALSE,          ///< push false
+  JSB_THIS,           ///< push 'this'
+  JSB_INT8,           ///< push an integer, followed by 1 signed byte
+  JSB_INT32,          ///< push an integer, followed by 4 bytes
+  JSB_FLOAT,          ///< push a float, followed by sizeof(JsVarFloat) bytes
+  JSB_STRING,         ///< push a string, followed by a 2 byte length and then the characters
+  JSB_ARRAY,          ///< pop N values and push an array containing them, followed by 1 byte N
+  JSB_LOCAL,          ///< push the name of a local variable, followed by 1 byte index
+  JSB_NAME,           ///< push a variable from the scopes, followed by its zero terminated name
+  JSB_FIELD,          ///< pop an object and push the name of its field, followed by the zero terminated field name
+  JSB_FIELD_PARENT,   ///< as JSB_FIELD, but leave the object on the stack beneath the field (for method calls)
+  JSB_INDEX,          ///< pop an index and an object, and push the name of the object's field
+  JSB_INDEX_PARENT,   ///< as JSB_INDEX, but leave the object on the stack beneath the field (for method calls)
+  JSB_CALL,           ///< call a function with N arguments, followed by 1 byte N
+  JSB_CALL_METHOD,    ///< as JSB_CALL, but the parent ('this') is beneath the function on the stack
+  JSB_POP,            ///< pop a value and forget it
+  JSB_ASSIGN,         ///< pop a value and assign it to the name on the top of the stack, followed by the operator
+  JSB_MATHSOP,        ///< pop b and a, then push 'a op b', followed by the operator
+  JSB_UNARY,          ///< pop a and push 'op a', followed by the operator ('!','~','-','+' or LEX_R_TYPEOF)
+  JSB_PREFIX,         ///< ++a or --a on the top of the stack, followed by '+' or '-'
+  JSB_POSTFIX,        ///< a++ or a-- on the top of the stack, followed by '+' or '-'
+  JSB_JUMP,           ///< jump, followed by a 2 byte relative offset
+  JSB_JUMP_IF_FALSE,  ///< pop a value and jump if it is false
+  JSB_JUMP_IF_FALSE_OR_POP, ///< jump if the top of the stack is false (leaving it there), else pop it - for &&
+  JSB_JUMP_IF_TRUE_OR_POP,  ///< jump if the top of the stack is true (leaving it there), else pop it - for ||
+  JSB_RETURN,         ///< pop a value and return it
+  JSB_THROW,          ///< pop a value and throw it as an exception
+} PACKED_FLAGS JsbOpcode;
+
+#define JSB_MAX_STACK 255
+#define JSB_MAX_LOCALS 255
+#define JSB_MAX_CODE_LENGTH 32767 // so jumps fit in 16 bits
+
+// Operators are stored in one byte, the same way as in pretokenised code
+static unsigned char jsbTokenToByte(int tk) {
+  return (tk>=LEX_ID) ? LEX_TOKENISED_CHAR(tk) : (unsigned char)tk;
+}
+static int jsbByteToToken(unsigned char ch) {
+  return LEX_IS_TOKENISED_CHAR(ch) ? LEX_TOKENISED_TOKEN(ch) : ch;
+}
+
+// ----------------------------------------------------------------------------
+//                                                                     COMPILER
+
+typedef struct {
+  char *code;            ///< Where code is written, or 0 if we're just working out the size
+  size_t length;         ///< Amount of code so far
+  int stackDepth;        ///< How many items will be on the stack when executing at this point
+  int maxStackDepth;     ///< The most items that will ever be on the stack
+  JsVar *locals;         ///< Array of local variable names (parameters first)
+  bool inLoop;           ///< Are we in a loop (so we can use break/continue)?
+  size_t breakChain;     ///< Position of the last 'break' jump (each one points to the one before), or 0
+  size_t continueChain;  ///< Position of the last 'continue' jump, or 0
+} JsbCompiler;
+
+/// The compiler that is currently in use
+static JsbCompiler *jsbc;
+
+#define JSB_CHECK(X) if (!(X)) return false
+#define JSB_MATCH(TK) if (lex->tk!=(TK)) return false; jslGetNextToken()
+
+static bool jsbExpression();
+static bool jsbAssignmentExpression();
+static bool jsbUnaryExpression();
+static bool jsbStatement();
+
+static void jsbEmit(unsigned char ch) {
+  if (jsbc->code) jsbc->code[jsbc->length] = (char)ch;
+  jsbc->length++;
+}
+
+static void jsbEmitData(const void *data, size_t len) {
+  if (jsbc->code) memcpy(&jsbc->code[jsbc->length], data, len);
+  jsbc->length += len;
+}
+
+/// Emit an opcode, which changes the number of items on the stack by stackChange
+static void jsbEmitOp(JsbOpcode op, int stackChange) {
+  jsbEmit((unsigned char)op);
+  jsbc->stackDepth += stackChange;
+  if (jsbc->stackDepth > jsbc->maxStackDepth)
+    jsbc->maxStackDepth = jsbc->stackDepth;
+}
+
+/// Set the target of a jump at the given position
+static void jsbSetJumpTarget(size_t pos, size_t target) {
+  if (!jsbc->code) return;
+  int16_t offset = (int16_t)((int)target - (int)(pos+2));
+  memcpy(&jsbc->code[pos], &offset, 2);
+}
+
+/// Emit a jump to target (which can be set later with jsbSetJumpTarget). Returns the position of the jump
+static size_t jsbEmitJump(JsbOpcode op, int stackChange, size_t target) {
+  jsbEmitOp(op, stackChange);
+  size_t pos = jsbc->length;
+  jsbc->length += 2;
+  jsbSetJumpTarget(pos, target);
+  return pos;
+}
+
+/** Emit a jump whose target isn't known yet (for break/continue). While we're
+ * compiling, the jump holds the position of the last jump in the chain */
+static void jsbEmitChainedJump(size_t *chain) {
+  size_t pos = jsbEmitJump(JSB_JUMP, 0, 0);
+  if (jsbc->code) {
+    uint16_t link = (uint16_t)*chain;
+    memcpy(&jsbc->code[pos], &link, 2);
+  }
+  *chain = pos;
+}
+
+/// Point all the jumps in a chain at the target
+static void jsbSetChainTarget(size_t chain, size_t target) {
+  while (chain && jsbc->code) {
+    uint16_t link;
+    memcpy(&link, &jsbc->code[chain], 2);
+    jsbSetJumpTarget(chain, target);
+    chain = link;
+  }
+}
+
+/// Emit a zero-terminated string
+static void jsbEmitName(const char *name) {
+  jsbEmitData(name, strlen(name)+1);
+}
+
+/// Return the index of the given local variable, or -1
+static int jsbFindLocal(JsVar *name) {
+  JsVar *idx = jsvGetArrayIndexOf(jsbc->locals, name, false);
+  if (!idx) return -1;
+  return (int)jsvGetIntegerAndUnLock(idx);
+}
+
+static bool jsbIsAssignmentOp(int tk) {
+  return tk=='=' || tk==LEX_PLUSEQUAL || tk==LEX_MINUSEQUAL ||
+         tk==LEX_MULEQUAL || tk==LEX_DIVEQUAL || tk==LEX_MODEQUAL ||
+         tk==LEX_ANDEQUAL || tk==LEX_OREQUAL ||
+         tk==LEX_XOREQUAL || tk==LEX_RSHIFTEQUAL ||
+         tk==LEX_LSHIFTEQUAL || tk==LEX_RSHIFTUNSIGNEDEQUAL;
+}
+
+static void jsbEmitInteger(long long v) {
+  if (v>=-128 && v<=127) {
+    jsbEmitOp(JSB_INT8, 1);
+    jsbEmit((unsigned char)(signed char)v);
+  } else if (v>=-2147483648LL && v<=2147483647LL) {
+    int32_t i = (int32_t)v;
+    jsbEmitOp(JSB_INT32, 1);
+    jsbEmitData(&i, sizeof(i));
+  } else { // as for jsvNewFromLongInteger
+    JsVarFloat f = (JsVarFloat)v;
+    jsbEmitOp(JSB_FLOAT, 1);
+    jsbEmitData(&f, sizeof(f));
+  }
+}
+
+static bool jsbFactorArray() {
+  int count = 0;
+  JSB_MATCH('[');
+  while (lex->tk != ']') {
+    if (lex->tk==',') return false; // [1,,2] - leave holes to the interpreter
+    JSB_CHECK(jsbAssignmentExpression());
+    count++;
+    if (lex->tk != ']') { JSB_MATCH(','); }
+  }
+  JSB_MATCH(']');
+  if (count>255) return false;
+  jsbEmitOp(JSB_ARRAY, 1-count);
+  jsbEmit((unsigned char)count);
+  return true;
+}
+
+static bool jsbFactor() {
+  int tk = lex->tk;
+  if (tk==LEX_ID) {
+    JsVar *name = jslGetTokenValueAsVar();
+    int local = jsbFindLocal(name);
+    jsvUnLock(name);
+    if (local>=0) {
+      jsbEmitOp(JSB_LOCAL, 1);
+      jsbEmit((unsigned char)local);
+    } else {
+      jsbEmitOp(JSB_NAME, 1);
+      jsbEmitName(jslGetTokenValueAsString());
+    }
+  } else if (tk==LEX_INT) {
+    jsbEmitInteger(stringToInt(jslGetTokenValueAsString()));
+  } else if (tk==LEX_FLOAT) {
+    JsVarFloat f = stringToFloat(jslGetTokenValueAsString());
+    jsbEmitOp(JSB_FLOAT, 1);
+    jsbEmitData(&f, sizeof(f));
+  } else if (tk==LEX_STR) {
+    JsVar *str = jslGetTokenValueAsVar();
+    size_t len = jsvGetStringLength(str);
+    if (len>0xFFFF) {
+      jsvUnLock(str);
+      return false;
+    }
+    uint16_t l = (uint16_t)len;
+    jsbEmitOp(JSB_STRING, 1);
+    jsbEmitData(&l, 2);
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, str, 0);
+    while (jsvStringIteratorHasChar(&it)) {
+      jsbEmit((unsigned char)jsvStringIteratorGetChar(&it));
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+    jsvUnLock(str);
+  } else if (tk=='(') {
+    JSB_MATCH('(');
+    JSB_CHECK(jsbExpression());
+    JSB_MATCH(')');
+    return true;
+  } else if (tk=='[') {
+    return jsbFactorArray();
+  } else if (tk==LEX_R_TYPEOF) {
+    JSB_MATCH(LEX_R_TYPEOF);
+    JSB_CHECK(jsbUnaryExpression());
+    jsbEmitOp(JSB_UNARY, 0);
+    jsbEmit(jsbTokenToByte(LEX_R_TYPEOF));
+    return true;
+  } else if (tk==LEX_R_TRUE) jsbEmitOp(JSB_TRUE, 1);
+  else if (tk==LEX_R_FALSE) jsbEmitOp(JSB_FALSE, 1);
+  else if (tk==LEX_R_NULL) jsbEmitOp(JSB_NULL, 1);
+  else if (tk==LEX_R_UNDEFINED) jsbEmitOp(JSB_UNDEFINED, 1);
+  else if (tk==LEX_R_THIS) jsbEmitOp(JSB_THIS, 1);
+  else return false; // objects, functions, delete, void, etc
+  jslGetNextToken();
+  return true;
+}
+
+/// Factor, followed by any number of member accesses and function calls
+static bool jsbFactorFunctionCall() {
+  JSB_CHECK(jsbFactor());
+  bool hasParent = false;
+  while (lex->tk=='.' || lex->tk=='[' || lex->tk=='(') {
+    if (lex->tk=='.') {
+      JSB_MATCH('.');
+      if (!jslIsIDOrReservedWord()) return false;
+      char name[JSLEX_MAX_TOKEN_LENGTH];
+      strcpy(name, jslGetTokenValueAsString());
+      jslGetNextToken();
+      // If we're going to call it, we need to keep the parent for 'this'
+      hasParent = lex->tk=='(';
+      jsbEmitOp(hasParent ? JSB_FIELD_PARENT : JSB_FIELD, hasParent ? 1 : 0);
+      jsbEmitName(name);
+    } else if (lex->tk=='[') {
+      JSB_MATCH('[');
+      JSB_CHECK(jsbAssignmentExpression());
+      JSB_MATCH(']');
+      hasParent = lex->tk=='(';
+      jsbEmitOp(hasParent ? JSB_INDEX_PARENT : JSB_INDEX, hasParent ? 0 : -1);
+    } else {
+      int argCount = 0;
+      JSB_MATCH('(');
+      while (lex->tk!=')') {
+        JSB_CHECK(jsbAssignmentExpression());
+        argCount++;
+        if (lex->tk!=')') { JSB_MATCH(','); }
+      }
+      JSB_MATCH(')');
+      if (argCount>255) return false;
+      jsbEmitOp(hasParent ? JSB_CALL_METHOD : JSB_CALL, -(argCount + (hasParent?1:0)));
+      jsbEmit((unsigned char)argCount);
+      hasParent = false;
+    }
+  }
+  return true;
+}
+
+static bool jsbPostfixExpression() {
+  if (lex->tk==LEX_PLUSPLUS || lex->tk==LEX_MINUSMINUS) {
+    int op = lex->tk;
+    jslGetNextToken();
+    JSB_CHECK(jsbPostfixExpression());
+    jsbEmitOp(JSB_PREFIX, 0);
+    jsbEmit(op==LEX_PLUSPLUS ? '+' : '-');
+  } else {
+    if (lex->tk==LEX_R_NEW) return false;
+    JSB_CHECK(jsbFactorFunctionCall());
+  }
+  while (lex->tk==LEX_PLUSPLUS || lex->tk==LEX_MINUSMINUS) {
+    int op = lex->tk;
+    jslGetNextToken();
+    jsbEmitOp(JSB_POSTFIX, 0);
+    jsbEmit(op==LEX_PLUSPLUS ? '+' : '-');
+  }
+  return true;
+}
+
+static bool jsbUnaryExpression() {
+  if (lex->tk=='!' || lex->tk=='~' || lex->tk=='-' || lex->tk=='+') {
+    int op = lex->tk;
+    jslGetNextToken();
+    JSB_CHECK(jsbUnaryExpression());
+    jsbEmitOp(JSB_UNARY, 0);
+    jsbEmit((unsigned char)op);
+    return true;
+  }
+  return jsbPostfixExpression();
+}
+
+/// As __jspeBinaryExpression - the left hand side has already been compiled
+static bool jsbBinaryExpression(unsigned int lastPrecedence) {
+  unsigned int precedence = jspeGetBinaryExpressionPrecedence(lex->tk);
+  while (precedence && precedence>lastPrecedence) {
+    int op = lex->tk;
+    if (op==LEX_R_IN || op==LEX_R_INSTANCEOF) return false;
+    jslGetNextToken();
+    if (op==LEX_ANDAND || op==LEX_OROR) {
+      // Short-circuit - if we know the outcome, don't evaluate the right hand side
+      size_t jump = jsbEmitJump(op==LEX_ANDAND ? JSB_JUMP_IF_FALSE_OR_POP : JSB_JUMP_IF_TRUE_OR_POP, -1, 0);
+      JSB_CHECK(jsbUnaryExpression());
+      JSB_CHECK(jsbBinaryExpression(precedence));
+      jsbSetJumpTarget(jump, jsbc->length);
+    } else {
+      JSB_CHECK(jsbUnaryExpression());
+      JSB_CHECK(jsbBinaryExpression(precedence));
+      jsbEmitOp(JSB_MATHSOP, -1);
+      jsbEmit(jsbTokenToByte(op));
+    }
+    precedence = jspeGetBinaryExpressionPrecedence(lex->tk);
+  }
+  return true;
+}
+
+static bool jsbConditionalExpression() {
+  JSB_CHECK(jsbUnaryExpression());
+  JSB_CHECK(jsbBinaryExpression(0));
+  if (lex->tk=='?') {
+    JSB_MATCH('?');
+    size_t jumpElse = jsbEmitJump(JSB_JUMP_IF_FALSE, -1, 0);
+    JSB_CHECK(jsbAssignmentExpression());
+    JSB_MATCH(':');
+    size_t jumpEnd = jsbEmitJump(JSB_JUMP, -1, 0); // -1 because the other branch starts without our result
+    jsbSetJumpTarget(jumpElse, jsbc->length);
+    JSB_CHECK(jsbAssignmentExpression());
+    jsbSetJumpTarget(jumpEnd, jsbc->length);
+  }
+  return true;
+}
+
+static bool jsbAssignmentExpression() {
+  JSB_CHECK(jsbConditionalExpression());
+  if (jsbIsAssignmentOp(lex->tk)) {
+    int op = lex->tk;
+    jslGetNextToken();
+    JSB_CHECK(jsbAssignmentExpression());
+    jsbEmitOp(JSB_ASSIGN, -1);
+    jsbEmit(jsbTokenToByte(op));
+  }
+  return true;
+}
+
+static bool jsbExpression() {
+  JSB_CHECK(jsbAssignmentExpression());
+  while (lex->tk==',') {
+    jslGetNextToken();
+    jsbEmitOp(JSB_POP, -1);
+    JSB_CHECK(jsbAssignmentExpression());
+  }
+  return true;
+}
+
+static bool jsbBlockOrStatement() {
+  if (lex->tk=='{') return jsbStatement();
+  JSB_CHECK(jsbStatement());
+  if (lex->tk==';') jslGetNextToken();
+  return true;
+}
+
+static bool jsbStatementVar() {
+  JSB_MATCH(LEX_R_VAR);
+  bool hasComma = true;
+  while (hasComma && lex->tk==LEX_ID) {
+    JsVar *name = jslGetTokenValueAsVar();
+    int local = jsbFindLocal(name);
+    if (local<0) {
+      local = (int)jsvArrayPush(jsbc->locals, name) - 1;
+      if (local>=JSB_MAX_LOCALS) local = -1;
+    }
+    jsvUnLock(name);
+    if (local<0) return false;
+    JSB_MATCH(LEX_ID);
+    if (lex->tk=='=') {
+      JSB_MATCH('=');
+      jsbEmitOp(JSB_LOCAL, 1);
+      jsbEmit((unsigned char)local);
+      JSB_CHECK(jsbAssignmentExpression());
+      jsbEmitOp(JSB_ASSIGN, -1);
+      jsbEmit('=');
+      jsbEmitOp(JSB_POP, -1);
+    } else if (lex->tk=='.' || lex->tk=='[') {
+      return false; // eg. `var a.b`
+    }
+    hasComma = lex->tk==',';
+    if (hasComma) jslGetNextToken();
+  }
+  return true;
+}
+
+static bool jsbStatementIf() {
+  JSB_MATCH(LEX_R_IF);
+  JSB_MATCH('(');
+  JSB_CHECK(jsbExpression());
+  JSB_MATCH(')');
+  size_t jumpElse = jsbEmitJump(JSB_JUMP_IF_FALSE, -1, 0);
+  JSB_CHECK(jsbBlockOrStatement());
+  if (lex->tk==LEX_R_ELSE) {
+    JSB_MATCH(LEX_R_ELSE);
+    size_t jumpEnd = jsbEmitJump(JSB_JUMP, 0, 0);
+    jsbSetJumpTarget(jumpElse, jsbc->length);
+    JSB_CHECK(jsbBlockOrStatement());
+    jsbSetJumpTarget(jumpEnd, jsbc->length);
+  } else {
+    jsbSetJumpTarget(jumpElse, jsbc->length);
+  }
+  return true;
+}
+
+/// Compile the body of a loop. Any 'continue's jump to continueTarget (or the end of the body if it is 0)
+static bool jsbLoopBody(size_t *breakChain, size_t continueTarget) {
+  bool wasInLoop = jsbc->inLoop;
+  size_t oldBreakChain = jsbc->breakChain;
+  size_t oldContinueChain = jsbc->continueChain;
+  jsbc->inLoop = true;
+  jsbc->breakChain = 0;
+  jsbc->continueChain = 0;
+  bool ok = jsbBlockOrStatement();
+  jsbSetChainTarget(jsbc->continueChain, continueTarget ? continueTarget : jsbc->length);
+  *breakChain = jsbc->breakChain;
+  jsbc->inLoop = wasInLoop;
+  jsbc->breakChain = oldBreakChain;
+  jsbc->continueChain = oldContinueChain;
+  return ok;
+}
+
+static bool jsbStatementDoOrWhile(bool isWhile) {
+  size_t breakChain;
+  size_t loopStart = jsbc->length;
+  if (isWhile) {
+    JSB_MATCH(LEX_R_WHILE);
+    JSB_MATCH('(');
+    JSB_CHECK(jsbAssignmentExpression());
+    JSB_MATCH(')');
+    size_t jumpEnd = jsbEmitJump(JSB_JUMP_IF_FALSE, -1, 0);
+    JSB_CHECK(jsbLoopBody(&breakChain, loopStart));
+    jsbEmitJump(JSB_JUMP, 0, loopStart);
+    jsbSetJumpTarget(jumpEnd, jsbc->length);
+  } else {
+    JSB_MATCH(LEX_R_DO);
+    JSB_CHECK(jsbLoopBody(&breakChain, 0));
+    JSB_MATCH(LEX_R_WHILE);
+    JSB_MATCH('(');
+    JSB_CHECK(jsbAssignmentExpression());
+    JSB_MATCH(')');
+    size_t jumpEnd = jsbEmitJump(JSB_JUMP_IF_FALSE, -1, 0);
+    jsbEmitJump(JSB_JUMP, 0, loopStart);
+    jsbSetJumpTarget(jumpEnd, jsbc->length);
+  }
+  jsbSetChainTarget(breakChain, jsbc->length);
+  return true;
+}
+
+/* for (init;cond;step) body - compiled as:
+ *
+ *   init
+ * loopStart:
+ *   if (!cond) goto end
+ *   body
+ *   step
+ *   goto loopStart
+ * end:
+ *
+ * The step comes before the body in the source, so we skip over it and come back */
+static bool jsbStatementFor() {
+  JSB_MATCH(LEX_R_FOR);
+  JSB_MATCH('(');
+  if (lex->tk != ';') {
+    JSB_CHECK(jsbStatement());
+  }
+  JSB_MATCH(';');
+  size_t loopStart = jsbc->length;
+  size_t jumpEnd = 0;
+  if (lex->tk != ';') {
+    JSB_CHECK(jsbExpression());
+    jumpEnd = jsbEmitJump(JSB_JUMP_IF_FALSE, -1, 0);
+  }
+  JSB_MATCH(';');
+  JslCharPos stepStart = jslCharPosClone(&lex->tokenStart);
+  bool hasStep = lex->tk != ')';
+  int brackets = 0;
+  while (lex->tk && (brackets || lex->tk != ')')) {
+    if (lex->tk == '(') brackets++;
+    if (lex->tk == ')') brackets--;
+    jslGetNextToken();
+  }
+  bool ok = lex->tk==')';
+  if (ok) {
+    jslGetNextToken();
+    size_t breakChain;
+    ok = jsbLoopBody(&breakChain, 0);
+    if (ok && hasStep) {
+      JslCharPos bodyEnd = jslCharPosClone(&lex->tokenStart);
+      jslSeekToP(&stepStart);
+      ok = jsbExpression() && lex->tk==')';
+      jsbEmitOp(JSB_POP, -1);
+      jslSeekToP(&bodyEnd);
+      jslCharPosFree(&bodyEnd);
+    }
+    jsbEmitJump(JSB_JUMP, 0, loopStart);
+    if (jumpEnd) jsbSetJumpTarget(jumpEnd, jsbc->length);
+    jsbSetChainTarget(breakChain, jsbc->length);
+  }
+  jslCharPosFree(&stepStart);
+  return ok;
+}
+
+static bool jsbStatement() {
+  int tk = lex->tk;
+  if (tk==LEX_ID || tk==LEX_INT || tk==LEX_FLOAT || tk==LEX_STR ||
+      tk==LEX_R_NULL || tk==LEX_R_UNDEFINED || tk==LEX_R_TRUE ||
+      tk==LEX_R_FALSE || tk==LEX_R_THIS || tk==LEX_R_TYPEOF ||
+      tk==LEX_PLUSPLUS || tk==LEX_MINUSMINUS ||
+      tk=='!' || tk=='-' || tk=='+' || tk=='~' || tk=='[' || tk=='(') {
+    JSB_CHECK(jsbExpression());
+    jsbEmitOp(JSB_POP, -1);
+  } else if (tk=='{') {
+    JSB_MATCH('{');
+    while (lex->tk && lex->tk!='}')
+      JSB_CHECK(jsbStatement());
+    JSB_MATCH('}');
+  } else if (tk==';') {
+    JSB_MATCH(';');
+  } else if (tk==LEX_R_VAR) {
+    return jsbStatementVar();
+  } else if (tk==LEX_R_IF) {
+    return jsbStatementIf();
+  } else if (tk==LEX_R_DO) {
+    return jsbStatementDoOrWhile(false);
+  } else if (tk==LEX_R_WHILE) {
+    return jsbStatementDoOrWhile(true);
+  } else if (tk==LEX_R_FOR) {
+    return jsbStatementFor();
+  } else if (tk==LEX_R_RETURN) {
+    JSB_MATCH(LEX_R_RETURN);
+    if (lex->tk != ';' && lex->tk != '}' && lex->tk != LEX_EOF) {
+      JSB_CHECK(jsbExpression());
+    } else
+      jsbEmitOp(JSB_UNDEFINED, 1);
+    jsbEmitOp(JSB_RETURN, -1);
+  } else if (tk==LEX_R_THROW) {
+    JSB_MATCH(LEX_R_THROW);
+    JSB_CHECK(jsbExpression());
+    jsbEmitOp(JSB_THROW, -1);
+  } else if (tk==LEX_R_BREAK || tk==LEX_R_CONTINUE) {
+    // leave errors for break/continue outside loops to the interpreter
+    if (!jsbc->inLoop) return false;
+    jslGetNextToken();
+    jsbEmitChainedJump(tk==LEX_R_BREAK ? &jsbc->breakChain : &jsbc->continueChain);
+  } else {
+    return false; // function, try, switch, etc
+  }
+  return true;
+}
+
+/// Compile the function's code into 'code' (or if code==0, just work out how big it will be)
+static bool jsbCompilePass(JsVar *funcVar, JsVar *funcCode, char *code) {
+  jsbc->code = code;
+  jsbc->length = 0;
+  jsbc->stackDepth = 0;
+  jsbc->maxStackDepth = 0;
+  jsbc->inLoop = false;
+  jsbc->breakChain = 0;
+  jsbc->continueChain = 0;
+  // Parameters are the first locals
+  jsbc->locals = jsvNewEmptyArray();
+  if (!jsbc->locals) return false;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, funcVar);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *param = jsvObjectIteratorGetKey(&it);
+    if (jsvIsFunctionParameter(param))
+      jsvArrayPushAndUnLock(jsbc->locals, jsvNewFromStringVar(param, 0, JSVAPPENDSTRINGVAR_MAXLENGTH));
+    jsvUnLock(param);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+
+  jslInit(funcCode);
+  // skip over the "bytecode" that told us to compile this
+  if (lex->tk==LEX_STR && !strcmp(jslGetTokenValueAsString(), "bytecode"))
+    jslGetNextToken();
+  bool ok = true;
+  while (ok && lex->tk!=LEX_EOF)
+    ok = jsbStatement();
+  jsbEmitOp(JSB_END, 0);
+  jslKill();
+  return ok && !jspHasError() &&
+         jsbc->maxStackDepth <= JSB_MAX_STACK &&
+         jsvGetArrayLength(jsbc->locals) <= JSB_MAX_LOCALS &&
+         jsbc->length <= JSB_MAX_CODE_LENGTH;
+}
+
+JsVar *jsbCompile(JsVar *funcVar, JsVar *funcCode) {
+  JsbCompiler compiler;
+  JsbCompiler *oldCompiler = jsbc;
+  jsbc = &compiler;
+  JsLex newLex;
+  JsLex *oldLex = jslSetLex(&newLex);
+
+  JsVar *bytecode = 0;
+  // First pass works out the size and which locals we have, second one fills in the code
+  if (jsbCompilePass(funcVar, funcCode, 0)) {
+    JsVar *locals = compiler.locals;
+    unsigned char maxStackDepth = (unsigned char)compiler.maxStackDepth;
+    size_t headerLength = 2;
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, locals);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *name = jsvObjectIteratorGetValue(&it);
+      headerLength += jsvGetStringLength(name)+1;
+      jsvUnLock(name);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+
+    bytecode = jsvNewFlatStringOfLength((unsigned int)(headerLength + compiler.length));
+    if (bytecode) {
+      char *ptr = jsvGetFlatStringPointer(bytecode);
+      *(ptr++) = (char)maxStackDepth;
+      *(ptr++) = (char)jsvGetArrayLength(locals);
+      jsvObjectIteratorNew(&it, locals);
+      while (jsvObjectIteratorHasValue(&it)) {
+        JsVar *name = jsvObjectIteratorGetValue(&it);
+        ptr += jsvGetString(name, ptr, JSLEX_MAX_TOKEN_LENGTH)+1;
+        jsvUnLock(name);
+        jsvObjectIteratorNext(&it);
+      }
+      jsvObjectIteratorFree(&it);
+      if (!jsbCompilePass(funcVar, funcCode, ptr)) {
+        jsvUnLock(bytecode);
+        bytecode = 0;
+      }
+      jsvUnLock(compiler.locals);
+    }
+    jsvUnLock(locals);
+  } else
+    jsvUnLock(compiler.locals);
+
+  jslSetLex(oldLex);
+  jsbc = oldCompiler;
+  return bytecode;
+}
+
+// ----------------------------------------------------------------------------
+//                                                                  INTERPRETER
+
+/// Read a relative jump offset and return the new program counter
+static ALWAYS_INLINE const unsigned char *jsbJump(const unsigned char *pc) {
+  int16_t offset;
+  memcpy(&offset, pc, 2);
+  return pc + 2 + offset;
+}
+
+JsVar *jsbExecute(JsVar *bytecode, JsVar *functionRoot) {
+  const unsigned char *pc = (const unsigned char *)jsvGetFlatStringPointer(bytecode);
+  int stackSize = *(pc++);
+  int localCount = *(pc++);
+  JsVar **locals = (JsVar**)alloca(sizeof(JsVar*)*(size_t)(localCount+stackSize));
+  JsVar **stack = &locals[localCount];
+  int sp = 0;
+  int i;
+  // Find (or create) all our local variables
+  for (i=0;i<localCount;i++) {
+    locals[i] = jsvFindChildFromString(functionRoot, (const char*)pc, true);
+    if (!locals[i]) jspSetError(false); // out of memory
+    pc += strlen((const char*)pc)+1;
+  }
+
+  JsVar *returnVar = 0;
+  while (pc && !(execInfo.execute&EXEC_ERROR_MASK)) {
+    JsbOpcode op = (JsbOpcode)*(pc++);
+    switch (op) {
+    case JSB_END:
+      pc = 0;
+      break;
+    case JSB_UNDEFINED:
+      stack[sp++] = 0;
+      break;
+    case JSB_NULL:
+      stack[sp++] = jsvNewWithFlags(JSV_NULL);
+      break;
+    case JSB_TRUE:
+    case JSB_FALSE:
+      stack[sp++] = jsvNewFromBool(op==JSB_TRUE);
+      break;
+    case JSB_THIS:
+      stack[sp++] = jsvLockAgain(execInfo.thisVar ? execInfo.thisVar : execInfo.root);
+      break;
+    case JSB_INT8:
+      stack[sp++] = jsvNewFromInteger((signed char)*(pc++));
+      break;
+    case JSB_INT32: {
+      int32_t v;
+      memcpy(&v, pc, sizeof(v));
+      pc += sizeof(v);
+      stack[sp++] = jsvNewFromInteger(v);
+      break;
+    }
+    case JSB_FLOAT: {
+      JsVarFloat v;
+      memcpy(&v, pc, sizeof(v));
+      pc += sizeof(v);
+      stack[sp++] = jsvNewFromFloat(v);
+      break;
+    }
+    case JSB_STRING: {
+      uint16_t len;
+      memcpy(&len, pc, 2);
+      pc += 2;
+      JsVar *str = jsvNewStringOfLength(len);
+      if (str) jsvSetString(str, (const char*)pc, len);
+      pc += len;
+      stack[sp++] = str;
+      break;
+    }
+    case JSB_ARRAY: { // as jspeFactorArray
+      int count = *(pc++);
+      JsVar *contents = jsvNewEmptyArray();
+      sp -= count;
+      for (i=0;i<count;i++) {
+        JsVar *aVar = jsvSkipNameAndUnLock(stack[sp+i]);
+        JsVar *indexName = jsvMakeIntoVariableName(jsvNewFromInteger(i), aVar);
+        if (indexName && contents) jsvAddName(contents, indexName);
+        jsvUnLock2(indexName, aVar);
+      }
+      if (contents) jsvSetArrayLength(contents, count, false);
+      else jspSetError(false);
+      stack[sp++] = contents;
+      break;
+    }
+    case JSB_LOCAL:
+      stack[sp++] = jsvLockAgainSafe(locals[*(pc++)]);
+      break;
+    case JSB_NAME: {
+      const char *name = (const char*)pc;
+      pc += strlen(name)+1;
+      stack[sp++] = jspGetNamedVariable(name);
+      break;
+    }
+    case JSB_FIELD:
+    case JSB_FIELD_PARENT: { // as jspeFactorMember
+      const char *name = (const char*)pc;
+      pc += strlen(name)+1;
+      JsVar *a = stack[sp-1];
+      JsVar *aVar = jsvSkipName(a);
+      JsVar *child = 0;
+      if (aVar)
+        child = jspGetNamedField(aVar, name, true);
+      if (!child) {
+        if (jsvHasChildren(aVar)) {
+          // if no child found, create a pointer to where it could be
+          JsVar *nameVar = jsvNewFromString(name);
+          child = jsvCreateNewChild(aVar, nameVar, 0);
+          jsvUnLock(nameVar);
+        } else {
+          jsExceptionHere(JSET_ERROR, "Field or method \"%s\" does not already exist, and can't create it on %t", name, aVar);
+        }
+      }
+      jsvUnLock(a);
+      if (op==JSB_FIELD_PARENT) {
+        stack[sp-1] = aVar;
+        stack[sp++] = child;
+      } else {
+        jsvUnLock(aVar);
+        stack[sp-1] = child;
+      }
+      break;
+    }
+    case JSB_INDEX:
+    case JSB_INDEX_PARENT: { // as jspeFactorMember
+      JsVar *index = jsvAsArrayIndexAndUnLock(jsvSkipNameAndUnLock(stack[--sp]));
+      JsVar *a = stack[sp-1];
+      JsVar *aVar = jsvSkipName(a);
+      JsVar *child = 0;
+      if (aVar)
+        child = jspGetVarNamedField(aVar, index, true);
+      if (!child) {
+        if (jsvHasChildren(aVar)) {
+          child = jsvCreateNewChild(aVar, index, 0);
+        } else {
+          jsExceptionHere(JSET_ERROR, "Field or method %q does not already exist, and can't create it on %t", index, aVar);
+        }
+      }
+      jsvUnLock2(a, index);
+      if (op==JSB_INDEX_PARENT) {
+        stack[sp-1] = aVar;
+        stack[sp++] = child;
+      } else {
+        jsvUnLock(aVar);
+        stack[sp-1] = child;
+      }
+      break;
+    }
+    case JSB_CALL:
+    case JSB_CALL_METHOD: {
+      int argCount = *(pc++);
+      JsVar **args = &stack[sp-argCount];
+      for (i=0;i<argCount;i++)
+        args[i] = jsvSkipNameAndUnLock(args[i]);
+      sp -= argCount+1;
+      JsVar *funcName = stack[sp];
+      JsVar *parent = 0;
+      if (op==JSB_CALL_METHOD) parent = stack[--sp];
+      JsVar *func = jsvSkipName(funcName);
+      JsVar *result = jspeFunctionCall(func, funcName, parent, false, argCount, args);
+      jsvUnLockMany((unsigned)argCount, args);
+      jsvUnLock3(func, funcName, parent);
+      stack[sp++] = result;
+      break;
+    }
+    case JSB_POP:
+      jsvUnLock(stack[--sp]);
+      break;
+    case JSB_ASSIGN: {
+      int tk = jsbByteToToken(*(pc++));
+      JsVar *rhs = jsvSkipNameAndUnLock(stack[--sp]);
+      if (stack[sp-1])
+        jspAssign(stack[sp-1], tk, rhs);
+      jsvUnLock(rhs);
+      break;
+    }
+    case JSB_MATHSOP: {
+      int tk = jsbByteToToken(*(pc++));
+      JsVar *b = stack[--sp];
+      JsVar *a = stack[sp-1];
+      stack[sp-1] = jsvMathsOpSkipNamesAndUnLockA(a, b, tk);
+      jsvUnLock(b);
+      break;
+    }
+    case JSB_UNARY: { // as jspeUnaryExpression and jspeFactorTypeOf
+      int tk = jsbByteToToken(*(pc++));
+      JsVar *a = stack[sp-1];
+      JsVar *r;
+      if (tk=='!') r = jsvNewFromBool(!jsvGetBoolAndUnLock(jsvSkipNameAndUnLock(a)));
+      else if (tk=='~') r = jsvNewFromInteger(~jsvGetIntegerAndUnLock(jsvSkipNameAndUnLock(a)));
+      else if (tk=='-') r = jsvNegateAndUnLock(a);
+      else if (tk=='+') {
+        JsVar *v = jsvSkipNameAndUnLock(a);
+        r = jsvAsNumber(v);
+        jsvUnLock(v);
+      } else { // LEX_R_TYPEOF
+        if (!jsvIsVariableDefined(a)) {
+          r = jsvNewFromString("undefined");
+        } else {
+          a = jsvSkipNameAndUnLock(a);
+          r = jsvNewFromString(jsvGetTypeOf(a));
+        }
+        jsvUnLock(a);
+      }
+      stack[sp-1] = r;
+      break;
+    }
+    case JSB_PREFIX:
+    case JSB_POSTFIX: { // as jspePostfixExpression
+      int tk = *(pc++);
+      JsVar *a = stack[sp-1];
+      JsVar *one = jsvNewFromInteger(1);
+      if (op==JSB_PREFIX) {
+        JsVar *res = jsvMathsOpSkipNames(a, one, tk);
+        jspReplaceWith(a, res);
+        jsvUnLock(res);
+      } else {
+        JsVar *oldValue = jsvAsNumberAndUnLock(jsvSkipName(a)); // keep the old value (but convert to number)
+        JsVar *res = jsvMathsOpSkipNames(oldValue, one, tk);
+        jspReplaceWith(a, res);
+        jsvUnLock2(res, a);
+        stack[sp-1] = oldValue;
+      }
+      jsvUnLock(one);
+      break;
+    }
+    case JSB_JUMP:
+      pc = jsbJump(pc);
+      break;
+    case JSB_JUMP_IF_FALSE: {
+      JsVar *v = stack[--sp];
+      if (jsvGetBoolAndUnLock(jsvSkipNameAndUnLock(v))) pc += 2;
+      else pc = jsbJump(pc);
+      break;
+    }
+    case JSB_JUMP_IF_FALSE_OR_POP:
+    case JSB_JUMP_IF_TRUE_OR_POP: {
+      bool v = jsvGetBoolAndUnLock(jsvSkipName(stack[sp-1]));
+      if (v == (op==JSB_JUMP_IF_TRUE_OR_POP)) {
+        pc = jsbJump(pc);
+      } else {
+        jsvUnLock(stack[--sp]);
+        pc += 2;
+      }
+      break;
+    }
+    case JSB_RETURN:
+      returnVar = jsvSkipNameAndUnLock(stack[--sp]);
+      pc = 0;
+      break;
+    case JSB_THROW: {
+      JsVar *v = jsvSkipNameAndUnLock(stack[--sp]);
+      jspSetException(v);
+      jsvUnLock(v);
+      break;
+    }
+    default:
+      assert(0);
+      jspSetError(false);
+      break;
+    }
+  }
+
+  // unlock anything left if we stopped early
+  jsvUnLockMany((unsigned)sp, stack);
+  jsvUnLockMany((unsigned)localCount, locals);
+  return returnVar;
+}
@@ -0,0 +1,28 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Bytecode compiler and interpreter for functions marked with "bytecode"
+ * ----------------------------------------------------------------------------
+ */
+#ifndef JSBYTECODE_H_
+#define JSBYTECODE_H_
+
+#include "jsvar.h"
+
+/** Compile the code of a function to bytecode. Returns 0 if the function
+ * uses something that the bytecode can't handle, in which case the function
+ * should just be executed from source as normal. */
+JsVar *jsbCompile(JsVar *funcVar, JsVar *funcCode);
+
+/** Execute bytecode created with jsbCompile. functionRoot should already
+ * contain the function's parameters. Returns the function's return value. */
+JsVar *jsbExecute(JsVar *bytecode, JsVar *functionRoot);
+
+#endif /* JSBYTECODE_H_ */
@@ -27,9 +27,38 @@
 //                                                              WATCH CALLBACKS
 JshEventCallbackCallback jshEventCallbacks[EV_EXTI_MAX+1-EV_EXTI0];
 
+// ----------------------------------------------------------------------------
+//                                                           QUEUE SYNCHRONISATION
+
+/* The IO event and transmit queues are ring buffers with one consumer (the
+ * main loop for ioBuffer, the USART IRQ or Linux input thread for txBuffer).
+ * Producers write the item first and only then move the head on, and the
+ * consumer copies the item out before moving the tail on, so neither needs a
+ * lock. On Linux the other side is a thread rather than an IRQ, so we also
+ * need a real memory barrier between the two. */
+#ifdef LINUX
+#define jshQueueBarrier() __sync_synchronize()
+/* On Linux, events are pushed from both the main thread and the input thread
+ * (where an MCU would use IRQs), so producers take a spinlock rather than
+ * relying on jshInterruptOff - held only while a slot is filled */
+static volatile int ioPushLock = 0;
+#define jshIOPushLock() while (__sync_lock_test_and_set(&ioPushLock, 1))
+#define jshIOPushUnlock() __sync_lock_release(&ioPushLock)
+#else
+#define jshQueueBarrier() __asm__ __volatile__("" ::: "memory")
+#define jshIOPushLock() jshInterruptOff()
+#define jshIOPushUnlock() jshInterruptOn()
+#endif
+
 // ----------------------------------------------------------------------------
 //                                                         DATA TRANSMIT BUFFER
 
+#if TXBUFFERMASK>255
+typedef unsigned short TxBufferIdx;
+#else
+typedef unsigned char TxBufferIdx;
+#endif
+
 /**
  * A single character to be transmitted.
  */
@@ -46,7 +75,7 @@ volatile TxBufferItem txBuffer[TXBUFFERMASK+1];
 /**
  * The head and tail of the list.
  */
-volatile unsigned char txHead=0, txTail=0;
+volatile TxBufferIdx txHead=0, txTail=0;
 
 typedef enum {
   SDS_NONE,
@@ -60,8 +89,18 @@ JshSerialDeviceState jshSerialDeviceStates[EV_SERIAL1+USART_COUNT-EV_SERIAL_STAR
 
 // ----------------------------------------------------------------------------
 //                                                              IO EVENT BUFFER
+#if IOBUFFERMASK>255
+typedef unsigned short IOBufferIdx;
+#else
+typedef unsigned char IOBufferIdx;
+#endif
+
 volatile IOEvent ioBuffer[IOBUFFERMASK+1];
-volatile unsigned char ioHead=0, ioTail=0;
+volatile IOBufferIdx ioHead=0, ioTail=0;
+/// Number of times data was lost because ioBuffer was full
+volatile unsigned int ioOverflows = 0;
+/// The most events ioBuffer has held at once
+volatile IOBufferIdx ioHighWater = 0;
 
 // ----------------------------------------------------------------------------
 
@@ -90,6 +129,34 @@ void jshResetDevices() {
 
 // ----------------------------------------------------------------------------
 
+/**
+ * Wait for space in the transmit buffer. Returns the device that data should
+ * now be sent to - this changes if we were writing to EV_LIMBO and the console
+ * moved to a real device while we waited.
+ */
+static IOEventFlags jshTransmitWaitForSpace(IOEventFlags device) {
+  jsiSetBusy(BUSY_TRANSMIT, true);
+  bool wasConsoleLimbo = device==EV_LIMBO && jsiGetConsoleDevice()==EV_LIMBO;
+  while (((txHead+1)&TXBUFFERMASK)==txTail) {
+    // wait for send to finish as buffer is about to overflow
+#ifdef USB
+    // just in case USB was unplugged while we were waiting!
+    if (!jshIsUSBSERIALConnected()) jshTransmitClearDevice(EV_USBSERIAL);
+#endif
+  }
+  if (wasConsoleLimbo && jsiGetConsoleDevice()!=EV_LIMBO) {
+    /* It was 'Limbo', but now it's not - see jsiOneSecondAfterStartup.
+    Basically we must have printed a bunch of stuff to LIMBO and blocked
+    with our output buffer full. But then jsiOneSecondAfterStartup
+    switches to the right console device and swaps everything we wrote
+    over to that device too. Only we're now here, still writing to the
+    old device when really we should be writing to the new one. */
+    device = jsiGetConsoleDevice();
+  }
+  jsiSetBusy(BUSY_TRANSMIT, false);
+  return device;
+}
+
 /**
  * Queue a character for transmission.
  */
@@ -129,36 +196,78 @@ void jshTransmit(
   // The txHead global points to the current item in the txBuffer.  Since we are adding a new
   // character, we increment the head pointer.   If it has caught up with the tail, then that means
   // we have filled the array backing the list.  What we do next is to wait for space to free up.
-  unsigned char txHeadNext = (unsigned char)((txHead+1)&TXBUFFERMASK);
-  if (txHeadNext==txTail) {
-    jsiSetBusy(BUSY_TRANSMIT, true);
-    bool wasConsoleLimbo = device==EV_LIMBO && jsiGetConsoleDevice()==EV_LIMBO;
-    while (txHeadNext==txTail) {
-      // wait for send to finish as buffer is about to overflow
-#ifdef USB
-      // just in case USB was unplugged while we were waiting!
-      if (!jshIsUSBSERIALConnected()) jshTransmitClearDevice(EV_USBSERIAL);
-#endif
-    }
-    if (wasConsoleLimbo && jsiGetConsoleDevice()!=EV_LIMBO) {
-      /* It was 'Limbo', but now it's not - see jsiOneSecondAfterStartup.
-      Basically we must have printed a bunch of stuff to LIMBO and blocked
-      with our output buffer full. But then jsiOneSecondAfterStartup
-      switches to the right console device and swaps everything we wrote
-      over to that device too. Only we're now here, still writing to the
-      old device when really we should be writing to the new one. */
-      device = jsiGetConsoleDevice();
-    }
-    jsiSetBusy(BUSY_TRANSMIT, false);
-  }
+  TxBufferIdx txHeadNext = (TxBufferIdx)((txHead+1)&TXBUFFERMASK);
+  if (txHeadNext==txTail)
+    device = jshTransmitWaitForSpace(device);
   // Save the device and data for the new character to be transmitted.
   txBuffer[txHead].flags = device;
   txBuffer[txHead].data = data;
+  jshQueueBarrier(); // the data must be there before we move the head on
   txHead = txHeadNext;
 
   jshUSARTKick(device); // set up interrupts if required
 }
 
+/**
+ * Queue a block of characters for transmission. This is the same as calling
+ * jshTransmit for each character, but avoids most of the per-character work.
+ */
+void jshTransmitBuf(
+    IOEventFlags device,       //!< The device to be used for transmission.
+    const unsigned char *data, //!< The characters to transmit.
+    size_t length              //!< The number of characters
+  ) {
+#ifndef LINUX
+#ifdef USB
+  if (device==EV_USBSERIAL && !jshIsUSBSERIALConnected()) {
+    jshTransmitClearDevice(EV_USBSERIAL); // clear out stuff already waiting
+    return;
+  }
+#endif
+#else // if PC, just put to stdout
+  if (device==DEFAULT_CONSOLE_DEVICE) {
+    fwrite(data, 1, length, stdout);
+    fflush(stdout);
+    return;
+  }
+#endif
+  if (device==EV_NONE) return;
+  if (device==EV_LOOPBACKA || device==EV_LOOPBACKB ||
+#ifdef USE_TELNET
+      device==EV_TELNET ||
+#endif
+      false) {
+    // These don't use the transmit buffer
+    while (length--) jshTransmit(device, *(data++));
+    return;
+  }
+  while (length) {
+    // Copy as many characters as will fit into the buffer in one go
+    TxBufferIdx head = txHead;
+    TxBufferIdx txHeadNext = (TxBufferIdx)((head+1)&TXBUFFERMASK);
+    while (length && txHeadNext!=txTail) {
+      txBuffer[head].flags = device;
+      txBuffer[head].data = *(data++);
+      length--;
+      head = txHeadNext;
+      txHeadNext = (TxBufferIdx)((head+1)&TXBUFFERMASK);
+    }
+    if (head != txHead) {
+      jshQueueBarrier(); // the data must be there before we move the head on
+      txHead = head;
+      jshUSARTKick(device); // set up interrupts if required
+    }
+    if (length) {
+      // The buffer is full - if the device changes while we wait, start again so it's handled properly
+      IOEventFlags newDevice = jshTransmitWaitForSpace(device);
+      if (newDevice != device) {
+        jshTransmitBuf(newDevice, data, length);
+        return;
+      }
+    }
+  }
+}
+
 // Return the device at the top of the transmit queue (or EV_NONE)
 IOEventFlags jshGetDeviceToTransmit() {
   if (!jshHasTransmitData()) return EV_NONE;
@@ -184,28 +293,77 @@ int jshGetCharToTransmit(
     }
   }
 
-  unsigned char tempTail = txTail;
+  TxBufferIdx tempTail = txTail;
   while (txHead != tempTail) {
     if (IOEVENTFLAGS_GETTYPE(txBuffer[tempTail].flags) == device) {
       unsigned char data = txBuffer[tempTail].data;
       if (tempTail != txTail) { // so we weren't right at the back of the queue
         // we need to work back from tempTail (until we hit tail), shifting everything forwards
-        unsigned char this = tempTail;
-        unsigned char last = (unsigned char)((this+TXBUFFERMASK)&TXBUFFERMASK);
+        TxBufferIdx this = tempTail;
+        TxBufferIdx last = (TxBufferIdx)((this+TXBUFFERMASK)&TXBUFFERMASK);
         while (this!=txTail) { // if this==txTail, then last is before it, so stop here
           txBuffer[this] = txBuffer[last];
           this = last;
-          last = (unsigned char)((this+TXBUFFERMASK)&TXBUFFERMASK);
+          last = (TxBufferIdx)((this+TXBUFFERMASK)&TXBUFFERMASK);
         }
       }
-      txTail = (unsigned char)((txTail+1)&TXBUFFERMASK); // advance the tail
+      txTail = (TxBufferIdx)((txTail+1)&TXBUFFERMASK); // advance the tail
       return data; // return data
     }
-    tempTail = (unsigned char)((tempTail+1)&TXBUFFERMASK);
+    tempTail = (TxBufferIdx)((tempTail+1)&TXBUFFERMASK);
   }
   return -1; // no data :(
 }
 
+/**
+ * Get up to 'length' characters for transmission on the given device. Unlike
+ * jshGetCharToTransmit this doesn't handle flow control characters, so is
+ * intended for devices (like those on Linux) that don't use them.
+ * \return The number of characters written into 'data'
+ */
+size_t jshGetDataToTransmit(
+    IOEventFlags device, //!< The device being looked at for a transmission.
+    unsigned char *data, //!< Buffer to copy the characters into
+    size_t length        //!< The size of 'data'
+  ) {
+  size_t count = 0;
+  TxBufferIdx head = txHead;
+  TxBufferIdx tail = txTail;
+  jshQueueBarrier(); // don't read items before we've read the head
+  // Take this device's characters from the front of the queue
+  while (tail!=head && count<length &&
+         IOEVENTFLAGS_GETTYPE(txBuffer[tail].flags) == device) {
+    data[count++] = txBuffer[tail].data;
+    tail = (TxBufferIdx)((tail+1)&TXBUFFERMASK);
+  }
+  size_t frontCount = count;
+  if (count<length && tail!=head) {
+    /* There's another device's data in the way, so find the rest of our data
+     * and then move the other devices' data up to fill the gaps, all in one
+     * pass (rather than once per character like jshGetCharToTransmit) */
+    TxBufferIdx end = tail;
+    while (end!=head && count<length) {
+      if (IOEVENTFLAGS_GETTYPE(txBuffer[end].flags) == device)
+        data[count++] = txBuffer[end].data;
+      end = (TxBufferIdx)((end+1)&TXBUFFERMASK);
+    }
+    if (count>frontCount) {
+      TxBufferIdx src = end, dst = end;
+      while (src!=tail) {
+        src = (TxBufferIdx)((src+TXBUFFERMASK)&TXBUFFERMASK);
+        if (IOEVENTFLAGS_GETTYPE(txBuffer[src].flags) != device) {
+          dst = (TxBufferIdx)((dst+TXBUFFERMASK)&TXBUFFERMASK);
+          txBuffer[dst] = txBuffer[src];
+        }
+      }
+      tail = dst;
+    }
+  }
+  jshQueueBarrier(); // finish with the items before they can be reused
+  txTail = tail;
+  return count;
+}
+
 void jshTransmitFlush() {
   jsiSetBusy(BUSY_TRANSMIT, true);
   while (jshHasTransmitData()) ; // wait for send to finish
@@ -225,12 +383,12 @@ void jshTransmitClearDevice(
 /// Move all output from one device to another
 void jshTransmitMove(IOEventFlags from, IOEventFlags to) {
   jshInterruptOff();
-  unsigned char tempTail = txTail;
+  TxBufferIdx tempTail = txTail;
   while (tempTail != txHead) {
     if (IOEVENTFLAGS_GETTYPE(txBuffer[tempTail].flags) == from) {
       txBuffer[tempTail].flags = (txBuffer[tempTail].flags&~EV_TYPE_MASK) | to;
     }
-    tempTail = (unsigned char)((tempTail+1)&TXBUFFERMASK);
+    tempTail = (TxBufferIdx)((tempTail+1)&TXBUFFERMASK);
   }
   jshInterruptOn();
 }
@@ -249,6 +407,13 @@ bool jshHasTransmitData() {
 void CALLED_FROM_INTERRUPT jshIOEventOverflowed() {
   // Error here - just set flag so we don't dump a load of data out
   jsErrorFlags |= JSERR_RX_FIFO_FULL;
+  ioOverflows++;
+}
+
+/// Called by producers after adding an event, to keep track of the high water mark
+static void CALLED_FROM_INTERRUPT jshIOEventAdded() {
+  IOBufferIdx used = (IOBufferIdx)((ioHead-ioTail) & IOBUFFERMASK);
+  if (used > ioHighWater) ioHighWater = used;
 }
 
 
@@ -267,7 +432,7 @@ void jshPushIOCharEvent(
   }
   // Check for existing buffer (we must have at least 2 in the queue to avoid dropping chars though!)
 #ifndef LINUX // no need for this on linux, and also potentially dodgy when multi-threading
-  unsigned char lastHead = (unsigned char)((ioHead+IOBUFFERMASK) & IOBUFFERMASK); // one behind head
+  IOBufferIdx lastHead = (IOBufferIdx)((ioHead+IOBUFFERMASK) & IOBUFFERMASK); // one behind head
   if (ioHead!=ioTail && lastHead!=ioTail) {
     // we can do this because we only read in main loop, and we're in an interrupt here
     if (IOEVENTFLAGS_GETTYPE(ioBuffer[lastHead].flags) == channel) {
@@ -290,20 +455,67 @@ void jshPushIOCharEvent(
    * We're disabling IRQs for this bit because it's actually quite likely for
    * USB and USART data to be coming in at the same time, and it can trip
    * things up if one IRQ interrupts another. */
-  jshInterruptOff();
-  unsigned char nextHead = (unsigned char)((ioHead+1) & IOBUFFERMASK);
+  jshIOPushLock();
+  IOBufferIdx nextHead = (IOBufferIdx)((ioHead+1) & IOBUFFERMASK);
   if (ioTail == nextHead) {
-    jshInterruptOn();
+    jshIOPushUnlock();
     jshIOEventOverflowed();
     return; // queue full - dump this event!
   }
-  unsigned char oldHead = ioHead;
+  ioBuffer[ioHead].flags = channel;
+  IOEVENTFLAGS_SETCHARS(ioBuffer[ioHead].flags, 1);
+  ioBuffer[ioHead].data.chars[0] = charData;
+  jshQueueBarrier(); // the event must be complete before the main loop can see it
   ioHead = nextHead;
-  ioBuffer[oldHead].flags = channel;
-  // once channel is set we're safe - another IRQ won't touch this
-  jshInterruptOn();
-  IOEVENTFLAGS_SETCHARS(ioBuffer[oldHead].flags, 1);
-  ioBuffer[oldHead].data.chars[0] = charData;
+  jshIOEventAdded();
+  jshIOPushUnlock();
+}
+
+/**
+ * Send several characters to the specified device. This packs as many
+ * characters as possible into each event, so uses less of the queue than
+ * calling jshPushIOCharEvent for each one.
+ */
+void jshPushIOCharEvents(
+    IOEventFlags channel, // !< The device to target for output.
+    char *data,           // !< The characters to send to the device.
+    unsigned int count    // !< The number of characters
+  ) {
+  bool isConsole = channel==jsiGetConsoleDevice();
+  while (count) {
+    // Check for a CTRL+C
+    if (*data==3 && isConsole) {
+      // Ctrl-C - force interrupt
+      execInfo.execute |= EXEC_CTRL_C;
+      data++;
+      count--;
+      continue;
+    }
+    // Set flow control (as we're going to use more data)
+    if (DEVICE_IS_USART(channel) && jshGetEventsUsed() > IOBUFFER_XOFF)
+      jshSetFlowControlXON(channel, false);
+
+    jshIOPushLock();
+    IOBufferIdx nextHead = (IOBufferIdx)((ioHead+1) & IOBUFFERMASK);
+    if (ioTail == nextHead) {
+      jshIOPushUnlock();
+      jshIOEventOverflowed();
+      return; // queue full - dump the rest of the data!
+    }
+    unsigned int c = 0;
+    while (c<IOEVENT_MAXCHARS && c<count && !(data[c]==3 && isConsole)) {
+      ioBuffer[ioHead].data.chars[c] = data[c];
+      c++;
+    }
+    ioBuffer[ioHead].flags = channel;
+    IOEVENTFLAGS_SETCHARS(ioBuffer[ioHead].flags, c);
+    jshQueueBarrier(); // the event must be complete before the main loop can see it
+    ioHead = nextHead;
+    jshIOEventAdded();
+    jshIOPushUnlock();
+    data += c;
+    count -= c;
+  }
 }
 
 /**
@@ -342,21 +554,28 @@ void CALLED_FROM_INTERRUPT jshPushIOEvent(
     IOEventFlags channel, //!< The event to add to the queue.
     JsSysTime time        //!< The time that the event is thought to have happened.
   ) {
-  unsigned char nextHead = (unsigned char)((ioHead+1) & IOBUFFERMASK);
+  jshIOPushLock();
+  IOBufferIdx nextHead = (IOBufferIdx)((ioHead+1) & IOBUFFERMASK);
   if (ioTail == nextHead) {
+    jshIOPushUnlock();
     jshIOEventOverflowed();
     return; // queue full - dump this event!
   }
   ioBuffer[ioHead].flags = channel;
   ioBuffer[ioHead].data.time = (unsigned int)time;
+  jshQueueBarrier(); // the event must be complete before the main loop can see it
   ioHead = nextHead;
+  jshIOEventAdded();
+  jshIOPushUnlock();
 }
 
 // returns true on success
 bool jshPopIOEvent(IOEvent *result) {
   if (ioHead==ioTail) return false;
+  jshQueueBarrier(); // don't read the event before we've read the head
   *result = ioBuffer[ioTail];
-  ioTail = (unsigned char)((ioTail+1) & IOBUFFERMASK);
+  jshQueueBarrier(); // finish reading before the slot can be reused
+  ioTail = (IOBufferIdx)((ioTail+1) & IOBUFFERMASK);
   return true;
 }
 
@@ -366,7 +585,7 @@ bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result) {
   if (IOEVENTFLAGS_GETTYPE(ioBuffer[ioTail].flags) == eventType)
     return jshPopIOEvent(result);
   // Now check non-top
-  unsigned char i = ioTail;
+  IOBufferIdx i = ioTail;
   while (ioHead!=i) {
     if (IOEVENTFLAGS_GETTYPE(ioBuffer[i].flags) == eventType) {
       /* We need IRQ off for this, because if we get data it's possible
@@ -375,22 +594,75 @@ bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result) {
       jshInterruptOff();
       *result = ioBuffer[i];
       // work back and shift all items in out queue
-      unsigned char n = (unsigned char)((i+IOBUFFERMASK) & IOBUFFERMASK);
+      IOBufferIdx n = (IOBufferIdx)((i+IOBUFFERMASK) & IOBUFFERMASK);
       while (n!=ioTail) {
         ioBuffer[i] = ioBuffer[n];
         i = n;
-        n = (unsigned char)((n+IOBUFFERMASK) & IOBUFFERMASK);
+        n = (IOBufferIdx)((n+IOBUFFERMASK) & IOBUFFERMASK);
       }
       // finally update the tail pointer, and return
-      ioTail = (unsigned char)((ioTail+1) & IOBUFFERMASK);
+      jshQueueBarrier();
+      ioTail = (IOBufferIdx)((ioTail+1) & IOBUFFERMASK);
       jshInterruptOn();
       return true;
     }
-    i = (unsigned char)((i+1) & IOBUFFERMASK);
+    i = (IOBufferIdx)((i+1) & IOBUFFERMASK);
   }
   return false;
 }
 
+/// Count the characters in the IO event queue for the given device
+int jshGetIOCharsInQueue(IOEventFlags device) {
+  int count = 0;
+  IOBufferIdx i = ioTail;
+  IOBufferIdx head = ioHead;
+  jshQueueBarrier(); // don't read events before we've read the head
+  while (i!=head) {
+    if (IOEVENTFLAGS_GETTYPE(ioBuffer[i].flags) == device)
+      count += IOEVENTFLAGS_GETCHARS(ioBuffer[i].flags);
+    i = (IOBufferIdx)((i+1) & IOBUFFERMASK);
+  }
+  return count;
+}
+
+/** Remove the character events for the given device from the IO event queue
+ * (leaving other events in order), copying up to 'length' characters into
+ * 'data'. Unlike calling jshPopIOEventOfType for each event, this makes only
+ * one pass over the queue. Returns the number of characters copied. */
+int jshPopIOCharsOfType(IOEventFlags device, char *data, int length) {
+  int count = 0;
+  /* IRQs could add characters to the last event while we're copying
+   * it out (see jshPushIOCharEvent), so stop them */
+  jshIOPushLock();
+  IOBufferIdx tail = ioTail;
+  IOBufferIdx end = tail;
+  IOBufferIdx head = ioHead;
+  jshQueueBarrier(); // don't read events before we've read the head
+  // copy out the characters, stopping at an event that won't fit
+  while (end!=head) {
+    if (IOEVENTFLAGS_GETTYPE(ioBuffer[end].flags) == device) {
+      int c, chars = IOEVENTFLAGS_GETCHARS(ioBuffer[end].flags);
+      if (count+chars > length) break;
+      for (c=0;c<chars;c++)
+        data[count++] = ioBuffer[end].data.chars[c];
+    }
+    end = (IOBufferIdx)((end+1) & IOBUFFERMASK);
+  }
+  // now move the other events up to fill the gaps
+  IOBufferIdx src = end, dst = end;
+  while (src!=tail) {
+    src = (IOBufferIdx)((src+IOBUFFERMASK) & IOBUFFERMASK);
+    if (IOEVENTFLAGS_GETTYPE(ioBuffer[src].flags) != device) {
+      dst = (IOBufferIdx)((dst+IOBUFFERMASK) & IOBUFFERMASK);
+      if (dst!=src) ioBuffer[dst] = ioBuffer[src];
+    }
+  }
+  jshQueueBarrier(); // finish with the events before the slots can be reused
+  ioTail = dst;
+  jshIOPushUnlock();
+  return count;
+}
+
 /**
  * Determine if we have I/O events to process.
  * \return True if there are I/O events to be processed.
@@ -417,6 +689,16 @@ bool jshHasEventSpaceForChars(int n) {
   return spaceLeft > spacesNeeded;
 }
 
+/// How many times has IO data been lost because the queue was full?
+unsigned int jshGetEventsOverflowed() {
+  return ioOverflows;
+}
+
+/// What is the most IO events that have been in the queue at once?
+int jshGetEventsHighWater() {
+  return ioHighWater;
+}
+
 // ----------------------------------------------------------------------------
 //                                                                      DEVICES
 
@@ -136,13 +136,13 @@ void jshPushIOWatchEvent(IOEventFlags channel); // push an even when a pin chang
 /// Push a single character event (for example USART RX)
 void jshPushIOCharEvent(IOEventFlags channel, char charData);
 /// Push many character events at once (for example USB RX)
-static inline void jshPushIOCharEvents(IOEventFlags channel, char *data, unsigned int count) {
-  // TODO: optimise me!
-  unsigned int i;
-  for (i=0;i<count;i++) jshPushIOCharEvent(channel, data[i]);
-}
+void jshPushIOCharEvents(IOEventFlags channel, char *data, unsigned int count);
 bool jshPopIOEvent(IOEvent *result); ///< returns true on success
 bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result); ///< returns true on success
+/// Count the characters in the IO event queue for the given device
+int jshGetIOCharsInQueue(IOEventFlags device);
+/// Remove the character events for the given device from the queue in one go, copying up to 'length' characters into 'data'. Returns the number of characters
+int jshPopIOCharsOfType(IOEventFlags device, char *data, int length);
 /// Do we have any events pending? Will jshPopIOEvent return true?
 bool jshHasEvents();
 /// Check if the top event is for the given device
@@ -154,6 +154,12 @@ int jshGetEventsUsed();
 /// Do we have enough space for N characters?
 bool jshHasEventSpaceForChars(int n);
 
+/// How many times has IO data been lost because the queue was full?
+unsigned int jshGetEventsOverflowed();
+
+/// What is the most IO events that have been in the queue at once?
+int jshGetEventsHighWater();
+
 const char *jshGetDeviceString(IOEventFlags device);
 IOEventFlags jshFromDeviceString(const char *device);
 
@@ -164,6 +170,8 @@ JsVar *jshGetDeviceObject(IOEventFlags device);
 //                                                         DATA TRANSMIT BUFFER
 /// Queue a character for transmission
 void jshTransmit(IOEventFlags device, unsigned char data);
+/// Queue a block of characters for transmission
+void jshTransmitBuf(IOEventFlags device, const unsigned char *data, size_t length);
 /// Wait for transmit to finish
 void jshTransmitFlush();
 /// Clear everything from a device
@@ -176,6 +184,8 @@ bool jshHasTransmitData();
 IOEventFlags jshGetDeviceToTransmit();
 /// Try and get a character for transmission - could just return -1 if nothing
 int jshGetCharToTransmit(IOEventFlags device);
+/// Get up to 'length' characters for transmission in one go (no flow control characters), returns the number of characters
+size_t jshGetDataToTransmit(IOEventFlags device, unsigned char *data, size_t length);
 
 
 /// Set whether the host should transmit or not
@@ -23,6 +23,9 @@
 #include "jswrap_flash.h" // load and save to flash
 #include "jswrap_object.h" // jswrap_object_keys_or_property_names
 #include "jsnative.h" // jsnSanityTest
+#ifdef USE_GRAPHICS
+#include "graphics.h" // graphicsFreeVectorFontCache
+#endif
 
 #ifdef ARM
 #define CHAR_DELETE_SEND 0x08
@@ -55,8 +58,14 @@ IOEventFlags consoleDevice = DEFAULT_CONSOLE_DEVICE; ///< The console device for
 Pin pinBusyIndicator = DEFAULT_BUSY_PIN_INDICATOR;
 Pin pinSleepIndicator = DEFAULT_SLEEP_PIN_INDICATOR;
 JsiStatus jsiStatus;
-JsSysTime jsiLastIdleTime;  ///< The last time we went around the idle loop - use this for timers
+JsSysTime jsiLastIdleTime;  ///< The last time we went around the idle loop
+JsSysTime jsiTimerBaseTime; ///< The time that timers' "time" values are relative to
+JsSysTime jsiTimerNextTime; ///< The earliest time (relative to jsiTimerBaseTime) that any timer could be due
 uint32_t jsiTimeSinceCtrlC;
+#ifndef SAVE_ON_FLASH
+uint32_t jsiSerialPending; ///< Bit per USART device (from EV_SERIAL_START) that has data waiting for 'chunk' characters
+JsSysTime jsiSerialPendingTime; ///< When the oldest data in jsiSerialPending should be delivered anyway
+#endif
 // ----------------------------------------------------------------------------
 JsVar *inputLine = 0; ///< The current input line
 JsvStringIterator inputLineIterator; ///< Iterator that points to the end of the input line
@@ -203,8 +212,17 @@ NO_INLINE void jsiConsolePrintChar(char data) {
  */
 NO_INLINE void jsiConsolePrintString(const char *str) {
   while (*str) {
-    if (*str == '\n') jsiConsolePrintChar('\r');
-    jsiConsolePrintChar(*(str++));
+    // send everything up to the next newline in one go
+    const char *end = str;
+    while (*end && *end!='\n') end++;
+    if (end != str) {
+      jshTransmitBuf(consoleDevice, (const unsigned char *)str, (size_t)(end-str));
+      str = end;
+    }
+    if (*str == '\n') {
+      jsiConsolePrintChar('\r');
+      jsiConsolePrintChar(*(str++));
+    }
   }
 }
 
@@ -468,9 +486,11 @@ void jsiSoftInit(bool hasBeenReset) {
   timerArray = _jsiInitNamedArray(JSI_TIMERS_NAME);
   watchArray = _jsiInitNamedArray(JSI_WATCHES_NAME);
 
-  // Make sure we set up lastIdleTime, as this could be used
+  // Make sure we set up lastIdleTime and the timer base, as these could be used
   // when adding an interval from onInit (called below)
   jsiLastIdleTime = jshGetSystemTime();
+  jsiTimerBaseTime = jsiLastIdleTime;
+  jsiTimerNextTime = 0; // check any timers we loaded as soon as we can
   jsiTimeSinceCtrlC = 0xFFFFFFFF;
 
   // Run wrapper initialisation stuff
@@ -487,6 +507,7 @@ void jsiSoftInit(bool hasBeenReset) {
   }
 
   // Check any existing watches and set up interrupts for them
+  jsiWatchesChanged(); // EXTI channels may not be the same as when we saved
   if (watchArray) {
     JsVar *watchArrayPtr = jsvLock(watchArray);
     JsvObjectIterator it;
@@ -692,8 +713,32 @@ void jsiDumpHardwareInitialisation(vcbprintf_callback user_callback, void *user_
 }
 
 // Used when shutting down before flashing
+/// Make all timers' "time" values relative to the given time, and use it as the new base
+static void jsiTimersRebase(JsSysTime time) {
+  JsSysTime offset = time - jsiTimerBaseTime;
+  jsiTimerBaseTime = time;
+  if (jsiTimerNextTime != JSSYSTIME_MAX)
+    jsiTimerNextTime -= offset;
+  if (!offset) return;
+  JsVar *timerArrayPtr = jsvLock(timerArray);
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, timerArrayPtr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
+    JsSysTime timerTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0));
+    jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger(timerTime - offset));
+    jsvUnLock(timerPtr);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(timerArrayPtr);
+}
+
 // 'release' anything we are using, but ensure that it doesn't get freed
 void jsiSoftKill() {
+#ifndef SAVE_ON_FLASH
+  jsiSerialPending = 0;
+#endif
   inputCursorPos = 0;
   jsiInputLineCursorMoved();
   jsvUnLock(inputLine);
@@ -709,6 +754,8 @@ void jsiSoftKill() {
     events=0;
   }
   if (timerArray) {
+    // make timers relative to now, so they're right if we're saving
+    jsiTimersRebase(jshGetSystemTime());
     jsvUnRefRef(timerArray);
     timerArray=0;
   }
@@ -729,6 +776,7 @@ void jsiSoftKill() {
     jsvUnLock(watchArrayPtr);
     watchArray=0;
   }
+  jsiWatchesChanged(); // no need to save the index
   // Save initialisation information
   JsVar *initCode = jsvNewFromEmptyString();
   if (initCode) { // out of memory
@@ -871,6 +919,10 @@ int jsiCountBracketsInInput() {
 
 /// Tries to get rid of some memory (by clearing command history). Returns true if it got rid of something, false if it didn't.
 bool jsiFreeMoreMemory() {
+#if defined(USE_GRAPHICS) && !defined(SAVE_ON_FLASH)
+  // cached vector font glyphs can just be rendered again
+  if (graphicsFreeVectorFontCache()) return true;
+#endif
   JsVar *history = jsvObjectGetChild(execInfo.hiddenRoot, JSI_HISTORY_NAME, 0);
   if (!history) return 0;
   JsVar *item = jsvArrayPopFirst(history);
@@ -1601,6 +1653,45 @@ bool jsiHasTimers() {
   return hasTimers;
 }
 
+void jsiWatchesChanged() {
+  jsvRemoveNamedChild(execInfo.hiddenRoot, JSI_WATCH_INDEX_NAME);
+  jsiStatus |= JSIS_WATCHES_CHANGED;
+}
+
+/** Return an array of the watches that the given EXTI event is for (locked).
+ * These are looked up once and stored in an index (by EXTI channel) until
+ * jsiWatchesChanged is called, so bursts of events are cheap to handle */
+static JsVar *jsiGetWatchesForEvent(IOEvent *event) {
+  JsVar *index = jsvObjectGetChild(execInfo.hiddenRoot, JSI_WATCH_INDEX_NAME, JSV_ARRAY);
+  if (!index) return 0;
+  JsVar *channel = jsvNewFromInteger(IOEVENTFLAGS_GETTYPE(event->flags) - EV_EXTI0);
+  JsVar *watchesName = channel ? jsvFindChildFromVar(index, channel, true) : 0;
+  jsvUnLock2(channel, index);
+  if (!watchesName) return 0;
+  JsVar *watches = jsvSkipName(watchesName);
+  if (!watches) {
+    watches = jsvNewEmptyArray();
+    if (watches) {
+      JsVar *watchArrayPtr = jsvLock(watchArray);
+      JsvObjectIterator it;
+      jsvObjectIteratorNew(&it, watchArrayPtr);
+      while (jsvObjectIteratorHasValue(&it)) {
+        JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
+        Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+        if (jshIsEventForPin(event, pin))
+          jsvArrayPush(watches, watchPtr);
+        jsvUnLock(watchPtr);
+        jsvObjectIteratorNext(&it);
+      }
+      jsvObjectIteratorFree(&it);
+      jsvUnLock(watchArrayPtr);
+      jsvSetValueOfName(watchesName, watches);
+    }
+  }
+  jsvUnLock(watchesName);
+  return watches;
+}
+
 /// Is the given watch object meant to be executed when the current value of the pin is pinIsHigh
 bool jsiShouldExecuteWatch(JsVar *watchPtr, bool pinIsHigh) {
   int watchEdge = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "edge", 0));
@@ -1627,48 +1718,142 @@ bool jsiIsWatchingPin(Pin pin) {
   return isWatched;
 }
 
-/** Take an event for a UART and handle the chareacters we're getting, potentially
- * grabbing more characters as well if it's easy. If more character events are
- * grabbed, the number of extra events (not characters) is returned */
+/// Mask received characters to the given number of bits
+static void jsiMaskUSARTData(char *data, int length, unsigned char bytesize) {
+  if (bytesize>=8) return;
+  int i;
+  for (i=0;i<length;i++)
+    data[i] = (char)(data[i] & ((1<<bytesize)-1));
+}
+
+#ifndef SAVE_ON_FLASH
+/** If Serial.setup was given a 'chunk' size, keep received data until there
+ * are 'chunk' characters (or USART_CHUNK_TIMEOUT has passed). Returns the
+ * data to deliver now (locked), or 0 if it should wait. */
+static JsVar *jsiGetUSARTChunk(JsVar *usartClass, IOEventFlags device, JsVar *stringData, JsVarInt chunk) {
+  JsVar *pending = jsvObjectGetChild(usartClass, USART_PENDING_NAME, 0);
+  if (jsvIsString(pending)) {
+    jsvAppendStringVarComplete(pending, stringData);
+    jsvUnLock(stringData);
+    stringData = pending;
+  } else
+    jsvUnLock(pending);
+  uint32_t bit = 1U<<(device-EV_SERIAL_START);
+  if ((JsVarInt)jsvGetStringLength(stringData) >= chunk) {
+    if (jsiSerialPending & bit) {
+      jsvRemoveNamedChild(usartClass, USART_PENDING_NAME);
+      jsiSerialPending &= ~bit;
+    }
+    return stringData;
+  }
+  if (!(jsiSerialPending & bit)) {
+    // Keep the data until later. It may be a flat string, which can't be appended to
+    JsVar *copy = jsvIsFlatString(stringData) ? jsvCopy(stringData) : jsvLockAgain(stringData);
+    if (copy) // could be out of memory
+      jsvObjectSetChildAndUnLock(usartClass, USART_PENDING_NAME, copy);
+    JsSysTime deliverTime = jshGetSystemTime() + jshGetTimeFromMilliseconds(USART_CHUNK_TIMEOUT);
+    if (!jsiSerialPending || deliverTime < jsiSerialPendingTime)
+      jsiSerialPendingTime = deliverTime;
+    jsiSerialPending |= bit;
+  }
+  jsvUnLock(stringData);
+  return 0;
+}
+
+/// Deliver any data that has been waiting for 'chunk' characters for too long
+static void jsiDeliverUSARTChunks() {
+  IOEventFlags device;
+  for (device=EV_SERIAL_START;device<=EV_SERIAL_MAX;device++) {
+    uint32_t bit = 1U<<(device-EV_SERIAL_START);
+    if (!(jsiSerialPending & bit)) continue;
+    jsiSerialPending &= ~bit;
+    JsVar *usartClass = jsvSkipNameAndUnLock(jsiGetClassNameFromDevice(device));
+    if (jsvIsObject(usartClass)) {
+      JsVar *stringData = jsvObjectGetChild(usartClass, USART_PENDING_NAME, 0);
+      jsvRemoveNamedChild(usartClass, USART_PENDING_NAME);
+      if (jsvIsString(stringData))
+        jswrap_stream_pushData(usartClass, stringData, true);
+      jsvUnLock(stringData);
+    }
+    jsvUnLock(usartClass);
+  }
+}
+#endif
+
+/** Take an event for a UART and handle the characters we're getting, as well
+ * as any other characters for the same UART that are in the event queue, so
+ * there is only one 'data' event per UART each time around the idle loop.
+ * The number of extra events (not characters) that were handled is returned */
 int jsiHandleIOEventForUSART(JsVar *usartClass, IOEvent *event) {
-  int eventsHandled = 0;
+  IOEventFlags device = IOEVENTFLAGS_GETTYPE(event->flags);
+  int eventsUsed = jshGetEventsUsed();
   /* work out byteSize. On STM32 we fake 7 bit, and it's easier to
    * check the options and work out the masking here than it is to
    * do it in the IRQ */
   unsigned char bytesize = 8;
+  JsVarInt chunk = 0;
   JsVar *options = jsvObjectGetChild(usartClass, DEVICE_OPTIONS_NAME, 0);
   if(jsvIsObject(options)) {
     unsigned char c = (unsigned char)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "bytesize", 0));
     if (c>=7 && c<10) bytesize = c;
+#ifndef SAVE_ON_FLASH
+    chunk = jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "chunk", 0));
+#endif
   }
   jsvUnLock(options);
 
-  JsVar *stringData = jsvNewFromEmptyString();
-  if (stringData) {
-    JsvStringIterator it;
-    jsvStringIteratorNew(&it, stringData, 0);
-
-    int i, chars = IOEVENTFLAGS_GETCHARS(event->flags);
-    while (chars) {
-      for (i=0;i<chars;i++) {
-        char ch = (char)(event->data.chars[i] & ((1<<bytesize)-1)); // mask
-        jsvStringIteratorAppend(&it, ch);
+  int chars = IOEVENTFLAGS_GETCHARS(event->flags);
+  jsiMaskUSARTData(event->data.chars, chars, bytesize);
+  int length = chars + jshGetIOCharsInQueue(device);
+  JsVar *stringData = 0;
+#ifndef SAVE_ON_FLASH
+  /* If there's a lot of data, try and allocate it all in one go as a flat
+   * string, and copy the data straight into it */
+  if (length > (int)(sizeof(JsVar)*4)) {
+    stringData = jsvNewFlatStringOfLength((unsigned int)length);
+    if (stringData) {
+      char *ptr = jsvGetFlatStringPointer(stringData);
+      memcpy(ptr, event->data.chars, (size_t)chars);
+      int got = jshPopIOCharsOfType(device, &ptr[chars], length-chars);
+      jsiMaskUSARTData(&ptr[chars], got, bytesize);
+      if (chars+got < length) {
+        // rare - an IRQ added to an event while we were counting. Use what we got
+        JsVar *s = jsvNewFromStringVar(stringData, 0, (size_t)(chars+got));
+        jsvUnLock(stringData);
+        stringData = s;
       }
-      // look down the stack and see if there is more data
-      if (jshIsTopEvent(IOEVENTFLAGS_GETTYPE(event->flags))) {
-        jshPopIOEvent(event);
-        eventsHandled++;
-        chars = IOEVENTFLAGS_GETCHARS(event->flags);
-      } else
-        chars = 0;
     }
-    jsvStringIteratorFree(&it);
-
+  }
+#endif
+  if (!stringData) {
+    stringData = jsvNewFromEmptyString();
+    if (stringData) {
+      JsvStringIterator it;
+      jsvStringIteratorNew(&it, stringData, 0);
+      jsvStringIteratorAppendBuf(&it, event->data.chars, (size_t)chars);
+      char buf[64];
+      int got, remaining = length-chars;
+      while (remaining>0 &&
+             (got = jshPopIOCharsOfType(device, buf, (remaining<(int)sizeof(buf)) ? remaining : (int)sizeof(buf))) > 0) {
+        jsiMaskUSARTData(buf, got, bytesize);
+        jsvStringIteratorAppendBuf(&it, buf, (size_t)got);
+        remaining -= got;
+      }
+      jsvStringIteratorFree(&it);
+    }
+  }
+#ifndef SAVE_ON_FLASH
+  if (stringData && chunk>0)
+    stringData = jsiGetUSARTChunk(usartClass, device, stringData, chunk);
+#endif
+  if (stringData) {
     // Now run the handler
     jswrap_stream_pushData(usartClass, stringData, true);
     jsvUnLock(stringData);
   }
-  return eventsHandled;
+  // the number of events we took out of the queue (ignoring any that arrived meanwhile)
+  int eventsHandled = eventsUsed - jshGetEventsUsed();
+  return (eventsHandled>0) ? eventsHandled : 0;
 }
 
 void jsiHandleIOEventForConsole(IOEvent *event) {
@@ -1720,109 +1905,119 @@ void jsiIdle() {
       jsvUnLock(usartClass);
     } else if (DEVICE_IS_EXTI(eventType)) { // ---------------------------------------------------------------- PIN WATCH
       // we have an event... find out what it was for...
-      // Check everything in our Watch array
-      JsVar *watchArrayPtr = jsvLock(watchArray);
-      JsvObjectIterator it;
-      jsvObjectIteratorNew(&it, watchArrayPtr);
-      while (jsvObjectIteratorHasValue(&it)) {
-        bool hasDeletedWatch = false;
-        JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
-        Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
-
-        if (jshIsEventForPin(&event, pin)) {
-          /** Work out event time. Events time is only stored in 32 bits, so we need to
-           * use the correct 'high' 32 bits from the current time.
-           *
-           * We know that the current time is always newer than the event time, so
-           * if the bottom 32 bits of the current time is less than the bottom
-           * 32 bits of the event time, we need to subtract a full 32 bits worth
-           * from the current time.
-           */
-          JsSysTime time = jshGetSystemTime();
-          if (((unsigned int)time) < (unsigned int)event.data.time)
-            time = time - 0x100000000LL;
-          // finally, mask in the event's time
-          JsSysTime eventTime = (time & ~0xFFFFFFFFLL) | (JsSysTime)event.data.time;
-
-          // Now actually process the event
-          bool pinIsHigh = (event.flags&EV_EXTI_IS_HIGH)!=0;
-
-          bool executeNow = false;
-          JsVarInt debounce = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
-          if (debounce<=0) {
-            executeNow = true;
-          } else { // Debouncing - use timeouts to ensure we only fire at the right time
-            // store the current state of the pin
-            bool oldWatchState = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr, "state",0));
-            jsvObjectSetChildAndUnLock(watchPtr, "state", jsvNewFromBool(pinIsHigh));
-
-            JsVar *timeout = jsvObjectGetChild(watchPtr, "timeout", 0);
-            if (timeout) { // if we had a timeout, update the callback time
-              JsSysTime timeoutTime = jsiLastIdleTime + (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timeout, "time", 0));
-              jsvUnLock(jsvObjectSetChild(timeout, "time", jsvNewFromLongInteger((JsSysTime)(eventTime - jsiLastIdleTime) + debounce)));
-              if (eventTime > timeoutTime) {
-                // timeout should have fired, but we didn't get around to executing it!
-                // Do it now (with the old timeout time)
-                executeNow = true;
-                eventTime = timeoutTime - debounce;
-                pinIsHigh = oldWatchState;
-              }
-            } else { // else create a new timeout
-              timeout = jsvNewObject();
-              if (timeout) {
-                jsvObjectSetChild(timeout, "watch", watchPtr); // no unlock
-                jsvObjectSetChildAndUnLock(timeout, "time", jsvNewFromLongInteger((JsSysTime)(eventTime - jsiLastIdleTime) + debounce));
-                jsvObjectSetChildAndUnLock(timeout, "callback", jsvObjectGetChild(watchPtr, "callback", 0));
-                jsvObjectSetChildAndUnLock(timeout, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
-                jsvObjectSetChildAndUnLock(timeout, "pin", jsvNewFromPin(pin));
-                // Add to timer array
-                jsiTimerAdd(timeout);
-                // Add to our watch
-                jsvObjectSetChild(watchPtr, "timeout", timeout); // no unlock
+      // Check the watches that are for this EXTI channel
+      JsVar *watches = jsiGetWatchesForEvent(&event);
+      if (watches) { // could be out of memory
+        JsVar *watchArrayPtr = jsvLock(watchArray);
+        JsvObjectIterator it;
+        jsvObjectIteratorNew(&it, watches);
+        jsiStatus &= ~JSIS_WATCHES_CHANGED;
+        while (jsvObjectIteratorHasValue(&it)) {
+          JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
+          Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+          // If a callback changed the watches, make sure this one wasn't removed
+          JsVar *watchNamePtr = 0;
+          if (jsiStatus & JSIS_WATCHES_CHANGED)
+            watchNamePtr = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
+
+          if (!(jsiStatus & JSIS_WATCHES_CHANGED) || watchNamePtr) {
+            /** Work out event time. Events time is only stored in 32 bits, so we need to
+             * use the correct 'high' 32 bits from the current time.
+             *
+             * We know that the current time is always newer than the event time, so
+             * if the bottom 32 bits of the current time is less than the bottom
+             * 32 bits of the event time, we need to subtract a full 32 bits worth
+             * from the current time.
+             */
+            JsSysTime time = jshGetSystemTime();
+            if (((unsigned int)time) < (unsigned int)event.data.time)
+              time = time - 0x100000000LL;
+            // finally, mask in the event's time
+            JsSysTime eventTime = (time & ~0xFFFFFFFFLL) | (JsSysTime)event.data.time;
+
+            // Now actually process the event
+            bool pinIsHigh = (event.flags&EV_EXTI_IS_HIGH)!=0;
+
+            bool executeNow = false;
+            JsVarInt debounce = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
+            if (debounce<=0) {
+              executeNow = true;
+            } else { // Debouncing - use timeouts to ensure we only fire at the right time
+              // store the current state of the pin
+              bool oldWatchState = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr, "state",0));
+              jsvObjectSetChildAndUnLock(watchPtr, "state", jsvNewFromBool(pinIsHigh));
+
+              JsVar *timeout = jsvObjectGetChild(watchPtr, "timeout", 0);
+              if (timeout) { // if we had a timeout, update the callback time
+                JsSysTime timeoutTime = jsiTimerBaseTime + (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timeout, "time", 0));
+                jsvUnLock(jsvObjectSetChild(timeout, "time", jsvNewFromLongInteger((JsSysTime)(eventTime - jsiTimerBaseTime) + debounce)));
+                jsiTimerTimeChanged(timeout);
+                if (eventTime > timeoutTime) {
+                  // timeout should have fired, but we didn't get around to executing it!
+                  // Do it now (with the old timeout time)
+                  executeNow = true;
+                  eventTime = timeoutTime - debounce;
+                  pinIsHigh = oldWatchState;
+                }
+              } else { // else create a new timeout
+                timeout = jsvNewObject();
+                if (timeout) {
+                  jsvObjectSetChild(timeout, "watch", watchPtr); // no unlock
+                  jsvObjectSetChildAndUnLock(timeout, "time", jsvNewFromLongInteger((JsSysTime)(eventTime - jsiTimerBaseTime) + debounce));
+                  jsvObjectSetChildAndUnLock(timeout, "callback", jsvObjectGetChild(watchPtr, "callback", 0));
+                  jsvObjectSetChildAndUnLock(timeout, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+                  jsvObjectSetChildAndUnLock(timeout, "pin", jsvNewFromPin(pin));
+                  // Add to timer array
+                  jsiTimerAdd(timeout);
+                  // Add to our watch
+                  jsvObjectSetChild(watchPtr, "timeout", timeout); // no unlock
+                }
               }
+              jsvUnLock(timeout);
             }
-            jsvUnLock(timeout);
-          }
 
-          // If we want to execute this watch right now...
-          if (executeNow) {
-            JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(eventTime)/1000);
-            if (jsiShouldExecuteWatch(watchPtr, pinIsHigh)) { // edge triggering
-              JsVar *watchCallback = jsvObjectGetChild(watchPtr, "callback", 0);
-              bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
-              JsVar *data = jsvNewObject();
-              if (data) {
-                jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
-                // set both data.time, and watch.lastTime in one go
-                jsvObjectSetChild(data, "time", timePtr); // no unlock
-                jsvObjectSetChildAndUnLock(data, "pin", jsvNewFromPin(pin));
-                jsvObjectSetChildAndUnLock(data, "state", jsvNewFromBool(pinIsHigh));
-              }
-              if (!jsiExecuteEventCallback(0, watchCallback, 1, &data) && watchRecurring) {
-                jsError("Ctrl-C while processing watch - removing it.");
-                jsErrorFlags |= JSERR_CALLBACK;
-                watchRecurring = false;
+            // If we want to execute this watch right now...
+            if (executeNow) {
+              JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(eventTime)/1000);
+              if (jsiShouldExecuteWatch(watchPtr, pinIsHigh)) { // edge triggering
+                JsVar *watchCallback = jsvObjectGetChild(watchPtr, "callback", 0);
+                bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
+                JsVar *data = jsvNewObject();
+                if (data) {
+                  jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+                  // set both data.time, and watch.lastTime in one go
+                  jsvObjectSetChild(data, "time", timePtr); // no unlock
+                  jsvObjectSetChildAndUnLock(data, "pin", jsvNewFromPin(pin));
+                  jsvObjectSetChildAndUnLock(data, "state", jsvNewFromBool(pinIsHigh));
+                }
+                if (!jsiExecuteEventCallback(0, watchCallback, 1, &data) && watchRecurring) {
+                  jsError("Ctrl-C while processing watch - removing it.");
+                  jsErrorFlags |= JSERR_CALLBACK;
+                  watchRecurring = false;
+                }
+                jsvUnLock(data);
+                if (!watchRecurring) {
+                  // free all
+                  if (!watchNamePtr)
+                    watchNamePtr = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
+                  if (watchNamePtr) // may already have been removed
+                    jsvRemoveChild(watchArrayPtr, watchNamePtr);
+                  jsiWatchesChanged();
+                  if (!jsiIsWatchingPin(pin))
+                    jshPinWatch(pin, false);
+                }
+                jsvUnLock(watchCallback);
               }
-              jsvUnLock(data);
-              if (!watchRecurring) {
-                // free all
-                jsvObjectIteratorRemoveAndGotoNext(&it, watchArrayPtr);
-                hasDeletedWatch = true;
-                if (!jsiIsWatchingPin(pin))
-                  jshPinWatch(pin, false);
-              }
-              jsvUnLock(watchCallback);
+              jsvObjectSetChildAndUnLock(watchPtr, "lastTime", timePtr);
             }
-            jsvObjectSetChildAndUnLock(watchPtr, "lastTime", timePtr);
           }
-        }
 
-        jsvUnLock(watchPtr);
-        if (!hasDeletedWatch)
+          jsvUnLock2(watchNamePtr, watchPtr);
           jsvObjectIteratorNext(&it);
+        }
+        jsvObjectIteratorFree(&it);
+        jsvUnLock2(watchArrayPtr, watches);
       }
-      jsvObjectIteratorFree(&it);
-      jsvUnLock(watchArrayPtr);
     }
   }
 
@@ -1845,112 +2040,141 @@ void jsiIdle() {
   if (oldTimeSinceCtrlC > jsiTimeSinceCtrlC)
     jsiTimeSinceCtrlC = 0xFFFFFFFF;
 
-  jsiStatus = jsiStatus & ~JSIS_TIMERS_CHANGED;
-  JsVar *timerArrayPtr = jsvLock(timerArray);
-  JsvObjectIterator it;
-  jsvObjectIteratorNew(&it, timerArrayPtr);
-  while (jsvObjectIteratorHasValue(&it) && !(jsiStatus & JSIS_TIMERS_CHANGED)) {
-    bool hasDeletedTimer = false;
-    JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
-    JsSysTime timerTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0));
-    JsSysTime timeUntilNext = timerTime - timePassed;
-
-    if (timeUntilNext<=0) {
-      // we're now doing work
-      jsiSetBusy(BUSY_INTERACTIVE, true);
-      wasBusy = true;
-      JsVar *timerCallback = jsvObjectGetChild(timerPtr, "callback", 0);
-      JsVar *watchPtr = jsvObjectGetChild(timerPtr, "watch", 0); // for debounce - may be undefined
-      bool exec = true;
-      JsVar *data = 0;
-      if (watchPtr) {
-        data = jsvNewObject();
-        // if we were from a watch then we were delayed by the debounce time...
-        if (data) {
-          JsVarInt delay = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
-          // Create the 'time' variable that will be passed to the user
-          JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(jsiLastIdleTime+timeUntilNext-delay)/1000);
-          // if it was a watch, set the last state up
-          bool state = jsvGetBoolAndUnLock(jsvObjectSetChild(data, "state", jsvObjectGetChild(watchPtr, "state", 0)));
-          exec = jsiShouldExecuteWatch(watchPtr, state);
-          // set up the lastTime variable of data to what was in the watch
-          jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
-          // set up the watches lastTime to this one
-          jsvObjectSetChild(watchPtr, "lastTime", timePtr); // don't unlock
-          jsvObjectSetChildAndUnLock(data, "time", timePtr);
-        }
-      }
-      JsVar *interval = jsvObjectGetChild(timerPtr, "interval", 0);
-      if (exec) {
-        bool execResult;
-        if (data) {
-          execResult = jsiExecuteEventCallback(0, timerCallback, 1, &data);
-        } else {
-          JsVar *argsArray = jsvObjectGetChild(timerPtr, "args", 0);
-          execResult = jsiExecuteEventCallbackArgsArray(0, timerCallback, argsArray);
-          jsvUnLock(argsArray);
-        }
-        if (!execResult && interval) {
-          jsError("Ctrl-C while processing interval - removing it.");
-          jsErrorFlags |= JSERR_CALLBACK;
-          // by setting interval to 0, we now think we've for a Timeout,
-          // which will get removed.
-          jsvUnLock(interval);
-          interval = 0;
+  /* Timers' "time" values are relative to jsiTimerBaseTime, so they don't
+   * need rewriting as time passes. We only look through them when one of
+   * them could be due (or the last look was cut short) */
+  if (time - jsiTimerBaseTime > jshGetTimeFromMilliseconds(TIMER_REBASE_TIME))
+    jsiTimersRebase(time);
+  JsSysTime timeSinceBase = time - jsiTimerBaseTime;
+  if (timeSinceBase >= jsiTimerNextTime) {
+    jsiTimerNextTime = JSSYSTIME_MAX;
+    jsiStatus = jsiStatus & ~JSIS_TIMERS_CHANGED;
+    JsVar *timerArrayPtr = jsvLock(timerArray);
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, timerArrayPtr);
+    while (jsvObjectIteratorHasValue(&it) && !(jsiStatus & JSIS_TIMERS_CHANGED)) {
+      bool hasDeletedTimer = false;
+      JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
+      JsSysTime timerTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0));
+      JsSysTime timeUntilNext = timerTime - timeSinceBase;
+
+      if (timeUntilNext<=0) {
+        // we're now doing work
+        jsiSetBusy(BUSY_INTERACTIVE, true);
+        wasBusy = true;
+        JsVar *timerCallback = jsvObjectGetChild(timerPtr, "callback", 0);
+        JsVar *watchPtr = jsvObjectGetChild(timerPtr, "watch", 0); // for debounce - may be undefined
+        bool exec = true;
+        JsVar *data = 0;
+        if (watchPtr) {
+          data = jsvNewObject();
+          // if we were from a watch then we were delayed by the debounce time...
+          if (data) {
+            JsVarInt delay = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
+            // Create the 'time' variable that will be passed to the user
+            JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(jsiLastIdleTime+timeUntilNext-delay)/1000);
+            // if it was a watch, set the last state up
+            bool state = jsvGetBoolAndUnLock(jsvObjectSetChild(data, "state", jsvObjectGetChild(watchPtr, "state", 0)));
+            exec = jsiShouldExecuteWatch(watchPtr, state);
+            // set up the lastTime variable of data to what was in the watch
+            jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+            // set up the watches lastTime to this one
+            jsvObjectSetChild(watchPtr, "lastTime", timePtr); // don't unlock
+            jsvObjectSetChildAndUnLock(data, "time", timePtr);
+          }
         }
-      }
-      jsvUnLock(data);
-      if (watchPtr) { // if we had a watch pointer, be sure to remove us from it
-        jsvObjectSetChild(watchPtr, "timeout", 0);
-        // Deal with non-recurring watches
+        JsVar *interval = jsvObjectGetChild(timerPtr, "interval", 0);
         if (exec) {
-          bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
-          if (!watchRecurring) {
-            JsVar *watchArrayPtr = jsvLock(watchArray);
-            JsVar *watchNamePtr = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
-            if (watchNamePtr) {
-              jsvRemoveChild(watchArrayPtr, watchNamePtr);
-              jsvUnLock(watchNamePtr);
+          bool execResult;
+          if (data) {
+            execResult = jsiExecuteEventCallback(0, timerCallback, 1, &data);
+          } else {
+            JsVar *argsArray = jsvObjectGetChild(timerPtr, "args", 0);
+            execResult = jsiExecuteEventCallbackArgsArray(0, timerCallback, argsArray);
+            jsvUnLock(argsArray);
+          }
+          if (!execResult && interval) {
+            jsError("Ctrl-C while processing interval - removing it.");
+            jsErrorFlags |= JSERR_CALLBACK;
+            // by setting interval to 0, we now think we've for a Timeout,
+            // which will get removed.
+            jsvUnLock(interval);
+            interval = 0;
+          }
+        }
+        jsvUnLock(data);
+        if (watchPtr) { // if we had a watch pointer, be sure to remove us from it
+          jsvObjectSetChild(watchPtr, "timeout", 0);
+          // Deal with non-recurring watches
+          if (exec) {
+            bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
+            if (!watchRecurring) {
+              JsVar *watchArrayPtr = jsvLock(watchArray);
+              JsVar *watchNamePtr = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
+              if (watchNamePtr) {
+                jsvRemoveChild(watchArrayPtr, watchNamePtr);
+                jsvUnLock(watchNamePtr);
+              }
+              jsvUnLock(watchArrayPtr);
+              jsiWatchesChanged();
+              Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+              if (!jsiIsWatchingPin(pin))
+                jshPinWatch(pin, false);
             }
-            jsvUnLock(watchArrayPtr);
-            Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
-            if (!jsiIsWatchingPin(pin))
-              jshPinWatch(pin, false);
           }
+          jsvUnLock(watchPtr);
         }
-        jsvUnLock(watchPtr);
-      }
 
-      if (interval) {
-        timeUntilNext = timeUntilNext + jsvGetLongIntegerAndUnLock(interval);
-      } else {
-        // free
-        // Beware... may have already been removed!
-        jsvObjectIteratorRemoveAndGotoNext(&it, timerArrayPtr);
-        hasDeletedTimer = true;
-        timeUntilNext = -1;
-      }
-      jsvUnLock(timerCallback);
+        if (interval) {
+          timeUntilNext = timeUntilNext + jsvGetLongIntegerAndUnLock(interval);
+          // update the timer's time
+          jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger(timeUntilNext + timeSinceBase));
+        } else {
+          // free
+          // Beware... may have already been removed!
+          jsvObjectIteratorRemoveAndGotoNext(&it, timerArrayPtr);
+          hasDeletedTimer = true;
+        }
+        jsvUnLock(timerCallback);
 
+      }
+      if (!hasDeletedTimer) {
+        // update the time the next timer is due
+        if (timeUntilNext + timeSinceBase < jsiTimerNextTime)
+          jsiTimerNextTime = timeUntilNext + timeSinceBase;
+        jsvObjectIteratorNext(&it);
+      }
+      jsvUnLock(timerPtr);
     }
-    // update the time until the next timer
-    if (timeUntilNext>=0 && timeUntilNext < minTimeUntilNext)
-      minTimeUntilNext = timeUntilNext;
-    // update the timer's time
-    if (!hasDeletedTimer) {
-      jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger(timeUntilNext));
-      jsvObjectIteratorNext(&it);
-    }
-    jsvUnLock(timerPtr);
+    // If the timers changed we didn't get to check them all, so look again next time
+    if (jsiStatus & JSIS_TIMERS_CHANGED)
+      jsiTimerNextTime = 0;
+    jsvObjectIteratorFree(&it);
+    jsvUnLock(timerArrayPtr);
+  }
+  // work out how long until the next timer
+  if (jsiTimerNextTime != JSSYSTIME_MAX) {
+    minTimeUntilNext = jsiTimerNextTime + jsiTimerBaseTime - time;
+    if (minTimeUntilNext<0) minTimeUntilNext = 0;
   }
-  jsvObjectIteratorFree(&it);
-  jsvUnLock(timerArrayPtr);
   /* We might have left the timers loop with stuff to do because the contents of it
    * changed. It's not a big deal because it could only have changed because a timer
    * got executed - so `wasBusy` got set and we know we're going to go around the
    * loop again before sleeping.
    */
 
+#ifndef SAVE_ON_FLASH
+  // Deliver any received Serial data that has waited long enough for 'chunk' characters
+  if (jsiSerialPending) {
+    JsSysTime timeUntilDelivery = jsiSerialPendingTime - time;
+    if (timeUntilDelivery <= 0) {
+      jsiDeliverUSARTChunks();
+      wasBusy = true;
+    } else if (timeUntilDelivery < minTimeUntilNext)
+      minTimeUntilNext = timeUntilDelivery;
+  }
+#endif
+
   // Check for events that might need to be processed from other libraries
   if (jswIdle()) wasBusy = true;
 
@@ -2013,6 +2237,23 @@ void jsiIdle() {
     jsiSetBusy(BUSY_INTERACTIVE, false);
   }
 
+#ifndef SAVE_ON_FLASH
+  /* If we're getting low on memory, garbage collect a bit at a time so we
+   * never stop for long. Once started, keep going each time around the loop */
+  if (jsvGarbageCollectInProgress() ||
+      (loopsIdling==1 && !jsvMoreFreeVariablesThan(jsvGetMemoryTotal() / JS_VARS_BEFORE_IDLE_INCREMENTAL_GC_DIVISOR))) {
+    jsiSetBusy(BUSY_INTERACTIVE, true);
+    jsvGarbageCollectIncremental(jshGetTimeFromMilliseconds(JS_IDLE_INCREMENTAL_GC_MS));
+    jsiSetBusy(BUSY_INTERACTIVE, false);
+  } else if (loopsIdling>=1 && jsvDefragmentWanted()) {
+    /* A flat string couldn't be allocated earlier - move a few vars each
+     * time around the loop to make free memory contiguous again */
+    jsiSetBusy(BUSY_INTERACTIVE, true);
+    jsvDefragment();
+    jsiSetBusy(BUSY_INTERACTIVE, false);
+  }
+#endif
+
   /* if we've been around this loop, there is nothing to do, and
    * we have a spare 10ms then let's do some Garbage Collection
    * if we think we need to */
@@ -2032,6 +2273,10 @@ void jsiIdle() {
   if (loopsIdling>1 && // once around the idle loop without having done any work already (just in case)
 #ifdef USB
       !jshIsUSBSERIALConnected() && // if USB is on, no point sleeping (later, sleep might be more drastic)
+#endif
+#ifndef SAVE_ON_FLASH
+      !jsvGarbageCollectInProgress() && // finish garbage collecting first
+      !jsvDefragmentWanted() && // ... and defragmenting
 #endif
       !jshHasEvents() && //no events have arrived in the mean time
       !jshHasTransmitData()/* && //nothing left to send over serial?
@@ -2134,7 +2379,7 @@ void jsiDumpState(vcbprintf_callback user_callback, void *user_data) {
     JsVar *timerInterval = jsvObjectGetChild(timer, "interval", 0);
     user_callback(timerInterval ? "setInterval(" : "setTimeout(", user_data);
     jsiDumpJSON(user_callback, user_data, timerCallback, 0);
-    cbprintf(user_callback, user_data, ", %f);\n", jshGetMillisecondsFromTime(timerInterval ? jsvGetLongInteger(timerInterval) : jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timer, "time", 0))));
+    cbprintf(user_callback, user_data, ", %f);\n", jshGetMillisecondsFromTime(timerInterval ? jsvGetLongInteger(timerInterval) : (jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timer, "time", 0)) + jsiTimerBaseTime - jshGetSystemTime())));
     jsvUnLock2(timerInterval, timerCallback);
     // next
     jsvUnLock(timer);
@@ -2176,9 +2421,16 @@ JsVarInt jsiTimerAdd(JsVar *timerPtr) {
   JsVar *timerArrayPtr = jsvLock(timerArray);
   JsVarInt itemIndex = jsvArrayAddToEnd(timerArrayPtr, timerPtr, 1) - 1;
   jsvUnLock(timerArrayPtr);
+  jsiTimerTimeChanged(timerPtr);
   return itemIndex;
 }
 
+void jsiTimerTimeChanged(JsVar *timerPtr) {
+  JsSysTime timerTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0));
+  if (timerTime < jsiTimerNextTime)
+    jsiTimerNextTime = timerTime;
+}
+
 void jsiTimersChanged() {
   jsiStatus |= JSIS_TIMERS_CHANGED;
 }
@@ -19,6 +19,7 @@
 
 #define JSI_WATCHES_NAME "watches"
 #define JSI_TIMERS_NAME "timers"
+#define JSI_WATCH_INDEX_NAME "wix"
 #define JSI_HISTORY_NAME "history"
 #define JSI_INIT_CODE_NAME "init"
 #define JSI_ONINIT_NAME "onInit"
@@ -41,6 +42,7 @@ bool jsiFreeMoreMemory();
 
 bool jsiHasTimers(); // are there timers still left to run?
 bool jsiIsWatchingPin(Pin pin); // are there any watches for the given pin?
+void jsiWatchesChanged(); // watches have been added or removed, so the index of watches for each EXTI channel must be rebuilt
 
 /// Queue a function, string, or array (of funcs/strings) to be executed next time around the idle loop
 void jsiQueueEvents(JsVar *object, JsVar *callback, JsVar **args, int argCount);
@@ -121,6 +123,8 @@ void jsiSetSleep(JsiSleepType isSleep);
 #define USART_CALLBACK_NAME JS_EVENT_PREFIX"data"
 #define USART_BAUDRATE_NAME "_baudrate"
 #define DEVICE_OPTIONS_NAME "_options"
+#define USART_PENDING_NAME JS_HIDDEN_CHAR_STR"rx" ///< Received data waiting for Serial.setup's 'chunk' characters
+#define USART_CHUNK_TIMEOUT 10 ///< Milliseconds received data waits for 'chunk' characters before it is delivered anyway
 #define INIT_CALLBACK_NAME JS_EVENT_PREFIX"init" ///< Callback for `E.on('init'`
 
 typedef enum {
@@ -139,6 +143,7 @@ typedef enum {
   JSIS_TODO_MASK = JSIS_TODO_FLASH_SAVE|JSIS_TODO_FLASH_LOAD|JSIS_TODO_RESET,
   JSIS_CONSOLE_FORCED = 512, // see jsiSetConsoleDevice
   JSIS_WATCHDOG_AUTO = 1024, // Automatically kick the watchdog timer on idle
+  JSIS_WATCHES_CHANGED = 2048, // Watches have been added or removed (see jsiWatchesChanged)
 
   JSIS_ECHO_OFF_MASK = JSIS_ECHO_OFF|JSIS_ECHO_OFF_FOR_LINE
 } PACKED_FLAGS JsiStatus;
@@ -148,14 +153,17 @@ bool jsiEcho();
 
 extern Pin pinBusyIndicator;
 extern Pin pinSleepIndicator;
-extern JsSysTime jsiLastIdleTime; ///< The last time we went around the idle loop - use this for timers
+extern JsSysTime jsiLastIdleTime; ///< The last time we went around the idle loop
+extern JsSysTime jsiTimerBaseTime; ///< The time that timers' "time" values are relative to
 
 void jsiDumpState(vcbprintf_callback user_callback, void *user_data);
 #define TIMER_MIN_INTERVAL 0.1 // in milliseconds
+#define TIMER_REBASE_TIME 60000 // in milliseconds - how often timers' "time" values are rewritten relative to the current time
 extern JsVarRef timerArray; // Linked List of timers to check and run
 extern JsVarRef watchArray; // Linked List of input watches to check and run
 
 extern JsVarInt jsiTimerAdd(JsVar *timerPtr);
+extern void jsiTimerTimeChanged(JsVar *timerPtr); // A timer's "time" has been set, so make sure we check it when it's due
 extern void jsiTimersChanged(); // Flag timers changed so we can skip out of the loop if needed
 // end for jswrap_interactive/io.c ------------------------------------------------
 
@@ -210,6 +210,34 @@ static ALWAYS_INLINE void jslSingleChar() {
   jslGetNextCh();
 }
 
+#ifndef SAVE_ON_FLASH
+// handle a token from pretokenised code (see jslNewTokenisedStringFromLexer)
+static void NO_INLINE jslTokenisedChar() {
+  lex->tk = LEX_TOKENISED_TOKEN(lex->currCh);
+  jslGetNextCh();
+  if (lex->tk == LEX_STR) {
+    // length byte, followed by the characters themselves - no escaping needed
+    size_t length = (unsigned char)lex->currCh;
+    jslGetNextCh();
+    lex->tokenValue = jsvNewFromEmptyString();
+    if (!lex->tokenValue) {
+      lex->tk = LEX_EOF;
+      return;
+    }
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, lex->tokenValue, 0);
+    while (length--) {
+      jslTokenAppendChar(lex->currCh);
+      jsvStringIteratorAppend(&it, lex->currCh);
+      jslGetNextCh();
+    }
+    jsvStringIteratorFree(&it);
+  }
+  // reserved words can still be used as field names, but their text is only
+  // filled in if asked for - see jslGetTokenValueAsString
+}
+#endif
+
 void jslGetNextToken() {
   jslGetNextToken_start:
   // Skip whitespace
@@ -253,7 +281,12 @@ void jslGetNextToken() {
   if (((unsigned char)lex->currCh) < jslJumpTableStart ||
       ((unsigned char)lex->currCh) > jslJumpTableEnd) {
     // if unhandled by the jump table, just pass it through as a single character
-    jslSingleChar();
+#ifndef SAVE_ON_FLASH
+    if (LEX_IS_TOKENISED_CHAR(lex->currCh))
+      jslTokenisedChar();
+    else
+#endif
+      jslSingleChar();
   } else {
     switch(jslJumpTable[((unsigned char)lex->currCh) - jslJumpTableStart]) {
     case JSLJT_ID: {
@@ -653,7 +686,7 @@ void jslTokenAsString(int token, char *str, size_t len) {
         /*LEX_R_DO :       */ "do\0"
         /*LEX_R_WHILE :    */ "while\0"
         /*LEX_R_FOR :      */ "for\0"
-        /*LEX_R_BREAK :    */ "return\0"
+        /*LEX_R_BREAK :    */ "break\0"
         /*LEX_R_CONTINUE   */ "continue\0"
         /*LEX_R_FUNCTION   */ "function\0"
         /*LEX_R_RETURN     */ "return\0"
@@ -710,6 +743,13 @@ void jslGetTokenString(char *str, size_t len) {
 
 char *jslGetTokenValueAsString() {
   assert(lex->tokenl < JSLEX_MAX_TOKEN_LENGTH);
+#ifndef SAVE_ON_FLASH
+  if (!lex->tokenl && lex->tk>=LEX_R_LIST_START) {
+    // pretokenised reserved word - we have to make up the text
+    jslTokenAsString(lex->tk, lex->token, JSLEX_MAX_TOKEN_LENGTH);
+    lex->tokenl = (unsigned char)strlen(lex->token);
+  }
+#endif
   lex->token[lex->tokenl]  = 0; // add final null
   return lex->token;
 }
@@ -722,9 +762,7 @@ JsVar *jslGetTokenValueAsVar() {
   if (lex->tokenValue) {
     return jsvLockAgain(lex->tokenValue);
   } else {
-    assert(lex->tokenl < JSLEX_MAX_TOKEN_LENGTH);
-    lex->token[lex->tokenl]  = 0; // add final null
-    return jsvNewFromString(lex->token);
+    return jsvNewFromString(jslGetTokenValueAsString());
   }
 }
 
@@ -811,6 +849,171 @@ JsVar *jslNewFromLexer(JslCharPos *charFrom, size_t charTo) {
   return var;
 }
 
+#ifndef SAVE_ON_FLASH
+static ALWAYS_INLINE void jslTokeniseOutput(JsvStringIterator *dst, size_t *length, char ch) {
+  if (dst) {
+    jsvStringIteratorSetChar(dst, ch);
+    jsvStringIteratorNext(dst);
+  }
+  (*length)++;
+}
+
+/* Tokenise the current lexer's source from charFrom to charTo, writing the
+ * result into dst (if it is nonzero). Returns the number of characters used.
+ * See jslNewTokenisedStringFromLexer */
+static size_t jslTokenise(JslCharPos *charFrom, size_t charTo, JsvStringIterator *dst) {
+  size_t length = 0;
+  jslSeekToP(charFrom);
+  // 'src' follows along behind the lexer so we can copy whitespace, comments and ID/number text
+  JsvStringIterator src;
+  jsvStringIteratorNew(&src, lex->sourceVar, jsvStringIteratorGetIndex(&charFrom->it)-1);
+  while (lex->tk!=LEX_EOF && jsvStringIteratorGetIndex(&lex->tokenStart.it)-1 < charTo) {
+    size_t tokenStart = jsvStringIteratorGetIndex(&lex->tokenStart.it)-1;
+    size_t tokenEnd = jsvStringIteratorGetIndex(&lex->it)-1;
+    /* Keep whitespace and comments between tokens as they were, so line numbers
+     * stay correct and dump()/edit() show the code as it was written. The lexer
+     * skips them anyway. */
+    while (jsvStringIteratorHasChar(&src) && jsvStringIteratorGetIndex(&src) < tokenStart) {
+      jslTokeniseOutput(dst, &length, jsvStringIteratorGetChar(&src));
+      jsvStringIteratorNext(&src);
+    }
+    bool copyText = lex->tk<=LEX_UNFINISHED_COMMENT && lex->tk>=LEX_ID;
+    if (lex->tk==LEX_STR) {
+      // If we can, store the string unescaped with a length byte in front
+      size_t stringLength = jsvGetStringLength(lex->tokenValue);
+      if (stringLength<=LEX_TOKENISED_STRING_MAX &&
+          stringLength!='\n' && // the length byte mustn't look like a newline
+          jsvGetStringIndexOf(lex->tokenValue, '\n')<0) {
+        copyText = false;
+        jslTokeniseOutput(dst, &length, (char)LEX_TOKENISED_CHAR(LEX_STR));
+        jslTokeniseOutput(dst, &length, (char)stringLength);
+        JsvStringIterator it;
+        jsvStringIteratorNew(&it, lex->tokenValue, 0);
+        while (jsvStringIteratorHasChar(&it)) {
+          jslTokeniseOutput(dst, &length, jsvStringIteratorGetChar(&it));
+          jsvStringIteratorNext(&it);
+        }
+        jsvStringIteratorFree(&it);
+      }
+    } else if (!copyText) {
+      jslTokeniseOutput(dst, &length, (lex->tk>=LEX_ID) ? (char)LEX_TOKENISED_CHAR(lex->tk) : (char)lex->tk);
+    }
+    while (jsvStringIteratorHasChar(&src) && jsvStringIteratorGetIndex(&src) < tokenEnd) {
+      if (copyText) jslTokeniseOutput(dst, &length, jsvStringIteratorGetChar(&src));
+      jsvStringIteratorNext(&src);
+    }
+    jslGetNextToken();
+  }
+  jsvStringIteratorFree(&src);
+  return length;
+}
+
+JsVar *jslNewTokenisedStringFromLexer(JslCharPos *charFrom, size_t charTo) {
+  JsLex newLex;
+  JsLex *oldLex = jslSetLex(&newLex);
+  jslInit(oldLex->sourceVar);
+  // First pass works out the length, second one fills in the data
+  size_t length = jslTokenise(charFrom, charTo, 0);
+  JsVar *var = 0;
+  if (length > JSV_FLAT_STRING_BREAK_EVEN)
+    var = jsvNewFlatStringOfLength((unsigned int)length);
+  if (!var)
+    var = jsvNewStringOfLength((unsigned int)length);
+  if (var) {
+    JsvStringIterator dst;
+    jsvStringIteratorNew(&dst, var, 0);
+    jslTokenise(charFrom, charTo, &dst);
+    jsvStringIteratorFree(&dst);
+  }
+  jslKill();
+  jslSetLex(oldLex);
+  return var;
+}
+
+typedef struct {
+  char lastCh; ///< The last character that was output
+  bool lastWasToken; ///< Was the last thing output from a token?
+  char quote; ///< If we're inside a quoted string, the quote character
+  char comment; ///< If we're inside a comment, '/' or '*'
+} JslPrintState;
+
+static bool jslIsIDChar(char ch) {
+  return isAlpha(ch) || isNumeric(ch) || ch=='$';
+}
+
+/* Print the next character (or token) from pretokenised code and move on.
+ * Returns the number of characters that were output. */
+static size_t jslPrintTokenisedChar(JsvStringIterator *it, JslPrintState *st, vcbprintf_callback user_callback, void *user_data) {
+  char ch = jsvStringIteratorGetChar(it);
+  char prevCh = st->lastCh;
+  jsvStringIteratorNext(it);
+  char buf[JSLEX_MAX_TOKEN_LENGTH+3];
+  if (st->quote || st->comment || !LEX_IS_TOKENISED_CHAR(ch)) {
+    // Just a normal character - but keep track of strings/comments so we don't expand their contents
+    bool commentEnded = false;
+    if (st->quote) {
+      if (ch==st->quote && prevCh!='\\') st->quote = 0;
+      else if (ch=='\\' && prevCh=='\\') ch = 0; // so an escaped backslash isn't seen as an escape
+    } else if (st->comment) {
+      if ((st->comment=='/' && ch=='\n') ||
+          (st->comment=='*' && ch=='/' && prevCh=='*')) {
+        st->comment = 0;
+        commentEnded = true;
+      }
+    } else if (ch=='"' || ch=='\'') {
+      st->quote = ch;
+    } else if (prevCh=='/' && (ch=='/' || ch=='*') && !st->lastWasToken) {
+      st->comment = ch;
+    }
+    size_t l = 0;
+    if (st->lastWasToken && jslIsIDChar(prevCh) && jslIsIDChar(ch))
+      buf[l++] = ' ';
+    buf[l++] = ch ? ch : '\\';
+    buf[l] = 0;
+    user_callback(buf, user_data);
+    st->lastCh = commentEnded ? ' ' : ch; // so '*//' isn't seen as the start of another comment
+    st->lastWasToken = false;
+    return l;
+  }
+  int tk = LEX_TOKENISED_TOKEN(ch);
+  size_t l = 0;
+  if (tk==LEX_STR) {
+    // unescaped string with a length byte in front
+    size_t length = (unsigned char)jsvStringIteratorGetChar(it);
+    jsvStringIteratorNext(it);
+    user_callback("\"", user_data);
+    l++;
+    while (length--) {
+      const char *s = escapeCharacter(jsvStringIteratorGetChar(it));
+      user_callback(s, user_data);
+      l += strlen(s);
+      jsvStringIteratorNext(it);
+    }
+    user_callback("\"", user_data);
+    st->lastCh = '"';
+    return l+1;
+  }
+  jslTokenAsString(tk, &buf[1], sizeof(buf)-1);
+  char *s = &buf[1];
+  if (jslIsIDChar(prevCh) && jslIsIDChar(*s)) *(--s) = ' ';
+  user_callback(s, user_data);
+  l = strlen(s);
+  st->lastCh = s[l-1];
+  st->lastWasToken = true;
+  return l;
+}
+
+void jslPrintTokenisedString(JsVar *code, vcbprintf_callback user_callback, void *user_data) {
+  JslPrintState st;
+  memset(&st, 0, sizeof(st));
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, code, 0);
+  while (jsvStringIteratorHasChar(&it))
+    jslPrintTokenisedChar(&it, &st, user_callback, user_data);
+  jsvStringIteratorFree(&it);
+}
+#endif
+
 /// Return the line number at the current character position (this isn't fast as it searches the string)
 unsigned int jslGetLineNumber() {
   size_t line;
@@ -848,20 +1051,34 @@ void jslPrintTokenLineMarker(vcbprintf_callback user_callback, void *user_data,
   }
 
   // print the string until the end of the line, or 60 chars (whichever is lesS)
-  int chars = 0;
+  size_t chars = 0;
   JsvStringIterator it;
   jsvStringIteratorNew(&it, lex->sourceVar, startOfLine);
+#ifndef SAVE_ON_FLASH
+  JslPrintState st;
+  memset(&st, 0, sizeof(st));
+  size_t markerCol = 0;
+#endif
   while (jsvStringIteratorHasChar(&it) && chars<60) {
     char ch = jsvStringIteratorGetChar(&it);
     if (ch == '\n') break;
+#ifndef SAVE_ON_FLASH
+    // pretokenised code may expand, so work out where the marker really goes
+    if (jsvStringIteratorGetIndex(&it) == tokenPos) markerCol = chars+1;
+    chars += jslPrintTokenisedChar(&it, &st, user_callback, user_data);
+#else
     char buf[2];
     buf[0] = ch;
     buf[1] = 0;
     user_callback(buf, user_data);
     chars++;
     jsvStringIteratorNext(&it);
+#endif
   }
   jsvStringIteratorFree(&it);
+#ifndef SAVE_ON_FLASH
+  if (markerCol) col = markerCol + (col - (tokenPos+1-startOfLine));
+#endif
 
   if (lineLength > 60)
     user_callback("...", user_data);
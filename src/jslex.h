@@ -86,6 +86,20 @@ typedef enum LEX_TYPES {
     LEX_R_LIST_END /* always the last entry */
 } LEX_TYPES;
 
+/* Pretokenised function code stores each token from LEX_ID upwards as a single
+ * byte (see jslNewTokenisedStringFromLexer). This is how we map to/from them.
+ * The range starts just above 0xA0, as that is treated as whitespace. */
+#define LEX_TOKENISED_OFFSET (LEX_ID-0xA1)
+#define LEX_TOKENISED_CHAR(TK) ((unsigned char)((TK)-LEX_TOKENISED_OFFSET))
+#define LEX_TOKENISED_TOKEN(CH) ((short)((unsigned char)(CH)+LEX_TOKENISED_OFFSET))
+/// Is the given character in a pretokenised string actually a token?
+#define LEX_IS_TOKENISED_CHAR(CH) (((unsigned char)(CH))>=LEX_TOKENISED_CHAR(LEX_ID) && ((unsigned char)(CH))<LEX_TOKENISED_CHAR(LEX_R_LIST_END))
+/** A string in pretokenised code is stored as LEX_TOKENISED_CHAR(LEX_STR),
+ * followed by a length byte and then the unescaped characters. Strings that
+ * contain a newline, or whose length byte would be '\n', are stored as they were
+ * written so that line numbers can still be found by searching for newlines. */
+#define LEX_TOKENISED_STRING_MAX 255
+
 typedef struct JslCharPos {
   JsvStringIterator it;
   char currCh;
@@ -144,6 +158,11 @@ void jslSeek(JslCharPos seekToChar); // like jslSeekTo, but doesn't pre-fill cha
 void jslGetNextToken(); ///< Get the text token from our text string
 
 JsVar *jslNewFromLexer(JslCharPos *charFrom, size_t charTo); // Create a new STRING from part of the lexer
+/** Create a new STRING from part of the lexer, but with reserved words and operators
+ * stored as single bytes, and with all whitespace apart from newlines removed. */
+JsVar *jslNewTokenisedStringFromLexer(JslCharPos *charFrom, size_t charTo);
+/// Print a (possibly) pretokenised string as normal JS source code
+void jslPrintTokenisedString(JsVar *code, vcbprintf_callback user_callback, void *user_data);
 
 /// Return the line number at the current character position (this isn't fast as it searches the string)
 unsigned int jslGetLineNumber();
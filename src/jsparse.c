@@ -19,6 +19,9 @@
 #include "jswrap_functions.h" // insane check for eval in jspeFunctionCall
 #include "jswrap_json.h" // for jsfPrintJSON
 #include "jswrap_espruino.h" // for jswrap_espruino_memoryArea
+#ifdef USE_BYTECODE
+#include "jsbytecode.h"
+#endif
 
 /* Info about execution when Parsing - this saves passing it on the stack
  * for each call */
@@ -370,6 +373,9 @@ NO_INLINE JsVar *jspeFunctionDefinition(bool parseNamedFunction) {
     jsWarn("Function marked with \"compiled\" uploaded in source form");
   }
 #endif
+#ifdef USE_BYTECODE
+  bool compileBytecode = lex->tk==LEX_STR && !strcmp(jslGetTokenValueAsString(lex), "bytecode");
+#endif
 
   /* If the function starts with return, treat it specially -
    * we don't want to store the 'return' part of it
@@ -408,8 +414,23 @@ NO_INLINE JsVar *jspeFunctionDefinition(bool parseNamedFunction) {
         funcCodeVar->varData.nativeStr.len = (uint16_t)(lastTokenEnd - s);
       }
     } else {
+#ifndef SAVE_ON_FLASH
+      /* Store the code pretokenised, so we don't have to skip over whitespace
+       * and match reserved words each time the function is called */
+      funcCodeVar = jslNewTokenisedStringFromLexer(&funcBegin, (size_t)lastTokenEnd);
+#else
       funcCodeVar = jslNewFromLexer(&funcBegin, (size_t)lastTokenEnd);
+#endif
+    }
+#ifdef USE_BYTECODE
+    if (compileBytecode && funcCodeVar) {
+      JsVar *funcBytecodeVar = jsbCompile(funcVar, funcCodeVar);
+      if (funcBytecodeVar)
+        jsvUnLock2(jsvAddNamedChild(funcVar, funcBytecodeVar, JSPARSE_FUNCTION_BYTECODE_NAME), funcBytecodeVar);
+      else
+        jsWarn("Function marked with \"bytecode\" couldn't be compiled, running it from source");
     }
+#endif
     jsvUnLock2(jsvAddNamedChild(funcVar, funcCodeVar, JSPARSE_FUNCTION_CODE_NAME), funcCodeVar);
     // scope var
     JsVar *funcScopeVar = jspeiGetScopesAsVar();
@@ -599,6 +620,9 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
       JsVar *functionScope = 0;
       JsVar *functionCode = 0;
+#ifdef USE_BYTECODE
+      JsVar *functionBytecode = 0;
+#endif
       JsVar *functionInternalName = 0;
       uint16_t functionLineNumber = 0;
 
@@ -683,6 +707,9 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
         if (jsvIsString(param)) {
           if (jsvIsStringEqual(param, JSPARSE_FUNCTION_SCOPE_NAME)) functionScope = jsvSkipName(param);
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_CODE_NAME)) functionCode = jsvSkipName(param);
+#ifdef USE_BYTECODE
+          else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_BYTECODE_NAME)) functionBytecode = jsvSkipName(param);
+#endif
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_NAME_NAME)) functionInternalName = jsvSkipName(param);
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_THIS_NAME)) {
             jsvUnLock(thisVar);
@@ -759,9 +786,18 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
 
             JsLex newLex;
-            JsLex *oldLex = jslSetLex(&newLex);
-            jslInit(functionCode);
-            newLex.lineNumberOffset = functionLineNumber;
+            JsLex *oldLex = lex;
+#ifdef USE_BYTECODE
+            // bytecode doesn't need a lexer - errors get reported at the call site
+            bool useLexer = !functionBytecode;
+#else
+            const bool useLexer = true;
+#endif
+            if (useLexer) {
+              jslSetLex(&newLex);
+              jslInit(functionCode);
+              newLex.lineNumberOffset = functionLineNumber;
+            }
             JSP_SAVE_EXECUTE();
             // force execute without any previous state
 #ifdef USE_DEBUGGER
@@ -769,7 +805,11 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 #else
             execInfo.execute = EXEC_YES | (execInfo.execute&(EXEC_CTRL_C_MASK|EXEC_ERROR_MASK));
 #endif
-            if (jsvIsFunctionReturn(function)) {
+            if (!useLexer) {
+#ifdef USE_BYTECODE
+              returnVar = jsbExecute(functionBytecode, functionRoot);
+#endif
+            } else if (jsvIsFunctionReturn(function)) {
               #ifdef USE_DEBUGGER
                 // we didn't parse a statement so wouldn't trigger the debugger otherwise
                 if (execInfo.execute&EXEC_DEBUGGER_NEXT_LINE && JSP_SHOULD_EXECUTE) {
@@ -810,8 +850,10 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
               execInfo.execute |= EXEC_DEBUGGER_NEXT_LINE;
 #endif
 
-            jslKill();
-            jslSetLex(oldLex);
+            if (useLexer) {
+              jslKill();
+              jslSetLex(oldLex);
+            }
 
             if (hasError) {
               execInfo.execute |= hasError; // propogate error
@@ -844,6 +886,9 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
         execInfo.scopeCount = oldScopeCount;
       }
       jsvUnLock(functionCode);
+#ifdef USE_BYTECODE
+      jsvUnLock(functionBytecode);
+#endif
       jsvUnLock(functionRoot);
     }
 
@@ -1563,8 +1608,7 @@ NO_INLINE JsVar *__jspeBinaryExpression(JsVar *a, unsigned int lastPrecedence) {
           jsvUnLock3(av, bv, a);
           a = jsvNewFromBool(inst);
         } else {  // --------------------------------------------- NORMAL
-          JsVar *res = jsvMathsOpSkipNames(a, b, op);
-          jsvUnLock(a); a = res;
+          a = jsvMathsOpSkipNamesAndUnLockA(a, b, op);
         }
       }
       jsvUnLock(b);
@@ -1614,6 +1658,50 @@ JsVar *jspeConditionalExpression() {
   return __jspeConditionalExpression(jspeBinaryExpression());
 }
 
+/** Perform the assignment `lhs op rhs`, where op is '=' or one of the
+ * LEX_*EQUAL tokens and rhs has already had its name skipped */
+void jspAssign(JsVar *lhs, int op, JsVar *rhs) {
+  if (op=='=') {
+    /* If we're assigning to this and we don't have a parent,
+     * add it to the symbol table root */
+    if (!jsvGetRefs(lhs) && jsvIsName(lhs)) {
+      if (!jsvIsArrayBufferName(lhs) && !jsvIsNewChild(lhs))
+        jsvAddName(execInfo.root, lhs);
+    }
+    jspReplaceWith(lhs, rhs);
+  } else {
+    if (op==LEX_PLUSEQUAL) op='+';
+    else if (op==LEX_MINUSEQUAL) op='-';
+    else if (op==LEX_MULEQUAL) op='*';
+    else if (op==LEX_DIVEQUAL) op='/';
+    else if (op==LEX_MODEQUAL) op='%';
+    else if (op==LEX_ANDEQUAL) op='&';
+    else if (op==LEX_OREQUAL) op='|';
+    else if (op==LEX_XOREQUAL) op='^';
+    else if (op==LEX_RSHIFTEQUAL) op=LEX_RSHIFT;
+    else if (op==LEX_LSHIFTEQUAL) op=LEX_LSHIFT;
+    else if (op==LEX_RSHIFTUNSIGNEDEQUAL) op=LEX_RSHIFTUNSIGNED;
+    if (op=='+' && jsvIsName(lhs)) {
+      JsVar *currentValue = jsvSkipName(lhs);
+      if (jsvIsString(currentValue) && !jsvIsFlatString(currentValue) && jsvGetRefs(currentValue)==1) {
+        /* A special case for string += where this is the only use of the string,
+         * as we may be able to do a simple append (rather than clone + append)*/
+        JsVar *str = jsvAsString(rhs, false);
+        jsvAppendStringVarComplete(currentValue, str);
+        jsvUnLock(str);
+        op = 0;
+      }
+      jsvUnLock(currentValue);
+    }
+    if (op) {
+      /* Fallback which does a proper add */
+      JsVar *res = jsvMathsOpSkipNames(lhs,rhs,op);
+      jspReplaceWith(lhs, res);
+      jsvUnLock(res);
+    }
+  }
+}
+
 NO_INLINE JsVar *__jspeAssignmentExpression(JsVar *lhs) {
   if (lex->tk=='=' || lex->tk==LEX_PLUSEQUAL || lex->tk==LEX_MINUSEQUAL ||
       lex->tk==LEX_MULEQUAL || lex->tk==LEX_DIVEQUAL || lex->tk==LEX_MODEQUAL ||
@@ -1627,47 +1715,8 @@ NO_INLINE JsVar *__jspeAssignmentExpression(JsVar *lhs) {
     rhs = jspeAssignmentExpression();
     rhs = jsvSkipNameAndUnLock(rhs); // ensure we get rid of any references on the RHS
 
-    if (JSP_SHOULD_EXECUTE && lhs) {
-      if (op=='=') {
-        /* If we're assigning to this and we don't have a parent,
-         * add it to the symbol table root */
-        if (!jsvGetRefs(lhs) && jsvIsName(lhs)) {
-          if (!jsvIsArrayBufferName(lhs) && !jsvIsNewChild(lhs))
-            jsvAddName(execInfo.root, lhs);
-        }
-        jspReplaceWith(lhs, rhs);
-      } else {
-        if (op==LEX_PLUSEQUAL) op='+';
-        else if (op==LEX_MINUSEQUAL) op='-';
-        else if (op==LEX_MULEQUAL) op='*';
-        else if (op==LEX_DIVEQUAL) op='/';
-        else if (op==LEX_MODEQUAL) op='%';
-        else if (op==LEX_ANDEQUAL) op='&';
-        else if (op==LEX_OREQUAL) op='|';
-        else if (op==LEX_XOREQUAL) op='^';
-        else if (op==LEX_RSHIFTEQUAL) op=LEX_RSHIFT;
-        else if (op==LEX_LSHIFTEQUAL) op=LEX_LSHIFT;
-        else if (op==LEX_RSHIFTUNSIGNEDEQUAL) op=LEX_RSHIFTUNSIGNED;
-        if (op=='+' && jsvIsName(lhs)) {
-          JsVar *currentValue = jsvSkipName(lhs);
-          if (jsvIsString(currentValue) && !jsvIsFlatString(currentValue) && jsvGetRefs(currentValue)==1) {
-            /* A special case for string += where this is the only use of the string,
-             * as we may be able to do a simple append (rather than clone + append)*/
-            JsVar *str = jsvAsString(rhs, false);
-            jsvAppendStringVarComplete(currentValue, str);
-            jsvUnLock(str);
-            op = 0;
-          }
-          jsvUnLock(currentValue);
-        }
-        if (op) {
-          /* Fallback which does a proper add */
-          JsVar *res = jsvMathsOpSkipNames(lhs,rhs,op);
-          jspReplaceWith(lhs, res);
-          jsvUnLock(res);
-        }
-      }
-    }
+    if (JSP_SHOULD_EXECUTE && lhs)
+      jspAssign(lhs, op, rhs);
     jsvUnLock(rhs);
   }
   return lhs;
@@ -189,4 +189,9 @@ JsVar *jspCallNamedFunction(JsVar *object, char* name, int argCount, JsVar **arg
 JsVar *jspeiFindInScopes(const char *name);
 void jspReplaceWith(JsVar *dst, JsVar *src);
 
+/// Perform `lhs op rhs` where op is '=' or LEX_*EQUAL, and rhs is not a name
+void jspAssign(JsVar *lhs, int op, JsVar *rhs);
+/// Get the precedence of a BinaryExpression - or return 0 if not one
+unsigned int jspeGetBinaryExpressionPrecedence(int op);
+
 #endif /* JSPARSE_H_ */
@@ -221,6 +221,18 @@ typedef int64_t JsSysTime;
 #define JS_NUMBER_BUFFER_SIZE 66 ///< 64 bit base 2 + minus + terminating 0
 
 #define JS_VARS_BEFORE_IDLE_GC 32 ///< If we have less free variables than this, do a garbage collect on Idle
+#define JS_VARS_BEFORE_IDLE_INCREMENTAL_GC_DIVISOR 8 ///< If less than 1/N of variables are free, start an incremental garbage collect on Idle
+#define JS_IDLE_INCREMENTAL_GC_MS 2 ///< How long we can spend doing incremental garbage collection each time around the idle loop
+#ifdef RESIZABLE_JSVARS
+#define JS_DEFRAG_MOVES 256 ///< How many vars jsvDefragment moves each time it is called
+#else
+#define JS_DEFRAG_MOVES 32 ///< How many vars jsvDefragment moves each time it is called
+#endif
+#ifdef SAVE_ON_FLASH
+#define JS_GC_MARK_STACK_SIZE 16 ///< How many vars the garbage collector can have waiting to be looked at before it has to rescan memory
+#else
+#define JS_GC_MARK_STACK_SIZE 128 ///< How many vars the garbage collector can have waiting to be looked at before it has to rescan memory
+#endif
 
 #define JSPARSE_MAX_SCOPES  8
 
@@ -241,6 +253,8 @@ typedef int64_t JsSysTime;
 #define JSPARSE_FUNCTION_THIS_NAME JS_HIDDEN_CHAR_STR"ths" // the 'this' variable - for bound functions
 #define JSPARSE_FUNCTION_NAME_NAME JS_HIDDEN_CHAR_STR"nam" // for named functions (a = function foo() { foo(); })
 #define JSPARSE_FUNCTION_LINENUMBER_NAME JS_HIDDEN_CHAR_STR"lin" // The line number offset of the function
+#define JSPARSE_FUNCTION_BYTECODE_NAME JS_HIDDEN_CHAR_STR"byc" // Compiled bytecode for functions marked "bytecode" (see jsbytecode.c)
+#define JSV_OBJECT_INDEX_NAME JS_HIDDEN_CHAR_STR"idx" // Hash index of a big object's children (see jsvar.c)
 #define JS_EVENT_PREFIX "#on"
 
 #define JSPARSE_EXCEPTION_VAR "except" // when exceptions are thrown, they're stored in the root scope
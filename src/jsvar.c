@@ -20,6 +20,7 @@
 #include "jswrap_math.h" // for jswrap_math_mod
 #include "jswrap_object.h" // for jswrap_object_toString
 #include "jswrap_arraybuffer.h" // for jsvNewTypedArray
+#include "jstimer.h" // for jstHasBufferTimerTasks
 
 #ifdef DEBUG
   /** When freeing, clear the references (nextChild/etc) in the JsVar.
@@ -48,6 +49,69 @@ unsigned int jsVarsSize = JSVAR_CACHE_SIZE;
 volatile JsVarRef jsVarFirstEmpty; ///< reference of first unused variable (variables are in a linked list)
 volatile bool isMemoryBusy; ///< Are we doing garbage collection or similar, so can't access memory?
 
+#ifndef SAVE_ON_FLASH
+/** Cache of recently found children for jsvFindChildFromString. Hashed on the
+ * parent and the first 4 characters of the name. An entry is only valid while
+ * the child is still linked into the parent, so entries for a parent are
+ * removed whenever one of its children is unlinked, and everything is
+ * cleared when we garbage collect. */
+#define JSV_LOOKUP_CACHE_SIZE 32 // must be a power of 2
+typedef struct {
+  JsVarRef parent;
+  JsVarRef child;
+} JsvLookupCacheEntry;
+static JsvLookupCacheEntry jsvLookupCache[JSV_LOOKUP_CACHE_SIZE];
+
+static ALWAYS_INLINE JsvLookupCacheEntry *jsvLookupCacheGet(JsVarRef parent, const char *fastCheck) {
+  uint32_t h = (*(uint32_t*)fastCheck) * 2654435761U; // Knuth's multiplicative hash
+  return &jsvLookupCache[((h>>24) ^ parent) & (JSV_LOOKUP_CACHE_SIZE-1)];
+}
+
+/// Remove any cached children of the given parent
+static void jsvLookupCacheRemove(JsVarRef parent) {
+  int i;
+  for (i=0;i<JSV_LOOKUP_CACHE_SIZE;i++)
+    if (jsvLookupCache[i].parent == parent)
+      jsvLookupCache[i].parent = 0;
+}
+
+static void jsvLookupCacheClear() {
+  memset(jsvLookupCache, 0, sizeof(jsvLookupCache));
+}
+#endif
+
+static JsVarRef jsvGCStack[JS_GC_MARK_STACK_SIZE]; ///< Vars that are marked by the garbage collector but whose children haven't been looked at yet
+static unsigned int jsvGCStackSize;
+static bool jsvGCStackOverflowed; ///< We ran out of jsvGCStack, so we must look for unmarked children of everything marked
+
+#ifndef SAVE_ON_FLASH
+/** State for incremental garbage collection - see jsvGarbageCollectIncremental */
+typedef enum {
+  JSV_GC_IDLE,  ///< No collection in progress
+  JSV_GC_MARK,  ///< Marking everything reachable, using jsvGCStack
+  JSV_GC_UNREF, ///< Unreferencing anything that garbage points to but that isn't garbage itself
+  JSV_GC_SWEEP, ///< Freeing garbage
+} JsvGCState;
+static JsvGCState jsvGCState;
+static JsVarRef jsvGCCursor; ///< where we're up to when unreffing/sweeping
+static JsSysTime jsvGCMaxPause; ///< The longest we've been busy garbage collecting for in one go
+static bool jsvDefragWanted; ///< A flat string couldn't be allocated, so jsvDefragment might help
+
+static void jsvGarbageCollectPush(JsVar *var);
+
+/// A flat string has just been allocated over these vars - make sure an incremental GC doesn't look at them as vars
+static void jsvGarbageCollectFlatStringAllocated(JsVarRef header, size_t blocks) {
+  if (jsvGCState==JSV_GC_IDLE) return;
+  JsVarRef last = (JsVarRef)(header+blocks);
+  unsigned int i;
+  for (i=0;i<jsvGCStackSize;i++)
+    if (jsvGCStack[i]>header && jsvGCStack[i]<=last)
+      jsvGCStack[i] = 0;
+  if (jsvGCCursor>header && jsvGCCursor<=last)
+    jsvGCCursor = (JsVarRef)(last+1);
+}
+#endif
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
@@ -116,6 +180,263 @@ JsVar *_jsvGetAddressOf(JsVarRef ref) {
   return jsvGetAddressOf(ref);
 }
 
+#ifndef SAVE_ON_FLASH
+/** Objects with lots of children get a hash index so we don't have to search
+ * through every child to find one. The index is a flat string of JsVarRefs
+ * (the number of entries, followed by a power-of-2 sized table that uses
+ * linear probing), stored in a hidden child that is always the object's first
+ * child. Only children with string names are indexed - strings never match
+ * integer names anyway. */
+#define JSV_INDEX_MIN_CHILDREN 24 // build an index if we had to search through more children than this
+#define JSV_INDEX_MIN_SLOTS 32
+
+/// Set if we couldn't allocate an index, so we don't keep trying (and searching memory) until the next GC
+static bool jsvIndexAllocFailed;
+
+static uint32_t jsvHashString(const char *s) {
+  uint32_t h = 2166136261U; // FNV-1a
+  while (*s) h = (h ^ (unsigned char)*(s++)) * 16777619U;
+  return h;
+}
+
+static uint32_t jsvHashStringVar(JsVar *v) {
+  uint32_t h = 2166136261U; // FNV-1a, as above
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, v, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    h = (h ^ (unsigned char)jsvStringIteratorGetChar(&it)) * 16777619U;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  return h;
+}
+
+static bool jsvIsObjectIndexName(JsVar *v) {
+  return jsvIsName(v) && v->varData.str[0]==JS_HIDDEN_CHAR && jsvIsStringEqual(v, JSV_OBJECT_INDEX_NAME);
+}
+
+/// Return the name of the object's index (not locked), or 0
+static JsVar *jsvGetObjectIndex(JsVar *parent) {
+  if (!jsvIsObject(parent) || !jsvGetFirstChild(parent)) return 0;
+  JsVar *first = jsvGetAddressOf(jsvGetFirstChild(parent));
+  return jsvIsObjectIndexName(first) ? first : 0;
+}
+
+/// Get the data of an index. data[0] is the number of entries, and data[1..mask+1] is the table
+static JsVarRef *jsvGetObjectIndexData(JsVar *indexName, unsigned int *mask) {
+  JsVar *flat = jsvGetAddressOf(jsvGetFirstChild(indexName));
+  *mask = (unsigned int)((size_t)flat->varData.integer / sizeof(JsVarRef)) - 2;
+  return (JsVarRef*)jsvGetFlatStringPointer(flat);
+}
+
+static void jsvObjectIndexInsert(JsVarRef *data, unsigned int mask, JsVar *child) {
+  unsigned int i = jsvHashStringVar(child) & mask;
+  while (data[1+i]) i = (i+1) & mask;
+  data[1+i] = jsvGetRef(child);
+  data[0]++;
+}
+
+/// Find a child in the index. Returns 0 if it's not a child of the object at all
+static JsVar *jsvObjectIndexFind(JsVar *indexName, const char *name) {
+  unsigned int mask;
+  JsVarRef *data = jsvGetObjectIndexData(indexName, &mask);
+  unsigned int i = jsvHashString(name) & mask;
+  while (data[1+i]) {
+    JsVar *child = jsvGetAddressOf(data[1+i]);
+    if (jsvIsStringEqual(child, name)) return child;
+    i = (i+1) & mask;
+  }
+  return 0;
+}
+
+/// As jsvObjectIndexFind, but with a string var
+static JsVar *jsvObjectIndexFindVar(JsVar *indexName, JsVar *name) {
+  unsigned int mask;
+  JsVarRef *data = jsvGetObjectIndexData(indexName, &mask);
+  unsigned int i = jsvHashStringVar(name) & mask;
+  while (data[1+i]) {
+    JsVar *child = jsvGetAddressOf(data[1+i]);
+    if (jsvIsBasicVarEqual(child, name)) return child;
+    i = (i+1) & mask;
+  }
+  return 0;
+}
+
+static void jsvObjectIndexRemove(JsVar *indexName, JsVar *child) {
+  unsigned int mask;
+  JsVarRef *data = jsvGetObjectIndexData(indexName, &mask);
+  JsVarRef ref = jsvGetRef(child);
+  unsigned int i = jsvHashStringVar(child) & mask;
+  while (data[1+i] && data[1+i]!=ref) i = (i+1) & mask;
+  if (!data[1+i]) return;
+  data[0]--;
+  /* Move back any following entries that would no longer be found
+   * because of the gap we're leaving */
+  unsigned int j = i;
+  while (true) {
+    j = (j+1) & mask;
+    if (!data[1+j]) break;
+    unsigned int k = jsvHashStringVar(jsvGetAddressOf(data[1+j])) & mask;
+    if ((j>i) ? (k<=i || k>j) : (k<=i && k>j)) {
+      data[1+i] = data[1+j];
+      i = j;
+    }
+  }
+  data[1+i] = 0;
+}
+
+/** Create (or resize, if indexName is set) the index for an object. If we're
+ * out of memory, any existing index is removed, so it can never be out of date */
+static void jsvObjectIndexBuild(JsVar *parent, JsVar *indexName) {
+  unsigned int count = 0;
+  JsVarRef childref = jsvGetFirstChild(parent);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsString(child) && child!=indexName) count++;
+    childref = jsvGetNextSibling(child);
+  }
+  unsigned int slots = JSV_INDEX_MIN_SLOTS;
+  while (slots < count*2) slots <<= 1;
+  JsVar *flat = 0;
+  if (slots <= (JsVarRef)~0) // make sure our entry count will fit
+    flat = jsvNewFlatStringOfLength((unsigned int)((slots+1)*sizeof(JsVarRef)));
+  if (!flat) {
+    jsvIndexAllocFailed = true;
+    if (indexName) jsvRemoveChild(parent, indexName);
+    return;
+  }
+  JsVarRef *data = (JsVarRef*)jsvGetFlatStringPointer(flat);
+  childref = jsvGetFirstChild(parent);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsString(child) && child!=indexName)
+      jsvObjectIndexInsert(data, slots-1, child);
+    childref = jsvGetNextSibling(child);
+  }
+  if (indexName) {
+    jsvSetValueOfName(indexName, flat);
+  } else if (jsVarFirstEmpty) { // don't trigger a GC/out of memory error just for this
+    indexName = jsvMakeIntoVariableName(jsvNewFromString(JSV_OBJECT_INDEX_NAME), flat);
+    if (indexName) {
+      // add to the start of the object, so we can find it quickly
+      jsvRef(indexName);
+      JsVarRef first = jsvGetFirstChild(parent);
+      jsvSetPrevSibling(jsvGetAddressOf(first), jsvGetRef(indexName));
+      jsvSetNextSibling(indexName, first);
+      jsvSetFirstChild(parent, jsvGetRef(indexName));
+      jsvUnLock(indexName);
+    }
+  }
+  jsvUnLock(flat);
+}
+
+/// Called after searching through 'searched' children of parent - add an index if it's worth it
+static ALWAYS_INLINE void jsvObjectIndexCheck(JsVar *parent, unsigned int searched) {
+  if (searched > JSV_INDEX_MIN_CHILDREN && !jsvIndexAllocFailed &&
+      jsvIsObject(parent) && !jsvGetObjectIndex(parent))
+    jsvObjectIndexBuild(parent, 0);
+}
+
+/** Arrays that have elements looked up get a dense index - a flat string of
+ * JsVarRefs where entry i is the name of element i (or 0). It is referenced
+ * from the array's nextSibling, which arrays don't otherwise use. The index
+ * doesn't have to be complete - an entry is only used if its name still has
+ * the right index, and if it isn't there we just search the list as before
+ * and fill the entry in. Anything that renumbers elements in place must call
+ * jsvArrayIndexInvalidate, as removing an element only clears the entry for
+ * its current index. */
+#define JSV_ARRAY_INDEX_MIN_LENGTH 16
+#define JSV_ARRAY_INDEX_MAX_LENGTH 65536
+
+/// Get the capacity of the array's index (and its data), or return 0
+static ALWAYS_INLINE unsigned int jsvGetArrayIndexData(const JsVar *arr, JsVarRef **data) {
+  JsVarRef ref = jsvGetNextSibling(arr);
+  if (!ref) return 0;
+  JsVar *flat = jsvGetAddressOf(ref);
+  *data = (JsVarRef*)jsvGetFlatStringPointer(flat);
+  return (unsigned int)((size_t)flat->varData.integer / sizeof(JsVarRef));
+}
+
+/// Return the name of an array element (not locked) if it's in the index, or 0
+static ALWAYS_INLINE JsVar *jsvArrayIndexGet(const JsVar *arr, JsVarInt index) {
+  JsVarRef *data;
+  unsigned int capacity = jsvGetArrayIndexData(arr, &data);
+  if (index<0 || (JsVarInt)capacity<=index || !data[index]) return 0;
+  JsVar *child = jsvGetAddressOf(data[index]);
+  return (jsvIsName(child) && jsvIsInt(child) && child->varData.integer==index) ? child : 0;
+}
+
+/// Set the array index entry for the given name (if it fits)
+static void jsvArrayIndexSet(JsVar *arr, JsVar *child, bool isSet) {
+  JsVarRef *data;
+  unsigned int capacity = jsvGetArrayIndexData(arr, &data);
+  JsVarInt index = child->varData.integer;
+  if (index<0 || (JsVarInt)capacity<=index) return;
+  if (isSet)
+    data[index] = jsvGetRef(child);
+  else if (data[index] == jsvGetRef(child))
+    data[index] = 0;
+}
+
+static void jsvArrayIndexFree(JsVar *arr) {
+  JsVarRef ref = jsvGetNextSibling(arr);
+  if (!ref) return;
+  jsvSetNextSibling(arr, 0);
+  JsVar *flat = jsvLock(ref);
+  jsvUnRef(flat);
+  jsvUnLock(flat);
+}
+
+/// Create an index for an array (replacing any existing one), big enough for the array's length
+static void jsvArrayIndexBuild(JsVar *arr) {
+  JsVarInt length = jsvGetArrayLength(arr);
+  unsigned int capacity = JSV_ARRAY_INDEX_MIN_LENGTH;
+  while ((JsVarInt)capacity < length) capacity <<= 1;
+  jsvArrayIndexFree(arr);
+  if (capacity > JSV_ARRAY_INDEX_MAX_LENGTH) return;
+  // Don't bother if the array is mostly holes
+  JsVarInt count = 0;
+  JsVarRef childref = jsvGetFirstChild(arr);
+  while (childref) {
+    count++;
+    childref = jsvGetNextSibling(jsvGetAddressOf(childref));
+  }
+  if (count*4 < length) return;
+  JsVar *flat = jsvNewFlatStringOfLength((unsigned int)(capacity*sizeof(JsVarRef)));
+  if (!flat) {
+    jsvIndexAllocFailed = true;
+    return;
+  }
+  JsVarRef *data = (JsVarRef*)jsvGetFlatStringPointer(flat);
+  childref = jsvGetFirstChild(arr);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsName(child) && jsvIsInt(child) && child->varData.integer>=0 && child->varData.integer<(JsVarInt)capacity)
+      data[child->varData.integer] = childref;
+    childref = jsvGetNextSibling(child);
+  }
+  jsvSetNextSibling(arr, jsvGetRef(jsvRef(flat)));
+  jsvUnLock(flat);
+}
+
+void jsvArrayIndexInvalidate(JsVar *arr) {
+  if (jsvIsArray(arr)) jsvArrayIndexFree(arr);
+}
+
+/// Called when we had to search the list for an array element
+static void jsvArrayIndexMissed(JsVar *arr, JsVar *child) {
+  if (jsvGetNextSibling(arr)) {
+    if (child) jsvArrayIndexSet(arr, child, true);
+  } else if (!jsvIndexAllocFailed && jsvGetArrayLength(arr) >= JSV_ARRAY_INDEX_MIN_LENGTH) {
+    jsvArrayIndexBuild(arr);
+  }
+}
+#else
+void jsvArrayIndexInvalidate(JsVar *arr) {
+  NOT_USED(arr);
+}
+#endif
+
 #ifdef JSVARREF_PACKED_BITS
 #define JSVARREF_PACKED_BIT_MASK ((1U<<JSVARREF_PACKED_BITS)-1)
 JsVarRef jsvGetFirstChild(const JsVar *v) { return (JsVarRef)(v->varData.ref.firstChild | (((v->varData.ref.pack)&JSVARREF_PACKED_BIT_MASK))<<8); }
@@ -207,6 +528,11 @@ void jsvClearEmptyVarList() {
 }
 
 void jsvSoftInit() {
+#ifndef SAVE_ON_FLASH
+  jsvLookupCacheClear();
+  jsvGCState = JSV_GC_IDLE; // forget any incremental GC - memory has been reloaded
+  jsvGCStackSize = 0;
+#endif
   jsvCreateEmptyVarList();
 }
 
@@ -435,7 +761,7 @@ ALWAYS_INLINE void jsvFreePtrInternal(JsVar *var) {
   jshInterruptOn();
 }
 
-ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
+static void jsvFreePtrNow(JsVar *var) {
   /* To be here, we're not supposed to be part of anything else. If
    * we were, we'd have been freed by jsvGarbageCollect */
   assert((!jsvGetNextSibling(var) && !jsvGetPrevSibling(var)) || // check that next/prevSibling are not set
@@ -496,6 +822,9 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
 
   if (jsvHasChildren(var)) {
     JsVarRef childref = jsvGetFirstChild(var);
+#ifndef SAVE_ON_FLASH
+    if (childref) jsvLookupCacheRemove(jsvGetRef(var));
+#endif
 #ifdef CLEAR_MEMORY_ON_FREE
     jsvSetFirstChild(var, 0);
     jsvSetLastChild(var, 0);
@@ -532,6 +861,37 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
   jsvFreePtrInternal(var);
 }
 
+/* Freeing something unreferences its children, which can free them too - so
+ * freeing a long linked list would recurse once for each item and could
+ * overflow the stack. Past a certain depth, things with children are put
+ * in a list (linked with nextSibling, which they don't use) and are freed
+ * when we get back to the top. */
+#define JSV_FREE_MAX_DEPTH 32
+static unsigned char jsvFreeDepth;
+static JsVarRef jsvFreePending;
+
+ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
+#ifndef SAVE_ON_FLASH
+  if (jsvIsArray(var)) jsvArrayIndexFree(var);
+#endif
+  if (jsvFreeDepth >= JSV_FREE_MAX_DEPTH && jsvHasChildren(var)) {
+    jsvSetNextSibling(var, jsvFreePending);
+    jsvFreePending = jsvGetRef(var);
+    return;
+  }
+  jsvFreeDepth++;
+  jsvFreePtrNow(var);
+  if (jsvFreeDepth==1) {
+    while (jsvFreePending) {
+      var = jsvGetAddressOf(jsvFreePending);
+      jsvFreePending = jsvGetNextSibling(var);
+      jsvSetNextSibling(var, 0);
+      jsvFreePtrNow(var);
+    }
+  }
+  jsvFreeDepth--;
+}
+
 /// Get a reference from a var - SAFE for null vars
 ALWAYS_INLINE JsVarRef jsvGetRef(JsVar *var) {
   if (!var) return 0;
@@ -620,6 +980,13 @@ NO_INLINE void jsvUnLockMany(unsigned int count, JsVar **vars) {
 /// Reference - set this variable as used by something
 JsVar *jsvRef(JsVar *var) {
   assert(var && jsvHasRef(var));
+#ifndef SAVE_ON_FLASH
+  /* Write barrier for incremental GC. Every new reference passes through
+   * here, so if we're marking make sure we don't miss this var because
+   * the thing now referencing it has already been looked at. */
+  if (jsvGCState==JSV_GC_MARK && (var->flags & JSV_GARBAGE_COLLECT))
+    jsvGarbageCollectPush(var);
+#endif
   jsvSetRefs(var, (JsVarRefCounter)(jsvGetRefs(var)+1));
   assert(jsvGetRefs(var));
   return var;
@@ -694,6 +1061,9 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
         flatString->varData.integer = (JsVarInt)byteLength;
         // clear data
         memset((char*)&flatString[1], 0, sizeof(JsVar)*(blocks-1));
+#ifndef SAVE_ON_FLASH
+        jsvGarbageCollectFlatStringAllocated((JsVarRef)(unsigned int)((unsigned)i+1-blocks), blocks-1);
+#endif
         // break out of the loop, and we'll return 'flatString'
         i++; // we are already at the final block
         break;
@@ -727,6 +1097,9 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
   jsvSetNextSibling(lastEmpty, 0);
   jsVarFirstEmpty = jsvGetNextSibling(&firstVar);
   isMemoryBusy = false;
+#ifndef SAVE_ON_FLASH
+  if (!flatString) jsvDefragWanted = true; // memory may just be fragmented
+#endif
   // Return whatever we had (0 if we couldn't manage it)
   return flatString;
 }
@@ -1401,16 +1774,7 @@ size_t jsvGetIndexFromLineAndCol(JsVar *v, size_t line, size_t col) {
 }
 
 void jsvAppendString(JsVar *var, const char *str) {
-  assert(jsvIsString(var));
-  JsvStringIterator dst;
-  jsvStringIteratorNew(&dst, var, 0);
-  jsvStringIteratorGotoEnd(&dst);
-  // now start appending
-  /* This isn't as fast as something single-purpose, but it's not that bad,
-   * and is less likely to break :) */
-  while (*str)
-    jsvStringIteratorAppend(&dst, *(str++));
-  jsvStringIteratorFree(&dst);
+  jsvAppendStringBuf(var, str, strlen(str));
 }
 
 // Append the given string to this one - but does not use null-terminated strings
@@ -1419,20 +1783,13 @@ void jsvAppendStringBuf(JsVar *var, const char *str, size_t length) {
   JsvStringIterator dst;
   jsvStringIteratorNew(&dst, var, 0);
   jsvStringIteratorGotoEnd(&dst);
-  // now start appending
-  /* This isn't as fast as something single-purpose, but it's not that bad,
-   * and is less likely to break :) */
-  while (length) {
-    jsvStringIteratorAppend(&dst, *(str++));
-    length--;
-  }
+  jsvStringIteratorAppendBuf(&dst, str, length);
   jsvStringIteratorFree(&dst);
 }
 
 /// Special version of append designed for use with vcbprintf_callback (See jsvAppendPrintf)
 void jsvStringIteratorPrintfCallback(const char *str, void *user_data) {
-  while (*str)
-    jsvStringIteratorAppend((JsvStringIterator *)user_data, *(str++));
+  jsvStringIteratorAppendBuf((JsvStringIterator *)user_data, str, strlen(str));
 }
 
 void jsvAppendPrintf(JsVar *var, const char *fmt, ...) {
@@ -1464,24 +1821,45 @@ JsVar *jsvVarPrintf( const char *fmt, ...) {
   return str;
 }
 
+/// Append characters from str to the end of the string iterator 'dst' (see jsvAppendStringVar)
+static void jsvStringIteratorAppendStringVar(JsvStringIterator *dst, const JsVar *str, size_t stridx, size_t maxLength) {
+  JsvStringIterator it;
+  jsvStringIteratorNewConst(&it, str, stridx);
+  if (jsvIsNativeString(str)) {
+    // may be in flash, so must be read a character at a time
+    while (jsvStringIteratorHasChar(&it) && (maxLength-->0)) {
+      char ch = jsvStringIteratorGetChar(&it);
+      jsvStringIteratorAppend(dst, ch);
+      jsvStringIteratorNext(&it);
+    }
+  } else {
+    // copy whatever is left in each of str's vars in one go
+    while (jsvStringIteratorHasChar(&it) && maxLength>0) {
+      size_t n = it.charsInVar - it.charIdx;
+      if (n > maxLength) n = maxLength;
+      jsvStringIteratorAppendBuf(dst, &it.ptr[it.charIdx], n);
+      maxLength -= n;
+      it.charIdx += n-1;
+      jsvStringIteratorNext(&it);
+    }
+  }
+  jsvStringIteratorFree(&it);
+}
+
 /** Append str to var. Both must be strings. stridx = start char or str, maxLength = max number of characters (can be JSVAPPENDSTRINGVAR_MAXLENGTH) */
 void jsvAppendStringVar(JsVar *var, const JsVar *str, size_t stridx, size_t maxLength) {
   assert(jsvIsString(var));
 
+  // If we're appending to ourselves, only copy what was there when we started
+  if (var==str) {
+    size_t len = jsvGetStringLength(str);
+    if (stridx >= len) return;
+    if (maxLength > len-stridx) maxLength = len-stridx;
+  }
   JsvStringIterator dst;
   jsvStringIteratorNew(&dst, var, 0);
   jsvStringIteratorGotoEnd(&dst);
-  // now start appending
-  /* This isn't as fast as something single-purpose, but it's not that bad,
-     * and is less likely to break :) */
-  JsvStringIterator it;
-  jsvStringIteratorNewConst(&it, str, stridx);
-  while (jsvStringIteratorHasChar(&it) && (maxLength-->0)) {
-    char ch = jsvStringIteratorGetChar(&it);
-    jsvStringIteratorAppend(&dst, ch);
-    jsvStringIteratorNext(&it);
-  }
-  jsvStringIteratorFree(&it);
+  jsvStringIteratorAppendStringVar(&dst, str, stridx, maxLength);
   jsvStringIteratorFree(&dst);
 }
 
@@ -2074,11 +2452,17 @@ JsVar *jsvCopy(JsVar *src) {
     vr = jsvGetFirstChild(src);
     while (vr) {
       JsVar *name = jsvLock(vr);
-      JsVar *child = jsvCopyNameOnly(name, true/*link children*/, true/*keep as name*/); // NO DEEP COPY!
-      if (child) { // could have been out of memory
-        jsvAddName(dst, child);
-        jsvUnLock(child);
+#ifndef SAVE_ON_FLASH
+      if (!jsvIsObjectIndexName(name)) { // the copy will make its own index if it needs one
+#endif
+        JsVar *child = jsvCopyNameOnly(name, true/*link children*/, true/*keep as name*/); // NO DEEP COPY!
+        if (child) { // could have been out of memory
+          jsvAddName(dst, child);
+          jsvUnLock(child);
+        }
+#ifndef SAVE_ON_FLASH
       }
+#endif
       vr = jsvGetNextSibling(name);
       jsvUnLock(name);
     }
@@ -2141,6 +2525,28 @@ void jsvAddName(JsVar *parent, JsVar *namedChild) {
     jsvSetFirstChild(parent, r);
     jsvSetLastChild(parent, r);
   }
+#ifndef SAVE_ON_FLASH
+  if (jsvIsArray(parent) && jsvIsInt(namedChild) && jsvGetNextSibling(parent)) {
+    JsVarRef *data;
+    unsigned int capacity = jsvGetArrayIndexData(parent, &data);
+    JsVarInt index = namedChild->varData.integer;
+    if (index>=(JsVarInt)capacity && index<(JsVarInt)capacity*2) // grow as we push
+      jsvArrayIndexBuild(parent);
+    else
+      jsvArrayIndexSet(parent, namedChild, true);
+  }
+  if (jsvIsString(namedChild)) {
+    JsVar *indexName = jsvGetObjectIndex(parent);
+    if (indexName && indexName!=namedChild) {
+      unsigned int mask;
+      JsVarRef *data = jsvGetObjectIndexData(indexName, &mask);
+      if (((unsigned int)data[0]+1)*4 > (mask+1)*3) // over 3/4 full - make it bigger
+        jsvObjectIndexBuild(parent, indexName);
+      else
+        jsvObjectIndexInsert(data, mask, namedChild);
+    }
+  }
+#endif
 }
 
 JsVar *jsvAddNamedChild(JsVar *parent, JsVar *child, const char *name) {
@@ -2224,20 +2630,56 @@ JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool addIfNotFoun
   }
 
   assert(jsvHasChildren(parent));
-  JsVarRef childref = jsvGetFirstChild(parent);
-  while (childref) {
-    // Don't Lock here, just use GetAddressOf - to try and speed up the finding
-    // TODO: We can do this now, but when/if we move to cacheing vars, it'll break
-    JsVar *child = jsvGetAddressOf(childref);
-    if (*(int*)fastCheck==*(int*)child->varData.str && // speedy check of first 4 bytes
-        jsvIsStringEqual(child, name)) {
-      // found it! unlock parent but leave child locked
+#ifndef SAVE_ON_FLASH
+  // Have we found this recently?
+  JsVarRef parentref = jsvGetRef(parent);
+  JsvLookupCacheEntry *cached = jsvLookupCacheGet(parentref, fastCheck);
+  if (cached->parent == parentref) {
+    JsVar *child = jsvGetAddressOf(cached->child);
+    if (*(int*)fastCheck==*(int*)child->varData.str &&
+        jsvIsStringEqual(child, name))
       return jsvLockAgain(child);
+  }
+#endif
+  JsVar *child = 0;
+#ifndef SAVE_ON_FLASH
+  JsVar *indexName = jsvGetObjectIndex(parent);
+  if (indexName) {
+    child = jsvObjectIndexFind(indexName, name);
+  } else
+#endif
+  {
+#ifndef SAVE_ON_FLASH
+    unsigned int searched = 0;
+#endif
+    JsVarRef childref = jsvGetFirstChild(parent);
+    while (childref) {
+      // Don't Lock here, just use GetAddressOf - to try and speed up the finding
+      // TODO: We can do this now, but when/if we move to cacheing vars, it'll break
+      JsVar *c = jsvGetAddressOf(childref);
+      if (*(int*)fastCheck==*(int*)c->varData.str && // speedy check of first 4 bytes
+          jsvIsStringEqual(c, name)) {
+        child = c;
+        break;
+      }
+      childref = jsvGetNextSibling(c);
+#ifndef SAVE_ON_FLASH
+      searched++;
+#endif
     }
-    childref = jsvGetNextSibling(child);
+#ifndef SAVE_ON_FLASH
+    jsvObjectIndexCheck(parent, searched);
+#endif
+  }
+  if (child) {
+#ifndef SAVE_ON_FLASH
+    cached->parent = parentref;
+    cached->child = jsvGetRef(child);
+#endif
+    // found it! unlock parent but leave child locked
+    return jsvLockAgain(child);
   }
 
-  JsVar *child = 0;
   if (addIfNotFound) {
     child = jsvMakeIntoVariableName(jsvNewFromString(name), 0);
     if (child) // could be out of memory
@@ -2276,16 +2718,43 @@ JsVar *jsvAsName(JsVar *var) {
 /** Non-recursive finding */
 JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound) {
   JsVar *child;
-  JsVarRef childref = jsvGetFirstChild(parent);
-
-  while (childref) {
-    child = jsvLock(childref);
-    if (jsvIsBasicVarEqual(child, childName)) {
-      // found it! unlock parent but leave child locked
-      return child;
+#ifndef SAVE_ON_FLASH
+  bool isArrayIndex = jsvIsArray(parent) && jsvIsInt(childName);
+  if (isArrayIndex) {
+    child = jsvArrayIndexGet(parent, jsvGetInteger(childName));
+    if (child) return jsvLockAgain(child);
+  }
+  JsVar *indexName = jsvIsString(childName) ? jsvGetObjectIndex(parent) : 0;
+  if (indexName) {
+    child = jsvObjectIndexFindVar(indexName, childName);
+    if (child) return jsvLockAgain(child);
+  } else
+#endif
+  {
+#ifndef SAVE_ON_FLASH
+    unsigned int searched = 0;
+#endif
+    JsVarRef childref = jsvGetFirstChild(parent);
+    while (childref) {
+      child = jsvLock(childref);
+      if (jsvIsBasicVarEqual(child, childName)) {
+#ifndef SAVE_ON_FLASH
+        if (isArrayIndex && searched > JSV_ARRAY_INDEX_MIN_LENGTH)
+          jsvArrayIndexMissed(parent, child);
+#endif
+        // found it! unlock parent but leave child locked
+        return child;
+      }
+      childref = jsvGetNextSibling(child);
+      jsvUnLock(child);
+#ifndef SAVE_ON_FLASH
+      searched++;
+#endif
     }
-    childref = jsvGetNextSibling(child);
-    jsvUnLock(child);
+#ifndef SAVE_ON_FLASH
+    if (jsvIsString(childName))
+      jsvObjectIndexCheck(parent, searched);
+#endif
   }
 
   child = 0;
@@ -2301,6 +2770,13 @@ void jsvRemoveChild(JsVar *parent, JsVar *child) {
   assert(jsvIsName(child));
   JsVarRef childref = jsvGetRef(child);
   bool wasChild = false;
+#ifndef SAVE_ON_FLASH
+  JsVar *indexName = jsvGetObjectIndex(parent);
+  if (indexName && indexName!=child && jsvIsString(child))
+    jsvObjectIndexRemove(indexName, child);
+  if (jsvIsArray(parent) && jsvIsInt(child))
+    jsvArrayIndexSet(parent, child, false);
+#endif
   // unlink from parent
   if (jsvGetFirstChild(parent) == childref) {
     jsvSetFirstChild(parent, jsvGetNextSibling(child));
@@ -2328,8 +2804,12 @@ void jsvRemoveChild(JsVar *parent, JsVar *child) {
 
   jsvSetPrevSibling(child, 0);
   jsvSetNextSibling(child, 0);
-  if (wasChild)
+  if (wasChild) {
+#ifndef SAVE_ON_FLASH
+    jsvLookupCacheRemove(jsvGetRef(parent));
+#endif
     jsvUnRef(child);
+  }
 }
 
 void jsvRemoveAllChildren(JsVar *parent) {
@@ -2403,7 +2883,10 @@ int jsvGetChildren(JsVar *v) {
   JsVarRef childref = jsvGetFirstChild(v);
   while (childref) {
     JsVar *child = jsvLock(childref);
-    children++;
+#ifndef SAVE_ON_FLASH
+    if (!jsvIsObjectIndexName(child))
+#endif
+      children++;
     childref = jsvGetNextSibling(child);
     jsvUnLock(child);
   }
@@ -2498,6 +2981,10 @@ size_t jsvCountJsVarsUsed(JsVar *v) {
 
 
 JsVar *jsvGetArrayItem(const JsVar *arr, JsVarInt index) {
+#ifndef SAVE_ON_FLASH
+  JsVar *indexed = jsvArrayIndexGet(arr, index);
+  if (indexed) return jsvSkipNameAndUnLock(jsvLockAgain(indexed));
+#endif
   JsVarRef childref = jsvGetLastChild(arr);
   JsVarInt lastArrayIndex = 0;
   // Look at last non-string element!
@@ -2527,6 +3014,9 @@ JsVar *jsvGetArrayItem(const JsVar *arr, JsVarInt index) {
 
       assert(jsvIsInt(child));
       if (child->varData.integer == index) {
+#ifndef SAVE_ON_FLASH
+        jsvArrayIndexMissed((JsVar*)arr, child);
+#endif
         return jsvSkipNameAndUnLock(child);
       }
       childref = jsvGetPrevSibling(child);
@@ -2540,6 +3030,9 @@ JsVar *jsvGetArrayItem(const JsVar *arr, JsVarInt index) {
 
       assert(jsvIsInt(child));
       if (child->varData.integer == index) {
+#ifndef SAVE_ON_FLASH
+        jsvArrayIndexMissed((JsVar*)arr, child);
+#endif
         return jsvSkipNameAndUnLock(child);
       }
       childref = jsvGetNextSibling(child);
@@ -2672,6 +3165,10 @@ JsVar *jsvArrayPopFirst(JsVar *arr) {
   assert(jsvIsArray(arr));
   if (jsvGetFirstChild(arr)) {
     JsVar *child = jsvLock(jsvGetFirstChild(arr));
+#ifndef SAVE_ON_FLASH
+    jsvLookupCacheRemove(jsvGetRef(arr));
+    if (jsvIsInt(child)) jsvArrayIndexSet(arr, child, false);
+#endif
     if (jsvGetFirstChild(arr) == jsvGetLastChild(arr))
       jsvSetLastChild(arr, 0); // if 1 item in array
     jsvSetFirstChild(arr, jsvGetNextSibling(child)); // unlink from end of array
@@ -2925,10 +3422,17 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
       return 0;
     }
     if (op=='+') {
-      JsVar *v = jsvCopy(da);
-      // TODO: can we be fancy and not copy da if we know it isn't reffed? what about locks?
-      if (v) // could be out of memory
-        jsvAppendStringVarComplete(v, db);
+      /* Build the result in one pass rather than copying da (which recurses
+       * down the StringExts) and then walking to the end again to append.
+       * See jsvMathsOpSkipNamesAndUnLockA for appending without a copy */
+      JsVar *v = jsvNewFromEmptyString();
+      if (v) { // could be out of memory
+        JsvStringIterator it;
+        jsvStringIteratorNew(&it, v, 0);
+        jsvStringIteratorAppendStringVar(&it, da, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+        jsvStringIteratorAppendStringVar(&it, db, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+        jsvStringIteratorFree(&it);
+      }
       jsvUnLock2(da, db);
       return v;
     }
@@ -2948,6 +3452,31 @@ JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op) {
   }
 }
 
+/** As jsvMathsOpSkipNames, but unlocks 'a'. If 'a' is a temporary string
+ * (not a name, not referenced, and only locked by the caller - for instance
+ * the result of the previous '+' in "a"+b+"c"+d) then nothing else can see
+ * it, so for '+' we append to it in place rather than copying it. */
+JsVar *jsvMathsOpSkipNamesAndUnLockA(JsVar *a, JsVar *b, int op) {
+  if (op=='+' && jsvIsBasicString(a) &&
+      jsvGetRefs(a)==0 && jsvGetLocks(a)==1) {
+    JsVar *pb = jsvSkipName(b);
+    JsVar *ob = jsvGetValueOf(pb);
+    jsvUnLock(pb);
+    JsVar *db = jsvAsString(ob, false);
+    jsvUnLock(ob);
+    if (!db) { // out of memory
+      jsvUnLock(a);
+      return 0;
+    }
+    jsvAppendStringVarComplete(a, db);
+    jsvUnLock(db);
+    return a;
+  }
+  JsVar *res = jsvMathsOpSkipNames(a, b, op);
+  jsvUnLock(a);
+  return res;
+}
+
 JsVar *jsvNegateAndUnLock(JsVar *v) {
   JsVar *zero = jsvNewFromInteger(0);
   JsVar *res = jsvMathsOpSkipNames(zero, v, '-');
@@ -3119,16 +3648,30 @@ void jsvTrace(JsVar *var, int indent) {
 }
 
 
-/** Recursively mark the variable */
-static void jsvGarbageCollectMarkUsed(JsVar *var) {
+/* Garbage collection marks without recursing, so deeply nested data can't
+ * overflow the C stack. Every used var gets JSV_GARBAGE_COLLECT set, apart
+ * from locked vars which are pushed onto jsvGCStack. Vars are then popped
+ * off the stack, and any of their children that are still flagged are
+ * unflagged and pushed. If the stack overflows we keep going, and when it's
+ * empty we rescan memory for flagged children of anything that isn't
+ * flagged. Anything still flagged at the end is garbage. */
+
+/// Mark a var as used, and push it so its children get looked at
+static void jsvGarbageCollectPush(JsVar *var) {
   var->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+  if (jsvGCStackSize < JS_GC_MARK_STACK_SIZE)
+    jsvGCStack[jsvGCStackSize++] = jsvGetRef(var);
+  else
+    jsvGCStackOverflowed = true;
+}
 
+/// Mark and push any children of this var that are still flagged
+static void jsvGarbageCollectScan(JsVar *var) {
   if (jsvHasCharacterData(var)) {
-    // non-recursively scan strings
+    // string data can't reference anything else, so just unflag it
     JsVarRef child = jsvGetLastChild(var);
     while (child) {
-      JsVar *childVar;
-      childVar = jsvGetAddressOf(child);
+      JsVar *childVar = jsvGetAddressOf(child);
       childVar->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
       child = jsvGetLastChild(childVar);
     }
@@ -3138,50 +3681,235 @@ static void jsvGarbageCollectMarkUsed(JsVar *var) {
     if (jsvGetFirstChild(var)) {
       JsVar *childVar = jsvGetAddressOf(jsvGetFirstChild(var));
       if (childVar->flags & JSV_GARBAGE_COLLECT)
-        jsvGarbageCollectMarkUsed(childVar);
+        jsvGarbageCollectPush(childVar);
     }
   } else if (jsvHasChildren(var)) {
+#ifndef SAVE_ON_FLASH
+    if (jsvIsArray(var) && jsvGetNextSibling(var)) // the array's index
+      jsvGetAddressOf(jsvGetNextSibling(var))->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+#endif
     JsVarRef child = jsvGetFirstChild(var);
     while (child) {
-      JsVar *childVar;
-      childVar = jsvGetAddressOf(child);
-      if (childVar->flags & JSV_GARBAGE_COLLECT)
-        jsvGarbageCollectMarkUsed(childVar);
+      JsVar *childVar = jsvGetAddressOf(child);
+      // children are names that only we reference, so deal with them now rather than pushing them
+      if (childVar->flags & JSV_GARBAGE_COLLECT) {
+        childVar->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+        jsvGarbageCollectScan(childVar);
+      }
       child = jsvGetNextSibling(childVar);
     }
   }
 }
 
-/** Run a garbage collection sweep - return true if things have been freed */
-bool jsvGarbageCollect() {
-  if (isMemoryBusy) return false;
-  isMemoryBusy = true;
+/// Flag every used var apart from locked ones, which are pushed
+static void jsvGarbageCollectStart() {
+  jsvGCStackSize = 0;
+  jsvGCStackOverflowed = false;
   JsVarRef i;
-  // clear garbage collect flags
   for (i=1;i<=jsVarsSize;i++)  {
     JsVar *var = jsvGetAddressOf(i);
-    if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) { // if it is not unused
-      var->flags |= (JsVarFlags)JSV_GARBAGE_COLLECT;
+    if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) {
+      if (jsvGetLocks(var)>0)
+        jsvGarbageCollectPush(var);
+      else
+        var->flags |= (JsVarFlags)JSV_GARBAGE_COLLECT;
       // if we have a flat string, skip that many blocks
       if (jsvIsFlatString(var))
         i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
     }
   }
-  // recursively add 'native' vars
+}
+
+/// Look at the children of vars on the stack until it's empty (return true) or we run out of time
+static bool jsvGarbageCollectMarkSome(JsSysTime endTime) {
+  unsigned int count = 0;
+  while (jsvGCStackSize) {
+    JsVarRef ref = jsvGCStack[--jsvGCStackSize];
+    if (ref) { // 0 if a flat string has been allocated over it
+      JsVar *var = jsvGetAddressOf(ref);
+      if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) // it may have been freed since
+        jsvGarbageCollectScan(var);
+    }
+    if (endTime!=JSSYSTIME_MAX && !(++count & 63) && jshGetSystemTime()>endTime)
+      return false;
+  }
+  return true;
+}
+
+/** When the stack is empty, push anything flagged that has been locked since
+ * we started (if garbage collecting incrementally), and if the stack
+ * overflowed, anything flagged that is a child of something that isn't. */
+static void jsvGarbageCollectRescan() {
+  bool overflowed = jsvGCStackOverflowed;
+  jsvGCStackOverflowed = false;
+  JsVarRef i;
   for (i=1;i<=jsVarsSize;i++)  {
     JsVar *var = jsvGetAddressOf(i);
-    if ((var->flags & JSV_GARBAGE_COLLECT) && // not already GC'd
-        jsvGetLocks(var)>0) // or it is locked
-      jsvGarbageCollectMarkUsed(var);
-    // if we have a flat string, skip that many blocks
-    if (jsvIsFlatString(var))
-      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) {
+      if (var->flags & JSV_GARBAGE_COLLECT) {
+        if (jsvGetLocks(var)>0)
+          jsvGarbageCollectPush(var);
+      } else if (overflowed)
+        jsvGarbageCollectScan(var);
+      if (jsvIsFlatString(var))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+  }
+}
+
+#ifndef SAVE_ON_FLASH
+/* Incremental garbage collection.
+ *
+ * jsvGarbageCollect stops everything while it goes over all of memory.
+ * jsvGarbageCollectIncremental instead does a little bit of the work each
+ * time it is called (from jsiIdle), with JS code running in between:
+ *
+ * * At the start, flag everything and push locked vars (in one go).
+ * * JSV_GC_MARK: Mark from the stack as above. Anything that is referenced
+ *   with jsvRef while this happens is pushed too, so vars that get moved
+ *   into something we have already looked at aren't missed. The final
+ *   rescan also pushes flagged vars that have been locked since we started.
+ * * JSV_GC_UNREF: Anything still flagged is garbage. If it references
+ *   something that isn't garbage, unreference it.
+ * * JSV_GC_SWEEP: Free anything that is still flagged.
+ *
+ * Vars allocated while a collection is in progress are never flagged, so
+ * won't be freed by it.
+ */
+
+/** Garbage that references something that isn't garbage must unreference it.
+ * We do this before freeing anything, as once freed a var could be reused. */
+static bool jsvGarbageCollectUnRefSome(JsSysTime endTime) {
+  unsigned int count = 0;
+  while (jsvGCCursor<=jsVarsSize) {
+    JsVar *var = jsvGetAddressOf(jsvGCCursor);
+    if (jsvIsFlatString(var)) {
+      jsvGCCursor = (JsVarRef)(jsvGCCursor+jsvGetFlatStringBlocks(var));
+    } else if ((var->flags & JSV_GARBAGE_COLLECT) && jsvHasSingleChild(var) && jsvGetFirstChild(var)) {
+      JsVar *child = jsvGetAddressOf(jsvGetFirstChild(var)); // not locked
+      if (child->flags!=JSV_UNUSED && // not already freed
+          !(child->flags&JSV_GARBAGE_COLLECT)) // not garbage
+        jsvUnRef(child);
+    }
+    jsvGCCursor++;
+    if (!(++count & 255) && jshGetSystemTime()>endTime)
+      return false;
+  }
+  return true;
+}
+
+/// Free anything that is still flagged
+static bool jsvGarbageCollectSweepSome(JsSysTime endTime) {
+  unsigned int count = 0;
+  while (jsvGCCursor<=jsVarsSize) {
+    JsVar *var = jsvGetAddressOf(jsvGCCursor);
+    size_t blocks = jsvIsFlatString(var) ? jsvGetFlatStringBlocks(var) : 0;
+    if (var->flags & JSV_GARBAGE_COLLECT) {
+      // free this, and all the blocks if it's a flat string
+      JsVarRef last = (JsVarRef)(jsvGCCursor+blocks);
+      while (jsvGCCursor<=last) {
+        var = jsvGetAddressOf(jsvGCCursor++);
+        var->flags = JSV_UNUSED; // set locks to 0 so the assert in jsvFreePtrInternal doesn't get fed up
+        jsvFreePtrInternal(var);
+      }
+    } else {
+      jsvGCCursor = (JsVarRef)(jsvGCCursor+blocks+1);
+    }
+    if (!(++count & 255) && jshGetSystemTime()>endTime)
+      return false;
+  }
+  return true;
+}
+
+/// Carry on with an incremental garbage collection until it's done, or until endTime
+static void jsvGarbageCollectContinue(JsSysTime endTime) {
+  while (jsvGCState!=JSV_GC_IDLE && jshGetSystemTime()<=endTime) {
+    if (jsvGCState==JSV_GC_MARK) {
+      if (jsvGarbageCollectMarkSome(endTime)) {
+        jsvGarbageCollectRescan();
+        if (!jsvGCStackSize) {
+          // Everything reachable is marked - anything still flagged is garbage
+          jsvGCState = JSV_GC_UNREF;
+          jsvGCCursor = 1;
+          jsvLookupCacheClear(); // we free children without unlinking them
+          jsvIndexAllocFailed = false;
+        }
+      }
+    } else if (jsvGCState==JSV_GC_UNREF) {
+      if (jsvGarbageCollectUnRefSome(endTime)) {
+        jsvGCState = JSV_GC_SWEEP;
+        jsvGCCursor = 1;
+      }
+    } else { // JSV_GC_SWEEP
+      if (jsvGarbageCollectSweepSome(endTime))
+        jsvGCState = JSV_GC_IDLE;
+    }
   }
+}
+
+static void jsvGarbageCollectRecordPause(JsSysTime startTime) {
+  JsSysTime t = jshGetSystemTime() - startTime;
+  if (t > jsvGCMaxPause) jsvGCMaxPause = t;
+}
+
+/** Do around timeLimit's worth of incremental garbage collection, starting
+ * a collection if one isn't in progress. Returns true if the collection
+ * hasn't finished yet. */
+bool jsvGarbageCollectIncremental(JsSysTime timeLimit) {
+  if (isMemoryBusy) return jsvGCState!=JSV_GC_IDLE;
+  isMemoryBusy = true;
+  JsSysTime startTime = jshGetSystemTime();
+  if (jsvGCState==JSV_GC_IDLE) {
+    jsvGarbageCollectStart();
+    jsvGCState = JSV_GC_MARK;
+  }
+  jsvGarbageCollectContinue(startTime + timeLimit);
+  jsvGarbageCollectRecordPause(startTime);
+  isMemoryBusy = false;
+  return jsvGCState!=JSV_GC_IDLE;
+}
+
+/// Is an incremental garbage collection in progress?
+bool jsvGarbageCollectInProgress() {
+  return jsvGCState!=JSV_GC_IDLE;
+}
+
+/// The longest time any garbage collection (or slice of an incremental one) has taken
+JsSysTime jsvGarbageCollectMaxPause() {
+  return jsvGCMaxPause;
+}
+#endif
+
+/** Run a garbage collection sweep - return true if things have been freed */
+bool jsvGarbageCollect() {
+  if (isMemoryBusy) return false;
+  isMemoryBusy = true;
+  bool freedSomething = false;
+#ifndef SAVE_ON_FLASH
+  JsSysTime startTime = jshGetSystemTime();
+  /* If an incremental GC has started unreferencing garbage, finish it off
+   * (or we'd unreference things twice). Otherwise just forget about it. */
+  if (jsvGCState==JSV_GC_UNREF || jsvGCState==JSV_GC_SWEEP) {
+    JsVarRef firstEmpty = jsVarFirstEmpty;
+    jsvGarbageCollectContinue(JSSYSTIME_MAX);
+    freedSomething = jsVarFirstEmpty!=firstEmpty;
+  }
+  jsvGCState = JSV_GC_IDLE;
+  jsvLookupCacheClear(); // GC frees children without unlinking them
+  jsvIndexAllocFailed = false;
+#endif
+  // flag everything, and mark everything reachable from locked vars
+  jsvGarbageCollectStart();
+  jsvGarbageCollectMarkSome(JSSYSTIME_MAX);
+  while (jsvGCStackOverflowed) {
+    jsvGarbageCollectRescan();
+    jsvGarbageCollectMarkSome(JSSYSTIME_MAX);
+  }
+  JsVarRef i;
   /* now sweep for things that we can GC!
    * Also update the free list - this means that every new variable that
    * gets allocated gets allocated towards the start of memory, which
    * hopefully helps compact everything towards the start. */
-  bool freedSomething = false;
   jsVarFirstEmpty = 0;
   JsVar firstVar; // temporary var to simplify code in the loop below
   jsvSetNextSibling(&firstVar, 0);
@@ -3257,11 +3985,158 @@ bool jsvGarbageCollect() {
    * our fake 'firstVar' variable */
   jsvSetNextSibling(lastEmpty, 0);
   jsVarFirstEmpty = jsvGetNextSibling(&firstVar);
+#ifndef SAVE_ON_FLASH
+  jsvGarbageCollectRecordPause(startTime);
+#endif
   isMemoryBusy = false;
   return freedSomething;
 }
 
 
+#ifndef SAVE_ON_FLASH
+/* Defragmentation.
+ *
+ * Flat strings need a run of contiguous free vars. jsvDefragment moves
+ * unlocked vars from the end of memory into the free vars nearest the start,
+ * a few at a time, and then rewrites every reference to the vars it moved.
+ * Locked vars (something has a pointer to them) and flat strings (something
+ * may have a pointer to their data) never move.
+ */
+
+/// If ref is in 'from' (which is sorted), return the matching ref in 'to'
+static JsVarRef jsvDefragRemap(JsVarRef ref, const JsVarRef *from, const JsVarRef *to, unsigned int count) {
+  if (!ref || ref<from[0] || ref>from[count-1]) return ref;
+  unsigned int lo = 0, hi = count;
+  while (lo<hi) {
+    unsigned int mid = (lo+hi)>>1;
+    if (from[mid]==ref) return to[mid];
+    if (from[mid]<ref) lo = mid+1;
+    else hi = mid;
+  }
+  return ref;
+}
+
+/// Rewrite all references from this var to vars that have moved
+static void jsvDefragUpdateVar(JsVar *var, const JsVarRef *from, const JsVarRef *to, unsigned int count) {
+  if (jsvHasStringExt(var) && !jsvIsFlatString(var) && !jsvIsNativeString(var))
+    jsvSetLastChild(var, jsvDefragRemap(jsvGetLastChild(var), from, to, count));
+  if (jsvHasSingleChild(var))
+    jsvSetFirstChild(var, jsvDefragRemap(jsvGetFirstChild(var), from, to, count));
+  if (jsvIsName(var) && !jsvIsArrayBufferName(var)) {
+    jsvSetNextSibling(var, jsvDefragRemap(jsvGetNextSibling(var), from, to, count));
+    jsvSetPrevSibling(var, jsvDefragRemap(jsvGetPrevSibling(var), from, to, count));
+  }
+  if (jsvHasChildren(var)) {
+    jsvSetFirstChild(var, jsvDefragRemap(jsvGetFirstChild(var), from, to, count));
+    jsvSetLastChild(var, jsvDefragRemap(jsvGetLastChild(var), from, to, count));
+    // Indexes are flat strings so never move, but the refs inside them might
+    JsVarRef *data = 0;
+    unsigned int i, entries = 0;
+    JsVar *indexName = jsvGetObjectIndex(var);
+    if (indexName) {
+      data = jsvGetObjectIndexData(indexName, &entries) + 1; // skip the count
+      entries++;
+    } else if (jsvIsArray(var))
+      entries = jsvGetArrayIndexData(var, &data);
+    for (i=0;i<entries;i++)
+      data[i] = jsvDefragRemap(data[i], from, to, count);
+  }
+}
+
+/** Move up to JS_DEFRAG_MOVES unlocked vars from the end of memory into free
+ * vars nearer the start, so that free memory is more contiguous. Returns the
+ * number of vars moved (0 if there's nothing more that can be done) */
+unsigned int jsvDefragment() {
+  /* Don't move anything if a waveform might be using its buffer from an
+   * IRQ, or if a GC is part way through */
+  if (isMemoryBusy || jsvGCState!=JSV_GC_IDLE || jstHasBufferTimerTasks())
+    return 0;
+  isMemoryBusy = true;
+  JsVarRef freeVars[JS_DEFRAG_MOVES]; // the first free vars, in order
+  JsVarRef usedVars[JS_DEFRAG_MOVES]; // the last movable vars (used as a circular buffer)
+  JsVarRef from[JS_DEFRAG_MOVES], to[JS_DEFRAG_MOVES];
+  unsigned int freeCount = 0, usedCount = 0;
+  JsVarRef i;
+  for (i=1;i<=jsVarsSize;i++) {
+    JsVar *var = jsvGetAddressOf(i);
+    if ((var->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
+      if (freeCount<JS_DEFRAG_MOVES)
+        freeVars[freeCount++] = i;
+    } else if (jsvIsFlatString(var)) {
+      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    } else if (jsvGetLocks(var)==0) {
+      usedVars[usedCount % JS_DEFRAG_MOVES] = i;
+      usedCount++;
+    }
+  }
+  // Pair the last movable vars with the first free ones, while that moves them backwards
+  unsigned int n, count = 0;
+  for (n=0;n<freeCount && n<usedCount && n<JS_DEFRAG_MOVES;n++) {
+    JsVarRef src = usedVars[(usedCount-1-n) % JS_DEFRAG_MOVES];
+    if (src < freeVars[n]) break;
+    count++;
+  }
+  // Move them, filling in 'from' in increasing order so we can binary search it
+  for (n=0;n<count;n++) {
+    from[count-1-n] = usedVars[(usedCount-1-n) % JS_DEFRAG_MOVES];
+    to[count-1-n] = freeVars[n];
+    JsVar *src = jsvGetAddressOf(from[count-1-n]);
+    *jsvGetAddressOf(to[count-1-n]) = *src;
+    src->flags = JSV_UNUSED;
+  }
+  if (count) {
+    // Now rewrite every reference to the vars that moved
+    for (i=1;i<=jsVarsSize;i++) {
+      JsVar *var = jsvGetAddressOf(i);
+      if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) {
+        jsvDefragUpdateVar(var, from, to, count);
+        if (jsvIsFlatString(var))
+          i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+      }
+    }
+    timerArray = jsvDefragRemap(timerArray, from, to, count);
+    watchArray = jsvDefragRemap(watchArray, from, to, count);
+    jsvLookupCacheClear();
+  } else
+    jsvDefragWanted = false; // nothing more we can do
+  jsVarFirstEmpty = 0;
+  isMemoryBusy = false;
+  jsvCreateEmptyVarList(); // the free list is now completely different
+  return count;
+}
+
+/// Has allocating a flat string failed since jsvDefragment last finished?
+bool jsvDefragmentWanted() {
+  return jsvDefragWanted;
+}
+
+/// Return the size (in vars) of the largest contiguous area of free memory
+unsigned int jsvGetLargestFreeArea() {
+  unsigned int largest = 0, run = 0;
+#ifdef RESIZABLE_JSVARS
+  JsVar *lastVar = 0;
+#endif
+  JsVarRef i;
+  for (i=1;i<=jsVarsSize;i++) {
+    JsVar *var = jsvGetAddressOf(i);
+    if ((var->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
+#ifdef RESIZABLE_JSVARS
+      // blocks of vars may not be next to each other in memory
+      if (var != lastVar+1) run = 0;
+      lastVar = var;
+#endif
+      run++;
+      if (run>largest) largest = run;
+    } else {
+      run = 0;
+      if (jsvIsFlatString(var))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+  }
+  return largest;
+}
+#endif
+
 /** Remove whitespace to the right of a string - on MULTIPLE LINES */
 JsVar *jsvStringTrimRight(JsVar *srcString) {
   JsvStringIterator src, dst;
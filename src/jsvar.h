@@ -625,6 +625,7 @@ JsVar *jsvAsName(JsVar *var);
 
 /// MATHS!
 JsVar *jsvMathsOpSkipNames(JsVar *a, JsVar *b, int op);
+JsVar *jsvMathsOpSkipNamesAndUnLockA(JsVar *a, JsVar *b, int op); ///< As jsvMathsOpSkipNames, but unlocks a (and may append to it in place)
 bool jsvMathsOpTypeEqual(JsVar *a, JsVar *b);
 JsVar *jsvMathsOp(JsVar *a, JsVar *b, int op);
 /// Negates an integer/double value
@@ -676,6 +677,7 @@ JsVarInt jsvArrayPush(JsVar *arr, JsVar *value); ///< Adds a new element to the
 JsVarInt jsvArrayPushAndUnLock(JsVar *arr, JsVar *value); ///< Adds a new element to the end of an array, unlocks it, and returns the new length
 JsVar *jsvArrayPop(JsVar *arr); ///< Removes the last element of an array, and returns that element (or 0 if empty). includes the NAME
 JsVar *jsvArrayPopFirst(JsVar *arr); ///< Removes the first element of an array, and returns that element (or 0 if empty) includes the NAME. DOES NOT RENUMBER.
+void jsvArrayIndexInvalidate(JsVar *arr); ///< Must be called before renumbering the elements of an array in place
 void jsvArrayAddUnique(JsVar *arr, JsVar *v); ///< Adds a new variable element to the end of an array (IF it was not already there). Return true if successful
 JsVar *jsvArrayJoin(JsVar *arr, JsVar *filler); ///< Join all elements of an array together into a string
 void jsvArrayInsertBefore(JsVar *arr, JsVar *beforeIndex, JsVar *element); ///< Insert a new element before beforeIndex, DOES NOT UPDATE INDICES
@@ -687,6 +689,30 @@ void jsvTrace(JsVar *var, int indent);
 /** Run a garbage collection sweep - return true if things have been freed */
 bool jsvGarbageCollect();
 
+#ifndef SAVE_ON_FLASH
+/** Do around timeLimit's worth of incremental garbage collection, starting
+ * a collection if one isn't in progress. Returns true if the collection
+ * hasn't finished yet. */
+bool jsvGarbageCollectIncremental(JsSysTime timeLimit);
+
+/// Is an incremental garbage collection in progress?
+bool jsvGarbageCollectInProgress();
+
+/// The longest time any garbage collection (or slice of an incremental one) has taken
+JsSysTime jsvGarbageCollectMaxPause();
+
+/** Move up to JS_DEFRAG_MOVES unlocked vars from the end of memory into free
+ * vars nearer the start, so that free memory is more contiguous. Returns the
+ * number of vars moved (0 if there's nothing more that can be done) */
+unsigned int jsvDefragment();
+
+/// Has allocating a flat string failed since jsvDefragment last finished?
+bool jsvDefragmentWanted();
+
+/// Return the size (in vars) of the largest contiguous area of free memory
+unsigned int jsvGetLargestFreeArea();
+#endif
+
 /** Remove whitespace to the right of a string - on MULTIPLE LINES */
 JsVar *jsvStringTrimRight(JsVar *srcString);
 
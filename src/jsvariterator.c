@@ -238,11 +238,60 @@ void jsvStringIteratorAppend(JsvStringIterator *it, char ch) {
   jsvSetCharactersInVar(it->var, it->charsInVar);
 }
 
+void jsvStringIteratorAppendBuf(JsvStringIterator *it, const char *str, size_t length) {
+  if (!it->var || !length) return;
+  // First fill up the space left in the current var (flat/native strings can't be added to)
+  if (!jsvIsFlatString(it->var) && !jsvIsNativeString(it->var)) {
+    size_t maxChars = jsvGetMaxCharactersInVar(it->var);
+    if (it->charsInVar < maxChars) {
+      size_t n = maxChars - it->charsInVar;
+      if (n > length) n = length;
+      memcpy(&it->ptr[it->charsInVar], str, n);
+      it->charsInVar += n;
+      jsvSetCharactersInVar(it->var, it->charsInVar);
+      str += n;
+      length -= n;
+    }
+  }
+  // Now add as many new StringExts as we need, filling each one as we go
+  while (length) {
+    assert(!jsvGetLastChild(it->var));
+    JsVar *next = jsvNewWithFlags(JSV_STRING_EXT_0);
+    if (!next) {
+      jsvUnLock(it->var);
+      it->var = 0;
+      it->ptr = 0;
+      it->charIdx = 0;
+      return; // out of memory
+    }
+    // we don't ref, because  StringExts are never reffed as they only have one owner (and ALWAYS have an owner)
+    jsvSetLastChild(it->var, jsvGetRef(next));
+    jsvUnLock(it->var);
+    it->var = next;
+    it->ptr = &next->varData.str[0];
+    it->varIndex += it->charsInVar;
+    size_t n = (length < JSVAR_DATA_STRING_MAX_LEN) ? length : JSVAR_DATA_STRING_MAX_LEN;
+    memcpy(it->ptr, str, n);
+    it->charsInVar = n;
+    jsvSetCharactersInVar(next, n);
+    str += n;
+    length -= n;
+  }
+  // leave the iterator on the last character, as jsvStringIteratorAppend does
+  it->charIdx = it->charsInVar ? it->charsInVar-1 : 0;
+}
+
 // --------------------------------------------------------------------------------------------
 
 void jsvObjectIteratorNew(JsvObjectIterator *it, JsVar *obj) {
   assert(jsvIsArray(obj) || jsvIsObject(obj) || jsvIsFunction(obj));
   it->var = jsvGetFirstChild(obj) ? jsvLock(jsvGetFirstChild(obj)) : 0;
+#ifndef SAVE_ON_FLASH
+  // skip over the hash index of big objects (see jsvar.c)
+  if (it->var && jsvIsObject(obj) && it->var->varData.str[0]==JS_HIDDEN_CHAR &&
+      jsvIsStringEqual(it->var, JSV_OBJECT_INDEX_NAME))
+    jsvObjectIteratorNext(it);
+#endif
 }
 
 /// Clone the iterator
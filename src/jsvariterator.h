@@ -105,6 +105,9 @@ void jsvStringIteratorGotoEnd(JsvStringIterator *it);
 /// Append a character TO THE END of a string iterator
 void jsvStringIteratorAppend(JsvStringIterator *it, char ch);
 
+/// Append 'length' characters TO THE END of a string iterator. Copies a whole var at a time, so is much faster than jsvStringIteratorAppend for more than a few characters
+void jsvStringIteratorAppendBuf(JsvStringIterator *it, const char *str, size_t length);
+
 static ALWAYS_INLINE void jsvStringIteratorFree(JsvStringIterator *it) {
   jsvUnLock(it->var);
 }
@@ -474,6 +474,7 @@ JsVar *jswrap_array_splice(JsVar *parent, JsVarInt index, JsVar *howManyVar, JsV
     jsvUnLock(idxVar);
     jsvObjectIteratorNext(&it);
   }
+  if (shift) jsvArrayIndexInvalidate(parent); // any index entries are now in the wrong place
   // free
   jsvObjectIteratorFree(&it);
 
@@ -934,6 +935,7 @@ JsVar *jswrap_array_reverse(JsVar *parent) {
       jsvUnLock(k);
       jsvIteratorNext(&it);
     }
+    jsvArrayIndexInvalidate(parent); // any index entries are now in the wrong place
   }
   jsvIteratorFree(&it);
 
@@ -643,6 +643,34 @@ JsVar *jswrap_espruino_getErrorFlags() {
   return arr;
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "getEventQueueInfo",
+  "generate" : "jswrap_espruino_getEventQueueInfo",
+  "return" : ["JsVar","An object containing information on the IO event queue"]
+}
+Return information on the queue that received characters and `setWatch` events
+are put in before they are handled:
+
+* `size` : The number of events the queue can hold
+* `used` : The number of events in the queue now
+* `highWater` : The most events that have been in the queue at once
+* `overflows` : The number of times data was lost because the queue was full (see the `'FIFO_FULL'` flag in `E.getErrorFlags()`)
+
+The queue's size is set per board, with `io_buffer_size` in the board's `info`.
+ */
+JsVar *jswrap_espruino_getEventQueueInfo() {
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  jsvObjectSetChildAndUnLock(obj, "size", jsvNewFromInteger(IOBUFFERMASK+1));
+  jsvObjectSetChildAndUnLock(obj, "used", jsvNewFromInteger(jshGetEventsUsed()));
+  jsvObjectSetChildAndUnLock(obj, "highWater", jsvNewFromInteger(jshGetEventsHighWater()));
+  jsvObjectSetChildAndUnLock(obj, "overflows", jsvNewFromInteger((JsVarInt)jshGetEventsOverflowed()));
+  return obj;
+}
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "E",
@@ -879,6 +907,36 @@ void jswrap_espruino_dumpTimers() {
   jstDumpUtilityTimers();
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "pushWatchEvent",
+  "ifndef" : "RELEASE",
+  "generate" : "jswrap_espruino_pushWatchEvent",
+  "params" : [
+    ["pin","pin","The pin that is being watched"],
+    ["state","bool","The state the pin should appear to have changed to"]
+  ],
+  "return" : ["bool","True if the pin was being watched and the event was added"]
+}
+Add an event to the input queue as if the given watched pin had changed state
+(without changing the pin itself) - for testing only
+ */
+bool jswrap_espruino_pushWatchEvent(Pin pin, bool state) {
+  IOEvent event;
+  IOEventFlags exti;
+  // find the EXTI channel for this pin
+  for (exti=EV_EXTI0;exti<=EV_EXTI_MAX;exti++) {
+    event.flags = exti;
+    if (jshIsEventForPin(&event, pin)) {
+      if (jshGetEventsUsed() >= IOBUFFERMASK) return false;
+      jshPushIOEvent(exti | (state?EV_EXTI_IS_HIGH:0), jshGetSystemTime());
+      return true;
+    }
+  }
+  return false;
+}
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -949,6 +1007,31 @@ JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth) {
   return jsvNewFromInteger((JsVarInt)jsvCountJsVarsUsed(v));
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "defrag",
+  "generate" : "jswrap_espruino_defrag",
+  "return" : ["int","How many variable blocks the largest area of free memory grew by"]
+}
+Garbage collect, and then move variables towards the start of memory so that
+free memory is in one contiguous area. This helps when creating large Typed
+Arrays, which need to be allocated in one block.
+
+Variables that are currently being used by native code (and the data in
+Typed Arrays that already exist) can't be moved.
+
+Espruino also does this automatically a little at a time when it is idle,
+if it has failed to allocate a large block of memory.
+ */
+JsVarInt jswrap_espruino_defrag() {
+  jsvGarbageCollect();
+  unsigned int before = jsvGetLargestFreeArea();
+  while (jsvDefragment());
+  return (JsVarInt)jsvGetLargestFreeArea() - (JsVarInt)before;
+}
+
 /*JSON{
   "type" : "staticmethod",
     "ifndef" : "SAVE_ON_FLASH",
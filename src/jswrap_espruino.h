@@ -28,6 +28,7 @@ JsVarFloat jswrap_espruino_interpolate2d(JsVar *array, int width, JsVarFloat x,
 void jswrap_espruino_enableWatchdog(JsVarFloat time, JsVar *isAuto);
 void jswrap_espruino_kickWatchdog();
 JsVar *jswrap_espruino_getErrorFlags();
+JsVar *jswrap_espruino_getEventQueueInfo();
 JsVar *jswrap_espruino_toArrayBuffer(JsVar *str);
 JsVar *jswrap_espruino_toUint8Array(JsVar *args);
 JsVar *jswrap_espruino_toString(JsVar *args);
@@ -37,7 +38,9 @@ int jswrap_espruino_setClock(JsVar *options);
 
 int jswrap_espruino_reverseByte(int v);
 void jswrap_espruino_dumpTimers();
+bool jswrap_espruino_pushWatchEvent(Pin pin, bool state);
 JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth);
+JsVarInt jswrap_espruino_defrag();
 void jswrap_espruino_mapInPlace(JsVar *from, JsVar *to, JsVar *map, JsVarInt bits);
 JsVar *jswrap_e_dumpStr();
 JsVarInt jswrap_espruino_HSBtoRGB(JsVarFloat hue, JsVarFloat sat, JsVarFloat bri);
@@ -330,6 +330,8 @@ Set the current system time in seconds (to the nearest second)
  */
 void jswrap_interactive_setTime(JsVarFloat time) {
   JsSysTime stime = jshGetTimeFromMilliseconds(time*1000);
+  // move the timer base by the same amount so timers still fire at the right time
+  jsiTimerBaseTime += stime - jshGetSystemTime();
   jsiLastIdleTime = stime;
   jshSetSystemTime(stime);
 }
@@ -445,7 +447,7 @@ JsVar *_jswrap_interface_setTimeoutOrInterval(JsVar *func, JsVarFloat interval,
     JsVar *timerPtr = jsvNewObject();
     if (interval<TIMER_MIN_INTERVAL) interval=TIMER_MIN_INTERVAL;
     JsSysTime intervalInt = jshGetTimeFromMilliseconds(interval);
-    jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger((jshGetSystemTime() - jsiLastIdleTime) + intervalInt));
+    jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger((jshGetSystemTime() - jsiTimerBaseTime) + intervalInt));
     if (!isTimeout) {
       jsvObjectSetChildAndUnLock(timerPtr, "interval", jsvNewFromLongInteger(intervalInt));
     }
@@ -456,7 +458,6 @@ JsVar *_jswrap_interface_setTimeoutOrInterval(JsVar *func, JsVarFloat interval,
     // Add to array
     itemIndex = jsvNewFromInteger(jsiTimerAdd(timerPtr));
     jsvUnLock(timerPtr);
-    jsiTimersChanged(); // mark timers as changed
   }
   return itemIndex;
 }
@@ -568,10 +569,11 @@ void jswrap_interface_changeInterval(JsVar *idVar, JsVarFloat interval) {
     JsVarInt intervalInt = (JsVarInt)jshGetTimeFromMilliseconds(interval);
     v = jsvNewFromInteger(intervalInt);
     jsvUnLock2(jsvSetNamedChild(timer, v, "interval"), v);
-    v = jsvNewFromInteger((JsVarInt)(jshGetSystemTime()-jsiLastIdleTime) + intervalInt);
-    jsvUnLock3(jsvSetNamedChild(timer, v, "time"), v, timer);
+    v = jsvNewFromLongInteger((JsSysTime)(jshGetSystemTime()-jsiTimerBaseTime) + intervalInt);
+    jsvUnLock2(jsvSetNamedChild(timer, v, "time"), v);
+    jsiTimerTimeChanged(timer); // make sure we check it when it's due
+    jsvUnLock(timer);
     // timerName already unlocked
-    jsiTimersChanged(); // mark timers as changed
   } else {
     jsExceptionHere(JSET_ERROR, "Unknown Interval");
   }
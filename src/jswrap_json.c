@@ -189,7 +189,13 @@ void jsfGetJSONForFunctionWithCallback(JsVar *var, JSONFlags flags, vcbprintf_ca
       } else {
         const char *prefix = jsvIsFunctionReturn(var) ? "return " : "";
         bool hadNewLine = jsvGetStringIndexOf(codeVar,'\n')>0;
+#ifndef SAVE_ON_FLASH
+        cbprintf(user_callback, user_data, hadNewLine?"{\n  %s":"{%s", prefix);
+        jslPrintTokenisedString(codeVar, user_callback, user_data);
+        cbprintf(user_callback, user_data, hadNewLine?"\n}":"}");
+#else
         cbprintf(user_callback, user_data, hadNewLine?"{\n  %s%v\n}":"{%s%v}", prefix, codeVar);
+#endif
       }
     } else cbprintf(user_callback, user_data, "{}");
   }
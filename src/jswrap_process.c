@@ -122,6 +122,8 @@ Run a Garbage Collection pass, and return an object containing information on me
 * `usage` : Memory that has been used (in blocks)
 * `total` : Total memory (in blocks)
 * `history` : Memory used for command history - that is freed if memory is low. Note that this is INCLUDED in the figure for 'free'
+* `gctime` : (not on devices with limited flash) the time in milliseconds that the garbage collection pass run by this call took
+* `gcmaxpause` : (not on devices with limited flash) the longest time in milliseconds that garbage collection has stopped execution for. When memory gets low, garbage is collected a few milliseconds at a time while idle.
 * `stackEndAddress` : (on ARM) the address (that can be used with peek/poke/etc) of the END of the stack. The stack grows down, so unless you do a lot of recursion the bytes above this can be used.
 * `flash_start` : (on ARM) the address of the start of flash memory (usually `0x8000000`)
 * `flash_binary_end` : (on ARM) the address in flash memory of the end of Espruino's firmware.
@@ -133,7 +135,13 @@ Memory units are specified in 'blocks', which are around 16 bytes each (dependin
 **Note:** To find free areas of flash memory, see `require('Flash').getFree()`
  */
 JsVar *jswrap_process_memory() {
+#ifndef SAVE_ON_FLASH
+  JsSysTime gcTime = jshGetSystemTime();
+#endif
   jsvGarbageCollect();
+#ifndef SAVE_ON_FLASH
+  gcTime = jshGetSystemTime() - gcTime;
+#endif
   JsVar *obj = jsvNewObject();
   if (obj) {
     unsigned int history = 0;
@@ -148,6 +156,10 @@ JsVar *jswrap_process_memory() {
     jsvObjectSetChildAndUnLock(obj, "usage", jsvNewFromInteger((JsVarInt)usage));
     jsvObjectSetChildAndUnLock(obj, "total", jsvNewFromInteger((JsVarInt)total));
     jsvObjectSetChildAndUnLock(obj, "history", jsvNewFromInteger((JsVarInt)history));
+#ifndef SAVE_ON_FLASH
+    jsvObjectSetChildAndUnLock(obj, "gctime", jsvNewFromFloat(jshGetMillisecondsFromTime(gcTime)));
+    jsvObjectSetChildAndUnLock(obj, "gcmaxpause", jsvNewFromFloat(jshGetMillisecondsFromTime(jsvGarbageCollectMaxPause())));
+#endif
 
 #ifdef ARM
     extern int LINKER_END_VAR; // end of ram used (variables) - should be 'void', but 'int' avoids warnings
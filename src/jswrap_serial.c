@@ -183,7 +183,7 @@ Unless `force` is set to true, changes in the connection state of the board
   "generate" : "jswrap_serial_setup",
   "params" : [
     ["baudrate","JsVar","The baud rate - the default is 9600"],
-    ["options","JsVar",["An optional structure containing extra information on initialising the serial port.","```{rx:pin,tx:pin,bytesize:8,parity:null/'none'/'o'/'odd'/'e'/'even',stopbits:1,flow:null/undefined/'none'/'xon',path:null/undefined/string}```","You can find out which pins to use by looking at [your board's reference page](#boards) and searching for pins with the `UART`/`USART` markers.","Note that even after changing the RX and TX pins, if you have called setup before then the previous RX and TX pins will still be connected to the Serial port as well - until you set them to something else using digitalWrite"]]
+    ["options","JsVar",["An optional structure containing extra information on initialising the serial port.","```{rx:pin,tx:pin,bytesize:8,parity:null/'none'/'o'/'odd'/'e'/'even',stopbits:1,flow:null/undefined/'none'/'xon',path:null/undefined/string,chunk:0}```","`chunk` (if nonzero) makes Espruino wait until it has received that many characters before calling the `data` event (or until no more data has arrived for a few milliseconds)","You can find out which pins to use by looking at [your board's reference page](#boards) and searching for pins with the `UART`/`USART` markers.","Note that even after changing the RX and TX pins, if you have called setup before then the previous RX and TX pins will still be connected to the Serial port as well - until you set them to something else using digitalWrite"]]
   ]
 }
 Setup this Serial port with the given baud rate and options.
@@ -205,6 +205,9 @@ void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options) {
   JsVar *parity = 0;
   JsVar *flow = 0;
   JsVar *path = 0;
+#ifndef SAVE_ON_FLASH
+  JsVarInt chunk = 0;
+#endif
   jsvConfigObject configs[] = {
       {"rx", JSV_PIN, &inf.pinRX},
       {"tx", JSV_PIN, &inf.pinTX},
@@ -214,6 +217,9 @@ void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options) {
       {"path", JSV_STRING_0, &path},
       {"parity", JSV_OBJECT /* a variable */, &parity},
       {"flow", JSV_OBJECT /* a variable */, &flow},
+#ifndef SAVE_ON_FLASH
+      {"chunk", JSV_INTEGER, &chunk},
+#endif
   };
 
 
@@ -243,6 +249,13 @@ void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options) {
       ok = false;
     }
 
+#ifndef SAVE_ON_FLASH
+    if (chunk<0) {
+      jsExceptionHere(JSET_ERROR, "Invalid chunk size %d", (int)chunk);
+      ok = false;
+    }
+#endif
+
     if (ok) {
       if (jsvIsUndefined(flow) || jsvIsNull(flow) || jsvIsStringEqual(flow, "none"))
         inf.xOnXOff = false;
@@ -277,22 +290,38 @@ void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options) {
 }
 
 
-static void _jswrap_serial_print_cb(int data, void *userData) {
-  IOEventFlags device = *(IOEventFlags*)userData;
-  jshTransmit(device, (unsigned char)data);
+/// Characters are collected here so they can be sent with jshTransmitBuf
+typedef struct {
+  IOEventFlags device;
+  size_t len;
+  unsigned char buf[32];
+} SerialPrintData;
+
+static void _jswrap_serial_print_flush(SerialPrintData *data) {
+  jshTransmitBuf(data->device, data->buf, data->len);
+  data->len = 0;
+}
+static void _jswrap_serial_print_cb(int ch, void *userData) {
+  SerialPrintData *data = (SerialPrintData*)userData;
+  data->buf[data->len++] = (unsigned char)ch;
+  if (data->len >= sizeof(data->buf))
+    _jswrap_serial_print_flush(data);
 }
 void _jswrap_serial_print(JsVar *parent, JsVar *arg, bool isPrint, bool newLine) {
   NOT_USED(parent);
-  IOEventFlags device = jsiGetDeviceFromClass(parent);
-  if (!DEVICE_IS_USART(device)) return;
+  SerialPrintData data;
+  data.device = jsiGetDeviceFromClass(parent);
+  data.len = 0;
+  if (!DEVICE_IS_USART(data.device)) return;
 
   if (isPrint) arg = jsvAsString(arg, false);
-  jsvIterateCallback(arg, _jswrap_serial_print_cb, (void*)&device);
+  jsvIterateCallback(arg, _jswrap_serial_print_cb, (void*)&data);
   if (isPrint) jsvUnLock(arg);
   if (newLine) {
-    _jswrap_serial_print_cb((unsigned char)'\r', (void*)&device);
-    _jswrap_serial_print_cb((unsigned char)'\n', (void*)&device);
+    _jswrap_serial_print_cb((unsigned char)'\r', (void*)&data);
+    _jswrap_serial_print_cb((unsigned char)'\n', (void*)&data);
   }
+  _jswrap_serial_print_flush(&data);
 }
 
 /*JSON{
@@ -87,8 +87,11 @@ bool jswrap_stream_pushData(JsVar *parent, JsVar *dataString, bool force) {
     // No callback - try and add buffer
     JsVar *buf = jsvObjectGetChild(parent, STREAM_BUFFER_NAME, 0);
     if (!jsvIsString(buf)) {
-      // no buffer, just set this one up
-      jsvObjectSetChild(parent, STREAM_BUFFER_NAME, dataString);
+      // no buffer, just set this one up (flat strings can't be appended to, so copy them)
+      if (jsvIsFlatString(dataString))
+        jsvObjectSetChildAndUnLock(parent, STREAM_BUFFER_NAME, jsvCopy(dataString));
+      else
+        jsvObjectSetChild(parent, STREAM_BUFFER_NAME, dataString);
     } else {
       // append (if there is room!)
       size_t bufLen = jsvGetStringLength(buf);
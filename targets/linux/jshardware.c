@@ -16,6 +16,7 @@
  #include <stdio.h>
  #include <unistd.h>
  #include <sys/time.h>
+ #include <errno.h>
 #ifdef __MINGW32__
  #include <conio.h>
 #else//!__MINGW32__
@@ -25,6 +26,13 @@
 #endif//__MINGW32__
  #include <signal.h>
  #include <inttypes.h>
+#ifdef __linux__
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/timerfd.h>
+ // Wait for IO with epoll rather than polling
+ #define USE_EPOLL
+#endif
 
 #include "jshardware.h"
 #include "jsutils.h"
@@ -221,8 +229,8 @@ int getch()
 {
     int r;
     unsigned char c;
-    if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) < 0) {
-        return r;
+    if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) <= 0) {
+        return -1; // error, or end of file
     } else {
         return c;
     }
@@ -231,44 +239,111 @@ int getch()
 
 pthread_t inputThread;
 bool isInitialised;
+#ifdef USE_EPOLL
+int inputEpoll = -1; ///< epoll set the input thread waits on - the console, open devices and inputWake
+int inputWake = -1; ///< eventfd used to wake the input thread when there is data to transmit
+volatile int inputWaiting; ///< nonzero while the input thread is (about to be) waiting on inputEpoll
+bool inputPollConsole; ///< stdin can't be used with epoll (eg. it's a file) so it has to be polled
+int sleepEpoll = -1; ///< epoll set jshSleep waits on - sleepWake, sleepTimer and any sockets
+int sleepWake = -1; ///< eventfd used by the input thread to wake jshSleep when it has received data
+int sleepTimer = -1; ///< timerfd for the time jshSleep should wake up at
+
+static void jshEpollAdd(int epoll, int fd) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/// Clear the count in an eventfd after it has woken us
+static void jshEpollClear(int fd) {
+  uint64_t count;
+  if (read(fd, &count, sizeof(count))) {};
+}
+
+static void jshWakeMainThread() {
+  uint64_t one = 1;
+  if (write(sleepWake, &one, sizeof(one))) {};
+}
+
+/// Wake jshSleep when the given socket has data (used by network_linux.c)
+void jshWakeOnFd(int fd) {
+  if (sleepEpoll>=0) jshEpollAdd(sleepEpoll, fd);
+}
+#else
+// Used so the input thread can wake the main thread from jshSleep when it has received data
+pthread_mutex_t sleepMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sleepCond = PTHREAD_COND_INITIALIZER;
+
+static void jshWakeMainThread() {
+  pthread_mutex_lock(&sleepMutex);
+  pthread_cond_signal(&sleepCond);
+  pthread_mutex_unlock(&sleepMutex);
+}
+#endif
 
 void jshInputThread() {
   while (isInitialised) {
     bool shortSleep = false;
+    bool txBufferFull = false; // the transmit buffer was full - something may be waiting for space
+    bool ioBufferFull = false; // we stopped reading because the IO queue was getting full
     /* Handle the delayed Ctrl-C -> interrupt behaviour (see description by EXEC_CTRL_C's definition)  */
     if (execInfo.execute & EXEC_CTRL_C_WAIT)
       execInfo.execute = (execInfo.execute & ~EXEC_CTRL_C_WAIT) | EXEC_INTERRUPTED;
     if (execInfo.execute & EXEC_CTRL_C)
       execInfo.execute = (execInfo.execute & ~EXEC_CTRL_C) | EXEC_CTRL_C_WAIT;
+    bool received = false;
     // Read from the console
     while (kbhit()) {
       int ch = getch();
-      if (ch<0) break;
+      if (ch<0) {
+#ifdef USE_EPOLL
+        // end of file - stop epoll returning straight away for it
+        if (!inputPollConsole) epoll_ctl(inputEpoll, EPOLL_CTL_DEL, STDIN_FILENO, 0);
+        inputPollConsole = true;
+#endif
+        break;
+      }
       jshPushIOCharEvent(EV_USBSERIAL, (char)ch);
+      received = true;
     }
     // Read from any open devices - if we have space
     if (jshGetEventsUsed() < IOBUFFERMASK/2) {
       int i;
       for (i=0;i<=EV_DEVICE_MAX;i++) {
         if (ioDevices[i]) {
-          char buf[32];
-          // read can return -1 (EAGAIN) because O_NONBLOCK is set
-          int bytes = (int)read(ioDevices[i], buf, sizeof(buf));
-          if (bytes>0) {
-            //int j; for (j=0;j<bytes;j++) printf("]] '%c'\r\n", buf[j]);
-            jshPushIOCharEvents(i, buf, (unsigned int)bytes);
-            shortSleep = true;
-          }
+          char buf[128];
+          int bytes;
+          do { // keep reading while there's more data and we have space
+            // read can return -1 (EAGAIN) because O_NONBLOCK is set
+            bytes = (int)read(ioDevices[i], buf, sizeof(buf));
+            if (bytes>0) {
+              //int j; for (j=0;j<bytes;j++) printf("]] '%c'\r\n", buf[j]);
+              jshPushIOCharEvents(i, buf, (unsigned int)bytes);
+              shortSleep = true;
+              received = true;
+            }
+          } while (bytes==(int)sizeof(buf) && jshGetEventsUsed() < IOBUFFERMASK/2);
         }
       }
-    }
-    // Write any data we have
+    } else
+      ioBufferFull = true;
+    if (received) jshWakeMainThread();
+    // Write any data we have, a block at a time
     IOEventFlags device = jshGetDeviceToTransmit();
     while (device != EV_NONE) {
-      char ch = (char)jshGetCharToTransmit(device);
-      //printf("[[ '%c'\r\n", ch);
+      unsigned char buf[TXBUFFERMASK+1];
+      size_t len = jshGetDataToTransmit(device, buf, sizeof(buf));
+      if (len >= TXBUFFERMASK) txBufferFull = true;
       if (ioDevices[device]) {
-        write(ioDevices[device], &ch, 1);
+        size_t written = 0;
+        while (written < len) {
+          ssize_t r = write(ioDevices[device], &buf[written], len-written);
+          if (r > 0) written += (size_t)r;
+          else if (r<0 && errno==EAGAIN) usleep(1000); // O_NONBLOCK, so wait for space
+          else break; // error - drop the data
+        }
         shortSleep = true;
       }
       device = jshGetDeviceToTransmit();
@@ -288,7 +363,34 @@ void jshInputThread() {
       }
 #endif
 
-    usleep(shortSleep ? 1000 : 50000);
+#ifdef USE_EPOLL
+    /* Wait until a device has data, or jshUSARTKick says there's something to
+     * send. We still have to poll for GPIO watches, for files as stdin, and
+     * to turn Ctrl-C into an interrupt if JS doesn't respond to it */
+    NOT_USED(shortSleep);
+    NOT_USED(txBufferFull);
+    int timeout = -1;
+    if (inputPollConsole || (execInfo.execute & EXEC_CTRL_C_MASK))
+      timeout = 50;
+#ifdef SYSFS_GPIO_DIR
+    for (pin=0;pin<JSH_PIN_COUNT;pin++)
+      if (gpioShouldWatch[pin]) timeout = 1;
+#endif
+    if (ioBufferFull) {
+      usleep(1000); // devices still have data, so epoll would return straight away
+    } else {
+      inputWaiting = 1;
+      __sync_synchronize(); // so jshUSARTKick either sees inputWaiting or we see its data
+      if (!jshHasTransmitData()) {
+        struct epoll_event events[8];
+        epoll_wait(inputEpoll, events, sizeof(events)/sizeof(struct epoll_event), timeout);
+      }
+      inputWaiting = 0;
+      jshEpollClear(inputWake);
+    }
+#else
+    usleep(txBufferFull ? 100 : (shortSleep ? 1000 : 50000));
+#endif
   }
 }
 
@@ -326,6 +428,24 @@ void jshInit() {
     terminal_set = 1;
   }
 #endif//!__MINGW32__
+#ifdef USE_EPOLL
+  if (inputEpoll<0) {
+    inputEpoll = epoll_create1(EPOLL_CLOEXEC);
+    inputWake = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    jshEpollAdd(inputEpoll, inputWake);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = STDIN_FILENO;
+    // this fails for files and /dev/null, which are always readable anyway
+    inputPollConsole = epoll_ctl(inputEpoll, EPOLL_CTL_ADD, STDIN_FILENO, &ev)!=0;
+    sleepEpoll = epoll_create1(EPOLL_CLOEXEC);
+    sleepWake = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    sleepTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    jshEpollAdd(sleepEpoll, sleepWake);
+    jshEpollAdd(sleepEpoll, sleepTimer);
+  }
+#endif
   for (i=0;i<JSH_PIN_COUNT;i++) {
     gpioState[i] = JSHPINSTATE_UNDEFINED;
     gpioEventFlags[i] = 0;
@@ -619,6 +739,9 @@ void jshUSARTSetup(IOEventFlags device, JshUSARTInfo *inf) {
     if (!ioDevices[device]) {
       jsError("Open of path %s failed", path);
     } else {
+#ifdef USE_EPOLL
+      if (ioDevices[device]>0) jshEpollAdd(inputEpoll, ioDevices[device]);
+#endif
       struct termios settings;
       tcgetattr(ioDevices[device], &settings); // get current settings
 
@@ -697,7 +820,13 @@ void jshUSARTSetup(IOEventFlags device, JshUSARTInfo *inf) {
  * to set up interrupts */
 void jshUSARTKick(IOEventFlags device) {
   assert(DEVICE_IS_USART(device) || DEVICE_IS_SPI(device));
-  // all done by the idle loop
+  // all done by the input thread - just wake it if it's waiting
+#ifdef USE_EPOLL
+  if (inputWaiting && __sync_lock_test_and_set(&inputWaiting, 0)) {
+    uint64_t one = 1;
+    if (write(inputWake, &one, sizeof(one))) {};
+  }
+#endif
 }
 
 void jshSPISetup(IOEventFlags device, JshSPIInfo *inf) {
@@ -710,6 +839,9 @@ void jshSPISetup(IOEventFlags device, JshSPIInfo *inf) {
      if (!ioDevices[device]) {
        jsError("Open of path %s failed", path);
      } else {
+#ifdef USE_EPOLL
+       if (ioDevices[device]>0) jshEpollAdd(inputEpoll, ioDevices[device]);
+#endif
      }
    } else {
      jsError("No path defined for device");
@@ -766,10 +898,38 @@ bool jshSleep(JsSysTime timeUntilWake) {
   unsigned int usecs = (usecfloat < 0xFFFFFFFF) ? (unsigned int)usecfloat : 0xFFFFFFFF;
   if (hasWatches && usecs>1000) 
     usecs=1000; // don't sleep much if we have watches - we need to keep polling them
+#ifdef USE_EPOLL
+  /* Sleep until the input thread receives something, a socket has data, or
+   * sleepTimer says it's time for the next timer */
+  struct itimerspec wake;
+  memset(&wake, 0, sizeof(wake));
+  if (usecfloat < 0xFFFFFFFF || hasWatches) {
+    if (!usecs) return true;
+    wake.it_value.tv_sec = usecs / 1000000;
+    wake.it_value.tv_nsec = (long)(usecs % 1000000)*1000;
+  } // else there are no timers, so just wait for something to happen
+  timerfd_settime(sleepTimer, 0, &wake, 0);
+  if (!jshHasEvents()) {
+    struct epoll_event events[8];
+    epoll_wait(sleepEpoll, events, sizeof(events)/sizeof(struct epoll_event), -1);
+  }
+  jshEpollClear(sleepWake);
+#else
   if (usecs > 50000)
     usecs = 50000; // don't want to sleep too much (user input/HTTP/etc)
-  if (usecs >= 1000)  
-    usleep(usecs); 
+  if (usecs >= 1000) {
+    // sleep, but wake up early if the input thread receives something
+    struct timespec wake;
+    clock_gettime(CLOCK_REALTIME, &wake);
+    wake.tv_nsec += (long)usecs*1000;
+    wake.tv_sec += wake.tv_nsec / 1000000000;
+    wake.tv_nsec %= 1000000000;
+    pthread_mutex_lock(&sleepMutex);
+    if (!jshHasEvents())
+      pthread_cond_timedwait(&sleepCond, &sleepMutex, &wake);
+    pthread_mutex_unlock(&sleepMutex);
+  }
+#endif
   return true;
 }
 
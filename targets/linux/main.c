@@ -13,12 +13,24 @@
 #include "jsinteractive.h"
 #include "jshardware.h"
 #include "jswrapper.h"
+#ifdef USE_NET
+#include "socketserver.h"
+#endif
 
 
 #define TEST_DIR "tests/"
 
 bool isRunning = true;
 
+/// Should we keep going around the idle loop? (we don't exit while there are open sockets)
+bool shouldKeepRunning(bool isBusy) {
+  if (jsiHasTimers() || isBusy) return true;
+#ifdef USE_NET
+  if (socketHasConnections()) return true;
+#endif
+  return false;
+}
+
 void addNativeFunction(const char *name, void (*callbackPtr)(void)) {
   jsvObjectSetChildAndUnLock(execInfo.root, name, jsvNewNativeFunction(callbackPtr, JSWAT_VOID));
 }
@@ -70,7 +82,7 @@ bool run_test(const char *filename) {
 
   isRunning = true;
   bool isBusy = true;
-  while (isRunning && (jsiHasTimers() || isBusy))
+  while (isRunning && shouldKeepRunning(isBusy))
     isBusy = jsiLoop();
 
   JsVar *result = jsvObjectGetChild(execInfo.root, "result", 0/*no create*/);
@@ -266,7 +278,7 @@ int main(int argc, char **argv) {
         int errCode = handleErrors();
         isRunning = !errCode;
         bool isBusy = true;
-        while (isRunning && (jsiHasTimers() || isBusy))
+        while (isRunning && shouldKeepRunning(isBusy))
           isBusy = jsiLoop();
         jsiKill();
         jsvKill();
@@ -327,7 +339,7 @@ int main(int argc, char **argv) {
     free(buffer);
     isRunning = !errCode;
     bool isBusy = true;
-    while (isRunning && (jsiHasTimers() || isBusy))
+    while (isRunning && shouldKeepRunning(isBusy))
       isBusy = jsiLoop();
     jsiKill();
     jsvKill();
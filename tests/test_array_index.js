@@ -0,0 +1,53 @@
+// Arrays that are accessed by index get a dense index - check it stays correct
+
+var ok = true;
+var i, a = [];
+for (i=0;i<100;i++) a.push(i);
+for (i=0;i<100;i+=3) ok &= a[i]==i;
+// functions that renumber elements in place
+a.shift();
+ok &= a[0]==1 && a[98]==99 && a[99]===undefined;
+a.unshift(-1,-2);
+ok &= a[0]==-1 && a[1]==-2 && a[2]==1 && a[100]==99;
+a.splice(10,5,"x");
+ok &= a[10]=="x" && a[11]==14 && a.length==97;
+a.reverse();
+ok &= a[0]==99 && a[96]==-1;
+a.sort(function(x,y) { return (typeof x=="string") ? 1 : (typeof y=="string" ? -1 : x-y); });
+ok &= a[0]==-2 && a[1]==-1 && a[2]==1 && a[10]==14 && a[96]=="x";
+// removing elements
+delete a[45];
+ok &= a[45]===undefined && a[44]==48 && a[46]==50;
+ok &= a.pop()=="x" && a[96]===undefined && a[95]==99;
+// copies
+var b = a.slice();
+b[3] = "changed";
+ok &= a[3]==2 && b[3]=="changed" && b[4]==a[4];
+// sparse arrays
+var sparse = [];
+sparse[1000] = 1;
+sparse[5] = 2;
+ok &= sparse[5]==2 && sparse[1000]==1 && sparse[6]===undefined;
+
+process.memory(); // garbage collect
+ok &= a[0]==-2 && a[44]==48 && a[95]==99;
+
+// removing an element after renumbering mustn't leave an old index entry behind
+// (its name could be reused by another array)
+function fill(n) { var r = []; for (var i=0;i<n;i++) r.push(i); return r; }
+function check(arr, fn, expected) {
+  var other = [];
+  arr[31]; // make sure the index exists
+  fn(arr);
+  arr.pop();
+  other[31] = "LEAK"; // likely to reuse the variable that was just freed
+  return JSON.stringify(arr) == JSON.stringify(expected) && arr[31]===undefined && arr[expected.length]===undefined;
+}
+var n31 = fill(31);
+ok &= check(fill(32), function(a) { a.shift(); }, n31.slice(1,31));
+ok &= check(fill(32), function(a) { a.unshift("u"); a.shift(); a.shift(); }, n31.slice(1,31));
+ok &= check(fill(32), function(a) { a.splice(3,2); }, n31.slice(0,3).concat(n31.slice(5,31)));
+ok &= check(fill(32), function(a) { a.reverse(); }, fill(32).reverse().slice(0,31));
+ok &= check(fill(32), function(a) { a.sort(function(x,y) { return y-x; }); }, fill(32).reverse().slice(0,31));
+
+result = ok;
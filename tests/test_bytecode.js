@@ -0,0 +1,42 @@
+// Functions marked "bytecode" are compiled - check they give the same results as normal functions
+
+function loops(n) {
+  var s = 0;
+  for (var i=0;i<n;i++) {
+    if (i==3) continue;
+    if (i>7) break;
+    s += i;
+  }
+  var j = 0;
+  while (true) { if (++j>=5) break; }
+  do { s += j--; } while (j);
+  return s;
+}
+function logic(a, b) { return [a && b, a || b, a ? "yes" : "no", !a, ~b, -a, +"3", typeof a, typeof nothing]; }
+function makeArray(n) { return new Uint16Array(n); }
+function methods(arr) {
+  var u = makeArray(arr.length);
+  for (var i=0;i<arr.length;i++) u[i] = arr[i]*2;
+  u[0]--;
+  ++u[1];
+  var str = "x";
+  str += u.join(",");
+  return [str, u[2]++, u[2], arr.indexOf(3), [1,"a",null].length];
+}
+function fallback() { var a = {b:1}; try { return a.b; } catch (e) {} }
+
+var funcs = [loops, logic, methods, fallback];
+var args = [[20], [1, 2], [[1,2,3]], []];
+var bytecodeFuncs = funcs.map(function(f) {
+  return eval("("+f.toString().replace("{","{\"bytecode\";")+")");
+});
+
+var results = funcs.map(function(f,i) { return JSON.stringify(f.apply(undefined, args[i])); });
+var bytecodeResults = bytecodeFuncs.map(function(f,i) { return JSON.stringify(f.apply(undefined, args[i])); });
+
+var thrown;
+try {
+  (function() { "bytecode"; throw "boom"; })();
+} catch (e) { thrown = e; }
+
+result = JSON.stringify(results)==JSON.stringify(bytecodeResults) && thrown=="boom";
@@ -0,0 +1,63 @@
+// Check that E.defrag() moves variables around without breaking anything
+
+var ok = true;
+function check(c) { if (!c) ok = false; }
+
+// Fragment memory by creating lots of objects and freeing every other one
+var objs = [];
+for (var i=0;i<200;i++) objs.push({a:i, b:"Hello "+i});
+for (var i=0;i<objs.length;i+=2) objs[i] = undefined;
+
+// An object big enough to have a hash index
+var big = {};
+for (var i=0;i<40;i++) big["key"+i] = i*3;
+// An array that has an index
+var arr = [];
+for (var i=0;i<50;i++) arr.push(i*2);
+for (var i=0;i<50;i++) check(arr[i]==i*2);
+// A string long enough to have lots of blocks
+var str = "";
+for (var i=0;i<30;i++) str += "The quick brown fox "+i+". ";
+var strCopy = str.length;
+// A closure
+function counter() { var n = 10; return function() { return n++; }; }
+var c = counter();
+// A timeout
+var timedOut = false;
+setTimeout(function() { timedOut = true; }, 1);
+
+// How big a typed array is when its data is in one flat block
+var FLATLEN = 2000;
+var flatSize = E.getSizeOf(new Uint8Array(FLATLEN));
+// Now fill up almost all of memory with interleaved array elements, and free every other one
+var keep = [], drop = [];
+var n = (process.memory().free - 40) >> 1;
+for (var i=0;i<n;i++) { keep.push(i); drop.push(i); }
+drop = undefined;
+process.memory(); // garbage collect
+// There's no contiguous free area big enough, so this isn't flat
+check(E.getSizeOf(new Uint8Array(FLATLEN))!=flatSize);
+
+var grew = E.defrag();
+check(grew>0);
+// but now there is
+check(E.getSizeOf(new Uint8Array(FLATLEN))==flatSize);
+for (var i=0;i<n;i++) check(keep[i]==i);
+
+for (var i=1;i<objs.length;i+=2) check(objs[i].a==i && objs[i].b=="Hello "+i);
+for (var i=0;i<40;i++) check(big["key"+i]==i*3);
+check(Object.keys(big).length==40);
+big.another = 1;
+check(big.another==1 && big.key39==117);
+for (var i=0;i<50;i++) check(arr[i]==i*2);
+arr.push(100);
+check(arr.length==51 && arr[50]==100);
+check(str.length==strCopy && str.substr(0,20)=="The quick brown fox ");
+check(c()==10 && c()==11);
+// Allocating a large typed array should still work
+var buf = new Uint8Array(200);
+check(buf.length==200);
+
+setTimeout(function() {
+  result = ok && timedOut;
+}, 10);
@@ -0,0 +1,13 @@
+// Check the IO event queue's high water mark and overflow counters
+var info = E.getEventQueueInfo();
+var ok = info.size>0 && info.used==0 && info.overflows==0;
+E.getErrorFlags(); // clear flags
+var s = "";
+while (s.length <= info.size*4) s += "Hello World "; // chars may be packed 4 to an event
+// this fills the queue, as LoopbackB is only read when idle
+LoopbackA.write(s);
+var after = E.getEventQueueInfo();
+ok = ok && after.highWater==info.size-1 && after.overflows>0 &&
+     after.used==info.size-1 && E.getErrorFlags().indexOf("FIFO_FULL")>=0;
+
+result = ok;
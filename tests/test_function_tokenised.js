@@ -0,0 +1,39 @@
+// Function code is stored pretokenised - check it still runs and prints the same (with whitespace and comments)
+
+function foo(a, b) {
+  // a comment
+  var x = a - -b; /* block */
+  var s = "hello\nworld", t = 'it\'s';
+  if (x >= 2 && typeof x == "number") return x + 1 .toString() + s + t + {default:3}.default;
+  return 0;
+}
+function bar() { return 1 in {1:1}; }
+function baz(a) {
+  var b = a; // copy it
+  if (b) {
+    /* a block
+       comment */
+    b++;
+  }
+  return b;
+}
+function err() {
+  var s = "0123456789", q = "abcdefghij";
+  var t = 1;
+  t.foo.bar;
+}
+function ten() { var s = "0123456789"; return s.length; }
+
+var r1 = foo(1,2);
+var r2 = bar();
+var foo2 = eval("("+foo.toString()+")");
+var r3 = foo2(1,2);
+
+result = r1=="31hello\nworldit's3" && r2===true && r3==r1 &&
+         bar.toString()=="function () {return 1 in {1:1};}" &&
+         // whitespace and comments are kept for dump()/edit()
+         baz.toString()=="function (a) {\n  var b = a; // copy it\n  if (b) {\n    /* a block\n       comment */\n    b++;\n  }\n  return b;\n}" &&
+         baz(1)==2 &&
+         // strings of length 10 mustn't add newlines - line numbers for errors come from counting them
+         err["\xFFcod"].split("\n").length==3 &&
+         ten.toString()=="function () {var s = \"0123456789\"; return s.length;}" && ten()==10;
@@ -0,0 +1,26 @@
+// Garbage collecting (and freeing) deeply nested data shouldn't recurse
+
+var ok = true;
+var i, list;
+for (i=0;i<20000;i++) list = { v:i, next:list };
+process.memory();
+var n = 0, l = list;
+while (l) { ok &= l.v==19999-n; n++; l = l.next; }
+ok &= n==20000;
+// make it a loop, so only the garbage collector can free it
+l = list;
+while (l.next) l = l.next;
+l.next = list;
+l = list = undefined;
+var before = process.memory().usage;
+
+// lots of children - more than the garbage collector can keep track of at once
+var wide = [];
+for (i=0;i<500;i++) wide.push({ i:i, inner:{ s:"str"+i } });
+wide.self = wide;
+process.memory();
+for (i=0;i<500;i++) ok &= wide[i].i==i && wide[i].inner.s=="str"+i;
+wide = undefined;
+var after = process.memory().usage;
+
+result = ok && before < 1000 && after < 1000;
@@ -0,0 +1,43 @@
+// Cyclic garbage is collected a bit at a time on idle - check live data survives it being moved around while that happens
+
+var live = { list:[], obj:{} };
+var steps = 0;
+var ok = true;
+
+function check() {
+  var i;
+  for (i=0;i<live.list.length;i++)
+    ok &= live.list[i].n==i && live.list[i].self==live.list[i];
+  for (i in live.obj)
+    ok &= live.obj[i].name==i;
+}
+
+var interval = setInterval(function() {
+  var i;
+  // make lots of garbage that can only be freed by the garbage collector
+  for (i=0;i<50;i++) {
+    var a = { x:"garbage "+i }, b = { a:a };
+    a.b = b;
+  }
+  // move live data between objects, so things the collector has already looked at get new children
+  var item = { n:live.list.length, str:"item "+steps };
+  item.self = item;
+  live.list.push(item);
+  var name = "f"+steps;
+  var holder = { name:name, data:[steps] };
+  live.obj[name] = holder;
+  if (steps>2) {
+    var old = "f"+(steps-2);
+    var moved = live.obj[old];
+    delete live.obj[old];
+    moved.name = "m"+steps;
+    live.obj["m"+steps] = moved;
+  }
+  check();
+  if (++steps >= 100) {
+    clearInterval(interval);
+    check();
+    var mem = process.memory();
+    result = ok && live.list.length==100 && mem.gcmaxpause>=0;
+  }
+}, 1);
@@ -0,0 +1,49 @@
+// Drawing into a Graphics' own (flat) buffer is done directly on memory - check it gives
+// exactly the same results as drawing into an ArrayBuffer that isn't flat
+function nonFlat(len) {
+  var s = "";
+  for (var i=0;i<len;i++) s+="\0";
+  return E.toArrayBuffer(s);
+}
+
+function draw(g) {
+  var c = 0x89ABCDEF;
+  g.setBgColor(c*7);
+  g.clear();
+  g.setColor(c);
+  g.fillRect(1,2,11,9);
+  g.fillRect(0,3,12,4);
+  g.setColor(c>>>3);
+  g.fillRect(2,0,2,10);
+  g.fillRect(3,1,9,1);
+  g.drawLine(0,10,12,0);
+  g.setColor(0);
+  g.setPixel(5,5);
+  g.drawString("Hi",4,4);
+  var p = [];
+  for (var i=0;i<13;i++) p.push(g.getPixel(i,i%11));
+  return p.join(",");
+}
+
+var configs = [];
+[1,2,4,8,16,24,32].forEach(function(bpp) {
+  configs.push([bpp,{}],[bpp,{msb:true}],[bpp,{zigzag:true}],[bpp,{zigzag:true,msb:true}]);
+});
+configs.push([1,{vertical_byte:true}],[1,{vertical_byte:true,msb:true}],[1,{vertical_byte:true,zigzag:true}]);
+
+var ok = true;
+configs.forEach(function(c) {
+  var a = Graphics.createArrayBuffer(13,11,c[0],c[1]);
+  var b = Graphics.createArrayBuffer(13,11,c[0],c[1]);
+  b.buffer = nonFlat(c[1].vertical_byte ? 13*2 : (13*11*c[0]+7)>>3);
+  var pa = draw(a), pb = draw(b);
+  var ba = new Uint8Array(a.buffer), bb = new Uint8Array(b.buffer);
+  var same = pa==pb && ba.length==bb.length;
+  for (var i=0;i<ba.length;i++)
+    if (ba[i]!=bb[i]) same = false;
+  if (!same) {
+    console.log("Mismatch for "+c[0]+"bpp "+JSON.stringify(c[1]));
+    ok = false;
+  }
+});
+result = ok;
@@ -0,0 +1,88 @@
+// drawImage blits rows at a time (and copies raw data where it can) - check it gives the
+// same result as drawing every pixel with setPixel, for all sorts of images and targets
+function makeImage(w,h,bpp,flat) {
+  var len = (w*h*bpp+7)>>3;
+  var buf = flat ? new Uint8Array(len+64).buffer : E.toArrayBuffer(new Array(len+1).join("\0"));
+  var a = new Uint8Array(buf);
+  for (var i=0;i<len;i++) a[i] = (i*73+17)&255;
+  return { width:w, height:h, bpp:bpp, buffer:buf };
+}
+
+function getBits(a, bit, bpp) {
+  var v = 0;
+  for (var i=0;i<bpp;i++,bit++)
+    v = v*2 + ((a[bit>>3]>>(7-(bit&7)))&1);
+  return v;
+}
+
+// draw pixel by pixel, as drawImage used to
+function refDraw(g, img, x, y, opts, fg, bg) {
+  var a = new Uint8Array(img.buffer);
+  var area = (opts&&opts.area) || {x:0,y:0,width:img.width,height:img.height};
+  var w = Math.min(area.width, img.width-area.x), h = Math.min(area.height, img.height-area.y);
+  for (var iy=0;iy<h;iy++)
+    for (var ix=0;ix<w;ix++) {
+      var c = getBits(a, ((area.y+iy)*img.width + area.x+ix)*img.bpp, img.bpp);
+      if (img.transparent!==undefined && c==img.transparent) continue;
+      if (img.palette!==undefined) c = img.palette[c];
+      else if (img.bpp==1) c = c ? fg : bg;
+      g.setPixel(x+ix, y+iy, c);
+    }
+}
+
+var fg = 0x1234567, bg = 0x89ABCDEF;
+var tests = 0, ok = true;
+function check(bpp, gopts, rot, img, x, y, opts, nonFlatTarget) {
+  var a = Graphics.createArrayBuffer(14,11,bpp,gopts);
+  var b = Graphics.createArrayBuffer(14,11,bpp,gopts);
+  if (nonFlatTarget) a.buffer = E.toArrayBuffer(new Array(((14*11*bpp+7)>>3)+1).join("\0"));
+  [a,b].forEach(function(g) {
+    g.setRotation(rot&3, rot>3);
+    g.setColor(fg);
+    g.setBgColor(bg);
+    g.fillRect(0,0,20,20);
+    g.setColor(3);
+    g.setBgColor(fg);
+  });
+  a.drawImage(img, x, y, opts);
+  refDraw(b, img, x, y, opts, 3, fg);
+  var ba = new Uint8Array(a.buffer), bb = new Uint8Array(b.buffer);
+  var same = true;
+  for (var i=0;i<bb.length;i++)
+    if (ba[i]!=bb[i]) same = false;
+  tests++;
+  if (!same) {
+    console.log("Mismatch: "+bpp+"bpp "+JSON.stringify(gopts)+" rot "+rot+" img "+img.bpp+"bpp at "+x+","+y+" "+JSON.stringify(opts)+(nonFlatTarget?" nonflat":""));
+    ok = false;
+  }
+}
+
+[1,2,4,8,16,24].forEach(function(ibpp) {
+  [true,false].forEach(function(flat) {
+    var img = makeImage(9,7,ibpp,flat);
+    [1,2,4,8,16,24,32].forEach(function(bpp) {
+      [{},{msb:true},{zigzag:true,msb:true}].forEach(function(gopts) {
+        check(bpp, gopts, 0, img, 2, 1);
+        check(bpp, gopts, 0, img, -3, 6);
+        check(bpp, gopts, 1, img, 1, 2, {area:{x:2,y:1,width:5,height:4}});
+        check(bpp, gopts, 6, img, 10, -2);
+      });
+    });
+    check(1, {vertical_byte:true}, 0, img, 3, 2);
+    check(1, {vertical_byte:true,msb:true}, 3, img, 1, 5, {area:{x:1,y:2,width:20,height:3}});
+    check(ibpp, {msb:true}, 0, img, 1, 1, undefined, true);
+    img.transparent = 1;
+    check(8, {}, 0, img, 1, 1);
+    check(ibpp, {msb:true}, 0, img, 3, 3);
+    delete img.transparent;
+    if (ibpp<=8) {
+      img.palette = new Uint16Array(1<<ibpp);
+      for (var i=0;i<img.palette.length;i++) img.palette[i] = i*3+1;
+      check(16, {}, 0, img, 1, 1);
+      check(ibpp, {msb:true}, 0, img, 0, 0);
+      delete img.palette;
+    }
+  });
+});
+
+result = ok && tests>500;
@@ -0,0 +1,119 @@
+// Polygons are filled a scanline at a time with an active edge table, so concave shapes and holes work
+var g = Graphics.createArrayBuffer(64,64,8);
+var r = [];
+
+function bufStr(g) { return E.toString(new Uint8Array(g.buffer)); }
+function count(g) {
+  var b = new Uint8Array(g.buffer), n = 0;
+  for (var i=0;i<b.length;i++) if (b[i]) n++;
+  return n;
+}
+
+// a square with a square hole in it
+g.fillPoly([[1,1,20,1,20,20,1,20],[6,6,14,6,14,14,6,14]]);
+r[0] = g.getPixel(3,3) && g.getPixel(6,6) && !g.getPixel(7,7) && !g.getPixel(10,10) && g.getPixel(15,10);
+// typed arrays work too
+g.clear();
+g.fillPoly(new Int16Array([0,0,10,0,5,10]));
+r[12] = g.getPixel(5,5) && g.getPixel(0,0) && !g.getPixel(1,9);
+// a concave 'n' shape
+g.clear();
+g.fillPoly([22,1,38,1,38,22,34,22,34,5,26,5,26,22,22,22]);
+r[1] = g.getPixel(30,3) && g.getPixel(24,15) && g.getPixel(36,15) && !g.getPixel(30,15);
+// a star - the middle is a hole with evenodd, but filled with nonzero
+g.clear();
+var star = [10,1, 16,20, 1,8, 19,8, 4,20];
+g.fillPoly(star);
+r[2] = !g.getPixel(10,11) && g.getPixel(10,3);
+g.fillPoly(star, {fillRule:"nonzero"});
+r[3] = g.getPixel(10,11);
+
+// convex polygons are exactly the same as the old min/max scanline fill
+function refFillPoly(buf, w, h, v) {
+  var minx = [], maxx = [], y, n = v.length/2;
+  for (var i=0,j=n-1;i<n;j=i++) {
+    var x1=v[j*2],y1=v[j*2+1],x2=v[i*2],y2=v[i*2+1];
+    if (y2<y1) { var t=x1;x1=x2;x2=t; t=y1;y1=y2;y2=t; }
+    var yl = (y2-y1) || 1, xh = x1*256, step = ((x2-x1)*256/yl)|0;
+    for (y=y1;y<=y2;y++) {
+      var x = xh>>8;
+      if (y>=0 && y<h) {
+        if (minx[y]===undefined || x<minx[y]) minx[y]=x;
+        if (maxx[y]===undefined || x>maxx[y]) maxx[y]=x;
+      }
+      xh += step;
+    }
+  }
+  for (y=0;y<h;y++) if (minx[y]!==undefined)
+    for (var x=Math.max(minx[y],0);x<=Math.min(maxx[y],w-1);x++) buf[x+y*w]=255;
+}
+var seed = 1;
+function rnd(n) { seed = (seed*69069+1)&0xFFFFFF; return seed%n; }
+r[4] = true;
+for (var t=0;t<40;t++) {
+  var n = 3+rnd(6), cx = rnd(80)-8, cy = rnd(80)-8, rad = 1+rnd(40), poly = [], inc = [], tot = 0, i;
+  for (i=0;i<n;i++) { inc.push(1+rnd(100)); tot += inc[i]; }
+  var ang = rnd(628)/100;
+  for (i=0;i<n;i++) {
+    ang += inc[i]*6.28/tot;
+    poly.push(Math.round(cx+rad*Math.cos(ang)), Math.round(cy+rad*Math.sin(ang)));
+  }
+  g.clear();
+  g.fillPoly(poly);
+  var ref = new Uint8Array(64*64);
+  refFillPoly(ref, 64, 64, poly);
+  if (bufStr(g) != E.toString(ref)) {
+    console.log("Mismatch for "+JSON.stringify(poly));
+    r[4] = false;
+  }
+}
+
+// circles and ellipses fill exactly their bounding box, and are symmetric
+g.clear();
+g.getModified(true);
+g.fillCircle(20,20,7);
+var m = g.getModified(true);
+r[5] = m.x1==13 && m.y1==13 && m.x2==27 && m.y2==27;
+r[6] = true;
+for (var y=13;y<=27;y++) for (var x=13;x<=27;x++)
+  if (g.getPixel(x,y)!=g.getPixel(40-x,y) || g.getPixel(x,y)!=g.getPixel(x,40-y) || g.getPixel(x,y)!=g.getPixel(y,x)) r[6] = false;
+g.clear();
+g.getModified(true);
+g.fillEllipse(30,5,50,15);
+m = g.getModified(true);
+r[7] = m.x1==30 && m.y1==5 && m.x2==50 && m.y2==15 && g.getPixel(40,10) && !g.getPixel(30,5);
+g.clear();
+g.fillCircle(5,5,0);
+r[8] = count(g)==1 && g.getPixel(5,5);
+
+// drawPoly is lines between the points
+g.clear();
+g.drawPoly([2,2,30,2,30,20], true);
+var a = bufStr(g);
+g.clear();
+g.drawLine(2,2,30,2);
+g.drawLine(30,2,30,20);
+g.drawLine(30,20,2,2);
+r[9] = a == bufStr(g);
+// ...and thick lines are the right width
+g.clear();
+g.drawPoly([5,10,40,10,40,50], false, 5);
+r[10] = g.getPixel(20,8) && g.getPixel(20,12) && !g.getPixel(20,7) && !g.getPixel(20,13) &&
+        g.getPixel(38,30) && g.getPixel(42,30) && !g.getPixel(37,30) && !g.getPixel(43,30) &&
+        g.getPixel(41,9); // joint is filled
+
+// the same shapes via a callback-based Graphics
+g.clear();
+var pixels = {};
+var gc = Graphics.createCallback(64,64,8,{
+  setPixel:function(x,y,c) { pixels[x+","+y]=1; },
+  fillRect:function(x1,y1,x2,y2) { for (var y=y1;y<=y2;y++) for (var x=x1;x<=x2;x++) pixels[x+","+y]=1; }
+});
+[g,gc].forEach(function(g) {
+  g.fillPoly([[1,1,20,1,20,20,1,20],[6,6,14,6,14,14,6,14]]);
+  g.fillCircle(40,40,9);
+});
+r[11] = Object.keys(pixels).length == count(g);
+
+result = r.every(function(x){return x;});
+if (!result) console.log(r);
@@ -0,0 +1,51 @@
+// Modified areas are kept as a few separate rectangles, and flip() sends just those
+var flips = [];
+var g = Graphics.createArrayBuffer(128,64,1,{flip:function(x1,y1,x2,y2) { flips.push([x1,y1,x2,y2].join(",")); }});
+var r = [];
+
+// a status bar and a pixel in the opposite corner are two small areas
+g.fillRect(0,0,127,7);
+g.setPixel(127,63);
+r[0] = JSON.stringify(g.getModifiedRects()) == '[{"x1":0,"y1":0,"x2":127,"y2":7},{"x1":127,"y1":63,"x2":127,"y2":63}]';
+r[1] = JSON.stringify(g.getModified()) == '{"x1":0,"y1":0,"x2":127,"y2":63}';
+
+// flip sends them, and resets everything
+g.flip();
+r[2] = flips.join(" ") == "0,0,127,7 127,63,127,63";
+r[3] = g.getModifiedRects().length==0 && g.getModified()===undefined;
+
+// areas next to each other (or overlapping) are merged
+g.fillRect(0,0,9,9);
+g.fillRect(10,0,19,9);
+g.fillRect(5,5,12,12);
+g.setPixel(6,6);
+r[4] = JSON.stringify(g.getModifiedRects(true)) == '[{"x1":0,"y1":0,"x2":19,"y2":12}]';
+
+// lots of scattered pixels - never more than 4 areas, they don't overlap, and they cover everything
+var pts = [];
+for (var i=0;i<40;i++) {
+  var x = (i*37)&127, y = (i*23)&63;
+  g.setPixel(x,y);
+  pts.push([x,y]);
+}
+var rects = g.getModifiedRects(true);
+r[5] = rects.length>0 && rects.length<=4;
+r[6] = pts.every(function(p) {
+  return rects.some(function(a) { return p[0]>=a.x1 && p[0]<=a.x2 && p[1]>=a.y1 && p[1]<=a.y2; });
+});
+r[7] = rects.every(function(a,i) {
+  return rects.every(function(b,j) {
+    return i==j || a.x2<b.x1 || b.x2<a.x1 || a.y2<b.y1 || b.y2<a.y1;
+  });
+});
+
+// Callback graphics can have a flip function too
+var cflips = 0;
+var c = Graphics.createCallback(32,32,1,{setPixel:function(){}, flip:function(x1,y1,x2,y2) { cflips += (1+x2-x1)*(1+y2-y1); }});
+c.fillRect(2,2,3,3);
+c.flip();
+c.flip(); // nothing modified
+r[8] = cflips==4;
+
+result = r.every(function(x){return x;});
+if (!result) console.log(r);
@@ -0,0 +1,48 @@
+// Vector font characters are drawn from cached bitmaps - check they're exactly the same
+// as when every character's polygons were filled each time
+function hash(g) {
+  var a = new Uint8Array(g.buffer), h = 0;
+  for (var i=0;i<a.length;i++) h = (h*31 + a[i]) & 0xFFFFFF;
+  return h;
+}
+function draw(size) {
+  var g = Graphics.createArrayBuffer(128,64,1,{msb:true});
+  g.setFontVector(size);
+  g.drawString("Hello! 0123 @#%&$ jgyq",-3,size==60?10:2);
+  g.drawString("Wide ~{}|",5,30);
+  var g2 = Graphics.createArrayBuffer(64,32,8);
+  g2.setFontVector(size); g2.setColor(0x55); g2.setBgColor(3); g2.drawString("AbC",1,1);
+  return hash(g)+"/"+hash(g2);
+}
+var sizes = [8,13,20,31,40,60];
+// results from before glyphs were cached (60 is too big to be cached anyway)
+var expected = ["14092568/100351","7371129/13420497","662531/8026931","10164406/9788839","9987553/5858368","4092895/8826475"];
+
+var ok = true;
+// twice - the second time everything should come from the cache
+for (var n=0;n<2;n++)
+  sizes.forEach(function(s,i) {
+    var h = draw(s);
+    if (h!=expected[i]) {
+      console.log("Size "+s+" got "+h+", expected "+expected[i]);
+      ok = false;
+    }
+  });
+
+// lots of different glyphs, so older ones get thrown out - and it still works
+var g = Graphics.createArrayBuffer(128,64,1);
+for (var s=10;s<20;s++) {
+  g.setFontVector(s);
+  g.drawString("ABCDEFGHIJ",0,0);
+}
+ok = ok && draw(13)==expected[1];
+
+// the cache is dropped when we run low on memory (before more is allocated on Linux)
+var hidden = global["\xFF"];
+ok = ok && hidden["\xFFVFc"]!==undefined;
+var total = process.memory().total, a = [];
+while (process.memory().total==total) a.push("x"+a.length);
+a = undefined;
+ok = ok && hidden["\xFFVFc"]===undefined && draw(13)==expected[1];
+
+result = ok;
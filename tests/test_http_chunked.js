@@ -0,0 +1,43 @@
+// HTTP chunked transfer-encoding is decoded, in both directions, even when
+// it (and the headers) arrive split up into lots of small pieces
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var serverGot = "";
+var clientGot = "";
+var rawGot = "";
+
+var server = http.createServer(function (req, res) {
+  res.writeHead(200, {'Transfer-Encoding': 'chunked'});
+  res.write("5\r\nHello\r\n");
+  res.write("7;ext=1\r\n World!\r\n");
+  res.end("0\r\nX-Trailer: 1\r\n\r\n");
+  req.on('data', function(d) { serverGot += d; });
+});
+server.listen(8080);
+
+// a client that sends its request a few bytes at a time
+var request = "POST /x HTTP/1.0\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\nA\r\n0123456789\r\n0\r\n\r\n";
+var c = net.connect({host: "localhost", port: 8080}, function() {
+  var i = 0;
+  var iv = setInterval(function() {
+    c.write(request.substr(i, 4));
+    i += 4;
+    if (i >= request.length) clearInterval(iv);
+  }, 5);
+});
+c.on('data', function(d) { rawGot += d; });
+
+setTimeout(function() {
+  http.get("http://localhost:8080/", function(res) {
+    res.on('data', function(d) { clientGot += d; });
+    res.on('close', function() {
+      server.close();
+      console.log(JSON.stringify([serverGot, clientGot]));
+      result = serverGot=="abc0123456789" && clientGot=="Hello World!" &&
+               rawGot.indexOf("5\r\nHello\r\n")>0;
+    });
+  });
+}, 500);
@@ -0,0 +1,52 @@
+// HTTP client keep-alive - requests with an agent reuse the same connection
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+// A tiny HTTP/1.1 server that keeps connections open
+var connections = 0;
+var requests = 0;
+var server = net.createServer(function(c) {
+  connections++;
+  var rx = "";
+  c.on('data', function(d) {
+    rx += d;
+    var i;
+    while ((i = rx.indexOf("\r\n\r\n")) >= 0) {
+      rx = rx.substr(i+4);
+      requests++;
+      if (requests==3) // chunked response
+        c.write("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nR3\r\n0\r\n\r\n");
+      else
+        c.write("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nR"+requests);
+      if (requests==4) c.end(); // so the idle socket in the client's pool gets closed too
+    }
+  });
+});
+server.listen(8080);
+
+var agent = { keepAlive : true, maxSockets : 1 };
+var got = [];
+function get(n, callback) {
+  http.request({ host: "localhost", port: 8080, path: "/"+n, method: "GET", agent: agent }, function(res) {
+    var data = "";
+    res.on('data', function(d) { data += d; });
+    res.on('close', function() { got.push(data); if (callback) callback(); });
+  }).end();
+}
+
+// one after the other
+get(1, function() {
+  get(2, function() {
+    // then two at once - maxSockets:1 means the second one waits for the first
+    get(3);
+    get(4, function() {
+      setTimeout(function() {
+        server.close();
+        console.log(JSON.stringify([connections, requests, got]));
+        result = connections==1 && requests==4 && got.join()=="R1,R2,R3,R4";
+      }, 50);
+    });
+  });
+});
@@ -0,0 +1,29 @@
+// Recently found fields are cached - check the cache doesn't return stale fields
+
+var ok = true;
+var o = { a:1, b:2, c:3 };
+for (var i=0;i<3;i++) ok &= o.c==3;
+delete o.c;
+ok &= o.c===undefined;
+o.c = 4;
+ok &= o.c==4;
+
+// free an object with cached fields, and make new ones that may reuse its memory
+for (i=0;i<10;i++) {
+  var p = { x:i };
+  ok &= p.x==i;
+  var q = { y:i };
+  ok &= q.x===undefined && q.y==i;
+}
+
+// removing from arrays
+var arr = ["a","b","c"];
+ok &= arr[0]=="a";
+arr.shift();
+ok &= arr[0]=="b" && arr.length==2;
+ok &= arr.pop()=="c" && arr[1]===undefined;
+
+process.memory(); // garbage collect
+ok &= o.a==1 && o.c==4;
+
+result = ok;
@@ -0,0 +1,18 @@
+// Recently resolved host names are cached - but not while a (JS) network is still resolving them
+var hosts = [];
+var sockets = 0;
+require("NetworkJS").create({
+  create : function(host, port) { hosts.push(host); return ++sockets; },
+  close : function(sckt) { },
+  accept : function(sckt) { return -1; },
+  recv : function(sckt, maxLen) { return null; },
+  send : function(sckt, data) { return data.length; }
+});
+var net = require("net");
+net.connect({host:"alpha.example", port:80});
+net.connect({host:"beta.example", port:80});
+net.connect({host:"alpha.example", port:80});
+setTimeout(function() {
+  result = JSON.stringify(hosts) == '["alpha.example","beta.example","alpha.example"]';
+  if (!result) console.log(hosts);
+}, 10);
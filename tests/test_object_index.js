@@ -0,0 +1,32 @@
+// Big objects get a hash index of their children - check it stays correct
+
+var o = {};
+var i, ok = true;
+for (i=0;i<300;i++) o["key"+i] = i;
+for (i=0;i<300;i++) ok &= o["key"+i]==i;
+ok &= o.key299==299 && o.nothere===undefined && ("key150" in o) && !("key300" in o);
+// the index must not be visible
+ok &= Object.keys(o).length==300 && JSON.stringify(o).indexOf("idx")<0;
+var n = 0;
+for (i in o) n++;
+ok &= n==300;
+// removing
+for (i=0;i<300;i+=2) delete o["key"+i];
+for (i=0;i<300;i++) ok &= o["key"+i]===(i&1 ? i : undefined);
+ok &= Object.keys(o).length==150;
+// adding again
+for (i=0;i<300;i+=2) o["key"+i] = -i;
+for (i=0;i<300;i++) ok &= o["key"+i]==(i&1 ? i : -i);
+// copies get their own index
+var c = o.clone();
+c.key1 = "changed";
+delete c.key3;
+ok &= c.key1=="changed" && o.key1==1 && o.key3==3 && c.key3===undefined && c.key5==5;
+// integer keys aren't indexed, but should still work
+o[5] = "five";
+ok &= o[5]=="five" && o["5"]=="five";
+
+process.memory(); // garbage collect
+ok &= o.key200==-200 && o.key201==201;
+
+result = ok;
@@ -0,0 +1,31 @@
+// Check that received Serial data is coalesced, and that 'chunk' holds back data
+var got = [];
+var results = [];
+LoopbackB.on('data', function(d) { got.push(d); });
+LoopbackA.write("Hello");
+LoopbackA.write(" World");
+
+setTimeout(function() {
+  // Both writes should arrive in one 'data' event
+  results.push(JSON.stringify(got)=='["Hello World"]');
+  got = [];
+  LoopbackB.setup(9600, {chunk:8});
+  LoopbackA.write("abc");
+  setTimeout(function() { LoopbackA.write("defghijklm"); }, 1);
+  setTimeout(function() { LoopbackA.write("xyz"); }, 30);
+}, 10);
+
+setTimeout(function() {
+  // 'abc' is held until we have 8 chars, and 'xyz' is delivered after a timeout
+  results.push(JSON.stringify(got)=='["abcdefghijklm","xyz"]');
+  got = [];
+  LoopbackB.setup(9600, {chunk:0});
+  var s = "";
+  for (var i=0;i<600;i++) s+=String.fromCharCode(48+i%40);
+  LoopbackA.write(s);
+  setTimeout(function() {
+    // A big burst should arrive intact and in very few events
+    results.push(got.join("")==s && got.length<=2);
+    result = results.length==3 && results.every(function(r) { return r; });
+  }, 10);
+}, 100);
@@ -0,0 +1,14 @@
+// Write a block that is bigger than the transmit buffer, so we have to wait for space part way through
+
+var f = "./tests/Serial_Write_Test.txt";
+require("fs").writeFile(f, "");
+Serial1.path = f;
+Serial1.setup(9600);
+var s = "";
+for (var i=0;i<300;i++) s += String.fromCharCode(65+(i%26))+i;
+Serial1.write(s);
+
+setTimeout(function() {
+  var d = require("fs").readFile(f);
+  result = s.length>1024 && d==s;
+}, 200);
@@ -0,0 +1,9 @@
+// Chains of '+' append to the temporary result in place - check nothing else gets modified
+var b="B", o={toString:function(){return "O"}}, v={valueOf:function(){return 5}};
+var r1 = "a"+b+"c"+1+o+v+null+undefined;
+var lit = function(){ return "L"; };
+var x1 = lit()+"1"; var x2 = lit()+"2";
+var s="q"; var t = s+"r"+"s";
+var long=""; for (var i=0;i<50;i++) long+="0123456789";
+var u = long+"x"+long;
+result = r1=="aBc1O5nullundefined" && x1=="L1" && x2=="L2" && s=="q" && t=="qrs" && u.length==1001 && u[500]=="x" && ("x"+"y"+"z")=="xyz";
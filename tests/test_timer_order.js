@@ -0,0 +1,27 @@
+// Lots of timers with different times should still fire in the right order
+
+var order = [];
+var ids = [];
+for (var i=0;i<50;i++) {
+  var t = (i*37)%50; // jumbled up
+  ids.push(setTimeout(function(t) { order.push(t); }, t*10, t));
+}
+// cancel a few
+clearTimeout(ids[1]); // t=37
+clearTimeout(ids[2]); // t=24
+// an interval that gets slowed down after it first runs
+var ticks = 0;
+var iv = setInterval(function() { ticks++; }, 100);
+setTimeout(function() { changeInterval(iv, 1000); }, 150);
+// a timeout added from inside a timeout
+var nested = false;
+setTimeout(function() { setTimeout(function() { nested = true; }, 5); }, 5);
+
+setTimeout(function() {
+  clearInterval(iv);
+  var ok = order.length==48 && ticks==1 && nested;
+  for (var i=1;i<order.length;i++)
+    if (order[i-1] >= order[i]) ok = false;
+  ok &= order.indexOf(37)<0 && order.indexOf(24)<0;
+  result = ok;
+}, 700);
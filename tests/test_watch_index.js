@@ -0,0 +1,23 @@
+// Watch events should go to the right watches, even as watches are added and removed
+
+var a = 0, b = 0, once = 0, late = 0, cleared = 0;
+setWatch(function(e) { a++; }, 3, {repeat:true});
+setWatch(function(e) { b++; }, 4, {repeat:true});
+setWatch(function(e) { once++; }, 3, {repeat:false});
+// clears the watch after it, which should then not get called
+setWatch(function(e) { clearWatch(idToClear); }, 4, {repeat:true});
+var idToClear = setWatch(function(e) { cleared++; }, 4, {repeat:true});
+
+E.pushWatchEvent(3, true);
+E.pushWatchEvent(3, false);
+E.pushWatchEvent(4, true);
+
+setTimeout(function() {
+  setWatch(function(e) { late++; }, 3, {repeat:true});
+  E.pushWatchEvent(3, true);
+  E.pushWatchEvent(4, false);
+  setTimeout(function() {
+    result = a==3 && b==2 && once==1 && late==1 && cleared==0;
+    clearWatch();
+  }, 10);
+}, 10);